@@ -4,10 +4,21 @@ layout(location = 1) in vec3 v_color;
 
 out vec3 f_color;
 
-uniform mat4 world_view_proj;
+// matches FrameConstants in app.cpp
+layout(std140) uniform FrameConstants {
+  mat4 view;
+  mat4 proj;
+  vec4 light_pos_vs;
+  vec4 light_color;
+  float light_intensity;
+  float light_range;
+  vec2 camera_near_far;
+};
+
+uniform mat4 world;
 
 void main() {
-  gl_Position = world_view_proj * vec4(v_position, 1.0);
+  gl_Position = proj * view * world * vec4(v_position, 1.0);
 
   f_color = v_color;
 }
@@ -1,6 +1,15 @@
 #version 330 core
 
-uniform vec2 camera_near_far;
+// matches FrameConstants in app.cpp
+layout(std140) uniform FrameConstants {
+  mat4 view;
+  mat4 proj;
+  vec4 light_pos_vs;
+  vec4 light_color;
+  float light_intensity;
+  float light_range;
+  vec2 camera_near_far;
+};
 
 in vec3 f_color;
 in vec3 f_position_vs;
@@ -4,9 +4,22 @@ layout(location = 15) in vec2 v_lightmap_uv;
 
 out vec2 f_lightmap_uv;
 
-uniform mat4 world_view_proj;
+// matches FrameConstants in app.cpp
+layout(std140) uniform FrameConstants {
+  mat4 view;
+  mat4 proj;
+  vec4 light_pos_vs;
+  vec4 light_color;
+  float light_intensity;
+  float light_range;
+  vec2 camera_near_far;
+};
+
+uniform mat4 world;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
 
 void main() {
-  gl_Position = world_view_proj * vec4(v_position, 1.0);
+  gl_Position = proj * view * world * vec4(position_offset + position_scale * v_position, 1.0);
   f_lightmap_uv = v_lightmap_uv;
 }
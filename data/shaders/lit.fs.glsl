@@ -1,13 +1,23 @@
 #version 330 core
 
-uniform vec3 light_pos_vs;
-uniform vec3 light_color;
-uniform float light_intensity;
-uniform float light_range;
+// matches FrameConstants in app.cpp
+layout(std140) uniform FrameConstants {
+  mat4 view;
+  mat4 proj;
+  vec4 light_pos_vs;
+  vec4 light_color;
+  float light_intensity;
+  float light_range;
+  vec2 camera_near_far;
+};
+
+// the bounced light, see transfer_relight()
+uniform sampler2D u_texture_lightmap;
 
 in vec3 f_color;
 in vec3 f_position_vs;
 in vec3 f_normal_vs;
+in vec2 f_lightmap_uv;
 
 out vec3 color;
 
@@ -15,14 +25,15 @@ void main() {
   vec3 albedo = f_color;
 
   vec3 n = f_normal_vs;
-  vec3 l = light_pos_vs - f_position_vs;
+  vec3 l = light_pos_vs.xyz - f_position_vs;
   float l_dist = length(l);
   l = l / l_dist;
 
   float attenuation = 1.0 - smoothstep(light_range * 0.75, light_range, l_dist);
 
   float n_dot_l = clamp(dot(n, l), 0, 1);
-  vec3 diffuse = n_dot_l * light_color * attenuation * light_intensity;
+  vec3 diffuse = n_dot_l * light_color.rgb * attenuation * light_intensity;
+  vec3 indirect = texture(u_texture_lightmap, f_lightmap_uv).rgb;
 
-  color = vec3(0.1f) * albedo + albedo * diffuse;
+  color = albedo * (diffuse + indirect);
 }
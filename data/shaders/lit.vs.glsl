@@ -2,18 +2,47 @@
 layout(location = 0) in vec3 v_position;
 layout(location = 1) in vec3 v_normal;
 layout(location = 2) in vec3 v_color;
+layout(location = 15) in vec2 v_lightmap_uv;
 
 out vec3 f_position_vs;
 out vec3 f_normal_vs;
 out vec3 f_color;
+out vec2 f_lightmap_uv;
 
-uniform mat4 world_view_proj;
-uniform mat4 world_view;
+// matches FrameConstants in app.cpp
+layout(std140) uniform FrameConstants {
+  mat4 view;
+  mat4 proj;
+  vec4 light_pos_vs;
+  vec4 light_color;
+  float light_intensity;
+  float light_range;
+  vec2 camera_near_far;
+};
+
+uniform mat4 world;
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+uniform bool octahedral_normals;
+
+// unfolds the lower half of the octahedron, see mesh_quantize()
+vec3 decode_octahedral(vec2 e) {
+  vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+  if (n.z < 0.0) {
+    n.xy = (1.0 - abs(n.yx)) * vec2(n.x < 0.0 ? -1.0 : 1.0, n.y < 0.0 ? -1.0 : 1.0);
+  }
+  return normalize(n);
+}
 
 void main() {
-  gl_Position = world_view_proj * vec4(v_position, 1.0);
+  vec3 position = position_offset + position_scale * v_position;
+  vec3 normal = octahedral_normals ? decode_octahedral(v_normal.xy) : v_normal;
+  mat4 world_view = view * world;
+  vec4 position_vs = world_view * vec4(position, 1.0);
+  gl_Position = proj * position_vs;
 
-  f_position_vs = vec3(world_view * vec4(v_position, 1.0));
-  f_normal_vs = mat3(world_view) * v_normal;
+  f_position_vs = vec3(position_vs);
+  f_normal_vs = mat3(world_view) * normal;
   f_color = v_color;
+  f_lightmap_uv = v_lightmap_uv;
 }
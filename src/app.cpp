@@ -1,23 +1,35 @@
 #include "app.h"
+#include "bake.h"
 #include "debug_draw.h"
-#include "vendor/tinyobjloader/tiny_obj_loader.h"
-#include <OpenGL/gl3.h>
+#include "gl_backend.h"
+#include "job.h"
+#include "lightmap.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "profile.h"
+#include "progressive.h"
+#include "render_queue.h"
+#include "transfer.h"
+#include "vertex_format.h"
 #include <assert.h>
 #include <fstream>
 #include <iostream>
 #include <math.h>
 #include <stdarg.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string>
 #include <unistd.h>
 #include <vectorial/vectorial.h>
 
 #define GL_CHECK_ENABLED 1
+#define GL_STATE_TEXTURE_UNITS 4
 
 #if GL_CHECK_ENABLED
 #define GL_CHECK(expr)                                                                                                 \
   do {                                                                                                                 \
+    PROFILE_COUNT(PROFILE_COUNTER_GL_CALLS, 1);                                                                        \
     (expr);                                                                                                            \
     GLenum err = glGetError();                                                                                         \
     if (err != GL_NO_ERROR) {                                                                                          \
@@ -25,51 +37,25 @@
     }                                                                                                                  \
   } while (false)
 #else
-#define GL_CHECK(expr) (expr)
+#define GL_CHECK(expr)                                                                                                 \
+  do {                                                                                                                 \
+    PROFILE_COUNT(PROFILE_COUNTER_GL_CALLS, 1);                                                                        \
+    (expr);                                                                                                            \
+  } while (false)
 #endif
 
-#define MAX_CHANNELS 16
-
 enum KeyStatus {
   KEY_STATUS_DOWN = 0x01,
   KEY_STATUS_EDGE = 0x02,
 };
 
-enum ChannelSemantic {
-  CHANNEL_SEMANTIC_COLOR,
-  CHANNEL_SEMANTIC_NORMAL,
-  CHANNEL_SEMANTIC_POSITION,
-  CHANNEL_SEMANTIC_TEXCOORD,
-};
-
-enum ChannelType {
-  CHANNEL_TYPE_FLOAT_3,
-  CHANNEL_TYPE_UBYTE_4,
-};
-
-struct VertexChannelDesc {
-  ChannelType type;
-  ChannelSemantic semantic;
-};
-
-struct Mesh {
-  void* indices;
-  void* vertices;
-  VertexChannelDesc channels[MAX_CHANNELS];
-  unsigned index_count;
-  unsigned vertex_count;
-  unsigned channel_count;
-  bool index_size_32_bit;
-};
-
 struct Model {
   vectorial::mat4f transform;
-  GLuint ib;
-  GLuint vb;
-  GLuint lightmap_vb;
+  unsigned pool_index;  // of the ModelPool holding its vertices and indices
   int tri_count;
-  VertexChannelDesc channels[MAX_CHANNELS];
-  unsigned channel_count;
+  std::vector<MeshSubmesh> submeshes;  // offsets and base vertices within the pool
+  MeshQuantization quantization;
+  vectorial::vec3f center;  // of the bounds in model space, for sorting
   bool wireframe;
 };
 
@@ -82,54 +68,30 @@ struct Camera {
   vectorial::mat4f projection;
 };
 
-struct Light {
-  vectorial::vec3f pos;
-  vectorial::vec3f color;
-  float intensity;
-  float range;
-};
-
-struct Vec3 {
-  float x;
-  float y;
-  float z;
-};
-
-struct Vertex {
-  Vec3 p;
-  Vec3 n;
-  Vec3 c;
-};
-
 struct VertexPN {
   Vec3 p;
   Vec3 n;
 };
 
-struct LightmapTriangle {
-  vectorial::vec2f positions[3];
-  vectorial::vec2f uvs[3];
-  float width;
-  float height;
-  int mesh_tri_index;
-  int projected_edge_index;
-};
+typedef void (*VertexAttribsFunc)();
 
-static uint32_t s_brewer_colors[] = {
-    0xa6cee3ff,
-    0x1f78b4ff,
-    0xb2df8aff,
-    0x33a02cff,
-    0xfb9a99ff,
-    0xe31a1cff,
-    0xfdbf6fff,
-    0xff7f00ff,
-    0xcab2d6ff,
-    0x6a3d9aff,
-    0xffff99ff,
-    0xb15928ff,
+// the buffers and vertex array that the models with the same vertex layout and index type share, so one
+// glMultiDrawElementsBaseVertex() can draw several of them. the models' data collects here as they're created and goes
+// up to GL in one go in model_pools_upload().
+struct ModelPool {
+  VertexAttribsFunc bind_vertex_attribs;
+  GLenum index_type;
+  bool has_lightmap_uvs;  // float2 uvs at location 15 in a stream of their own, for vertices that don't carry them
+  unsigned vertex_count;
+  unsigned index_count;
+  std::vector<uint8_t> vertices;
+  std::vector<uint8_t> indices;
+  std::vector<float> lightmap_uvs;
+  GLuint vao;  // the index buffer and every attribute stream
+  GLuint ib;
+  GLuint vb;
+  GLuint lightmap_vb;
 };
-#define BREWER_COLOR_COUNT 12
 
 static float s_window_width;
 static float s_window_height;
@@ -137,39 +99,112 @@ static float s_window_height;
 static bool s_first_draw = true;
 static float s_time = 0.0f;
 static std::vector<Model> s_models;
+static std::vector<ModelPool> s_model_pools;
 static Camera s_camera;
 static Light s_light;
 
+// the surface behind the lightmap texels, built once and read by both ways of lighting them below
+static BakeScene s_bake_scene;
+static TexelGbuffer s_texel_gbuffer;
+
+// the bounced light in the lightmap, gathered through the precomputed transfer whenever the light changes
+static Transfer* s_transfer;
+static float* s_lightmap_texels;  // RGB floats, what the lightmap texture holds
+static int s_lightmap_width;
+static int s_lightmap_height;
+static Light s_relit_light;  // the light the lightmap was last relit with
+static bool s_lightmap_stale = false;  // holds something other than what the transfer gathered
+static int s_transfer_bounce_count = 3;
+
+// or path traced a few tiles a frame while the frames keep coming, F9 switches. it's only set up the first time it's
+// needed, and is the only way when the transfer doesn't fit. the refined tiles go up through a ring of pixel buffers,
+// so the copy of one frame doesn't wait for the GPU to be done with the last one.
+#define LIGHTMAP_UPLOAD_BUFFER_COUNT 3
+static ProgressiveBake* s_progressive;
+static bool s_progressive_lightmap = false;
+static double s_progressive_budget_ms = 4.0;          // of refining a frame
+static size_t s_lightmap_upload_budget = 192 * 1024;  // bytes of refined tiles uploaded a frame
+static GLuint s_lightmap_upload_buffers[LIGHTMAP_UPLOAD_BUFFER_COUNT];
+static unsigned s_lightmap_upload_buffer_index;
+static std::vector<uint32_t> s_lightmap_upload_tiles;
+static uint8_t* s_lightmap_upload_texels;  // for when the buffer can't be mapped
+
 // debug
 static bool s_draw_wireframe = false;
 static bool s_draw_depth = false;
 static bool s_draw_lightmap = false;
 static bool s_vis_lightmap = false;
+static bool s_vis_lightmap_pack = false;
+static bool s_draw_profile_overlay = false;
 static int s_num_lightmap_tris = -1;
 
+// meshes too big for 16-bit indices get drawn as 16-bit submeshes with a base vertex instead of with 32-bit indices
+static bool s_split_16_bit_submeshes = true;
+// uploads 16 bytes a vertex (see mesh_quantize()) instead of 36 plus a separate uv stream
+static bool s_quantize_vertices = true;
+
+// the per-draw uniforms the programs may declare, looked up once by shader_create()
+enum UniformSemantic {
+  UNIFORM_SEMANTIC_WORLD,
+  UNIFORM_SEMANTIC_POSITION_OFFSET,
+  UNIFORM_SEMANTIC_POSITION_SCALE,
+  UNIFORM_SEMANTIC_OCTAHEDRAL_NORMALS,
+  UNIFORM_SEMANTIC_COUNT,
+};
+
+// a program and the locations of the per-draw uniforms it uses, -1 for the ones it doesn't
+struct Shader {
+  GLuint program;
+  GLint uniforms[UNIFORM_SEMANTIC_COUNT];
+};
+
+// the uniform block every program shares, refilled once a frame. std140, the shaders declare the same block.
+struct FrameConstants {
+  float view[16];  // with the z up to y up rotation
+  float proj[16];
+  float light_pos_vs[4];
+  float light_color[4];
+  float light_intensity;
+  float light_range;
+  float camera_near_far[2];
+};
+static_assert(sizeof(FrameConstants) == 176, "FrameConstants has to match the std140 layout of the block");
+
+#define FRAME_CONSTANTS_BINDING 0
+
 static GLuint s_default_vao;
-static GLuint s_program;
-static GLuint s_program_depth;
-static GLuint s_program_lightmap_only;
+static vectorial::mat4f s_view_proj;  // of the frame being drawn, with the z up to y up rotation
+static GLuint s_frame_constants_ub;
+static Shader s_program;
+static Shader s_program_depth;
+static Shader s_program_lightmap_only;
 
-static GLuint s_lightmap_pack_program;
 static GLuint s_draw_texture_program;
 
 static GLuint s_lightmap_tex_id;
+static GLuint s_lightmap_pack_tex_id;
 
 static int s_key_status[APP_KEY_CODE_COUNT];
 
 static GLuint s_debug_draw_points_vb;
 static GLuint s_debug_draw_lines_vb;
-static GLuint s_debug_draw_program;
+static GLuint s_debug_draw_screen_lines_vb;
+static Shader s_debug_draw_program;
 static std::vector<VertexPN> s_debug_normals;
 
-static int32_t min(int32_t a, int32_t b) {
-  if (a < b) {
-    return a;
-  }
-  return b;
-}
+// one submesh of a model, what a RenderItem points at
+struct RenderDraw {
+  unsigned model_index;
+  unsigned submesh_index;
+};
+
+// reused from frame to frame
+static std::vector<RenderDraw> s_render_draws;
+static std::vector<RenderItem> s_render_items;
+static std::vector<RenderItem> s_render_scratch;
+static std::vector<GLsizei> s_batch_counts;
+static std::vector<const void*> s_batch_offsets;
+static std::vector<GLint> s_batch_base_vertices;
 
 static void report_error(const char* format, ...) {
   va_list args;
@@ -193,56 +228,153 @@ static const char* get_gl_error_description(GLint err) {
   }
 }
 
-static int channel_size(const VertexChannelDesc* channel) {
-  switch (channel->type) {
+static GLenum to_gl_channel_type(ChannelType type) {
+  switch (type) {
     case CHANNEL_TYPE_FLOAT_3:
-      return 12;
+      return GL_FLOAT;
     case CHANNEL_TYPE_UBYTE_4:
-      return 4;
+      return GL_UNSIGNED_BYTE;
+    case CHANNEL_TYPE_UNORM16_3:
+    case CHANNEL_TYPE_UNORM16_3_PADDED:
+    case CHANNEL_TYPE_UNORM16_2:
+      return GL_UNSIGNED_SHORT;
+    case CHANNEL_TYPE_OCT_SNORM16_2:
+      return GL_SHORT;
+    case CHANNEL_TYPE_OCT_SNORM8_2:
+      return GL_BYTE;
     default:
       assert(false && "unknown channel type");
       return 0;
   }
 }
 
-static int channel_elements(const VertexChannelDesc* channel) {
-  switch (channel->type) {
-    case CHANNEL_TYPE_FLOAT_3:
-      return 3;
-    case CHANNEL_TYPE_UBYTE_4:
-      return 4;
+// the attribute locations the shaders declare
+static GLuint to_gl_attrib_location(ChannelSemantic semantic) {
+  switch (semantic) {
+    case CHANNEL_SEMANTIC_POSITION:
+      return 0;
+    case CHANNEL_SEMANTIC_NORMAL:
+      return 1;
+    case CHANNEL_SEMANTIC_COLOR:
+      return 2;
+    case CHANNEL_SEMANTIC_TEXCOORD:
+      return 15;
     default:
-      assert(false && "unknown channel type");
+      assert(false && "unknown channel semantic");
       return 0;
   }
 }
 
-static GLenum to_gl_channel_type(ChannelType type) {
-  switch (type) {
-    case CHANNEL_TYPE_FLOAT_3:
-      return GL_FLOAT;
-    case CHANNEL_TYPE_UBYTE_4:
-      return GL_UNSIGNED_BYTE;
-    default:
-      assert(false && "unknown channel type");
-      return 0;
+// the binds the draws go through. each one remembers what it last set and drops calls that wouldn't change anything.
+// GL_ELEMENT_ARRAY_BUFFER isn't tracked since it belongs to the bound vertex array.
+struct GlState {
+  GLuint program;
+  GLuint vertex_array;
+  GLuint array_buffer;
+  GLenum active_texture;
+  GLuint textures_2d[GL_STATE_TEXTURE_UNITS];
+  GLenum polygon_mode;
+};
+
+struct GlStateCounters {
+  unsigned calls;   // changes that went through to GL
+  unsigned elided;  // redundant ones that were dropped
+};
+
+static GlState s_gl_state;
+static GlStateCounters s_gl_state_counters;
+
+// forgets what's bound, for when objects get deleted (their names get reused) or GL gets called around the filter
+static void gl_state_invalidate() {
+  memset(&s_gl_state, 0xff, sizeof(s_gl_state));
+}
+
+static bool gl_state_set(GLuint* current, GLuint value) {
+  if (*current == value) {
+    ++s_gl_state_counters.elided;
+    return false;
+  }
+  *current = value;
+  ++s_gl_state_counters.calls;
+  return true;
+}
+
+static void gl_use_program(GLuint program) {
+  if (gl_state_set(&s_gl_state.program, program)) {
+    GL_CHECK(glUseProgram(program));
+  }
+}
+
+static void gl_bind_vertex_array(GLuint vertex_array) {
+  if (gl_state_set(&s_gl_state.vertex_array, vertex_array)) {
+    GL_CHECK(glBindVertexArray(vertex_array));
+  }
+}
+
+static void gl_bind_array_buffer(GLuint buffer) {
+  if (gl_state_set(&s_gl_state.array_buffer, buffer)) {
+    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, buffer));
+  }
+}
+
+static void gl_bind_texture_2d(unsigned unit, GLuint texture) {
+  assert(unit < GL_STATE_TEXTURE_UNITS);
+  if (s_gl_state.textures_2d[unit] == texture) {
+    ++s_gl_state_counters.elided;
+    return;
+  }
+  if (gl_state_set(&s_gl_state.active_texture, GL_TEXTURE0 + unit)) {
+    GL_CHECK(glActiveTexture(GL_TEXTURE0 + unit));
+  }
+  gl_state_set(&s_gl_state.textures_2d[unit], texture);
+  GL_CHECK(glBindTexture(GL_TEXTURE_2D, texture));
+}
+
+static void gl_polygon_mode(GLenum mode) {
+  if (gl_state_set(&s_gl_state.polygon_mode, mode)) {
+    GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, mode));
   }
 }
 
-static int vertex_stride(const VertexChannelDesc* channels, int channel_count) {
-  int stride = 0;
-  for (int index = 0; index < channel_count; ++index) {
-    stride += channel_size(channels + index);
+// the attribute setup of a vertex format, unrolled over its channels at compile time
+template <typename Format>
+struct VertexAttribs;
+
+template <typename... Channels>
+struct VertexAttribs<VertexFormat<Channels...>> {
+  typedef VertexFormat<Channels...> Format;
+
+  template <typename Channel>
+  static int bind_channel() {
+    const GLuint location = to_gl_attrib_location(Channel::semantic);
+    GL_CHECK(glEnableVertexAttribArray(location));
+    GL_CHECK(glVertexAttribPointer(location,
+                                   Channel::elements,
+                                   to_gl_channel_type(Channel::type),
+                                   Channel::normalized ? GL_TRUE : GL_FALSE,
+                                   Format::stride,
+                                   (void*)(size_t)Format::template Channel<Channel::semantic>::offset));
+    return 0;
+  }
+
+  static void bind() {
+    const int channels[] = {bind_channel<Channels>()...};
+    (void)channels;
+  }
+};
+
+// picks the attribute setup for the mesh's layout. returns nullptr if it isn't one of the formats the shaders take.
+template <typename Format, typename... Formats>
+static VertexAttribsFunc vertex_attribs_for(const Mesh* mesh) {
+  if (Format::matches(mesh)) {
+    return &VertexAttribs<Format>::bind;
   }
-  return stride;
+  return vertex_attribs_for<Formats...>(mesh);
 }
 
-static vectorial::vec4f color_rgba_to_float4(uint32_t in) {
-  float r = (float)((in >> 24) & 0xff) / 255.0f;
-  float g = (float)((in >> 16) & 0xff) / 255.0f;
-  float b = (float)((in >> 8) & 0xff) / 255.0f;
-  float a = (float)((in >> 0) & 0xff) / 255.0f;
-  return vectorial::vec4f(r, g, b, a);
+template <>
+VertexAttribsFunc vertex_attribs_for<void>(const Mesh* mesh) {
+  return nullptr;
 }
 
 static void load_file(std::string* out, const char* filename) {
@@ -329,594 +461,477 @@ static GLuint load_shader(const char* base_filename) {
   return load_shader(filename_vs.c_str(), filename_fs.c_str());
 }
 
-static vectorial::vec3f
-normal_from_face(const vectorial::vec3f& p0, const vectorial::vec3f& p1, const vectorial::vec3f& p2) {
-  vectorial::vec3f p01 = p1 - p0;
-  vectorial::vec3f p02 = p2 - p0;
-  vectorial::vec3f cross = vectorial::cross(p01, p02);
-  vectorial::vec3f normal = vectorial::normalize(cross);
-  return normal;
-}
-
-static void bind_constant_float(GLuint program, const char* name, float value) {
-  // TODO: cache the uniform id
-  GLuint uniform_id;
-  GL_CHECK(uniform_id = glGetUniformLocation(program, name));
-  GL_CHECK(glUniform1fv(uniform_id, 1, &value));
-}
-
-static void bind_constant_vec2(GLuint program, const char* name, const vectorial::vec2f& value) {
-  float value_f[2];
-  value.store(value_f);
-
-  // TODO: cache the uniform id
-  GLuint uniform_id;
-  GL_CHECK(uniform_id = glGetUniformLocation(program, name));
-  GL_CHECK(glUniform2fv(uniform_id, 1, value_f));
-}
-
-static void bind_constant_vec3(GLuint program, const char* name, const vectorial::vec3f& value) {
-  float value_f[3];
-  value.store(value_f);
-
-  // TODO: cache the uniform id
-  GLuint uniform_id;
-  GL_CHECK(uniform_id = glGetUniformLocation(program, name));
-  GL_CHECK(glUniform3fv(uniform_id, 1, value_f));
-}
-
-static void bind_constant_vec4(GLuint program, const char* name, const vectorial::vec4f& value) {
-  float value_f[4];
-  value.store(value_f);
-
-  // TODO: cache the uniform id
-  GLuint uniform_id;
-  GL_CHECK(uniform_id = glGetUniformLocation(program, name));
-  GL_CHECK(glUniform4fv(uniform_id, 1, value_f));
-}
-
-static void bind_constant_mat4(GLuint program, const char* name, const vectorial::mat4f& value) {
-  float value_f[16];
-  value.store(value_f);
+static const char* s_uniform_names[UNIFORM_SEMANTIC_COUNT] = {
+    "world",
+    "position_offset",
+    "position_scale",
+    "octahedral_normals",
+};
 
-  // TODO: cache the uniform id
-  GLuint uniform_id;
-  GL_CHECK(uniform_id = glGetUniformLocation(program, name));
-  GL_CHECK(glUniformMatrix4fv(uniform_id, 1, GL_FALSE, value_f));
-}
+static void shader_create(Shader* shader, const char* filename_vs, const char* filename_fs) {
+  const GLuint program = load_shader(filename_vs, filename_fs);
+  shader->program = program;
+  for (int semantic = 0; semantic < UNIFORM_SEMANTIC_COUNT; ++semantic) {
+    shader->uniforms[semantic] = -1;
+  }
+  if (!program) {
+    return;
+  }
 
-static void bind_constants(GLuint program,
-                           const vectorial::mat4f& world,
-                           const vectorial::mat4f& view,
-                           const vectorial::mat4f& proj) {
-  // add a transform to rotation Z up to Y up
-  // NOTE: this is applied to the view transform (inverse of the camera world transform)
-  vectorial::mat4f makeYUp = vectorial::mat4f::axisRotation(-1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f));
-  const vectorial::mat4f world_view = makeYUp * view * world;
-  const vectorial::mat4f world_view_proj = proj * world_view;
+  for (int semantic = 0; semantic < UNIFORM_SEMANTIC_COUNT; ++semantic) {
+    GL_CHECK(shader->uniforms[semantic] = glGetUniformLocation(program, s_uniform_names[semantic]));
+  }
 
-  const vectorial::vec3f light_pos_vs = vectorial::transformPoint((makeYUp * view), s_light.pos);
+  GLuint block_index;
+  GL_CHECK(block_index = glGetUniformBlockIndex(program, "FrameConstants"));
+  if (block_index != GL_INVALID_INDEX) {
+    GL_CHECK(glUniformBlockBinding(program, block_index, FRAME_CONSTANTS_BINDING));
+  }
 
-  // loop over the program's uniforms
+  // everything else the program declares has to be a sampler or live in the frame constants
   GLint uniform_count;
   GLint uniform_name_max_len;
   GL_CHECK(glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &uniform_count));
   GL_CHECK(glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &uniform_name_max_len));
   char* uniform_name = (char*)alloca(uniform_name_max_len);
   for (int index = 0; index < uniform_count; ++index) {
+    const GLuint uniform_index = (GLuint)index;
     GLint uniform_size;
     GLenum uniform_type;
+    GLint uniform_block;
     GL_CHECK(
         glGetActiveUniform(program, index, uniform_name_max_len, nullptr, &uniform_size, &uniform_type, uniform_name));
-    // printf("Uniform[%d]: '%s'\n", index, uniform_name);
-
-    if (0 == strcmp(uniform_name, "world_view_proj")) {
-      bind_constant_mat4(program, "world_view_proj", world_view_proj);
-    }
-    else if (0 == strcmp(uniform_name, "world_view")) {
-      bind_constant_mat4(program, "world_view", world_view);
-    }
-    else if (0 == strcmp(uniform_name, "light_pos_vs")) {
-      bind_constant_vec3(program, "light_pos_vs", light_pos_vs);
+    GL_CHECK(glGetActiveUniformsiv(program, 1, &uniform_index, GL_UNIFORM_BLOCK_INDEX, &uniform_block));
+    if (uniform_block >= 0 || uniform_type == GL_SAMPLER_2D || 0 == strncmp(uniform_name, "gl_", 3)) {
+      continue;
     }
-    else if (0 == strcmp(uniform_name, "light_color")) {
-      bind_constant_vec3(program, "light_color", s_light.color);
+    bool known = false;
+    for (int semantic = 0; semantic < UNIFORM_SEMANTIC_COUNT; ++semantic) {
+      known = known || 0 == strcmp(uniform_name, s_uniform_names[semantic]);
     }
-    else if (0 == strcmp(uniform_name, "light_intensity")) {
-      bind_constant_float(program, "light_intensity", s_light.intensity);
-    }
-    else if (0 == strcmp(uniform_name, "light_range")) {
-      bind_constant_float(program, "light_range", s_light.range);
-    }
-    else if (0 == strcmp(uniform_name, "camera_near_far")) {
-      bind_constant_vec2(program, "camera_near_far", vectorial::vec2f(s_camera.near, s_camera.far));
-    }
-    else if (0 == strncmp(uniform_name, "gl_", 3)) {
-      // ignore
-    }
-    else {
-      printf("WARN: Unknown uniform: '%s'\n", uniform_name);
+    if (!known) {
+      printf("WARN: Unknown uniform: '%s' (%s)\n", uniform_name, filename_vs);
     }
   }
 }
 
-static vectorial::vec2f snap_to_half(const vectorial::vec2f& pos) {
-  return vectorial::vec2f(truncf(pos.x()) + 0.5f, truncf(pos.y()) + 0.5f);
+static void shader_create(Shader* shader, const char* base_filename) {
+  const std::string filename_vs = std::string(base_filename) + ".vs.glsl";
+  const std::string filename_fs = std::string(base_filename) + ".fs.glsl";
+  shader_create(shader, filename_vs.c_str(), filename_fs.c_str());
 }
 
-static bool lightmap_project_triangles(std::vector<LightmapTriangle>& triangles, const Mesh* mesh) {
-  // find the channel with the positions
-  unsigned position_channel = 0xffffffffU;
-  unsigned offset = 0;
-  for (unsigned index = 0; index < mesh->channel_count; ++index) {
-    if (mesh->channels[index].semantic == CHANNEL_SEMANTIC_POSITION) {
-      position_channel = index;
-      break;
-    }
-    offset += channel_size(mesh->channels + index);
-  }
-  if (position_channel == 0xffffffffU) {
-    return false;
-  }
+static void shader_destroy(Shader* shader) {
+  GL_CHECK(glDeleteProgram(shader->program));
+  shader->program = 0;
+}
 
-  if (mesh->channels[position_channel].type != CHANNEL_TYPE_FLOAT_3) {
-    return false;
+static void bind_constant_mat4(const Shader& shader, UniformSemantic semantic, const vectorial::mat4f& value) {
+  if (shader.uniforms[semantic] < 0) {
+    return;
   }
+  float value_f[16];
+  value.store(value_f);
+  GL_CHECK(glUniformMatrix4fv(shader.uniforms[semantic], 1, GL_FALSE, value_f));
+}
 
-  triangles.reserve(mesh->index_count / 3);
-
-  const unsigned stride = vertex_stride(mesh->channels, mesh->channel_count);
-  for (unsigned tri_index0 = 0; tri_index0 < mesh->index_count; tri_index0 += 3) {
-    const uint16_t* indices = (const uint16_t*)mesh->indices + tri_index0;
-    const uint16_t index0 = indices[0];
-    const uint16_t index1 = indices[1];
-    const uint16_t index2 = indices[2];
-    const float* pos_data0 = (const float*)((char*)mesh->vertices + offset + (stride * index0));
-    const float* pos_data1 = (const float*)((char*)mesh->vertices + offset + (stride * index1));
-    const float* pos_data2 = (const float*)((char*)mesh->vertices + offset + (stride * index2));
-
-    vectorial::vec3f positions[3];
-    positions[0].load(pos_data0);
-    positions[1].load(pos_data1);
-    positions[2].load(pos_data2);
-
-    // find the longest edge
-    vectorial::vec3f edges[3];
-    edges[0] = positions[1] - positions[0];
-    edges[1] = positions[2] - positions[1];
-    edges[2] = positions[0] - positions[2];
-    float lengths[3];
-    lengths[0] = vectorial::length(edges[0]);
-    lengths[1] = vectorial::length(edges[1]);
-    lengths[2] = vectorial::length(edges[2]);
-    int longest_edge_index;
-    if (lengths[0] > lengths[1] && lengths[0] > lengths[2]) {
-      longest_edge_index = 0;
-    }
-    else if (lengths[1] > lengths[0] && lengths[1] > lengths[2]) {
-      longest_edge_index = 1;
-    }
-    else {
-      longest_edge_index = 2;
-    }
-
-    int sorted_indices[3];
-    sorted_indices[0] = longest_edge_index;
-    sorted_indices[1] = (longest_edge_index + 1) % 3;
-    sorted_indices[2] = (longest_edge_index + 2) % 3;
-
-    // assuming the longest edge is on the x axis, find the height of the triangle using Heron's formula
-    //  - a = {longest edge}
-    //  - s = (a+b+c)/2
-    //  - A = sqrt(s(s-a)(s-b)(s-c))
-    //  - A = 0.5ah
-    // => h = A/(0.5a)
-    // const float a = lengths[sorted_indices[0]];
-    // const float b = lengths[sorted_indices[1]];
-    // const float c = lengths[sorted_indices[2]];
-    // const float s = (a + b + c) * 0.5f;
-    // const float area = sqrtf(s * (s - a) * (s - b) * (s - c));
-    // const float h = area / (0.5 * a);
-
-    // project the triangle to an XY plane
-    vectorial::vec2f projected[3];
-    projected[0] = vectorial::vec2f::zero();
-    projected[1] = vectorial::vec2f(lengths[longest_edge_index], 0.0f);
-
-    // using the dot product, derive the projected length of the third edge
-    // dp = |a||b|cos(theta)
-    const vectorial::vec3f edge_a = vectorial::normalize(positions[sorted_indices[1]] - positions[sorted_indices[0]]);
-    const vectorial::vec3f edge_c = vectorial::normalize(positions[sorted_indices[2]] - positions[sorted_indices[0]]);
-    const float cos_ac = vectorial::dot(edge_a, edge_c);
-    const float sin_ac = sqrtf(1.0f - (cos_ac * cos_ac));
-    projected[2] = vectorial::vec2f(lengths[sorted_indices[2]] * cos_ac, lengths[sorted_indices[2]] * sin_ac);
-
-    // assuming the longest edge is on the x axis, find the height of the triangle using Heron's formula
-    //  - a = {longest edge}
-    //  - s = (a+b+c)/2
-    //  - A = sqrt(s(s-a)(s-b)(s-c))
-    //  - A = 0.5ah
-    // => h = A/(0.5a)
-    const float a = lengths[sorted_indices[0]];
-    const float b = lengths[sorted_indices[1]];
-    const float c = lengths[sorted_indices[2]];
-    const float s = (a + b + c) * 0.5f;
-    const float area = sqrtf(s * (s - a) * (s - b) * (s - c));
-    const float h = area / (0.5 * a);
-
-    LightmapTriangle tri;
-    tri.positions[0] = projected[0];
-    tri.positions[1] = projected[1];
-    tri.positions[2] = projected[2];
-    tri.width = lengths[sorted_indices[0]];
-    tri.height = h;
-    tri.mesh_tri_index = tri_index0 / 3;
-    tri.projected_edge_index = longest_edge_index;
-    triangles.push_back(tri);
+static void bind_constant_vec3(const Shader& shader, UniformSemantic semantic, const vectorial::vec3f& value) {
+  if (shader.uniforms[semantic] < 0) {
+    return;
   }
-
-  return true;
+  float value_f[3];
+  value.store(value_f);
+  GL_CHECK(glUniform3fv(shader.uniforms[semantic], 1, value_f));
 }
 
-static void lightmap_pack_texture(std::vector<LightmapTriangle>& triangles, int tex_width, int tex_height) {
-  // const size_t texel_count = tex_width * tex_height;
-  // std::vector<bool> used(texel_count, false);
+static void bind_constant_int(const Shader& shader, UniformSemantic semantic, int value) {
+  if (shader.uniforms[semantic] < 0) {
+    return;
+  }
+  GL_CHECK(glUniform1i(shader.uniforms[semantic], value));
+}
 
-  const vectorial::vec2f tex_scale(1.0f / tex_width, 1.0f / tex_height);
-  const vectorial::vec2f vtx_scale = tex_scale * 2.0f;
-  const vectorial::vec2f vtx_offset(-1.0f, -1.0f);
+// fills the frame constants from the camera and the light, once before anything gets drawn
+static void frame_constants_update(const vectorial::mat4f& view) {
+  // add a transform to rotation Z up to Y up
+  // NOTE: this is applied to the view transform (inverse of the camera world transform)
+  vectorial::mat4f makeYUp = vectorial::mat4f::axisRotation(-1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f));
+  const vectorial::mat4f view_y_up = makeYUp * view;
+
+  s_view_proj = s_camera.projection * view_y_up;
+
+  FrameConstants constants;
+  view_y_up.store(constants.view);
+  s_camera.projection.store(constants.proj);
+  vectorial::transformPoint(view_y_up, s_light.pos).store(constants.light_pos_vs);
+  constants.light_pos_vs[3] = 1.0f;
+  s_light.color.store(constants.light_color);
+  constants.light_color[3] = 1.0f;
+  constants.light_intensity = s_light.intensity;
+  constants.light_range = s_light.range;
+  constants.camera_near_far[0] = s_camera.near;
+  constants.camera_near_far[1] = s_camera.far;
+
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, s_frame_constants_ub));
+  GL_CHECK(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(constants), &constants));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, sizeof(constants));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
 
-  // reverse sort the triangles by height
-  std::sort(triangles.begin(), triangles.end(), [](const LightmapTriangle& a, const LightmapTriangle& b) {
-    return a.height > b.height;
-  });
+static void bind_constants(const Shader& shader, const Model& model) {
+  bind_constant_mat4(shader, UNIFORM_SEMANTIC_WORLD, model.transform);
+  bind_constant_vec3(shader, UNIFORM_SEMANTIC_POSITION_OFFSET, model.quantization.position_offset);
+  bind_constant_vec3(shader, UNIFORM_SEMANTIC_POSITION_SCALE, model.quantization.position_scale);
+  bind_constant_int(shader, UNIFORM_SEMANTIC_OCTAHEDRAL_NORMALS, model.quantization.octahedral_normals);
+}
 
-  GLuint framebuf_id;
-  GL_CHECK(glGenFramebuffers(1, &framebuf_id));
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, framebuf_id));
+static GLuint lightmap_create_vb(const float* uv_data, size_t uv_count) {
+  GLuint vb;
+  GL_CHECK(glGenBuffers(1, &vb));
+  gl_bind_array_buffer(vb);
+  GL_CHECK(glBufferData(GL_ARRAY_BUFFER, uv_count * 2 * sizeof(float), uv_data, GL_STATIC_DRAW));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, uv_count * 2 * sizeof(float));
+  gl_bind_array_buffer(0);
+  return vb;
+}
 
-  GL_CHECK(glGenTextures(1, &s_lightmap_tex_id));
-  GLuint tex_id = s_lightmap_tex_id;
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D, tex_id));
-  GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, tex_width, tex_height, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr));
+static GLuint texture_create(GLint internal_format, int width, int height, GLenum type, const void* texels) {
+  GLuint tex_id;
+  GL_CHECK(glGenTextures(1, &tex_id));
+  gl_bind_texture_2d(0, tex_id);
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CHECK(glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, GL_RGB, type, texels));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, width * height * 3 * (type == GL_FLOAT ? sizeof(float) : 1));
   GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
   GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
+  gl_bind_texture_2d(0, 0);
+  return tex_id;
+}
 
-  GL_CHECK(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_id, 0));
-  GLenum draw_buffers[] = {GL_COLOR_ATTACHMENT0};
-  GL_CHECK(glDrawBuffers(1, draw_buffers));
+static GLuint lightmap_create_pack_texture(const std::vector<LightmapTriangle>& lightmap_triangles,
+                                           int tex_width,
+                                           int tex_height) {
+  uint8_t* texels = (uint8_t*)malloc(tex_width * tex_height * 3);
+  lightmap_draw_debug(texels, tex_width, tex_height, lightmap_triangles, s_num_lightmap_tris);
+  GLuint tex_id = texture_create(GL_RGB8, tex_width, tex_height, GL_UNSIGNED_BYTE, texels);
+  free(texels);
+  return tex_id;
+}
 
-  GLenum framebuf_status;
-  GL_CHECK(framebuf_status = glCheckFramebufferStatus(GL_FRAMEBUFFER));
-  if (framebuf_status != GL_FRAMEBUFFER_COMPLETE) {
-    printf("framebuf status not complete: %d\n", framebuf_status);
-    exit(1);
+// builds the transfer between the lightmap texels and a texture of the light they bounce. the lit program adds that to
+// the direct light it computes per pixel. when the transfer doesn't fit, the texture starts out black and the bounces
+// are path traced instead.
+static GLuint lightmap_create_texture(const Mesh* mesh, const float* uv_data, int tex_width, int tex_height) {
+  PROFILE_SCOPE("lightmap_create_texture");
+  s_lightmap_texels = (float*)calloc(tex_width * tex_height * 3, sizeof(float));
+  s_lightmap_width = tex_width;
+  s_lightmap_height = tex_height;
+  s_relit_light = s_light;
+  s_lightmap_stale = false;
+
+  bake_scene_create(&s_bake_scene, mesh);
+  if (s_bake_scene.bvh && !texel_gbuffer_create(&s_texel_gbuffer, &s_bake_scene, uv_data, tex_width, tex_height)) {
+    bake_scene_destroy(&s_bake_scene);
+  }
+  if (s_bake_scene.bvh) {
+    TransferSettings settings;
+    transfer_settings_init(&settings);
+    s_transfer = transfer_create(&s_bake_scene, &s_texel_gbuffer, uv_data, &settings);
+  }
+  if (s_transfer) {
+    printf("transfer: %u texels, %.1f sources a texel, %.1f MB\n",
+           s_transfer->row_count,
+           s_transfer->row_count ? (double)transfer_entry_count(s_transfer) / s_transfer->row_count : 0.0,
+           s_transfer->byte_count / (1024.0 * 1024.0));
+    transfer_relight(s_transfer, s_light, s_transfer_bounce_count, false, s_lightmap_texels);
+  }
+  else if (s_bake_scene.bvh) {
+    printf("transfer: doesn't fit, path tracing the lightmap instead\n");
+    s_progressive_lightmap = true;
   }
 
-  GL_CHECK(glViewport(0, 0, tex_width, tex_height));
-  GL_CHECK(glUseProgram(s_lightmap_pack_program));
-
-  GLuint vb;
-  GL_CHECK(glGenBuffers(1, &vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vb));
-  GL_CHECK(glEnableVertexAttribArray(0));
-  GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), nullptr));
-
-  GL_CHECK(glClearColor(0.0f, 0.0f, 0.0f, 0.0f));
-  GL_CHECK(glClear(GL_COLOR_BUFFER_BIT));
-  GL_CHECK(glDisable(GL_DEPTH_TEST));
-  GL_CHECK(glDisable(GL_CULL_FACE));
-
-  const int padding = 2;
-  bool flip = false;
-  float dp_prev = 1.0f;
-  int row_height = -1.0f;
-  int u_top = 0;
-  int u_bottom = 0;
-  int v = 0;
-  int color_index = 0;
-  const int tri_count = s_num_lightmap_tris < 0 ? triangles.size() : min(triangles.size(), s_num_lightmap_tris);
-  for (int tri_index = 0; tri_index < tri_count; ++tri_index) {
-    LightmapTriangle& tri = triangles[tri_index];
-
-    // extract the triangle positions
-    vectorial::vec2f pos0 = tri.positions[0];
-    vectorial::vec2f pos1 = tri.positions[1];
-    vectorial::vec2f pos2 = tri.positions[2];
-
-    // determine the relationship between the current triangle's angle and the previous one. if the current angle is
-    // smaller, the next triangle can fit starting from the top of the previous, otherwise it must start from the bottom
-    // of the previous
-    const vectorial::vec2f vec_10 = vectorial::normalize(pos0 - pos1);
-    const vectorial::vec2f vec_12 = vectorial::normalize(pos2 - pos1);
-    const float dp = vectorial::dot(vec_12, vec_10);
-    int u;
-    if (dp < dp_prev) {
-      // offset from the base
-      u = u_bottom;
-    }
-    else {
-      // offset from the top
-      u = u_top;
-    }
-
-    // compute the rectangular bounds (rounded to nearest integer)
-    const int32_t tri_width = (int32_t)(pos1.x() + 0.5f);
-    const int32_t tri_height = (int32_t)(pos2.y() + 0.5f);
-
-    // if this is the first iteration, set the initial row_height;
-    if (tri_index == 0) {
-      row_height = tri_height;
-    }
-
-    // if adding this will wrap us around the end of the buffer, start a new row
-    if (u + tri_width > tex_width) {
-      u = 0;
-      v += row_height + padding;
-      row_height = tri_height;
-      flip = false;
-    }
+  GLuint tex_id = texture_create(GL_RGB16F, tex_width, tex_height, GL_FLOAT, s_lightmap_texels);
 
-    // mirror the triangle over the diagonal
-    if (flip) {
-      vectorial::vec2f old_pos0 = pos0;
-      vectorial::vec2f old_pos1 = pos1;
-      vectorial::vec2f old_pos2 = pos2;
-
-      pos0 = old_pos1;
-      pos1 = old_pos0;
-      const float pos2_x_offset = (old_pos2.x() - old_pos0.x());
-      pos2 = vectorial::vec2f(old_pos1.x() - pos2_x_offset, -old_pos2.y());
-
-      // add an offset to account for being attached to the top of the row
-      vectorial::vec2f offset_y(0.0f, row_height);
-      pos0 += offset_y;
-      pos1 += offset_y;
-      pos2 += offset_y;
-    }
+  // it's dilated for bilinear lookups
+  gl_bind_texture_2d(0, tex_id);
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GL_CHECK(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+  gl_bind_texture_2d(0, 0);
+  return tex_id;
+}
 
-    // snap the verts to texel centers
-    pos0 = snap_to_half(pos0);
-    pos1 = snap_to_half(pos1);
-    pos2 = snap_to_half(pos2);
-
-    // place the triangle in the correct spot on the map
-    vectorial::vec2f uv_offset(u, v);
-    vectorial::vec2f uv_pos0;
-    vectorial::vec2f uv_pos1;
-    vectorial::vec2f uv_pos2;
-    uv_pos0 = pos0 + uv_offset;
-    uv_pos1 = pos1 + uv_offset;
-    uv_pos2 = pos2 + uv_offset;
-
-    tri.uvs[0] = uv_pos0 * tex_scale;
-    tri.uvs[1] = uv_pos1 * tex_scale;
-    tri.uvs[2] = uv_pos2 * tex_scale;
-
-    uv_pos0 = (uv_pos0 * vtx_scale) + vtx_offset;
-    uv_pos1 = (uv_pos1 * vtx_scale) + vtx_offset;
-    uv_pos2 = (uv_pos2 * vtx_scale) + vtx_offset;
-
-    // fill the VB with the new triangle
-    float positions[6];
-    uv_pos2.store(positions);
-    uv_pos1.store(positions + 2);
-    uv_pos0.store(positions + 4);
-    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(float), positions, GL_STATIC_DRAW));
-
-    // choose a color
-    const uint32_t color_uint32 = s_brewer_colors[color_index];
-    color_index = (color_index + 1) % BREWER_COLOR_COUNT;
-    const vectorial::vec4f color = color_rgba_to_float4(color_uint32);
-    bind_constant_vec4(s_lightmap_pack_program, "u_color", color);
-
-    // draw the triangle into the buffer
-    GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, 3));
-
-    if (flip) {
-      u_bottom = (pos0 + uv_offset).x() + padding;
-    }
-    else {
-      u_bottom = (pos1 + uv_offset).x() + padding;
-    }
-    u_top = (pos2 + uv_offset).x() + padding;
-    dp_prev = dp;
-    flip = !flip;
+// sets up the progressive bake over the shared G-buffer and the buffers its tiles go up through
+static bool lightmap_create_progressive() {
+  PROFILE_SCOPE("lightmap_create_progressive");
+  ProgressiveSettings settings;
+  progressive_settings_init(&settings);
+  s_progressive = progressive_bake_create(&s_bake_scene, &s_texel_gbuffer, &settings);
+  if (!s_progressive) {
+    return false;
   }
 
-  GL_CHECK(glDisableVertexAttribArray(0));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-  GL_CHECK(glDeleteBuffers(1, &vb));
-  GL_CHECK(glUseProgram(0));
-  GL_CHECK(glBindFramebuffer(GL_FRAMEBUFFER, 0));
-  GL_CHECK(glDeleteFramebuffers(1, &framebuf_id));
+  const int tile_size = s_progressive->settings.tile_size;
+  const size_t tile_bytes = tile_size * tile_size * 3 * sizeof(float);
+  s_lightmap_upload_tiles.resize(std::max(s_lightmap_upload_budget / tile_bytes, (size_t)1));
+  s_lightmap_upload_texels = (uint8_t*)malloc(s_lightmap_upload_tiles.size() * tile_bytes);
+  GL_CHECK(glGenBuffers(LIGHTMAP_UPLOAD_BUFFER_COUNT, s_lightmap_upload_buffers));
+  for (GLuint buffer : s_lightmap_upload_buffers) {
+    GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer));
+    GL_CHECK(glBufferData(
+        GL_PIXEL_UNPACK_BUFFER, s_lightmap_upload_tiles.size() * tile_bytes, nullptr, GL_STREAM_DRAW));
+  }
+  GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  return true;
+}
 
-  // sort the triangles by mesh order
-  std::sort(triangles.begin(), triangles.end(), [](const LightmapTriangle& a, const LightmapTriangle& b) {
-    return a.mesh_tri_index < b.mesh_tri_index;
-  });
+static bool vec3_equal(const vectorial::vec3f& a, const vectorial::vec3f& b) {
+  return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
 }
 
-static GLuint lightmap_create_vb(const std::vector<LightmapTriangle>& lightmap_triangles) {
-  const size_t tri_count = lightmap_triangles.size();
-  const size_t uv_count = tri_count * 3;
-  const size_t vb_size_bytes = uv_count * 2 * sizeof(float);
-  float* uv_data = (float*)malloc(vb_size_bytes);
+static bool light_equal(const Light& a, const Light& b) {
+  return vec3_equal(a.pos, b.pos) && vec3_equal(a.color, b.color) && a.intensity == b.intensity && a.range == b.range;
+}
 
-  int uv_index = 0;
-  for (const LightmapTriangle& tri : lightmap_triangles) {
-    int out_index0 = tri.projected_edge_index;
-    int out_index1 = (tri.projected_edge_index + 1) % 3;
-    int out_index2 = (tri.projected_edge_index + 2) % 3;
-    tri.uvs[out_index0].store((uv_data + (2 * uv_index + 0)));
-    tri.uvs[out_index1].store((uv_data + (2 * uv_index + 2)));
-    tri.uvs[out_index2].store((uv_data + (2 * uv_index + 4)));
-    uv_index += 3;
+// gathers the bounces again when the light moved or changed and uploads them
+static void lightmap_relight() {
+  if (!s_transfer || (!s_lightmap_stale && light_equal(s_light, s_relit_light))) {
+    return;
   }
-
-  GLuint vb;
-  GL_CHECK(glGenBuffers(1, &vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vb));
-  GL_CHECK(glBufferData(GL_ARRAY_BUFFER, uv_count * 2 * sizeof(float), uv_data, GL_STATIC_DRAW));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-
-  free(uv_data);
-  return vb;
+  PROFILE_SCOPE("lightmap_relight");
+  s_relit_light = s_light;
+  s_lightmap_stale = false;
+  transfer_relight(s_transfer, s_light, s_transfer_bounce_count, false, s_lightmap_texels);
+
+  gl_bind_texture_2d(0, s_lightmap_tex_id);
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  GL_CHECK(glTexSubImage2D(
+      GL_TEXTURE_2D, 0, 0, 0, s_lightmap_width, s_lightmap_height, GL_RGB, GL_FLOAT, s_lightmap_texels));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, s_lightmap_width * s_lightmap_height * 3 * sizeof(float));
 }
 
-static Mesh* mesh_load(const char* filename, const char* mtl_dirname, const vectorial::mat4f& transform) {
-  tinyobj::attrib_t attrib;
-  std::vector<tinyobj::shape_t> shapes;
-  std::vector<tinyobj::material_t> materials;
-  std::string err;
-  bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, filename, mtl_dirname, true);
-  if (!err.empty()) {
-    std::cerr << "ERROR: " << err << std::endl;
+// path traces more of the bounced light, starting over when the light changed, and uploads the refined tiles that fit
+// the budget. the rest wait for the next frame.
+static void lightmap_refine() {
+  if (!s_bake_scene.bvh) {
+    return;
   }
-  if (!ret) {
-    exit(1);
+  PROFILE_SCOPE("lightmap_refine");
+  if (!s_progressive && !lightmap_create_progressive()) {
+    s_progressive_lightmap = false;
+    return;
   }
-
-  std::vector<uint16_t> indices;
-  std::vector<Vertex> vertices;
-
-  for (const tinyobj::shape_t& shape : shapes) {
-    for (size_t face = 0, face_count = shape.mesh.indices.size() / 3; face < face_count; ++face) {
-      tinyobj::index_t idx0 = shape.mesh.indices[3 * face + 0];
-      tinyobj::index_t idx1 = shape.mesh.indices[3 * face + 1];
-      tinyobj::index_t idx2 = shape.mesh.indices[3 * face + 2];
-
-      // positions
-      vectorial::vec3f pos0, pos1, pos2;
-      pos0.load(&attrib.vertices[3 * idx0.vertex_index]);
-      pos1.load(&attrib.vertices[3 * idx1.vertex_index]);
-      pos2.load(&attrib.vertices[3 * idx2.vertex_index]);
-      pos0 = vectorial::transformPoint(transform, pos0);
-      pos1 = vectorial::transformPoint(transform, pos1);
-      pos2 = vectorial::transformPoint(transform, pos2);
-
-      // normals
-      vectorial::vec3f nor0, nor1, nor2;
-      if (attrib.normals.size() > 0) {
-        nor0.load(&attrib.normals[3 * idx0.normal_index]);
-        nor1.load(&attrib.normals[3 * idx1.normal_index]);
-        nor2.load(&attrib.normals[3 * idx2.normal_index]);
-        nor0 = vectorial::transformVector(transform, nor0);
-        nor1 = vectorial::transformVector(transform, nor1);
-        nor2 = vectorial::transformVector(transform, nor2);
-      }
-      else {
-        vectorial::vec3f normal = normal_from_face(pos0, pos1, pos2);
-        nor0 = normal;
-        nor1 = normal;
-        nor2 = normal;
-      }
-
-      vectorial::vec3f center;
-      center = pos0 + pos1 + pos2;
-      center /= 3.0f;
-      VertexPN vtx;
-      center.store(&vtx.p.x);
-      nor0.store(&vtx.n.x);
-      s_debug_normals.push_back(vtx);
-
-      vectorial::vec3f color;
-      if (materials.size() > 0) {
-        const tinyobj::material_t& mat = materials[shape.mesh.material_ids[face]];
-        color.load(mat.diffuse);
-      }
-      else {
-        color = vectorial::vec3f(0.5f);
-      }
-
-      Vertex v0, v1, v2;
-      pos0.store(&v0.p.x);
-      nor0.store(&v0.n.x);
-      color.store(&v0.c.x);
-      pos1.store(&v1.p.x);
-      nor1.store(&v1.n.x);
-      color.store(&v1.c.x);
-      pos2.store(&v2.p.x);
-      nor2.store(&v2.n.x);
-      color.store(&v2.c.x);
-      vertices.push_back(v0);
-      vertices.push_back(v1);
-      vertices.push_back(v2);
-
-      indices.push_back(indices.size());
-      indices.push_back(indices.size());
-      indices.push_back(indices.size());
-    }
+  if (!light_equal(s_light, s_progressive->light)) {
+    progressive_bake_restart(s_progressive, s_light);
+  }
+  progressive_bake_refine(s_progressive, s_progressive_budget_ms);
+  const unsigned tile_count = progressive_bake_take_dirty(
+      s_progressive, s_lightmap_upload_tiles.data(), (unsigned)s_lightmap_upload_tiles.size());
+  if (!tile_count) {
+    return;
   }
 
-  Mesh* mesh = (Mesh*)malloc(sizeof(Mesh));
-  mesh->channels[0] = {CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_POSITION};
-  mesh->channels[1] = {CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_NORMAL};
-  mesh->channels[2] = {CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_COLOR};
-  mesh->index_count = (unsigned)indices.size();
-  mesh->vertex_count = (unsigned)vertices.size();
-  mesh->channel_count = 3;
-  mesh->index_size_32_bit = false;
+  // the tiles go back to back into the next buffer of the ring, and each is copied to the texture from there
+  const int tile_size = s_progressive->settings.tile_size;
+  const size_t tile_bytes = tile_size * tile_size * 3 * sizeof(float);
+  GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s_lightmap_upload_buffers[s_lightmap_upload_buffer_index]));
+  s_lightmap_upload_buffer_index = (s_lightmap_upload_buffer_index + 1) % LIGHTMAP_UPLOAD_BUFFER_COUNT;
+  uint8_t* mapped;
+  GL_CHECK(mapped = (uint8_t*)glMapBufferRange(
+               GL_PIXEL_UNPACK_BUFFER, 0, tile_count * tile_bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (!mapped) {
+    GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  }
+  uint8_t* texels = mapped ? mapped : s_lightmap_upload_texels;
+  for (unsigned index = 0; index < tile_count; ++index) {
+    progressive_bake_read_tile(s_progressive, s_lightmap_upload_tiles[index], (float*)(texels + index * tile_bytes));
+  }
+  if (mapped) {
+    GL_CHECK(glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+  }
 
-  const unsigned ib_size = mesh->index_count * sizeof(uint16_t);
-  const unsigned vb_size = mesh->vertex_count * vertex_stride(mesh->channels, mesh->channel_count);
-  mesh->indices = malloc(ib_size);
-  mesh->vertices = malloc(vb_size);
-  memmove(mesh->indices, &indices[0], ib_size);
-  memmove(mesh->vertices, &vertices[0], vb_size);
+  // offsets into the buffer when one is bound
+  const uint8_t* source = mapped ? nullptr : s_lightmap_upload_texels;
+  gl_bind_texture_2d(0, s_lightmap_tex_id);
+  GL_CHECK(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+  for (unsigned index = 0; index < tile_count; ++index) {
+    int x;
+    int y;
+    int width;
+    int height;
+    progressive_bake_tile_rect(s_progressive, s_lightmap_upload_tiles[index], &x, &y, &width, &height);
+    GL_CHECK(glTexSubImage2D(
+        GL_TEXTURE_2D, 0, x, y, width, height, GL_RGB, GL_FLOAT, source + index * tile_bytes));
+    PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, width * height * 3 * sizeof(float));
+  }
+  if (mapped) {
+    GL_CHECK(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+  }
+}
 
-  return mesh;
+static void debug_normals_add(const Mesh* mesh) {
+  const Vertex* vertices = (const Vertex*)mesh->vertices;
+  for (unsigned index = 0; index < mesh->index_count; index += 3) {
+    const Vertex& v0 = vertices[mesh_index(mesh, index + 0)];
+    const Vertex& v1 = vertices[mesh_index(mesh, index + 1)];
+    const Vertex& v2 = vertices[mesh_index(mesh, index + 2)];
+
+    VertexPN vtx;
+    vtx.p.x = (v0.p.x + v1.p.x + v2.p.x) / 3.0f;
+    vtx.p.y = (v0.p.y + v1.p.y + v2.p.y) / 3.0f;
+    vtx.p.z = (v0.p.z + v1.p.z + v2.p.z) / 3.0f;
+    vtx.n = v0.n;
+    s_debug_normals.push_back(vtx);
+  }
 }
 
-static void mesh_destroy(Mesh* mesh) {
-  free(mesh->indices);
-  free(mesh->vertices);
-  free(mesh);
+// the pool for a layout and an index type, a new one if no model has used them yet
+static unsigned model_pool_find(VertexAttribsFunc bind_vertex_attribs, GLenum index_type, bool has_lightmap_uvs) {
+  for (unsigned pool_index = 0; pool_index < s_model_pools.size(); ++pool_index) {
+    const ModelPool& pool = s_model_pools[pool_index];
+    if (pool.bind_vertex_attribs == bind_vertex_attribs && pool.index_type == index_type &&
+        pool.has_lightmap_uvs == has_lightmap_uvs) {
+      return pool_index;
+    }
+  }
+
+  ModelPool pool;
+  pool.bind_vertex_attribs = bind_vertex_attribs;
+  pool.index_type = index_type;
+  pool.has_lightmap_uvs = has_lightmap_uvs;
+  pool.vertex_count = 0;
+  pool.index_count = 0;
+  pool.vao = 0;
+  pool.ib = 0;
+  pool.vb = 0;
+  pool.lightmap_vb = 0;
+  s_model_pools.push_back(pool);
+  return (unsigned)s_model_pools.size() - 1;
 }
 
-static void model_create(Model* model, const Mesh* mesh, GLuint lightmap_vb) {
-  model->ib = 0;
-  model->vb = 0;
-  model->lightmap_vb = lightmap_vb;
+// `quantization` decodes a mesh from mesh_quantize(), nullptr for a float mesh. `lightmap_uvs` has one float2 per
+// vertex for meshes whose vertices don't carry them, nullptr otherwise. the model draws once model_pools_upload() ran.
+static void model_create(Model* model,
+                         const Mesh* mesh,
+                         const float* lightmap_uvs,
+                         const MeshQuantization* quantization) {
   model->tri_count = 0;
   model->wireframe = false;
-  model->channel_count = mesh->channel_count;
-  memmove(model->channels, mesh->channels, mesh->channel_count * sizeof(VertexChannelDesc));
-
-  // create the index buffer
-  int ib_size_bytes;
-  if (mesh->index_size_32_bit) {
-    ib_size_bytes = mesh->index_count * sizeof(uint32_t);
+  const VertexAttribsFunc bind_vertex_attribs =
+      vertex_attribs_for<MeshVertexFormat, QuantizedVertexFormat8, QuantizedVertexFormat16, void>(mesh);
+  if (!bind_vertex_attribs) {
+    report_error("model_create: unsupported vertex format\n");
+    exit(1);
+  }
+  if (quantization) {
+    model->quantization = *quantization;
+    model->center = quantization->position_offset + quantization->position_scale * 0.5f;
   }
   else {
-    ib_size_bytes = mesh->index_count * sizeof(uint16_t);
+    model->quantization.position_offset = vectorial::vec3f(0.0f);
+    model->quantization.position_scale = vectorial::vec3f(1.0f);
+    model->quantization.octahedral_normals = false;
+    vectorial::vec3f bounds_min(0.0f);
+    vectorial::vec3f bounds_max(0.0f);
+    for (unsigned index = 0; index < mesh->vertex_count; ++index) {
+      const vectorial::vec3f p = to_vec3f(MeshVertexFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, index));
+      bounds_min = index ? vectorial::min(bounds_min, p) : p;
+      bounds_max = index ? vectorial::max(bounds_max, p) : p;
+    }
+    model->center = (bounds_min + bounds_max) * 0.5f;
   }
 
-  GL_CHECK(glGenBuffers(1, &model->ib));
-  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->ib));
-  GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, ib_size_bytes, mesh->indices, GL_STATIC_DRAW));
-  GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-
-  int vb_size_bytes = mesh->vertex_count * vertex_stride(mesh->channels, mesh->channel_count);
-  GL_CHECK(glGenBuffers(1, &model->vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, model->vb));
-  GL_CHECK(glBufferData(GL_ARRAY_BUFFER, vb_size_bytes, mesh->vertices, GL_STATIC_DRAW));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  // split the indices into 16-bit submeshes if they need more
+  const void* indices = mesh->indices;
+  std::vector<uint16_t> split_indices;
+  GLenum index_type;
+  if (mesh->index_size_32_bit && s_split_16_bit_submeshes) {
+    split_indices.resize(mesh->index_count);
+    mesh_split_16_bit(mesh, split_indices.data(), model->submeshes);
+    indices = split_indices.data();
+    index_type = GL_UNSIGNED_SHORT;
+  }
+  else {
+    model->submeshes.assign(1, MeshSubmesh{0, mesh->index_count, 0});
+    index_type = mesh->index_size_32_bit ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+  }
+  const size_t index_size = index_type == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+
+  // append to the pool, the submeshes move along by what it already holds
+  model->pool_index = model_pool_find(bind_vertex_attribs, index_type, lightmap_uvs != nullptr);
+  ModelPool& pool = s_model_pools[model->pool_index];
+  for (MeshSubmesh& submesh : model->submeshes) {
+    submesh.index_offset += pool.index_count;
+    submesh.base_vertex += pool.vertex_count;
+  }
+  const uint8_t* index_bytes = (const uint8_t*)indices;
+  pool.indices.insert(pool.indices.end(), index_bytes, index_bytes + mesh->index_count * index_size);
+  const uint8_t* vertex_bytes = (const uint8_t*)mesh->vertices;
+  pool.vertices.insert(pool.vertices.end(),
+                       vertex_bytes,
+                       vertex_bytes + mesh->vertex_count * (size_t)vertex_stride(mesh->channels, mesh->channel_count));
+  if (lightmap_uvs) {
+    pool.lightmap_uvs.insert(pool.lightmap_uvs.end(), lightmap_uvs, lightmap_uvs + 2 * mesh->vertex_count);
+  }
+  pool.index_count += mesh->index_count;
+  pool.vertex_count += mesh->vertex_count;
 
-  // finish up the model and save it
+  // finish up the model
   model->tri_count = mesh->index_count / 3;
   model->transform = vectorial::mat4f::identity();
 }
 
-static void model_create(const Mesh* mesh, GLuint lightmap_vb) {
+static void model_create(const Mesh* mesh, const float* lightmap_uvs, const MeshQuantization* quantization) {
   Model model;
-  model_create(&model, mesh, lightmap_vb);
+  model_create(&model, mesh, lightmap_uvs, quantization);
   s_models.push_back(model);
 }
 
-static void model_destroy(Model* model) {
-  GL_CHECK(glDeleteBuffers(1, &model->ib));
-  GL_CHECK(glDeleteBuffers(1, &model->vb));
+// uploads what the models collected in their pools and sets up the vertex arrays
+static void model_pools_upload() {
+  for (ModelPool& pool : s_model_pools) {
+    if (pool.vao) {
+      continue;
+    }
+
+    // the vertex array captures the index buffer binding and the attribute setup
+    GL_CHECK(glGenVertexArrays(1, &pool.vao));
+    gl_bind_vertex_array(pool.vao);
+
+    GL_CHECK(glGenBuffers(1, &pool.ib));
+    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pool.ib));
+    GL_CHECK(glBufferData(GL_ELEMENT_ARRAY_BUFFER, pool.indices.size(), pool.indices.data(), GL_STATIC_DRAW));
+    PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, pool.indices.size());
+
+    GL_CHECK(glGenBuffers(1, &pool.vb));
+    gl_bind_array_buffer(pool.vb);
+    GL_CHECK(glBufferData(GL_ARRAY_BUFFER, pool.vertices.size(), pool.vertices.data(), GL_STATIC_DRAW));
+    PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, pool.vertices.size());
+    pool.bind_vertex_attribs();
+
+    if (pool.has_lightmap_uvs) {
+      pool.lightmap_vb = lightmap_create_vb(pool.lightmap_uvs.data(), pool.vertex_count);
+      gl_bind_array_buffer(pool.lightmap_vb);
+      GL_CHECK(glEnableVertexAttribArray(15));
+      GL_CHECK(glVertexAttribPointer(15, 2, GL_FLOAT, GL_FALSE, 0, nullptr));
+    }
+    gl_bind_vertex_array(s_default_vao);
+
+    std::vector<uint8_t>().swap(pool.indices);
+    std::vector<uint8_t>().swap(pool.vertices);
+    std::vector<float>().swap(pool.lightmap_uvs);
+  }
+}
+
+static void model_pools_destroy() {
+  for (ModelPool& pool : s_model_pools) {
+    GL_CHECK(glDeleteVertexArrays(1, &pool.vao));
+    GL_CHECK(glDeleteBuffers(1, &pool.ib));
+    GL_CHECK(glDeleteBuffers(1, &pool.vb));
+    if (pool.lightmap_vb) {
+      GL_CHECK(glDeleteBuffers(1, &pool.lightmap_vb));
+    }
+  }
+  s_model_pools.clear();
 }
 
 static void draw_debug_texture(GLuint tex_id, float pos_x, float pos_y, float width, float height) {
@@ -953,73 +968,137 @@ static void draw_debug_texture(GLuint tex_id, float pos_x, float pos_y, float wi
 
   GLuint vb;
   GL_CHECK(glGenBuffers(1, &vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, vb));
+  gl_bind_vertex_array(s_default_vao);
+  gl_bind_array_buffer(vb);
   GL_CHECK(glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 24, vb_data, GL_STATIC_DRAW));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, sizeof(float) * 24);
 
   GL_CHECK(glEnableVertexAttribArray(0));
   GL_CHECK(glEnableVertexAttribArray(1));
   GL_CHECK(glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), nullptr));
   GL_CHECK(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float))));
 
-  GL_CHECK(glActiveTexture(GL_TEXTURE0));
-  GL_CHECK(glBindTexture(GL_TEXTURE_2D, tex_id));
+  gl_bind_texture_2d(0, tex_id);
 
   GL_CHECK(glDisable(GL_DEPTH_TEST));
-  GL_CHECK(glUseProgram(s_draw_texture_program));
+  gl_use_program(s_draw_texture_program);
 
   GL_CHECK(glDrawArrays(GL_TRIANGLES, 0, 6));
+  PROFILE_COUNT(PROFILE_COUNTER_DRAW_CALLS, 1);
 
-  GL_CHECK(glUseProgram(0));
   GL_CHECK(glEnable(GL_DEPTH_TEST));
-  GL_CHECK(glEnableVertexAttribArray(1));
-  GL_CHECK(glEnableVertexAttribArray(0));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CHECK(glDisableVertexAttribArray(1));
+  GL_CHECK(glDisableVertexAttribArray(0));
+  gl_bind_array_buffer(0);
   GL_CHECK(glDeleteBuffers(1, &vb));
 }
 
 static void load_models() {
+  PROFILE_SCOPE("load_models");
   // char * dir = getcwd(NULL, 0);
   // std::cout << "Current dir: " << dir << std::endl;
 
   const char* mtl_dirname = "data/";
-  Mesh* mesh = mesh_load("data/cornell_box.obj",
-                         mtl_dirname,
-                         vectorial::mat4f::scale(10.0f) *
-                             vectorial::mat4f::axisRotation(1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f)));
-
-  std::vector<LightmapTriangle> lightmap_triangles;
-  GLuint lightmap_vb = 0;
-  if (lightmap_project_triangles(lightmap_triangles, mesh)) {
-    lightmap_pack_texture(lightmap_triangles, 128, 128);
-    lightmap_vb = lightmap_create_vb(lightmap_triangles);
+  MeshLoadSettings load_settings;
+  mesh_load_settings_init(&load_settings);
+  LightmapPackSettings pack_settings;
+  lightmap_pack_settings_init(&pack_settings);
+  LightmapChartSettings chart_settings;
+  lightmap_chart_settings_init(&chart_settings);
+  MeshCache* cache = mesh_cache_load("data/cornell_box.obj.cache",
+                                     "data/cornell_box.obj",
+                                     mtl_dirname,
+                                     vectorial::mat4f::scale(10.0f) *
+                                         vectorial::mat4f::axisRotation(1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f)),
+                                     &load_settings,
+                                     &chart_settings,
+                                     &pack_settings);
+  if (!cache) {
+    exit(1);
   }
-
-  model_create(mesh, lightmap_vb);
-  mesh_destroy(mesh);
+  const MeshCacheContents* contents = mesh_cache_contents(cache);
+  const Mesh* mesh = &contents->mesh;
+  debug_normals_add(mesh);
+
+  const int tex_width = contents->tex_width;
+  const int tex_height = contents->tex_height;
+  printf("lightmap: %dx%d, %.0f%% utilized%s\n",
+         tex_width,
+         tex_height,
+         100.0f * contents->utilization,
+         mesh_cache_hit(cache) ? " (cached)" : "");
+
+  s_lightmap_tex_id = lightmap_create_texture(mesh, contents->corner_uvs, tex_width, tex_height);
+
+  // the pack view only needs the uvs and the pack order of each triangle
+  std::vector<LightmapTriangle> lightmap_triangles(mesh->index_count / 3);
+  for (size_t tri_index = 0; tri_index < lightmap_triangles.size(); ++tri_index) {
+    LightmapTriangle& tri = lightmap_triangles[tri_index];
+    for (int corner = 0; corner < 3; ++corner) {
+      tri.uvs[corner] = vectorial::vec2f(contents->corner_uvs + 6 * tri_index + 2 * corner);
+    }
+    tri.pack_index = contents->pack_indices[tri_index];
+  }
+  s_lightmap_pack_tex_id = lightmap_create_pack_texture(lightmap_triangles, tex_width, tex_height);
+
+  if (s_quantize_vertices) {
+    MeshQuantizeSettings quantize_settings;
+    mesh_quantize_settings_init(&quantize_settings);
+    MeshQuantization quantization;
+    Mesh* quantized = mesh_quantize(mesh, contents->vertex_uvs, &quantize_settings, &quantization);
+    if (!quantized) {
+      exit(1);
+    }
+    model_create(quantized, nullptr, &quantization);
+    mesh_destroy(quantized);
+  }
+  else {
+    model_create(mesh, contents->vertex_uvs, nullptr);
+  }
+  model_pools_upload();
+  mesh_cache_close(cache);
 }
 
 static void unload_models() {
-  for (Model& model : s_models) {
-    model_destroy(&model);
-  }
   s_models.clear();
+  model_pools_destroy();
+  s_debug_normals.clear();
+
+  GL_CHECK(glDeleteTextures(1, &s_lightmap_pack_tex_id));
+  GL_CHECK(glDeleteTextures(1, &s_lightmap_tex_id));
+  s_lightmap_pack_tex_id = 0;
+  s_lightmap_tex_id = 0;
+
+  transfer_destroy(s_transfer);
+  free(s_lightmap_texels);
+  s_transfer = nullptr;
+  s_lightmap_texels = nullptr;
+
+  if (s_progressive) {
+    GL_CHECK(glDeleteBuffers(LIGHTMAP_UPLOAD_BUFFER_COUNT, s_lightmap_upload_buffers));
+    memset(s_lightmap_upload_buffers, 0, sizeof(s_lightmap_upload_buffers));
+  }
+  progressive_bake_destroy(s_progressive);
+  free(s_lightmap_upload_texels);
+  s_progressive = nullptr;
+  s_lightmap_upload_texels = nullptr;
+
+  texel_gbuffer_destroy(&s_texel_gbuffer);
+  bake_scene_destroy(&s_bake_scene);
 }
 
 static void load_shaders() {
-  s_program = load_shader("data/shaders/lit");
-  s_program_lightmap_only = load_shader("data/shaders/lightmap_only");
-  s_program_depth = load_shader("data/shaders/lit.vs.glsl", "data/shaders/depth.fs.glsl");
-  s_lightmap_pack_program = load_shader("data/shaders/lightmap_pack");
+  PROFILE_SCOPE("load_shaders");
+  shader_create(&s_program, "data/shaders/lit");
+  shader_create(&s_program_lightmap_only, "data/shaders/lightmap_only");
+  shader_create(&s_program_depth, "data/shaders/lit.vs.glsl", "data/shaders/depth.fs.glsl");
   s_draw_texture_program = load_shader("data/shaders/debug_texture");
 }
 
 static void unload_shaders() {
-  GL_CHECK(glDeleteProgram(s_lightmap_pack_program));
-  GL_CHECK(glDeleteProgram(s_program_depth));
-  GL_CHECK(glDeleteProgram(s_program));
-  s_lightmap_pack_program = 0;
-  s_program_depth = 0;
-  s_program = 0;
+  shader_destroy(&s_program_depth);
+  shader_destroy(&s_program_lightmap_only);
+  shader_destroy(&s_program);
 }
 
 static void camera_set_projection(Camera* cam, float fov_y, float width, float height) {
@@ -1040,28 +1119,47 @@ static void debug_draw_points(const DDrawVertex* vertices, int vertex_count) {
 }
 
 static void debug_draw_lines(const DDrawVertex* vertices, int vertex_count) {
-  GL_CHECK(glUseProgram(s_debug_draw_program));
+  gl_use_program(s_debug_draw_program.program);
+  gl_bind_vertex_array(s_default_vao);
   GL_CHECK(glEnableVertexAttribArray(0));
   GL_CHECK(glEnableVertexAttribArray(1));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, s_debug_draw_lines_vb));
+  gl_bind_array_buffer(s_debug_draw_lines_vb);
   GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count * sizeof(DDrawVertex), vertices));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, vertex_count * sizeof(DDrawVertex));
   GL_CHECK(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DDrawVertex), (void*)offsetof(DDrawVertex, pos_x)));
   GL_CHECK(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(DDrawVertex), (void*)offsetof(DDrawVertex, col_r)));
 
-  // add a transform to rotation Z up to Y up
-  // NOTE: this is applied to the view transform (inverse of the camera world transform)
-  vectorial::mat4f makeYUp = vectorial::mat4f::axisRotation(-1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f));
-  const vectorial::mat4f world_view =
-      makeYUp * vectorial::inverse(makeCameraTransform(&s_camera)) * s_models.back().transform;
-  const vectorial::mat4f world_view_proj = s_camera.projection * world_view;
-  bind_constant_mat4(s_debug_draw_lines_vb, "world_view_proj", world_view_proj);
+  bind_constant_mat4(s_debug_draw_program, UNIFORM_SEMANTIC_WORLD, s_models.back().transform);
 
   GL_CHECK(glDrawArrays(GL_LINES, 0, vertex_count));
+  PROFILE_COUNT(PROFILE_COUNTER_DRAW_CALLS, 1);
+
+  GL_CHECK(glDisableVertexAttribArray(1));
+  GL_CHECK(glDisableVertexAttribArray(0));
+}
+
+// the debug draw program with a world transform that undoes the view and the projection, so the vertices land on the
+// screen as they are
+static void debug_draw_screen_lines(const DDrawVertex* vertices, int vertex_count) {
+  gl_use_program(s_debug_draw_program.program);
+  gl_bind_vertex_array(s_default_vao);
+  GL_CHECK(glEnableVertexAttribArray(0));
+  GL_CHECK(glEnableVertexAttribArray(1));
+  gl_bind_array_buffer(s_debug_draw_screen_lines_vb);
+  GL_CHECK(glBufferSubData(GL_ARRAY_BUFFER, 0, vertex_count * sizeof(DDrawVertex), vertices));
+  PROFILE_COUNT(PROFILE_COUNTER_BYTES_UPLOADED, vertex_count * sizeof(DDrawVertex));
+  GL_CHECK(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(DDrawVertex), (void*)offsetof(DDrawVertex, pos_x)));
+  GL_CHECK(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(DDrawVertex), (void*)offsetof(DDrawVertex, col_r)));
+
+  bind_constant_mat4(s_debug_draw_program, UNIFORM_SEMANTIC_WORLD, vectorial::inverse(s_view_proj));
+
+  GL_CHECK(glDisable(GL_DEPTH_TEST));
+  GL_CHECK(glDrawArrays(GL_LINES, 0, vertex_count));
+  PROFILE_COUNT(PROFILE_COUNTER_DRAW_CALLS, 1);
+  GL_CHECK(glEnable(GL_DEPTH_TEST));
 
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
   GL_CHECK(glDisableVertexAttribArray(1));
   GL_CHECK(glDisableVertexAttribArray(0));
-  GL_CHECK(glUseProgram(0));
 }
 
 static void debug_draw_init() {
@@ -1069,101 +1167,174 @@ static void debug_draw_init() {
   ddraw_settings_init(&settings);
   settings.draw_points = &debug_draw_points;
   settings.draw_lines = &debug_draw_lines;
+  settings.draw_screen_lines = &debug_draw_screen_lines;
 
   // create the VBs
   GL_CHECK(glGenBuffers(1, &s_debug_draw_points_vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, s_debug_draw_points_vb));
+  gl_bind_array_buffer(s_debug_draw_points_vb);
   GL_CHECK(glBufferData(GL_ARRAY_BUFFER, settings.max_points * sizeof(DDrawVertex), nullptr, GL_DYNAMIC_DRAW));
   GL_CHECK(glGenBuffers(1, &s_debug_draw_lines_vb));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, s_debug_draw_lines_vb));
+  gl_bind_array_buffer(s_debug_draw_lines_vb);
   GL_CHECK(glBufferData(GL_ARRAY_BUFFER, settings.max_lines * sizeof(DDrawVertex), nullptr, GL_DYNAMIC_DRAW));
-  GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
+  GL_CHECK(glGenBuffers(1, &s_debug_draw_screen_lines_vb));
+  gl_bind_array_buffer(s_debug_draw_screen_lines_vb);
+  GL_CHECK(
+      glBufferData(GL_ARRAY_BUFFER, settings.max_screen_lines * sizeof(DDrawVertex), nullptr, GL_DYNAMIC_DRAW));
+  gl_bind_array_buffer(0);
 
-  s_debug_draw_program = load_shader("data/shaders/debug_draw");
+  shader_create(&s_debug_draw_program, "data/shaders/debug_draw");
 
   ddraw_init(&settings);
 }
 
 static void debug_draw_shutdown() {
   ddraw_shutdown();
+  shader_destroy(&s_debug_draw_program);
 
   // destroy the VBs
+  GL_CHECK(glDeleteBuffers(1, &s_debug_draw_screen_lines_vb));
   GL_CHECK(glDeleteBuffers(1, &s_debug_draw_lines_vb));
   GL_CHECK(glDeleteBuffers(1, &s_debug_draw_points_vb));
+  s_debug_draw_screen_lines_vb = 0;
   s_debug_draw_lines_vb = 0;
   s_debug_draw_points_vb = 0;
 }
 
-static void draw_models(const Model* models, unsigned model_count, const vectorial::mat4f& view) {
-  for (unsigned index = 0; index < model_count; ++index) {
-    const Model& model = models[index];
+// true if drawing `b` right after `a` needs no uniform changed
+static bool same_draw_constants(const Model& a, const Model& b) {
+  float a_transform[16];
+  float b_transform[16];
+  a.transform.store(a_transform);
+  b.transform.store(b_transform);
+  float a_quantization[6];
+  float b_quantization[6];
+  a.quantization.position_offset.store(a_quantization);
+  a.quantization.position_scale.store(a_quantization + 3);
+  b.quantization.position_offset.store(b_quantization);
+  b.quantization.position_scale.store(b_quantization + 3);
+  return 0 == memcmp(a_transform, b_transform, sizeof(a_transform)) &&
+         0 == memcmp(a_quantization, b_quantization, sizeof(a_quantization)) &&
+         a.quantization.octahedral_normals == b.quantization.octahedral_normals;
+}
 
-    if (model.wireframe || s_draw_wireframe) {
-      GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, GL_LINE));
-    }
-    else {
-      GL_CHECK(glPolygonMode(GL_FRONT_AND_BACK, GL_FILL));
-    }
+// queues a draw for every submesh and sorts them by state, the ones out of the same model pool front to back. runs
+// that share the pool, the polygon mode and the uniforms go out as one glMultiDrawElementsBaseVertex(), which takes in
+// every submesh of a model and neighboring models that have the same transform and quantization.
+static void draw_models(const Model* models, unsigned model_count) {
+  PROFILE_SCOPE("draw_models");
+  const Shader* shader;
+  if (s_draw_depth) {
+    shader = &s_program_depth;
+  }
+  else if (s_draw_lightmap) {
+    shader = &s_program_lightmap_only;
+  }
+  else {
+    shader = &s_program;
+  }
 
-    GLuint program;
-    if (s_draw_depth) {
-      program = s_program_depth;
-    }
-    else if (s_draw_lightmap) {
-      program = s_program_lightmap_only;
+  s_render_draws.clear();
+  s_render_items.clear();
+  for (unsigned model_index = 0; model_index < model_count; ++model_index) {
+    const Model& model = models[model_index];
+    const bool wireframe = model.wireframe || s_draw_wireframe;
+    const float distance =
+        vectorial::length(vectorial::transformPoint(model.transform, model.center) - s_camera.pos) / s_camera.far;
+    const uint64_t key = render_key(shader->program, wireframe ? 1 : 0, s_model_pools[model.pool_index].vao, distance);
+    for (unsigned submesh_index = 0; submesh_index < model.submeshes.size(); ++submesh_index) {
+      RenderItem item;
+      item.key = key;
+      item.index = (uint32_t)s_render_draws.size();
+      s_render_items.push_back(item);
+      s_render_draws.push_back(RenderDraw{model_index, submesh_index});
     }
-    else {
-      program = s_program;
+  }
+  s_render_scratch.resize(s_render_items.size());
+  render_queue_sort(s_render_items.data(), s_render_scratch.data(), s_render_items.size());
+
+  for (size_t first = 0; first < s_render_items.size();) {
+    const Model& model = models[s_render_draws[s_render_items[first].index].model_index];
+    const ModelPool& pool = s_model_pools[model.pool_index];
+    const bool wireframe = model.wireframe || s_draw_wireframe;
+
+    // everything up to the next change of state
+    const size_t index_size = pool.index_type == GL_UNSIGNED_INT ? sizeof(uint32_t) : sizeof(uint16_t);
+    s_batch_counts.clear();
+    s_batch_offsets.clear();
+    s_batch_base_vertices.clear();
+    size_t last = first;
+    for (; last < s_render_items.size(); ++last) {
+      const RenderDraw& draw = s_render_draws[s_render_items[last].index];
+      const Model& draw_model = models[draw.model_index];
+      if (&draw_model != &model && (draw_model.pool_index != model.pool_index ||
+                                    (draw_model.wireframe || s_draw_wireframe) != wireframe ||
+                                    !same_draw_constants(draw_model, model))) {
+        break;
+      }
+      const MeshSubmesh& submesh = draw_model.submeshes[draw.submesh_index];
+      s_batch_counts.push_back((GLsizei)submesh.index_count);
+      s_batch_offsets.push_back((const void*)(submesh.index_offset * index_size));
+      s_batch_base_vertices.push_back((GLint)submesh.base_vertex);
     }
-    GL_CHECK(glUseProgram(program));
-    bind_constants(program, model.transform, view, s_camera.projection);
 
-    // bind the lightmap texture
-    GL_CHECK(glActiveTexture(GL_TEXTURE0));
-    GL_CHECK(glBindTexture(GL_TEXTURE_2D, s_lightmap_tex_id));
-
-    const unsigned stride = vertex_stride(model.channels, model.channel_count);
-    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model.ib));
-    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, model.vb));
-    size_t offset = 0;
-    for (int index = 0; index < model.channel_count; ++index) {
-      const VertexChannelDesc* channel = model.channels + index;
-      GL_CHECK(glEnableVertexAttribArray(index));
-      GL_CHECK(glVertexAttribPointer(
-          index, channel_elements(channel), to_gl_channel_type(channel->type), GL_FALSE, stride, (void*)offset));
-      offset += channel_size(channel);
-    }
-    GL_CHECK(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, n)));
-    GL_CHECK(glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, c)));
+    gl_polygon_mode(wireframe ? GL_LINE : GL_FILL);
+    gl_use_program(shader->program);
+    bind_constants(*shader, model);
 
-    if (model.lightmap_vb) {
-      GL_CHECK(glEnableVertexAttribArray(15));
-      GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, model.lightmap_vb));
-      GL_CHECK(glVertexAttribPointer(15, 2, GL_FLOAT, GL_FALSE, 0, nullptr));
-    }
-
-    GL_CHECK(glDrawElements(GL_TRIANGLES, model.tri_count * 3, GL_UNSIGNED_SHORT, nullptr));
+    // bind the lightmap texture
+    gl_bind_texture_2d(0, s_lightmap_tex_id);
+
+    gl_bind_vertex_array(pool.vao);
+    GL_CHECK(glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+                                           s_batch_counts.data(),
+                                           pool.index_type,
+                                           s_batch_offsets.data(),
+                                           (GLsizei)s_batch_counts.size(),
+                                           s_batch_base_vertices.data()));
+    PROFILE_COUNT(PROFILE_COUNTER_DRAW_CALLS, 1);
+    first = last;
+  }
+}
 
-    if (model.lightmap_vb) {
-      GL_CHECK(glDisableVertexAttribArray(15));
-    }
-    GL_CHECK(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-    GL_CHECK(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    for (int index = 0; index < model.channel_count; ++index) {
-      GL_CHECK(glDisableVertexAttribArray(index));
-    }
+// the counters of the last frame in the top left corner
+static void draw_profile_overlay(float dt) {
+  const float char_height = 0.03f;
+  const float char_width = char_height * 0.5f * s_window_height / s_window_width;
+  const float line_height = char_height * 1.5f;
+  const float color[3] = {1.0f, 1.0f, 0.0f};
+  char line[64];
+  float y = 0.95f;
+  snprintf(line, sizeof(line), "frame %.2f ms", dt * 1000.0f);
+  ddraw_screen_text(-0.95f, y, char_width, char_height, line, color);
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+    y -= line_height;
+    snprintf(line,
+             sizeof(line),
+             "%s %llu",
+             profile_counter_name((ProfileCounter)counter),
+             (unsigned long long)profile_counter_frame((ProfileCounter)counter));
+    ddraw_screen_text(-0.95f, y, char_width, char_height, line, color);
   }
 }
 
 static void init(bool reset) {
+  gl_state_invalidate();
   GL_CHECK(glGenVertexArrays(1, &s_default_vao));
-  GL_CHECK(glBindVertexArray(s_default_vao));
+  gl_bind_vertex_array(s_default_vao);
+
+  GL_CHECK(glGenBuffers(1, &s_frame_constants_ub));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, s_frame_constants_ub));
+  GL_CHECK(glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameConstants), nullptr, GL_DYNAMIC_DRAW));
+  GL_CHECK(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+  GL_CHECK(glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, s_frame_constants_ub));
 
   debug_draw_init();
 
-  load_shaders();
-  load_models();
+  JobSettings job_settings;
+  job_settings_init(&job_settings);
+  job_init(&job_settings);
 
+  // the light has to be set up before the models since it gets baked into the lightmap
   if (!reset) {
     s_camera.pos = vectorial::vec3f(0.0f, -20.0f, 10.0f);
     s_camera.pitch = 0.0f;
@@ -1177,6 +1348,9 @@ static void init(bool reset) {
     s_light.intensity = 1.0f;
     s_light.range = 15.0f;
   }
+
+  load_shaders();
+  load_models();
 }
 
 static void destroy() {
@@ -1184,10 +1358,15 @@ static void destroy() {
   unload_shaders();
 
   debug_draw_shutdown();
+  job_shutdown();
 
   s_models.clear();
-  GL_CHECK(glBindVertexArray(0));
+  GL_CHECK(glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_CONSTANTS_BINDING, 0));
+  GL_CHECK(glDeleteBuffers(1, &s_frame_constants_ub));
+  s_frame_constants_ub = 0;
+  gl_bind_vertex_array(0);
   GL_CHECK(glDeleteVertexArrays(1, &s_default_vao));
+  gl_state_invalidate();
 }
 
 static bool is_key_down(AppKeyCode key) {
@@ -1210,10 +1389,40 @@ extern "C" void app_input_key_up(AppKeyCode key) {
   s_key_status[key] = KEY_STATUS_EDGE;
 }
 
+// the host can load a backend before the first call, otherwise the driver's functions get looked up
+static void gl_backend_load() {
+  if (!gl_backend_loaded() && !gl_backend_load_real(nullptr)) {
+    report_error("failed to load the GL functions\n");
+    exit(1);
+  }
+}
+
+extern "C" void app_set_camera(float pos_x, float pos_y, float pos_z, float pitch, float yaw) {
+  s_camera.pos = vectorial::vec3f(pos_x, pos_y, pos_z);
+  s_camera.pitch = pitch;
+  s_camera.yaw = yaw;
+}
+
+extern "C" void app_set_light_position(float pos_x, float pos_y, float pos_z) {
+  s_light.pos = vectorial::vec3f(pos_x, pos_y, pos_z);
+}
+
+extern "C" void app_set_progressive_lightmap(int enabled) {
+  if (s_progressive_lightmap == (enabled != 0) || (!enabled && !s_transfer)) {
+    return;
+  }
+  s_progressive_lightmap = enabled != 0;
+  s_lightmap_stale = true;
+  if (s_progressive) {
+    progressive_bake_restart(s_progressive, s_light);
+  }
+}
+
 extern "C" void app_render(float dt) {
+  gl_backend_load();
+  PROFILE_SCOPE("app_render");
   if (s_first_draw) {
     s_first_draw = false;
-    debug_draw_init();
     init(false);
   }
   s_time += dt;
@@ -1250,6 +1459,20 @@ extern "C" void app_render(float dt) {
   if (is_key_edge_down(APP_KEY_CODE_F5)) {
     s_vis_lightmap = !s_vis_lightmap;
   }
+  if (is_key_edge_down(APP_KEY_CODE_F6)) {
+    s_vis_lightmap_pack = !s_vis_lightmap_pack;
+  }
+  if (is_key_edge_down(APP_KEY_CODE_F7)) {
+    s_draw_profile_overlay = !s_draw_profile_overlay;
+  }
+  if (is_key_edge_down(APP_KEY_CODE_F8)) {
+    if (profile_write_chrome_trace("gi-demo.trace.json")) {
+      printf("wrote gi-demo.trace.json\n");
+    }
+  }
+  if (is_key_edge_down(APP_KEY_CODE_F9)) {
+    app_set_progressive_lightmap(!s_progressive_lightmap);
+  }
   if (is_key_edge_down(APP_KEY_CODE_MINUS)) {
     --s_num_lightmap_tris;
     if (s_num_lightmap_tris < -1) {
@@ -1340,7 +1563,14 @@ extern "C" void app_render(float dt) {
   GL_CHECK(glCullFace(GL_BACK));
 
   // draw all the models
-  draw_models(&s_models[0], (unsigned)s_models.size(), view);
+  if (s_progressive_lightmap) {
+    lightmap_refine();
+  }
+  else {
+    lightmap_relight();
+  }
+  frame_constants_update(view);
+  draw_models(&s_models[0], (unsigned)s_models.size());
 
   for (const auto& normal : s_debug_normals) {
     float pos[3] = {normal.p.x, normal.p.y, normal.p.z};
@@ -1348,14 +1578,33 @@ extern "C" void app_render(float dt) {
     float col[3] = {1.0f, 1.0f, 1.0f};
     ddraw_normal(pos, nor, col, 0.5f);
   }
-  ddraw_flush();
+  if (s_draw_profile_overlay) {
+    draw_profile_overlay(dt);
+  }
+  {
+    PROFILE_SCOPE("ddraw_flush");
+    ddraw_flush();
+  }
 
   if (s_vis_lightmap) {
     // draw the lightmap texture
     draw_debug_texture(s_lightmap_tex_id, -0.8f, -0.8f, 1.6f, 1.6f);
   }
+  if (s_vis_lightmap_pack) {
+    // draw how the triangles were packed into the lightmap
+    draw_debug_texture(s_lightmap_pack_tex_id, -0.8f, -0.8f, 1.6f, 1.6f);
+  }
+
+  if (is_key_edge_down(APP_KEY_CODE_F4)) {
+    printf("gl state: %u changes this frame, %u redundant ones dropped\n",
+           s_gl_state_counters.calls,
+           s_gl_state_counters.elided);
+  }
+  s_gl_state_counters.calls = 0;
+  s_gl_state_counters.elided = 0;
 
   clear_key_edge_states();
+  profile_frame();
 }
 
 extern "C" void app_resize(float width, float height) {
@@ -1364,7 +1613,15 @@ extern "C" void app_resize(float width, float height) {
   }
   s_window_width = width;
   s_window_height = height;
+  gl_backend_load();
 
   GL_CHECK(glViewport(0, 0, (GLsizei)width, (GLsizei)height));
   camera_set_projection(&s_camera, 1.3f, s_window_width, s_window_height);
 }
+
+extern "C" void app_shutdown() {
+  if (!s_first_draw) {
+    destroy();
+    s_first_draw = true;
+  }
+}
@@ -42,10 +42,20 @@ typedef enum AppKeyCode {
 
 void app_render(float dt);
 void app_resize(float width, float height);
+// releases everything the first app_render() set up, the next one sets it up again
+void app_shutdown();
 
 void app_input_key_down(AppKeyCode key);
 void app_input_key_up(AppKeyCode key);
 
+// for hosts that move the view themselves, like a scripted path. z is up and the camera looks down +y at zero pitch
+// and yaw, like the keyboard controls. both get reset by the first app_render().
+void app_set_camera(float pos_x, float pos_y, float pos_z, float pitch, float yaw);
+void app_set_light_position(float pos_x, float pos_y, float pos_z);
+// path trace the bounced light progressively instead of gathering it through the transfer, F9 switches too. it can be
+// set before the first app_render().
+void app_set_progressive_lightmap(int enabled);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,573 @@
+#include "bake.h"
+#include "bvh.h"
+#include "job.h"
+#include "mesh.h"
+#include "profile.h"
+#include "texel_gbuffer.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define BAKE_PI 3.14159265f
+// paths every texel traces before its error is first looked at
+#define BAKE_FIRST_ROUND_SAMPLES 16
+// paths a texel traces before it's taken to be in the dark when none of them found any light
+#define BAKE_DARK_SAMPLES 128
+// fewest paths a texel traces in a round after the first
+#define BAKE_MIN_ROUND_SAMPLES 8
+// added to the brightness the error threshold is a fraction of, so the texels in the dark don't sample forever
+#define BAKE_DARK_LUMINANCE 0.02f
+
+// what the texels gathered so far, the G-buffer texels index it
+struct BakeJob {
+  const TexelGbuffer* gbuffer;
+  int texels_per_job;
+  const BakeScene* scene;
+  const Light* light;
+  const BakeSettings* settings;
+  float* directs;            // 4 floats a texel, rgb and a pad
+  float* sums;               // 4 floats a texel, of the bounced light of the paths
+  double* moments;           // 2 a texel, the sum of the paths' luminance and of its square
+  int* sample_counts;        // paths traced
+  const int* round_samples;  // paths to trace this round
+  bool first_round;
+};
+
+static uint32_t hash_u32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+static uint32_t reverse_bits(uint32_t x) {
+  x = (x << 16) | (x >> 16);
+  x = ((x & 0x00ff00ffU) << 8) | ((x & 0xff00ff00U) >> 8);
+  x = ((x & 0x0f0f0f0fU) << 4) | ((x & 0xf0f0f0f0U) >> 4);
+  x = ((x & 0x33333333U) << 2) | ((x & 0xccccccccU) >> 2);
+  x = ((x & 0x55555555U) << 1) | ((x & 0xaaaaaaaaU) >> 1);
+  return x;
+}
+
+// a random permutation of the bits where each only depends on the ones below it (Laine and Karras 2011)
+static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+  x += seed;
+  x ^= x * 0x6c50b47cU;
+  x ^= x * 0xb82f1e52U;
+  x ^= x * 0xc7afe638U;
+  x ^= x * 0x8d22f6e6U;
+  return x;
+}
+
+// the same from the top bit down, which is an Owen scramble of a number in [0, 1) in fixed point
+static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+  return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+}
+
+// the second dimension of the Sobol sequence, the first is just the reversed bits
+static uint32_t sobol_second(uint32_t index) {
+  uint32_t result = 0;
+  for (uint32_t direction = 0x80000000U; index; index >>= 1, direction ^= direction >> 1) {
+    if (index & 1) {
+      result ^= direction;
+    }
+  }
+  return result;
+}
+
+void bake_sampler_start(BakeSampler* sampler, uint32_t seed, uint32_t index) {
+  sampler->seed = hash_u32(seed);
+  sampler->index = index;
+  sampler->dimension = 0;
+}
+
+void bake_sampler_next_2d(BakeSampler* sampler, float* u1, float* u2) {
+  // shuffling the index with its own scramble decorrelates the pairs of the bounces
+  const uint32_t seed = hash_u32(sampler->seed ^ hash_u32(sampler->dimension + 0x9e3779b9U));
+  const uint32_t index = nested_uniform_scramble(sampler->index, seed);
+  const uint32_t x = nested_uniform_scramble(reverse_bits(index), hash_u32(seed ^ 0x68e31da4U));
+  const uint32_t y = nested_uniform_scramble(sobol_second(index), hash_u32(seed ^ 0xb5297a4dU));
+  *u1 = (float)(x >> 8) * (1.0f / 16777216.0f);
+  *u2 = (float)(y >> 8) * (1.0f / 16777216.0f);
+  ++sampler->dimension;
+}
+
+void bake_scene_create(BakeScene* scene, const Mesh* mesh) {
+  scene->tri_count = 0;
+  scene->bvh = nullptr;
+  if (!MeshVertexFormat::matches(mesh)) {
+    fprintf(stderr, "ERROR: the baker only takes meshes in MeshVertexFormat\n");
+    return;
+  }
+
+  scene->tri_count = mesh->index_count / 3;
+  scene->positions.resize(scene->tri_count * 3);
+  scene->normals.resize(scene->tri_count * 3);
+  scene->albedos.resize(scene->tri_count);
+
+  for (unsigned tri_index = 0; tri_index < scene->tri_count; ++tri_index) {
+    vectorial::vec3f albedo = vectorial::vec3f::zero();
+    for (int corner = 0; corner < 3; ++corner) {
+      const uint32_t vertex = mesh_index(mesh, 3 * tri_index + corner);
+      scene->positions[3 * tri_index + corner] =
+          to_vec3f(MeshVertexFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, vertex));
+      scene->normals[3 * tri_index + corner] =
+          to_vec3f(MeshVertexFormat::load<CHANNEL_SEMANTIC_NORMAL>(mesh->vertices, vertex));
+      albedo += to_vec3f(MeshVertexFormat::load<CHANNEL_SEMANTIC_COLOR>(mesh->vertices, vertex));
+    }
+    scene->albedos[tri_index] = albedo / 3.0f;
+  }
+
+  BvhSettings bvh_settings;
+  bvh_settings_init(&bvh_settings);
+  scene->bvh = bvh_create(mesh, &bvh_settings);
+}
+
+void bake_scene_destroy(BakeScene* scene) {
+  if (scene->bvh) {
+    bvh_destroy(scene->bvh);
+  }
+  scene->bvh = nullptr;
+  scene->tri_count = 0;
+  std::vector<vectorial::vec3f>().swap(scene->positions);
+  std::vector<vectorial::vec3f>().swap(scene->normals);
+  std::vector<vectorial::vec3f>().swap(scene->albedos);
+}
+
+vectorial::vec3f bake_direct_irradiance(const BakeScene* scene,
+                                        const Light& light,
+                                        const vectorial::vec3f& pos,
+                                        const vectorial::vec3f& normal,
+                                        float ray_bias,
+                                        unsigned* ray_count) {
+  vectorial::vec3f l = light.pos - pos;
+  const float l_dist = vectorial::length(l);
+  if (l_dist >= light.range) {
+    return vectorial::vec3f::zero();
+  }
+  l /= l_dist;
+
+  const float n_dot_l = vectorial::dot(normal, l);
+  if (n_dot_l <= 0.0f) {
+    return vectorial::vec3f::zero();
+  }
+
+  const float edge0 = light.range * 0.75f;
+  const float x = fminf(fmaxf((l_dist - edge0) / (light.range - edge0), 0.0f), 1.0f);
+  const float attenuation = 1.0f - (x * x * (3.0f - 2.0f * x));
+
+  const vectorial::vec3f org = pos + normal * ray_bias;
+  ++*ray_count;
+  if (bvh_intersect_any(scene->bvh, org, l, l_dist - ray_bias)) {
+    return vectorial::vec3f::zero();
+  }
+
+  return light.color * (n_dot_l * attenuation * light.intensity);
+}
+
+vectorial::vec3f bake_sample_cosine_hemisphere(const vectorial::vec3f& normal, float u1, float u2) {
+  // orthonormal basis around the normal (Duff et al. 2017)
+  const float nx = normal.x();
+  const float ny = normal.y();
+  const float nz = normal.z();
+  const float sign = copysignf(1.0f, nz);
+  const float a = -1.0f / (sign + nz);
+  const float b = nx * ny * a;
+  const vectorial::vec3f tangent(1.0f + sign * nx * nx * a, sign * b, -sign * nx);
+  const vectorial::vec3f bitangent(b, sign + ny * ny * a, -ny);
+
+  const float r = sqrtf(u1);
+  const float phi = 2.0f * BAKE_PI * u2;
+  const float z = sqrtf(fmaxf(0.0f, 1.0f - u1));
+  return tangent * (r * cosf(phi)) + bitangent * (r * sinf(phi)) + normal * z;
+}
+
+vectorial::vec3f bake_trace_path(const BakeScene* scene,
+                                 const Light& light,
+                                 const vectorial::vec3f& pos,
+                                 const vectorial::vec3f& normal,
+                                 int max_bounces,
+                                 float ray_bias,
+                                 BakeSampler* sampler,
+                                 unsigned* ray_count) {
+  // with cosine-weighted directions the pi and the lambertian 1/pi cancel, so every bounce just scales the throughput
+  // by the albedo of the surface it hit
+  vectorial::vec3f radiance = vectorial::vec3f::zero();
+  vectorial::vec3f throughput(1.0f);
+  vectorial::vec3f path_pos = pos;
+  vectorial::vec3f path_normal = normal;
+  for (int bounce = 0; bounce < max_bounces; ++bounce) {
+    float u1;
+    float u2;
+    bake_sampler_next_2d(sampler, &u1, &u2);
+    const vectorial::vec3f dir = bake_sample_cosine_hemisphere(path_normal, u1, u2);
+
+    BvhHit hit;
+    ++*ray_count;
+    if (!bvh_intersect_closest(scene->bvh, path_pos + path_normal * ray_bias, dir, FLT_MAX, &hit)) {
+      break;
+    }
+
+    const vectorial::vec3f* p = &scene->positions[3 * hit.tri_index];
+    vectorial::vec3f hit_normal = vectorial::normalize(vectorial::cross(p[1] - p[0], p[2] - p[0]));
+    if (vectorial::dot(hit_normal, dir) > 0.0f) {
+      hit_normal = -hit_normal;
+    }
+    path_pos = p[0] + (p[1] - p[0]) * hit.b1 + (p[2] - p[0]) * hit.b2;
+    path_normal = hit_normal;
+
+    throughput *= scene->albedos[hit.tri_index];
+    radiance += throughput * bake_direct_irradiance(scene, light, path_pos, path_normal, ray_bias, ray_count);
+  }
+  return radiance;
+}
+
+static float luminance(const vectorial::vec3f& rgb) {
+  return 0.2126f * rgb.x() + 0.7152f * rgb.y() + 0.0722f * rgb.z();
+}
+
+// traces the texels' paths of this round. a texel's paths are numbered on from the ones it already has and summed in
+// that order, so it comes out the same however the rounds and the blocks were split.
+static void bake_texels(void* user_data, int block_index) {
+  PROFILE_SCOPE("bake_texels");
+  const BakeJob* job = (const BakeJob*)user_data;
+  const TexelGbuffer* gbuffer = job->gbuffer;
+  const BakeSettings* settings = job->settings;
+  const unsigned texel_begin = block_index * job->texels_per_job;
+  const unsigned texel_end = std::min(texel_begin + job->texels_per_job, gbuffer->texel_count);
+
+  unsigned ray_count = 0;
+  for (unsigned texel = texel_begin; texel < texel_end; ++texel) {
+    const vectorial::vec3f pos = texel_gbuffer_position(gbuffer, texel);
+    const vectorial::vec3f normal = texel_gbuffer_normal(gbuffer, texel);
+    if (job->first_round) {
+      const vectorial::vec3f direct =
+          bake_direct_irradiance(job->scene, *job->light, pos, normal, settings->ray_bias, &ray_count);
+      direct.store(job->directs + 4 * texel);
+    }
+
+    const int sample_count = job->round_samples[texel];
+    if (sample_count == 0) {
+      continue;
+    }
+    vectorial::vec3f sum = vectorial::vec3f(job->sums + 4 * texel);
+    double* moments = job->moments + 2 * texel;
+    for (int sample = 0; sample < sample_count; ++sample) {
+      BakeSampler sampler;
+      bake_sampler_start(&sampler, gbuffer->atlas_texels[texel], (uint32_t)(job->sample_counts[texel] + sample));
+      const vectorial::vec3f radiance = bake_trace_path(
+          job->scene, *job->light, pos, normal, settings->max_bounces, settings->ray_bias, &sampler, &ray_count);
+      const double lum = luminance(radiance);
+      sum += radiance;
+      moments[0] += lum;
+      moments[1] += lum * lum;
+    }
+    sum.store(job->sums + 4 * texel);
+    job->sample_counts[texel] += sample_count;
+  }
+  PROFILE_COUNT(PROFILE_COUNTER_RAYS_TRACED, ray_count);
+}
+
+// how far the standard error of the texel's bounced light is over what the threshold allows, 1 being right at it. the
+// paths are stratified, so this overestimates the error a bit, which only errs on the safe side.
+static float bake_error_ratio(const BakeJob* job, unsigned texel) {
+  const int sample_count = job->sample_counts[texel];
+  const double* moments = job->moments + 2 * texel;
+  if (sample_count < 2) {
+    return 0.0f;
+  }
+  // none of its paths found any light, so there's no variance to go by
+  if (moments[0] == 0.0) {
+    return sample_count < BAKE_DARK_SAMPLES ? 2.0f : 0.0f;
+  }
+
+  const double mean = moments[0] / sample_count;
+  const double variance = std::max(moments[1] - mean * moments[0], 0.0) / (sample_count - 1);
+  const double direct = luminance(vectorial::vec3f(job->directs + 4 * texel));
+  const double tolerance = job->settings->noise_threshold * (direct + mean + BAKE_DARK_LUMINANCE);
+  return (float)(sqrt(variance / sample_count) / tolerance);
+}
+
+struct BakeCandidate {
+  float error_ratio;
+  uint32_t texel;
+  int sample_count;
+};
+
+// the next round's paths of every texel, 0 for the ones that are done, and returns their total. a texel over the
+// threshold asks for the paths that should bring it under, at most as many as it has. when they're more than the
+// budget left the noisiest texels go first. only reads what the texels gathered, so the plan doesn't depend on the
+// threads either. error_ratios and candidates are scratch of a float and a candidate a texel.
+static uint64_t bake_plan_round(int* round_samples,
+                                float* error_ratios,
+                                BakeCandidate* candidates,
+                                const BakeJob* job,
+                                uint64_t budget) {
+  const BakeSettings* settings = job->settings;
+  const TexelGbuffer* gbuffer = job->gbuffer;
+  for (unsigned texel = 0; texel < gbuffer->texel_count; ++texel) {
+    error_ratios[texel] = bake_error_ratio(job, texel);
+  }
+
+  unsigned candidate_count = 0;
+  uint64_t wanted = 0;
+  for (unsigned texel = 0; texel < gbuffer->texel_count; ++texel) {
+    round_samples[texel] = 0;
+    const int sample_count = job->sample_counts[texel];
+    if (sample_count >= settings->max_samples_per_texel) {
+      continue;
+    }
+
+    // the few paths that find a lot of light can all miss a texel's first ones, so it goes by the noisiest of its
+    // neighbors too
+    const int x = (int)(gbuffer->atlas_texels[texel] % gbuffer->tex_width);
+    const int y = (int)(gbuffer->atlas_texels[texel] / gbuffer->tex_width);
+    float error_ratio = 0.0f;
+    for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, gbuffer->tex_height - 1); ++ny) {
+      for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, gbuffer->tex_width - 1); ++nx) {
+        const int32_t neighbor = gbuffer->texel_indices[ny * gbuffer->tex_width + nx];
+        if (neighbor >= 0) {
+          error_ratio = std::max(error_ratio, error_ratios[neighbor]);
+        }
+      }
+    }
+    if (error_ratio <= 1.0f) {
+      continue;
+    }
+
+    // the error falls with the square root of the paths, aim a little under the threshold
+    const double target = ceil(sample_count * (double)error_ratio * error_ratio * 1.1);
+    const int needed = (int)std::min(target - sample_count, (double)sample_count);
+    BakeCandidate candidate;
+    candidate.error_ratio = error_ratio;
+    candidate.texel = texel;
+    candidate.sample_count =
+        std::min(std::max(needed, BAKE_MIN_ROUND_SAMPLES), settings->max_samples_per_texel - sample_count);
+    candidates[candidate_count++] = candidate;
+    wanted += candidate.sample_count;
+  }
+
+  if (wanted > budget) {
+    std::sort(candidates, candidates + candidate_count, [](const BakeCandidate& a, const BakeCandidate& b) {
+      return a.error_ratio != b.error_ratio ? a.error_ratio > b.error_ratio : a.texel < b.texel;
+    });
+  }
+  uint64_t planned = 0;
+  for (unsigned i = 0; i < candidate_count; ++i) {
+    const BakeCandidate& candidate = candidates[i];
+    const int sample_count = (int)std::min((uint64_t)candidate.sample_count, budget - planned);
+    if (sample_count == 0) {
+      break;
+    }
+    round_samples[candidate.texel] = sample_count;
+    planned += sample_count;
+  }
+  return planned;
+}
+
+void bake_texel_surface(vectorial::vec3f* pos,
+                        vectorial::vec3f* normal,
+                        const BakeScene* scene,
+                        const float* uv_data,
+                        int tex_width,
+                        int tex_height,
+                        int x,
+                        int y,
+                        int32_t tri_index) {
+  // barycentrics of the texel center in the uv triangle
+  const vectorial::vec2f tex_size((float)tex_width, (float)tex_height);
+  const float* uvs = uv_data + 6 * tri_index;
+  const vectorial::vec2f uv0 = vectorial::vec2f(uvs + 0) * tex_size;
+  const vectorial::vec2f uv1 = vectorial::vec2f(uvs + 2) * tex_size;
+  const vectorial::vec2f uv2 = vectorial::vec2f(uvs + 4) * tex_size;
+  const vectorial::vec2f center(x + 0.5f, y + 0.5f);
+  const vectorial::vec2f e1 = uv1 - uv0;
+  const vectorial::vec2f e2 = uv2 - uv0;
+  const vectorial::vec2f d = center - uv0;
+  const float area = e1.x() * e2.y() - e1.y() * e2.x();
+  float b1 = 0.0f;
+  float b2 = 0.0f;
+  if (fabsf(area) > 0.0f) {
+    b1 = (d.x() * e2.y() - d.y() * e2.x()) / area;
+    b2 = (e1.x() * d.y() - e1.y() * d.x()) / area;
+  }
+
+  // texels the triangle only partly covers have their center outside it, pull it back onto the triangle
+  b1 = fmaxf(b1, 0.0f);
+  b2 = fmaxf(b2, 0.0f);
+  if (b1 + b2 > 1.0f) {
+    const float scale = 1.0f / (b1 + b2);
+    b1 *= scale;
+    b2 *= scale;
+  }
+  const float b0 = 1.0f - b1 - b2;
+
+  const vectorial::vec3f* p = &scene->positions[3 * tri_index];
+  const vectorial::vec3f* n = &scene->normals[3 * tri_index];
+  *pos = p[0] * b0 + p[1] * b1 + p[2] * b2;
+  *normal = vectorial::normalize(n[0] * b0 + n[1] * b1 + n[2] * b2);
+}
+
+void bake_dilate(float* irradiance, const int32_t* tri_ids, int tex_width, int tex_height) {
+  for (int y = 0; y < tex_height; ++y) {
+    for (int x = 0; x < tex_width; ++x) {
+      if (tri_ids[y * tex_width + x] >= 0) {
+        continue;
+      }
+
+      float sum[3] = {0.0f, 0.0f, 0.0f};
+      int count = 0;
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int nx = x + dx;
+          const int ny = y + dy;
+          if (nx < 0 || ny < 0 || nx >= tex_width || ny >= tex_height || tri_ids[ny * tex_width + nx] < 0) {
+            continue;
+          }
+          const float* texel = irradiance + 3 * (ny * tex_width + nx);
+          sum[0] += texel[0];
+          sum[1] += texel[1];
+          sum[2] += texel[2];
+          ++count;
+        }
+      }
+      if (count > 0) {
+        float* out = irradiance + 3 * (y * tex_width + x);
+        out[0] = sum[0] / count;
+        out[1] = sum[1] / count;
+        out[2] = sum[2] / count;
+      }
+    }
+  }
+}
+
+void bake_settings_init(BakeSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->samples_per_texel = 64;
+  settings->max_bounces = 3;
+  settings->tile_size = 16;
+  settings->ray_bias = 0.001f;
+  settings->noise_threshold = 0.0f;
+  settings->max_samples_per_texel = 1024;
+}
+
+bool bake_lightmap(float* irradiance,
+                   int tex_width,
+                   int tex_height,
+                   const Mesh* mesh,
+                   const float* uv_data,
+                   const Light& light,
+                   const BakeSettings* settings) {
+  PROFILE_SCOPE("bake_lightmap");
+  BakeScene scene;
+  bake_scene_create(&scene, mesh);
+  if (!scene.bvh) {
+    bake_scene_destroy(&scene);
+    return false;
+  }
+
+  TexelGbuffer gbuffer;
+  if (!texel_gbuffer_create(&gbuffer, &scene, uv_data, tex_width, tex_height)) {
+    bake_scene_destroy(&scene);
+    return false;
+  }
+
+  const unsigned texel_count = gbuffer.texel_count;
+  void* directs = nullptr;
+  void* sums = nullptr;
+  const bool adaptive = settings->noise_threshold > 0.0f;
+  double* moments = (double*)calloc(2 * (size_t)texel_count + 1, sizeof(double));
+  int* sample_counts = (int*)calloc(texel_count + 1, sizeof(int));
+  int* round_samples = (int*)malloc((texel_count + 1) * sizeof(int));
+  // only the adaptive rounds need the scratch of bake_plan_round()
+  float* error_ratios = adaptive ? (float*)malloc((texel_count + 1) * sizeof(float)) : nullptr;
+  BakeCandidate* candidates = adaptive ? (BakeCandidate*)malloc((texel_count + 1) * sizeof(BakeCandidate)) : nullptr;
+  if (posix_memalign(&directs, 16, texel_count * 4 * sizeof(float) + 16) != 0) {
+    directs = nullptr;
+  }
+  if (posix_memalign(&sums, 16, texel_count * 4 * sizeof(float) + 16) != 0) {
+    sums = nullptr;
+  }
+  if (!directs || !sums || !moments || !sample_counts || !round_samples ||
+      (adaptive && (!error_ratios || !candidates))) {
+    fprintf(stderr, "ERROR: out of memory for the bake of %u lightmap texels\n", texel_count);
+    free(candidates);
+    free(error_ratios);
+    free(round_samples);
+    free(sample_counts);
+    free(moments);
+    free(sums);
+    free(directs);
+    texel_gbuffer_destroy(&gbuffer);
+    bake_scene_destroy(&scene);
+    return false;
+  }
+  memset(sums, 0, texel_count * 4 * sizeof(float));
+  memset(irradiance, 0, tex_width * tex_height * 3 * sizeof(float));
+
+  // a block of Morton-ordered texels is about a square tile of the atlas
+  BakeJob job;
+  job.gbuffer = &gbuffer;
+  job.texels_per_job = settings->tile_size * settings->tile_size;
+  job.scene = &scene;
+  job.light = &light;
+  job.settings = settings;
+  job.directs = (float*)directs;
+  job.sums = (float*)sums;
+  job.moments = moments;
+  job.sample_counts = sample_counts;
+  job.round_samples = round_samples;
+  job.first_round = true;
+  const int block_count = (int)((texel_count + job.texels_per_job - 1) / job.texels_per_job);
+
+  // every texel gets a first few paths, then the ones still too noisy get more for as long as the budget lasts
+  const int first_samples = std::max(
+      adaptive ? std::min(BAKE_FIRST_ROUND_SAMPLES, settings->max_samples_per_texel) : settings->samples_per_texel, 0);
+  uint64_t budget = (uint64_t)std::max(settings->samples_per_texel, 0) * texel_count;
+  std::fill(round_samples, round_samples + texel_count, first_samples);
+  budget -= std::min(budget, (uint64_t)first_samples * texel_count);
+  for (;;) {
+    job_parallel_for(&bake_texels, &job, block_count);
+    job.first_round = false;
+    if (!adaptive || budget == 0) {
+      break;
+    }
+    const uint64_t planned = bake_plan_round(round_samples, error_ratios, candidates, &job, budget);
+    if (planned == 0) {
+      break;
+    }
+    budget -= planned;
+  }
+
+  for (unsigned texel = 0; texel < texel_count; ++texel) {
+    vectorial::vec3f indirect = vectorial::vec3f(job.sums + 4 * texel);
+    if (sample_counts[texel] > 0) {
+      indirect /= (float)sample_counts[texel];
+    }
+    const vectorial::vec3f result = vectorial::vec3f(job.directs + 4 * texel) + indirect;
+    result.store(irradiance + 3 * gbuffer.atlas_texels[texel]);
+  }
+  free(candidates);
+  free(error_ratios);
+  free(round_samples);
+  free(sample_counts);
+  free(moments);
+  free(sums);
+  free(directs);
+
+  bake_dilate(irradiance, gbuffer.tri_ids, tex_width, tex_height);
+  texel_gbuffer_destroy(&gbuffer);
+  bake_scene_destroy(&scene);
+  return true;
+}
@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+struct Bvh;
+struct Mesh;
+
+struct Light {
+  vectorial::vec3f pos;
+  vectorial::vec3f color;
+  float intensity;
+  float range;
+};
+
+struct BakeSettings {
+  int samples_per_texel;  // average indirect paths a texel, the budget when sampling adaptively
+  int max_bounces;
+  int tile_size;
+  float ray_bias;
+
+  // with a threshold above 0 a texel stops tracing once the standard error of its bounced light is under this fraction
+  // of its brightness, and the paths it didn't trace go to the noisier ones, up to `max_samples_per_texel` each
+  float noise_threshold;
+  int max_samples_per_texel;
+};
+
+void bake_settings_init(BakeSettings* settings);
+
+// the mesh the way the baker traces it
+struct BakeScene {
+  std::vector<vectorial::vec3f> positions;  // 3 per triangle
+  std::vector<vectorial::vec3f> normals;    // 3 per triangle
+  std::vector<vectorial::vec3f> albedos;    // 1 per triangle
+  unsigned tri_count;
+  Bvh* bvh;
+};
+
+// leaves the scene empty if the mesh isn't in MeshVertexFormat
+void bake_scene_create(BakeScene* scene, const Mesh* mesh);
+void bake_scene_destroy(BakeScene* scene);
+
+// the surface point the center of texel (x, y) stands for on the triangle that covers it. texels the triangle only
+// partly covers get the closest point on it.
+void bake_texel_surface(vectorial::vec3f* pos,
+                        vectorial::vec3f* normal,
+                        const BakeScene* scene,
+                        const float* uv_data,
+                        int tex_width,
+                        int tex_height,
+                        int x,
+                        int y,
+                        int32_t tri_index);
+
+// the light arriving straight from the point light, with the same falloff as lit.fs.glsl and shadowed by the scene.
+// adds the rays it traces to `ray_count`, the callers hand their totals to PROFILE_COUNTER_RAYS_TRACED once a block.
+vectorial::vec3f bake_direct_irradiance(const BakeScene* scene,
+                                        const Light& light,
+                                        const vectorial::vec3f& pos,
+                                        const vectorial::vec3f& normal,
+                                        float ray_bias,
+                                        unsigned* ray_count);
+
+// a direction around `normal` with a cosine distribution, from two uniform numbers in [0, 1)
+vectorial::vec3f bake_sample_cosine_hemisphere(const vectorial::vec3f& normal, float u1, float u2);
+
+// Owen-scrambled Sobol points, a 2D pair every bounce (Burley 2020, "Practical Hash-based Owen Scrambling"). a
+// texel's sequence depends on its seed and nothing else, and every prefix of it is well spread, so the result doesn't
+// depend on which thread traced it or on how many samples the texel ends up taking.
+struct BakeSampler {
+  uint32_t seed;
+  uint32_t index;
+  uint32_t dimension;
+};
+
+// starts path `index` of the sequence
+void bake_sampler_start(BakeSampler* sampler, uint32_t seed, uint32_t index);
+// the next two dimensions of the path, uniform in [0, 1)
+void bake_sampler_next_2d(BakeSampler* sampler, float* u1, float* u2);
+
+// the light one cosine-distributed path from the surface point gathers over up to `max_bounces` bounces, the direct
+// light at the point itself not included. adds the rays it traces to `ray_count`.
+vectorial::vec3f bake_trace_path(const BakeScene* scene,
+                                 const Light& light,
+                                 const vectorial::vec3f& pos,
+                                 const vectorial::vec3f& normal,
+                                 int max_bounces,
+                                 float ray_bias,
+                                 BakeSampler* sampler,
+                                 unsigned* ray_count);
+
+// fills empty texels next to covered ones (`tri_ids` >= 0) with the average of those, so bilinear lookups don't bleed
+// black
+void bake_dilate(float* irradiance, const int32_t* tri_ids, int tex_width, int tex_height);
+
+// path traces direct plus multi-bounce diffuse irradiance for every texel covered by the mesh's lightmap uvs and
+// writes it to `irradiance` as RGB floats. empty texels next to covered ones are dilated so bilinear lookups don't
+// bleed black. `uv_data` has one float2 per triangle corner, see lightmap_build_uvs(). the texels come from a
+// TexelGbuffer and are spread over the job system in blocks of `tile_size` squared. with `noise_threshold` set they're
+// sampled in rounds, see BakeSettings. the result is the same on any number of threads. returns false, and leaves
+// `irradiance` alone, if the mesh isn't in MeshVertexFormat or it runs out of memory.
+bool bake_lightmap(float* irradiance,
+                   int tex_width,
+                   int tex_height,
+                   const Mesh* mesh,
+                   const float* uv_data,
+                   const Light& light,
+                   const BakeSettings* settings);
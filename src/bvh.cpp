@@ -0,0 +1,668 @@
+#include "bvh.h"
+#include "job.h"
+#include "mesh.h"
+#include "profile.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_MAX_BINS 32
+#define BVH_STACK_SIZE 64
+#define BVH_BIN_CHUNK_COUNT 64
+
+struct Aabb {
+  float min[3];
+  float max[3];
+};
+
+// binary node of the build tree, which gets collapsed into the 4-wide BvhNodes
+struct BvhBuildNode {
+  float bounds_min[3];
+  uint32_t offset;  // second child or first triangle
+  float bounds_max[3];
+  uint32_t count;
+};
+
+struct BvhBin {
+  Aabb bounds;
+  uint32_t count;
+};
+
+struct BvhBuilder {
+  const BvhSettings* settings;
+  const Aabb* tri_bounds;
+  const float* centroids;  // 3 per triangle
+  uint32_t* refs;
+  BvhBuildNode* nodes;     // 2n-1 slots, each subtree writes into its own reserved range
+};
+
+struct BvhBuildTask {
+  BvhBuilder* builder;
+  uint32_t node_index;
+  uint32_t begin;
+  uint32_t end;
+  int depth;
+};
+
+// the bounds and binning passes over a node's triangles. big nodes split them into chunks that run on the job system
+// and get merged afterwards, small nodes use a single chunk.
+struct BvhChunkJob {
+  const BvhBuilder* builder;
+  uint32_t begin;
+  uint32_t end;
+  int chunk_count;
+  int bin_count;
+  int axis_mask;
+  float centroid_min[3];
+  float bin_scale[3];
+  Aabb* bounds;           // one per chunk
+  Aabb* centroid_bounds;  // one per chunk
+  BvhBin* bins;           // [chunk][axis][bin]
+};
+
+static void aabb_reset(Aabb* aabb) {
+  for (int axis = 0; axis < 3; ++axis) {
+    aabb->min[axis] = FLT_MAX;
+    aabb->max[axis] = -FLT_MAX;
+  }
+}
+
+static void aabb_grow(Aabb* aabb, const float* point) {
+  for (int axis = 0; axis < 3; ++axis) {
+    aabb->min[axis] = fminf(aabb->min[axis], point[axis]);
+    aabb->max[axis] = fmaxf(aabb->max[axis], point[axis]);
+  }
+}
+
+static void aabb_merge(Aabb* aabb, const Aabb& other) {
+  for (int axis = 0; axis < 3; ++axis) {
+    aabb->min[axis] = fminf(aabb->min[axis], other.min[axis]);
+    aabb->max[axis] = fmaxf(aabb->max[axis], other.max[axis]);
+  }
+}
+
+static float aabb_half_area(const Aabb& aabb) {
+  const float dx = aabb.max[0] - aabb.min[0];
+  const float dy = aabb.max[1] - aabb.min[1];
+  const float dz = aabb.max[2] - aabb.min[2];
+  if (dx < 0.0f || dy < 0.0f || dz < 0.0f) {
+    return 0.0f;
+  }
+  return dx * dy + dy * dz + dz * dx;
+}
+
+static int bin_index(const BvhChunkJob* job, const float* centroid, int axis) {
+  const int index = (int)((centroid[axis] - job->centroid_min[axis]) * job->bin_scale[axis]);
+  return std::min(std::max(index, 0), job->bin_count - 1);
+}
+
+static BvhBin* chunk_bins(const BvhChunkJob* job, int chunk, int axis) {
+  return job->bins + (chunk * 3 + axis) * BVH_MAX_BINS;
+}
+
+static void chunk_range(const BvhChunkJob* job, int chunk, uint32_t* begin, uint32_t* end) {
+  const uint64_t count = job->end - job->begin;
+  *begin = job->begin + (uint32_t)((count * chunk) / job->chunk_count);
+  *end = job->begin + (uint32_t)((count * (chunk + 1)) / job->chunk_count);
+}
+
+static void compute_bounds_chunk(void* user_data, int chunk) {
+  BvhChunkJob* job = (BvhChunkJob*)user_data;
+  const BvhBuilder* builder = job->builder;
+  uint32_t begin, end;
+  chunk_range(job, chunk, &begin, &end);
+
+  Aabb& bounds = job->bounds[chunk];
+  Aabb& centroid_bounds = job->centroid_bounds[chunk];
+  aabb_reset(&bounds);
+  aabb_reset(&centroid_bounds);
+  for (uint32_t index = begin; index < end; ++index) {
+    const uint32_t ref = builder->refs[index];
+    aabb_merge(&bounds, builder->tri_bounds[ref]);
+    aabb_grow(&centroid_bounds, builder->centroids + 3 * ref);
+  }
+}
+
+static void bin_chunk(void* user_data, int chunk) {
+  BvhChunkJob* job = (BvhChunkJob*)user_data;
+  const BvhBuilder* builder = job->builder;
+  uint32_t begin, end;
+  chunk_range(job, chunk, &begin, &end);
+
+  for (int axis = 0; axis < 3; ++axis) {
+    BvhBin* bins = chunk_bins(job, chunk, axis);
+    for (int bin = 0; bin < job->bin_count; ++bin) {
+      aabb_reset(&bins[bin].bounds);
+      bins[bin].count = 0;
+    }
+  }
+
+  for (uint32_t index = begin; index < end; ++index) {
+    const uint32_t ref = builder->refs[index];
+    const float* centroid = builder->centroids + 3 * ref;
+    for (int axis = 0; axis < 3; ++axis) {
+      if (0 == (job->axis_mask & (1 << axis))) {
+        continue;
+      }
+      BvhBin& bin = chunk_bins(job, chunk, axis)[bin_index(job, centroid, axis)];
+      aabb_merge(&bin.bounds, builder->tri_bounds[ref]);
+      ++bin.count;
+    }
+  }
+}
+
+static void build_node(BvhBuilder* builder, uint32_t node_index, uint32_t begin, uint32_t end, int depth);
+
+static void build_child(void* user_data, int index) {
+  const BvhBuildTask* tasks = (const BvhBuildTask*)user_data;
+  build_node(tasks[index].builder, tasks[index].node_index, tasks[index].begin, tasks[index].end, tasks[index].depth);
+}
+
+static void make_leaf(BvhBuildNode* node, const Aabb& bounds, uint32_t begin, uint32_t end) {
+  memcpy(node->bounds_min, bounds.min, sizeof(bounds.min));
+  memcpy(node->bounds_max, bounds.max, sizeof(bounds.max));
+  node->offset = begin;
+  node->count = end - begin;
+}
+
+static void run_chunks(JobFunc func, BvhChunkJob* job) {
+  if (job->chunk_count > 1) {
+    job_parallel_for(func, job, job->chunk_count);
+  }
+  else {
+    func(job, 0);
+  }
+}
+
+static void build_node(BvhBuilder* builder, uint32_t node_index, uint32_t begin, uint32_t end, int depth) {
+  const BvhSettings* settings = builder->settings;
+  const uint32_t count = end - begin;
+  const bool parallel = (int)count > settings->parallel_threshold;
+  BvhBuildNode* node = builder->nodes + node_index;
+
+  // small nodes keep their scratch on the stack, the chunked version is too big for it
+  Aabb local_bounds[1];
+  Aabb local_centroid_bounds[1];
+  BvhBin local_bins[3 * BVH_MAX_BINS];
+  BvhChunkJob job;
+  job.builder = builder;
+  job.begin = begin;
+  job.end = end;
+  job.chunk_count = parallel ? BVH_BIN_CHUNK_COUNT : 1;
+  job.bin_count = std::min(std::max(settings->bin_count, 2), BVH_MAX_BINS);
+  job.bounds = local_bounds;
+  job.centroid_bounds = local_centroid_bounds;
+  job.bins = local_bins;
+  if (parallel) {
+    job.bounds = (Aabb*)malloc(job.chunk_count * sizeof(Aabb));
+    job.centroid_bounds = (Aabb*)malloc(job.chunk_count * sizeof(Aabb));
+    job.bins = (BvhBin*)malloc(job.chunk_count * 3 * BVH_MAX_BINS * sizeof(BvhBin));
+  }
+
+  // node bounds and centroid bounds
+  run_chunks(&compute_bounds_chunk, &job);
+  Aabb bounds = job.bounds[0];
+  Aabb centroid_bounds = job.centroid_bounds[0];
+  for (int chunk = 1; chunk < job.chunk_count; ++chunk) {
+    aabb_merge(&bounds, job.bounds[chunk]);
+    aabb_merge(&centroid_bounds, job.centroid_bounds[chunk]);
+  }
+
+  // bin the centroids along every axis that has some extent and find the cheapest split plane
+  job.axis_mask = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float extent = centroid_bounds.max[axis] - centroid_bounds.min[axis];
+    job.centroid_min[axis] = centroid_bounds.min[axis];
+    job.bin_scale[axis] = 0.0f;
+    if (extent > 0.0f) {
+      job.bin_scale[axis] = (float)job.bin_count / extent;
+      job.axis_mask |= 1 << axis;
+    }
+  }
+
+  int best_axis = -1;
+  int best_split = 0;
+  float best_cost = FLT_MAX;
+  if (count > 1 && job.axis_mask) {
+    run_chunks(&bin_chunk, &job);
+
+    const float inv_parent_area = 1.0f / std::max(aabb_half_area(bounds), FLT_MIN);
+    for (int axis = 0; axis < 3; ++axis) {
+      if (0 == (job.axis_mask & (1 << axis))) {
+        continue;
+      }
+
+      BvhBin bins[BVH_MAX_BINS];
+      for (int bin = 0; bin < job.bin_count; ++bin) {
+        bins[bin] = chunk_bins(&job, 0, axis)[bin];
+        for (int chunk = 1; chunk < job.chunk_count; ++chunk) {
+          const BvhBin& chunk_bin = chunk_bins(&job, chunk, axis)[bin];
+          aabb_merge(&bins[bin].bounds, chunk_bin.bounds);
+          bins[bin].count += chunk_bin.count;
+        }
+      }
+
+      // sweep from the right to get the cost of everything past each split plane
+      float right_area[BVH_MAX_BINS];
+      uint32_t right_count[BVH_MAX_BINS];
+      Aabb right_bounds;
+      aabb_reset(&right_bounds);
+      uint32_t right_total = 0;
+      for (int bin = job.bin_count - 1; bin > 0; --bin) {
+        aabb_merge(&right_bounds, bins[bin].bounds);
+        right_total += bins[bin].count;
+        right_area[bin] = aabb_half_area(right_bounds);
+        right_count[bin] = right_total;
+      }
+
+      Aabb left_bounds;
+      aabb_reset(&left_bounds);
+      uint32_t left_total = 0;
+      for (int split = 1; split < job.bin_count; ++split) {
+        aabb_merge(&left_bounds, bins[split - 1].bounds);
+        left_total += bins[split - 1].count;
+        if (left_total == 0 || right_count[split] == 0) {
+          continue;
+        }
+        const float cost =
+            settings->traversal_cost +
+            (aabb_half_area(left_bounds) * left_total + right_area[split] * right_count[split]) * inv_parent_area;
+        if (cost < best_cost) {
+          best_cost = cost;
+          best_axis = axis;
+          best_split = split;
+        }
+      }
+    }
+  }
+
+  if (parallel) {
+    free(job.bins);
+    free(job.centroid_bounds);
+    free(job.bounds);
+  }
+
+  // stop when splitting isn't worth it, or when we're about to overflow the traversal stack
+  const bool small = (int)count <= settings->max_leaf_size;
+  if (count == 1 || (small && best_cost >= (float)count) || depth >= BVH_STACK_SIZE - 1) {
+    make_leaf(node, bounds, begin, end);
+    return;
+  }
+
+  uint32_t mid;
+  if (best_axis >= 0) {
+    uint32_t* split_ref = std::partition(builder->refs + begin, builder->refs + end, [&](uint32_t ref) {
+      return bin_index(&job, builder->centroids + 3 * ref, best_axis) < best_split;
+    });
+    mid = (uint32_t)(split_ref - builder->refs);
+  }
+  else {
+    // every centroid is in the same spot, just cut the range in half
+    mid = begin + count / 2;
+  }
+
+  memcpy(node->bounds_min, bounds.min, sizeof(bounds.min));
+  memcpy(node->bounds_max, bounds.max, sizeof(bounds.max));
+  node->count = 0;
+
+  // the left subtree takes at most 2*left_count-1 slots, the right one starts after them
+  BvhBuildTask tasks[2];
+  tasks[0] = {builder, node_index + 1, begin, mid, depth + 1};
+  tasks[1] = {builder, node_index + 2 * (mid - begin), mid, end, depth + 1};
+  node->offset = tasks[1].node_index;
+  if (parallel) {
+    job_parallel_for(&build_child, tasks, 2);
+  }
+  else {
+    build_child(tasks, 0);
+    build_child(tasks, 1);
+  }
+}
+
+struct BvhCollapser {
+  const BvhBuildNode* nodes;
+  const uint32_t* refs;
+  const float* positions;  // 9 per mesh triangle
+  Bvh* bvh;
+};
+
+static float build_node_half_area(const BvhBuildNode& node) {
+  const float dx = node.bounds_max[0] - node.bounds_min[0];
+  const float dy = node.bounds_max[1] - node.bounds_min[1];
+  const float dz = node.bounds_max[2] - node.bounds_min[2];
+  return dx * dy + dy * dz + dz * dx;
+}
+
+// writes a leaf's triangles as packets and returns the packet count
+static uint32_t emit_leaf(BvhCollapser* collapser, uint32_t begin, uint32_t end) {
+  Bvh* bvh = collapser->bvh;
+  const uint32_t first_packet = bvh->packet_count;
+  const uint32_t packet_count = (end - begin + 3) / 4;
+  memset(bvh->packets + first_packet, 0, packet_count * sizeof(TriPacket4));
+  memset(bvh->tri_indices + 4 * first_packet, 0xff, packet_count * 4 * sizeof(uint32_t));
+  for (uint32_t index = begin; index < end; ++index) {
+    const uint32_t ref = collapser->refs[index];
+    const float* p = collapser->positions + 9 * ref;
+    TriPacket4& packet = bvh->packets[first_packet + (index - begin) / 4];
+    const uint32_t lane = (index - begin) % 4;
+    for (int axis = 0; axis < 3; ++axis) {
+      packet.v0[axis][lane] = p[axis];
+      packet.e1[axis][lane] = p[3 + axis] - p[axis];
+      packet.e2[axis][lane] = p[6 + axis] - p[axis];
+    }
+    bvh->tri_indices[4 * (first_packet + (index - begin) / 4) + lane] = ref;
+  }
+  bvh->packet_count += packet_count;
+  return packet_count;
+}
+
+// pulls the grandchildren of the biggest interior children up until a node has 4 children, then recurses. nodes are
+// written depth-first.
+static uint32_t collapse_node(BvhCollapser* collapser, uint32_t build_index) {
+  const BvhBuildNode* nodes = collapser->nodes;
+  uint32_t children[4];
+  int child_count = 0;
+  if (nodes[build_index].count > 0) {
+    // only the root can be a leaf
+    children[child_count++] = build_index;
+  }
+  else {
+    children[child_count++] = build_index + 1;
+    children[child_count++] = nodes[build_index].offset;
+    while (child_count < 4) {
+      int best_child = -1;
+      float best_area = -1.0f;
+      for (int child = 0; child < child_count; ++child) {
+        const BvhBuildNode& node = nodes[children[child]];
+        if (node.count == 0 && build_node_half_area(node) > best_area) {
+          best_area = build_node_half_area(node);
+          best_child = child;
+        }
+      }
+      if (best_child < 0) {
+        break;
+      }
+      const uint32_t split = children[best_child];
+      children[best_child] = split + 1;
+      children[child_count++] = nodes[split].offset;
+    }
+  }
+
+  Bvh* bvh = collapser->bvh;
+  const uint32_t node_index = bvh->node_count++;
+  for (int lane = 0; lane < 4; ++lane) {
+    BvhNode& node = bvh->nodes[node_index];
+    if (lane >= child_count) {
+      for (int axis = 0; axis < 3; ++axis) {
+        node.bounds.bounds_min[axis][lane] = FLT_MAX;
+        node.bounds.bounds_max[axis][lane] = -FLT_MAX;
+      }
+      node.child[lane] = 0;
+      node.count[lane] = 0;
+      continue;
+    }
+
+    const BvhBuildNode& child = nodes[children[lane]];
+    for (int axis = 0; axis < 3; ++axis) {
+      node.bounds.bounds_min[axis][lane] = child.bounds_min[axis];
+      node.bounds.bounds_max[axis][lane] = child.bounds_max[axis];
+    }
+    if (child.count > 0) {
+      node.child[lane] = bvh->packet_count;
+      node.count[lane] = emit_leaf(collapser, child.offset, child.offset + child.count);
+    }
+    else {
+      node.count[lane] = 0;
+      node.child[lane] = collapse_node(collapser, children[lane]);
+    }
+  }
+  return node_index;
+}
+
+void bvh_settings_init(BvhSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->bin_count = 16;
+  settings->max_leaf_size = 8;
+  settings->traversal_cost = 1.0f;
+  settings->parallel_threshold = 16 * 1024;
+}
+
+Bvh* bvh_create(const Mesh* mesh, const BvhSettings* settings) {
+  PROFILE_SCOPE("bvh_create");
+  if (!MeshVertexFormat::matches(mesh)) {
+    return nullptr;
+  }
+
+  const unsigned tri_count = mesh->index_count / 3;
+
+  Bvh* bvh = (Bvh*)malloc(sizeof(Bvh));
+  bvh->tri_count = tri_count;
+  bvh->node_count = 0;
+  bvh->packet_count = 0;
+  bvh->nodes = nullptr;
+  bvh->packets = nullptr;
+  bvh->tri_indices = nullptr;
+  if (tri_count == 0) {
+    return bvh;
+  }
+
+  // gather the triangles
+  float* positions = (float*)malloc(tri_count * 9 * sizeof(float));
+  Aabb* tri_bounds = (Aabb*)malloc(tri_count * sizeof(Aabb));
+  float* centroids = (float*)malloc(tri_count * 3 * sizeof(float));
+  uint32_t* refs = (uint32_t*)malloc(tri_count * sizeof(uint32_t));
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    float* tri_positions = positions + 9 * tri_index;
+    Aabb& aabb = tri_bounds[tri_index];
+    aabb_reset(&aabb);
+    for (int corner = 0; corner < 3; ++corner) {
+      const Vec3 position =
+          MeshVertexFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, mesh_index(mesh, 3 * tri_index + corner));
+      memcpy(tri_positions + 3 * corner, &position, 3 * sizeof(float));
+      aabb_grow(&aabb, tri_positions + 3 * corner);
+    }
+    for (int axis = 0; axis < 3; ++axis) {
+      centroids[3 * tri_index + axis] = (aabb.min[axis] + aabb.max[axis]) * 0.5f;
+    }
+    refs[tri_index] = tri_index;
+  }
+
+  BvhBuilder builder;
+  builder.settings = settings;
+  builder.tri_bounds = tri_bounds;
+  builder.centroids = centroids;
+  builder.refs = refs;
+  builder.nodes = (BvhBuildNode*)malloc((2 * tri_count - 1) * sizeof(BvhBuildNode));
+  build_node(&builder, 0, 0, tri_count, 0);
+
+  // every wide node uses up at least one binary interior node and every leaf holds at least one triangle
+  void* nodes = nullptr;
+  void* packets = nullptr;
+  const bool allocated = posix_memalign(&nodes, 64, tri_count * sizeof(BvhNode)) == 0 &&
+                         posix_memalign(&packets, 64, tri_count * sizeof(TriPacket4)) == 0;
+  bvh->nodes = (BvhNode*)nodes;
+  bvh->packets = (TriPacket4*)packets;
+  if (!allocated) {
+    fprintf(stderr, "ERROR: out of memory for the BVH of %u triangles\n", tri_count);
+    bvh_destroy(bvh);
+    bvh = nullptr;
+  }
+  else {
+    bvh->tri_indices = (uint32_t*)malloc(tri_count * 4 * sizeof(uint32_t));
+
+    BvhCollapser collapser;
+    collapser.nodes = builder.nodes;
+    collapser.refs = refs;
+    collapser.positions = positions;
+    collapser.bvh = bvh;
+    collapse_node(&collapser, 0);
+  }
+
+  free(builder.nodes);
+  free(refs);
+  free(centroids);
+  free(tri_bounds);
+  free(positions);
+  return bvh;
+}
+
+void bvh_destroy(Bvh* bvh) {
+  if (!bvh) {
+    return;
+  }
+  free(bvh->tri_indices);
+  free(bvh->packets);
+  free(bvh->nodes);
+  free(bvh);
+}
+
+struct BvhStackEntry {
+  uint32_t node_index;
+  float t;
+};
+
+struct BvhTraversal {
+  float t_max;
+  simd4f t_max4;
+  uint32_t hit_index;  // packet lane
+  float b1;
+  float b2;
+};
+
+// leaves run two packets at a time when they can
+template <bool AnyHit>
+static bool intersect_leaf(const Bvh* bvh, const SimdRay& ray, uint32_t first, uint32_t count, BvhTraversal* state) {
+  for (uint32_t packet = first, end = first + count; packet < end;) {
+    TriHit8 hits;
+    int mask;
+    uint32_t packet_count;
+    if (end - packet >= 2) {
+      mask = intersect_tri8(ray, *(const TriPacket8*)(bvh->packets + packet), state->t_max4, &hits);
+      packet_count = 2;
+    }
+    else {
+      mask = intersect_tri4(ray, bvh->packets[packet], state->t_max4, &hits.half[0]);
+      packet_count = 1;
+    }
+
+    if (mask) {
+      if (AnyHit) {
+        return true;
+      }
+
+      float t[8], b1[8], b2[8];
+      for (uint32_t half = 0; half < packet_count; ++half) {
+        simd4f_ustore4(hits.half[half].t, t + 4 * half);
+        simd4f_ustore4(hits.half[half].b1, b1 + 4 * half);
+        simd4f_ustore4(hits.half[half].b2, b2 + 4 * half);
+      }
+      for (int lane = 0; lane < 8; ++lane) {
+        if ((mask & (1 << lane)) && t[lane] < state->t_max) {
+          state->t_max = t[lane];
+          state->hit_index = 4 * packet + lane;
+          state->b1 = b1[lane];
+          state->b2 = b2[lane];
+        }
+      }
+      state->t_max4 = simd4f_splat(state->t_max);
+    }
+    packet += packet_count;
+  }
+  return false;
+}
+
+template <bool AnyHit>
+static bool traverse(const Bvh* bvh, const SimdRay& ray, float t_max, BvhHit* hit) {
+  if (bvh->node_count == 0) {
+    return false;
+  }
+
+  BvhTraversal state;
+  state.t_max = t_max;
+  state.t_max4 = simd4f_splat(t_max);
+  state.hit_index = 0xffffffffU;
+  state.b1 = 0.0f;
+  state.b2 = 0.0f;
+
+  BvhStackEntry stack[BVH_STACK_SIZE * 3 + 1];
+  int stack_size = 0;
+  stack[stack_size++] = {0, 0.0f};
+  while (stack_size > 0) {
+    const BvhStackEntry entry = stack[--stack_size];
+    if (entry.t >= state.t_max) {
+      continue;
+    }
+
+    const BvhNode& node = bvh->nodes[entry.node_index];
+    simd4f t_entry4;
+    const int mask = intersect_box4(ray, node.bounds, state.t_max4, &t_entry4);
+    if (!mask) {
+      continue;
+    }
+
+    // order the children that were hit near to far, any-hit queries don't care
+    float t_entry[4];
+    simd4f_ustore4(t_entry4, t_entry);
+    int order[4];
+    int order_count = 0;
+    for (int lane = 0; lane < 4; ++lane) {
+      if (0 == (mask & (1 << lane))) {
+        continue;
+      }
+      int slot = order_count++;
+      for (; !AnyHit && slot > 0 && t_entry[order[slot - 1]] > t_entry[lane]; --slot) {
+        order[slot] = order[slot - 1];
+      }
+      order[slot] = lane;
+    }
+
+    // leaves right away, then push the interior children far to near so the nearest is popped next
+    for (int index = 0; index < order_count; ++index) {
+      const int lane = order[index];
+      if (node.count[lane] > 0 && intersect_leaf<AnyHit>(bvh, ray, node.child[lane], node.count[lane], &state)) {
+        return true;
+      }
+    }
+    for (int index = order_count - 1; index >= 0; --index) {
+      const int lane = order[index];
+      if (node.count[lane] == 0) {
+        stack[stack_size++] = {node.child[lane], t_entry[lane]};
+      }
+    }
+  }
+
+  if (state.hit_index == 0xffffffffU) {
+    return false;
+  }
+  hit->tri_index = bvh->tri_indices[state.hit_index];
+  hit->t = state.t_max;
+  hit->b1 = state.b1;
+  hit->b2 = state.b2;
+  return true;
+}
+
+bool bvh_intersect_closest(
+    const Bvh* bvh, const vectorial::vec3f& org, const vectorial::vec3f& dir, float t_max, BvhHit* hit) {
+  float ray_org[3], ray_dir[3];
+  org.store(ray_org);
+  dir.store(ray_dir);
+  SimdRay ray;
+  simd_ray_init(&ray, ray_org, ray_dir);
+  return traverse<false>(bvh, ray, t_max, hit);
+}
+
+bool bvh_intersect_any(const Bvh* bvh, const vectorial::vec3f& org, const vectorial::vec3f& dir, float t_max) {
+  float ray_org[3], ray_dir[3];
+  org.store(ray_org);
+  dir.store(ray_dir);
+  SimdRay ray;
+  simd_ray_init(&ray, ray_org, ray_dir);
+  return traverse<true>(bvh, ray, t_max, nullptr);
+}
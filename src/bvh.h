@@ -0,0 +1,52 @@
+#pragma once
+#include "intersect.h"
+#include <stdint.h>
+#include <vectorial/vectorial.h>
+
+struct Mesh;
+
+// 128 bytes: the bounds of up to 4 children as a packet, stored depth-first. a child with `count` > 0 is a leaf of
+// `count` triangle packets starting at packet `child`, otherwise `child` is the index of another node. unused child
+// slots have empty bounds.
+struct BvhNode {
+  BoxPacket4 bounds;
+  uint32_t child[4];
+  uint32_t count[4];
+};
+
+struct Bvh {
+  BvhNode* nodes;         // 64-byte aligned
+  TriPacket4* packets;    // 64-byte aligned, in leaf order
+  uint32_t* tri_indices;  // mesh triangle index of every packet lane, ~0 for unused lanes
+  unsigned node_count;
+  unsigned packet_count;
+  unsigned tri_count;
+};
+
+struct BvhSettings {
+  int bin_count;
+  int max_leaf_size;
+  float traversal_cost;     // relative to one triangle test
+  int parallel_threshold;   // subtrees with more triangles than this are built on the job system
+};
+
+struct BvhHit {
+  uint32_t tri_index;  // mesh triangle index
+  float t;
+  float b1;
+  float b2;
+};
+
+void bvh_settings_init(BvhSettings* settings);
+
+// builds a binned SAH hierarchy over the triangles of the mesh and collapses it into 4-wide nodes. returns nullptr if
+// the mesh has no float3 positions or it runs out of memory.
+Bvh* bvh_create(const Mesh* mesh, const BvhSettings* settings);
+void bvh_destroy(Bvh* bvh);
+
+// closest hit with t in (0, t_max)
+bool bvh_intersect_closest(
+    const Bvh* bvh, const vectorial::vec3f& org, const vectorial::vec3f& dir, float t_max, BvhHit* hit);
+
+// true if anything is hit with t in (0, t_max). cheaper than the closest hit, use it for visibility.
+bool bvh_intersect_any(const Bvh* bvh, const vectorial::vec3f& org, const vectorial::vec3f& dir, float t_max);
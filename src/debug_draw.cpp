@@ -1,8 +1,10 @@
 #include "debug_draw.h"
+#include <stdint.h>
 #include <stdlib.h>
 
 void (*s_draw_points_func)(const DDrawVertex* vertices, int vertex_count);
 void (*s_draw_lines_func)(const DDrawVertex* vertices, int vertex_count);
+void (*s_draw_screen_lines_func)(const DDrawVertex* vertices, int vertex_count);
 
 static DDrawVertex* s_points;
 static int s_point_count;
@@ -12,6 +14,144 @@ static DDrawVertex* s_lines;
 static int s_line_count;
 static int s_line_capacity;
 
+static DDrawVertex* s_screen_lines;
+static int s_screen_line_count;
+static int s_screen_line_capacity;
+
+// the segments of a glyph cell one wide and two high, as x0, y0, x1, y1
+enum GlyphSegment {
+  GLYPH_TOP,
+  GLYPH_UPPER_RIGHT,
+  GLYPH_LOWER_RIGHT,
+  GLYPH_BOTTOM,
+  GLYPH_LOWER_LEFT,
+  GLYPH_UPPER_LEFT,
+  GLYPH_MIDDLE_LEFT,
+  GLYPH_MIDDLE_RIGHT,
+  GLYPH_UPPER_LEFT_DIAGONAL,
+  GLYPH_UPPER_CENTER,
+  GLYPH_UPPER_RIGHT_DIAGONAL,
+  GLYPH_LOWER_LEFT_DIAGONAL,
+  GLYPH_LOWER_CENTER,
+  GLYPH_LOWER_RIGHT_DIAGONAL,
+  GLYPH_SEGMENT_COUNT,
+};
+
+static const float s_glyph_segments[GLYPH_SEGMENT_COUNT][4] = {
+    {0.0f, 2.0f, 1.0f, 2.0f},
+    {1.0f, 2.0f, 1.0f, 1.0f},
+    {1.0f, 1.0f, 1.0f, 0.0f},
+    {0.0f, 0.0f, 1.0f, 0.0f},
+    {0.0f, 1.0f, 0.0f, 0.0f},
+    {0.0f, 2.0f, 0.0f, 1.0f},
+    {0.0f, 1.0f, 0.5f, 1.0f},
+    {0.5f, 1.0f, 1.0f, 1.0f},
+    {0.0f, 2.0f, 0.5f, 1.0f},
+    {0.5f, 2.0f, 0.5f, 1.0f},
+    {1.0f, 2.0f, 0.5f, 1.0f},
+    {0.5f, 1.0f, 0.0f, 0.0f},
+    {0.5f, 1.0f, 0.5f, 0.0f},
+    {0.5f, 1.0f, 1.0f, 0.0f},
+};
+
+#define GS(segment) (1 << GLYPH_##segment)
+
+// the segments of every glyph, by character
+static uint16_t glyph_segments(char c) {
+  switch (c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c) {
+    case '0':
+    case 'O':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT);
+    case '1':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT);
+    case '2':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT) | GS(LOWER_LEFT) | GS(BOTTOM);
+    case '3':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(MIDDLE_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM);
+    case '4':
+      return GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT);
+    case '5':
+    case 'S':
+      return GS(TOP) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM);
+    case '6':
+      return GS(TOP) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) |
+             GS(LOWER_LEFT);
+    case '7':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT);
+    case '8':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT) |
+             GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT);
+    case '9':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) |
+             GS(MIDDLE_RIGHT);
+    case 'A':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) |
+             GS(MIDDLE_RIGHT);
+    case 'B':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(MIDDLE_RIGHT) | GS(UPPER_CENTER) |
+             GS(LOWER_CENTER);
+    case 'C':
+      return GS(TOP) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT);
+    case 'D':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(UPPER_CENTER) | GS(LOWER_CENTER);
+    case 'E':
+      return GS(TOP) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT);
+    case 'F':
+      return GS(TOP) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT);
+    case 'G':
+      return GS(TOP) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_RIGHT);
+    case 'H':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) |
+             GS(MIDDLE_RIGHT);
+    case 'I':
+      return GS(TOP) | GS(BOTTOM) | GS(UPPER_CENTER) | GS(LOWER_CENTER);
+    case 'J':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT);
+    case 'K':
+      return GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(UPPER_RIGHT_DIAGONAL) |
+             GS(LOWER_RIGHT_DIAGONAL);
+    case 'L':
+      return GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT);
+    case 'M':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(UPPER_LEFT_DIAGONAL) |
+             GS(UPPER_RIGHT_DIAGONAL);
+    case 'N':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(UPPER_LEFT_DIAGONAL) |
+             GS(LOWER_RIGHT_DIAGONAL);
+    case 'P':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT);
+    case 'Q':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT) |
+             GS(LOWER_RIGHT_DIAGONAL);
+    case 'R':
+      return GS(TOP) | GS(UPPER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT) |
+             GS(LOWER_RIGHT_DIAGONAL);
+    case 'T':
+      return GS(TOP) | GS(UPPER_CENTER) | GS(LOWER_CENTER);
+    case 'U':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(BOTTOM) | GS(LOWER_LEFT) | GS(UPPER_LEFT);
+    case 'V':
+      return GS(UPPER_LEFT) | GS(LOWER_LEFT) | GS(LOWER_LEFT_DIAGONAL) | GS(UPPER_RIGHT_DIAGONAL);
+    case 'W':
+      return GS(UPPER_RIGHT) | GS(LOWER_RIGHT) | GS(LOWER_LEFT) | GS(UPPER_LEFT) | GS(LOWER_LEFT_DIAGONAL) |
+             GS(LOWER_RIGHT_DIAGONAL);
+    case 'X':
+      return GS(UPPER_LEFT_DIAGONAL) | GS(UPPER_RIGHT_DIAGONAL) | GS(LOWER_LEFT_DIAGONAL) | GS(LOWER_RIGHT_DIAGONAL);
+    case 'Y':
+      return GS(UPPER_LEFT_DIAGONAL) | GS(UPPER_RIGHT_DIAGONAL) | GS(LOWER_CENTER);
+    case 'Z':
+      return GS(TOP) | GS(BOTTOM) | GS(UPPER_RIGHT_DIAGONAL) | GS(LOWER_LEFT_DIAGONAL);
+    case '-':
+      return GS(MIDDLE_LEFT) | GS(MIDDLE_RIGHT);
+    case '/':
+      return GS(UPPER_RIGHT_DIAGONAL) | GS(LOWER_LEFT_DIAGONAL);
+    default:
+      return 0;
+  }
+}
+
+#undef GS
+
 static void flush_points() {
   if (s_point_count > 0) {
     if (s_draw_points_func) {
@@ -22,6 +162,16 @@ static void flush_points() {
   }
 }
 
+static void flush_screen_lines() {
+  if (s_screen_line_count > 0) {
+    if (s_draw_screen_lines_func) {
+      s_draw_screen_lines_func(s_screen_lines, s_screen_line_count);
+    }
+
+    s_screen_line_count = 0;
+  }
+}
+
 static void flush_lines() {
   if (s_line_count > 0) {
     if (s_draw_lines_func) {
@@ -39,8 +189,10 @@ void ddraw_settings_init(DDrawSettings* settings) {
 
   settings->max_points = 1024;
   settings->max_lines = 32 * 1024;
+  settings->max_screen_lines = 8 * 1024;
   settings->draw_points = nullptr;
   settings->draw_lines = nullptr;
+  settings->draw_screen_lines = nullptr;
 }
 
 void ddraw_init(DDrawSettings* settings) {
@@ -50,6 +202,7 @@ void ddraw_init(DDrawSettings* settings) {
 
   s_draw_points_func = settings->draw_points;
   s_draw_lines_func = settings->draw_lines;
+  s_draw_screen_lines_func = settings->draw_screen_lines;
 
   s_points = (DDrawVertex*)malloc(settings->max_points * sizeof(DDrawVertex));
   s_point_count = 0;
@@ -58,9 +211,15 @@ void ddraw_init(DDrawSettings* settings) {
   s_lines = (DDrawVertex*)malloc(settings->max_lines * sizeof(DDrawVertex));
   s_line_count = 0;
   s_line_capacity = settings->max_lines;
+
+  s_screen_lines = (DDrawVertex*)malloc(settings->max_screen_lines * sizeof(DDrawVertex));
+  s_screen_line_count = 0;
+  s_screen_line_capacity = settings->max_screen_lines;
 }
 
 void ddraw_shutdown() {
+  free(s_screen_lines);
+  s_screen_lines = nullptr;
   free(s_lines);
   s_lines = nullptr;
   free(s_points);
@@ -70,6 +229,7 @@ void ddraw_shutdown() {
 void ddraw_flush() {
   flush_points();
   flush_lines();
+  flush_screen_lines();
 }
 
 void ddraw_point(DDrawVec3Param pos, DDrawVec3Param color) {
@@ -109,3 +269,42 @@ void ddraw_normal(DDrawVec3Param pos, DDrawVec3Param normal, DDrawVec3Param colo
 
   ddraw_line(pos, pos1, color);
 }
+
+void ddraw_screen_line(float x0, float y0, float x1, float y1, DDrawVec3Param color) {
+  if (s_screen_line_count + 2 >= s_screen_line_capacity) {
+    flush_screen_lines();
+  }
+
+  s_screen_lines[s_screen_line_count] = {
+      x0, y0, 0.0f, color[0], color[1], color[2],
+  };
+
+  s_screen_lines[s_screen_line_count + 1] = {
+      x1, y1, 0.0f, color[0], color[1], color[2],
+  };
+  s_screen_line_count += 2;
+}
+
+void ddraw_screen_text(float x, float y, float char_width, float char_height, const char* text, DDrawVec3Param color) {
+  // a glyph cell is one unit wide and two high, with half a unit between cells
+  const float scale_x = char_width;
+  const float scale_y = char_height * 0.5f;
+  const float bottom = y - char_height;
+  for (; *text; ++text, x += char_width * 1.5f) {
+    if (*text == '.') {
+      ddraw_screen_line(x + 0.5f * scale_x, bottom, x + 0.5f * scale_x, bottom + 0.2f * scale_y, color);
+      continue;
+    }
+    const uint16_t segments = glyph_segments(*text);
+    for (int segment = 0; segment < GLYPH_SEGMENT_COUNT; ++segment) {
+      if (segments & (1 << segment)) {
+        const float* line = s_glyph_segments[segment];
+        ddraw_screen_line(x + line[0] * scale_x,
+                          bottom + line[1] * scale_y,
+                          x + line[2] * scale_x,
+                          bottom + line[3] * scale_y,
+                          color);
+      }
+    }
+  }
+}
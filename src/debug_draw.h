@@ -15,9 +15,12 @@ struct DDrawVertex {
 struct DDrawSettings {
   int max_points;
   int max_lines;
+  int max_screen_lines;
 
   void (*draw_points)(const DDrawVertex* vertices, int vertex_count);
   void (*draw_lines)(const DDrawVertex* vertices, int vertex_count);
+  // lines in normalized device coordinates, drawn on top of everything
+  void (*draw_screen_lines)(const DDrawVertex* vertices, int vertex_count);
 };
 
 void ddraw_settings_init(DDrawSettings* settings);
@@ -32,3 +35,9 @@ void ddraw_line(DDrawVec3Param pos0, DDrawVec3Param pos1, DDrawVec3Param color);
 void ddraw_line(DDrawVec3Param pos0, DDrawVec3Param pos1, DDrawVec3Param color0, DDrawVec3Param color1);
 
 void ddraw_normal(DDrawVec3Param pos0, DDrawVec3Param normal, DDrawVec3Param color, float length);
+
+// x and y in [-1, 1], y up
+void ddraw_screen_line(float x0, float y0, float x1, float y1, DDrawVec3Param color);
+// one line of text with its top left corner at x, y. the glyphs are line segments, like on a 14-segment display, and
+// only cover upper case letters (lower case is drawn as upper case), digits, '-', '.', '/' and ' '.
+void ddraw_screen_text(float x, float y, float char_width, float char_height, const char* text, DDrawVec3Param color);
@@ -0,0 +1,346 @@
+#include "bake.h"
+#include "job.h"
+#include "lightmap.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "profile.h"
+#include "transfer.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+struct BakeOptions {
+  const char* scene_filename;
+  std::string mtl_dirname;
+  std::string output_basename;
+  const char* trace_filename;
+  int thread_count;
+  bool use_cache;
+  bool use_transfer;
+  Light light;
+  MeshLoadSettings load;
+  LightmapChartSettings chart;
+  LightmapPackSettings pack;
+  BakeSettings bake;
+  TransferSettings transfer;
+};
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: gi-bake [options] scene.obj\n"
+          "\n"
+          "  -m mtl_dir          directory holding the scene's materials (defaults to the scene's directory)\n"
+          "  -o output_basename  defaults to 'lightmap'\n"
+          "  -s atlas_size       atlas width and height in texels, 0 for the smallest power of two that fits (0)\n"
+          "  -p packer           'skyline' or 'shelf' (skyline)\n"
+          "  -C                  don't read or write the mesh cache (scene.obj.cache)\n"
+          "  -S                  stream the OBJ import, slower but with a lower peak memory\n"
+          "  -T                  gather the bounces through a precomputed texel to texel transfer instead of path\n"
+          "                      tracing them, -n is then the rays every texel casts to build it\n"
+          "  -M megabytes        memory budget of the transfer (32)\n"
+          "  -a angle            most degrees between triangles merged into one chart, negative for no charts (2)\n"
+          "  -n samples          indirect paths per texel, on average with -e (64)\n"
+          "  -e error            stop texels once the standard error of their bounced light is under this fraction of\n"
+          "                      their brightness and give the paths they don't trace to the noisier ones (0, off)\n"
+          "  -N samples          most indirect paths a texel traces with -e (1024)\n"
+          "  -b bounces          maximum indirect bounces (3)\n"
+          "  -j threads          worker threads, 0 for one per core (0)\n"
+          "  -l x,y,z            light position (0,-8,10)\n"
+          "  -c r,g,b            light color (1,1,1)\n"
+          "  -i intensity        light intensity (1)\n"
+          "  -r range            light range (15)\n"
+          "  -t trace.json       write a Chrome trace of the import and the bake\n"
+          "\n"
+          "writes <output_basename>.ppm (the baked irradiance) and <output_basename>.uv (one little-endian float2 per\n"
+          "triangle corner, in mesh order)\n");
+}
+
+static bool parse_vec3(vectorial::vec3f* out, const char* str) {
+  float x, y, z;
+  if (3 != sscanf(str, "%f,%f,%f", &x, &y, &z)) {
+    return false;
+  }
+  *out = vectorial::vec3f(x, y, z);
+  return true;
+}
+
+static bool parse_options(BakeOptions* options, int argc, char** argv) {
+  options->scene_filename = nullptr;
+  options->trace_filename = nullptr;
+  options->output_basename = "lightmap";
+  options->thread_count = 0;
+  options->use_cache = true;
+  options->use_transfer = false;
+
+  // same light as the interactive demo starts with
+  options->light.pos = vectorial::vec3f(0.0f, -8.0f, 10.0f);
+  options->light.color = vectorial::vec3f(1.0f, 1.0f, 1.0f);
+  options->light.intensity = 1.0f;
+  options->light.range = 15.0f;
+
+  mesh_load_settings_init(&options->load);
+  lightmap_chart_settings_init(&options->chart);
+  lightmap_pack_settings_init(&options->pack);
+  bake_settings_init(&options->bake);
+  transfer_settings_init(&options->transfer);
+
+  int opt;
+  bool have_mtl_dirname = false;
+  while ((opt = getopt(argc, argv, "CSTM:N:a:b:c:e:i:j:l:m:n:o:p:r:s:t:h")) != -1) {
+    switch (opt) {
+      case 'm':
+        options->mtl_dirname = optarg;
+        have_mtl_dirname = true;
+        break;
+      case 'o':
+        options->output_basename = optarg;
+        break;
+      case 's':
+        options->pack.tex_width = options->pack.tex_height = atoi(optarg);
+        break;
+      case 'C':
+        options->use_cache = false;
+        break;
+      case 'S':
+        options->load.streaming = true;
+        break;
+      case 'T':
+        options->use_transfer = true;
+        break;
+      case 'M':
+        options->transfer.max_bytes = (size_t)(atof(optarg) * 1024.0 * 1024.0);
+        break;
+      case 'a':
+        options->chart.max_normal_angle = (float)atof(optarg);
+        break;
+      case 'p':
+        if (0 == strcmp(optarg, "skyline")) {
+          options->pack.packer = LIGHTMAP_PACKER_SKYLINE;
+        }
+        else if (0 == strcmp(optarg, "shelf")) {
+          options->pack.packer = LIGHTMAP_PACKER_SHELF;
+        }
+        else {
+          return false;
+        }
+        break;
+      case 'n':
+        options->bake.samples_per_texel = options->transfer.rays_per_texel = atoi(optarg);
+        break;
+      case 'e':
+        options->bake.noise_threshold = (float)atof(optarg);
+        break;
+      case 'N':
+        options->bake.max_samples_per_texel = atoi(optarg);
+        break;
+      case 'b':
+        options->bake.max_bounces = atoi(optarg);
+        break;
+      case 'j':
+        options->thread_count = atoi(optarg);
+        break;
+      case 'l':
+        if (!parse_vec3(&options->light.pos, optarg)) {
+          return false;
+        }
+        break;
+      case 'c':
+        if (!parse_vec3(&options->light.color, optarg)) {
+          return false;
+        }
+        break;
+      case 'i':
+        options->light.intensity = (float)atof(optarg);
+        break;
+      case 'r':
+        options->light.range = (float)atof(optarg);
+        break;
+      case 't':
+        options->trace_filename = optarg;
+        break;
+      default:
+        return false;
+    }
+  }
+  if (optind != argc - 1 || options->pack.tex_width < 0) {
+    return false;
+  }
+  options->scene_filename = argv[optind];
+
+  // default to looking for the materials next to the scene
+  if (!have_mtl_dirname) {
+    const std::string scene_filename(options->scene_filename);
+    const size_t slash = scene_filename.find_last_of('/');
+    options->mtl_dirname = slash == std::string::npos ? "./" : scene_filename.substr(0, slash + 1);
+  }
+  else if (!options->mtl_dirname.empty() && options->mtl_dirname.back() != '/') {
+    options->mtl_dirname += '/';
+  }
+  return true;
+}
+
+static bool write_ppm(const char* filename, const float* texels, int width, int height) {
+  FILE* file = fopen(filename, "wb");
+  if (!file) {
+    return false;
+  }
+
+  // the atlas is stored bottom-up like a GL texture, ppm wants it top-down
+  fprintf(file, "P6\n%d %d\n255\n", width, height);
+  std::vector<uint8_t> row(3 * width);
+  for (int y = height - 1; y >= 0; --y) {
+    const float* src = texels + 3 * y * width;
+    for (int index = 0; index < 3 * width; ++index) {
+      const float value = fminf(fmaxf(src[index], 0.0f), 1.0f);
+      row[index] = (uint8_t)(value * 255.0f + 0.5f);
+    }
+    fwrite(&row[0], 3, width, file);
+  }
+  return 0 == fclose(file);
+}
+
+static bool write_uvs(const char* filename, const float* uv_data, size_t uv_count) {
+  FILE* file = fopen(filename, "wb");
+  if (!file) {
+    return false;
+  }
+
+  fwrite(uv_data, 2 * sizeof(float), uv_count, file);
+  return 0 == fclose(file);
+}
+
+int main(int argc, char** argv) {
+  BakeOptions options;
+  if (!parse_options(&options, argc, argv)) {
+    print_usage();
+    return 1;
+  }
+
+  JobSettings job_settings;
+  job_settings_init(&job_settings);
+  job_settings.thread_count = options.thread_count;
+  job_init(&job_settings);
+  const int worker_count = job_worker_count();
+
+  // same import transform as the interactive demo
+  const vectorial::mat4f transform =
+      vectorial::mat4f::scale(10.0f) * vectorial::mat4f::axisRotation(1.5708f, vectorial::vec3f(1.0f, 0.0f, 0.0f));
+  const std::string cache_filename = std::string(options.scene_filename) + ".cache";
+  const auto load_start = std::chrono::steady_clock::now();
+  MeshCache* cache = mesh_cache_load(options.use_cache ? cache_filename.c_str() : nullptr,
+                                     options.scene_filename,
+                                     options.mtl_dirname.c_str(),
+                                     transform,
+                                     &options.load,
+                                     &options.chart,
+                                     &options.pack);
+  const auto load_end = std::chrono::steady_clock::now();
+  const double load_ms = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+  if (!cache) {
+    fprintf(stderr, "ERROR: failed to load '%s'\n", options.scene_filename);
+    job_shutdown();
+    return 1;
+  }
+
+  const MeshCacheContents* contents = mesh_cache_contents(cache);
+  const Mesh* mesh = &contents->mesh;
+  const int tex_width = contents->tex_width;
+  const int tex_height = contents->tex_height;
+
+  float* texels = (float*)malloc(tex_width * tex_height * 3 * sizeof(float));
+  const auto bake_start = std::chrono::steady_clock::now();
+  if (options.use_transfer) {
+    BakeScene scene;
+    TexelGbuffer gbuffer;
+    bake_scene_create(&scene, mesh);
+    Transfer* transfer = nullptr;
+    if (scene.bvh && texel_gbuffer_create(&gbuffer, &scene, contents->corner_uvs, tex_width, tex_height)) {
+      transfer = transfer_create(&scene, &gbuffer, contents->corner_uvs, &options.transfer);
+      if (!transfer) {
+        texel_gbuffer_destroy(&gbuffer);
+      }
+    }
+    if (!transfer) {
+      fprintf(stderr, "ERROR: failed to build the transfer of '%s'\n", options.scene_filename);
+      bake_scene_destroy(&scene);
+      free(texels);
+      mesh_cache_close(cache);
+      job_shutdown();
+      return 1;
+    }
+    const auto build_end = std::chrono::steady_clock::now();
+
+    // the bounces cost the difference to a relight with only the direct light
+    transfer_relight(transfer, options.light, 0, true, texels);
+    const auto direct_end = std::chrono::steady_clock::now();
+    transfer_relight(transfer, options.light, options.bake.max_bounces, true, texels);
+    const auto relight_end = std::chrono::steady_clock::now();
+
+    const double direct_ms = std::chrono::duration<double, std::milli>(direct_end - build_end).count();
+    const double relight_ms = std::chrono::duration<double, std::milli>(relight_end - direct_end).count();
+    printf("transfer: %u texels, %.1f sources a texel, %.1f MB, built in %.1f ms, relit in %.2f ms, %.2f ms a "
+           "bounce\n",
+           transfer->row_count,
+           transfer->row_count ? (double)transfer_entry_count(transfer) / transfer->row_count : 0.0,
+           transfer->byte_count / (1024.0 * 1024.0),
+           std::chrono::duration<double, std::milli>(build_end - bake_start).count(),
+           relight_ms,
+           options.bake.max_bounces > 0 ? (relight_ms - direct_ms) / options.bake.max_bounces : 0.0);
+    transfer_destroy(transfer);
+    texel_gbuffer_destroy(&gbuffer);
+    bake_scene_destroy(&scene);
+  }
+  else if (!bake_lightmap(texels, tex_width, tex_height, mesh, contents->corner_uvs, options.light, &options.bake)) {
+    fprintf(stderr, "ERROR: failed to bake '%s'\n", options.scene_filename);
+    free(texels);
+    mesh_cache_close(cache);
+    job_shutdown();
+    return 1;
+  }
+  const auto bake_end = std::chrono::steady_clock::now();
+  const double bake_ms = std::chrono::duration<double, std::milli>(bake_end - bake_start).count();
+
+  job_shutdown();
+
+  int result = 0;
+  const std::string atlas_filename = options.output_basename + ".ppm";
+  const std::string uv_filename = options.output_basename + ".uv";
+  if (!write_ppm(atlas_filename.c_str(), texels, tex_width, tex_height)) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", atlas_filename.c_str());
+    result = 1;
+  }
+  if (!write_uvs(uv_filename.c_str(), contents->corner_uvs, mesh->index_count)) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", uv_filename.c_str());
+    result = 1;
+  }
+
+  printf("%s: %u triangles in %d charts, %dx%d atlas (%.0f%% utilized), %s in %.1f ms, baked in %.1f ms on %d "
+         "threads\n",
+         options.scene_filename,
+         mesh->index_count / 3,
+         contents->chart_count,
+         tex_width,
+         tex_height,
+         100.0f * contents->utilization,
+         mesh_cache_hit(cache) ? "mapped from the cache" : "imported",
+         load_ms,
+         bake_ms,
+         worker_count);
+#if PROFILE_ENABLED
+  printf("%llu rays traced\n", (unsigned long long)profile_counter_total(PROFILE_COUNTER_RAYS_TRACED));
+#endif
+  if (options.trace_filename && !profile_write_chrome_trace(options.trace_filename)) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", options.trace_filename);
+    result = 1;
+  }
+
+  free(texels);
+  mesh_cache_close(cache);
+  return result;
+}
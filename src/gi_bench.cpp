@@ -0,0 +1,177 @@
+#include "app.h"
+#include "gl_backend.h"
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+struct BenchOptions {
+  bool progressive;
+  int frame_count;
+  int width;
+  int height;
+  double max_calls_per_frame;  // 0 for no budget
+  double max_calls_per_draw;
+  const char* trace_filename;
+};
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: gi-bench [options]\n"
+          "\n"
+          "  -f frames           frames to render after the first one (1000)\n"
+          "  -s width,height     window size (1280,720)\n"
+          "  -b calls            fail if a frame makes more GL calls than this on average (no budget)\n"
+          "  -d calls            fail if a draw takes more GL calls than this on average (no budget)\n"
+          "  -p                  path trace the bounced light progressively instead of gathering it\n"
+          "  -t trace.json       write a Chrome trace of the run\n"
+          "\n"
+          "runs the demo against the null GL backend with the camera turning, from the repository root so it finds\n"
+          "data/, and prints the CPU time of the load and of every frame along with the GL calls they make. the\n"
+          "glGetError() calls GL_CHECK adds are left out of the counts.\n");
+}
+
+static bool parse_options(BenchOptions* options, int argc, char** argv) {
+  options->progressive = false;
+  options->frame_count = 1000;
+  options->width = 1280;
+  options->height = 720;
+  options->max_calls_per_frame = 0.0;
+  options->max_calls_per_draw = 0.0;
+  options->trace_filename = nullptr;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "b:d:f:ps:t:h")) != -1) {
+    switch (opt) {
+      case 'f':
+        options->frame_count = atoi(optarg);
+        break;
+      case 's':
+        if (2 != sscanf(optarg, "%d,%d", &options->width, &options->height)) {
+          return false;
+        }
+        break;
+      case 'b':
+        options->max_calls_per_frame = atof(optarg);
+        break;
+      case 'd':
+        options->max_calls_per_draw = atof(optarg);
+        break;
+      case 'p':
+        options->progressive = true;
+        break;
+      case 't':
+        options->trace_filename = optarg;
+        break;
+      default:
+        return false;
+    }
+  }
+  return optind == argc && options->frame_count > 0 && options->width > 0 && options->height > 0;
+}
+
+static unsigned count_calls(const unsigned* counts) {
+  unsigned calls = 0;
+  for (int function = 0; function < GL_FUNCTION_COUNT; ++function) {
+    calls += function == GL_FUNCTION_GetError ? 0 : counts[function];
+  }
+  return calls;
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+  return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+int main(int argc, char** argv) {
+  BenchOptions options;
+  if (!parse_options(&options, argc, argv)) {
+    print_usage();
+    return 1;
+  }
+
+  gl_backend_load_null();
+  gl_backend_record();
+
+  // the first frame loads the shaders and the models
+  app_set_progressive_lightmap(options.progressive ? 1 : 0);
+  app_resize((float)options.width, (float)options.height);
+  const auto load_start = std::chrono::steady_clock::now();
+  app_render(0.0f);
+  const auto load_end = std::chrono::steady_clock::now();
+  const double load_ms = std::chrono::duration<double, std::milli>(load_end - load_start).count();
+  const unsigned load_calls = count_calls(gl_recording_counts());
+
+  gl_recording_reset();
+  app_input_key_down(APP_KEY_CODE_LEFT);
+  std::vector<double> frame_ms(options.frame_count);
+  for (int frame = 0; frame < options.frame_count; ++frame) {
+    const auto frame_start = std::chrono::steady_clock::now();
+    app_render(1.0f / 60.0f);
+    const auto frame_end = std::chrono::steady_clock::now();
+    frame_ms[frame] = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+  }
+  app_input_key_up(APP_KEY_CODE_LEFT);
+
+  std::vector<unsigned> counts(gl_recording_counts(), gl_recording_counts() + GL_FUNCTION_COUNT);
+  app_shutdown();
+  gl_backend_stop_recording();
+
+  const double frame_count = (double)options.frame_count;
+  const unsigned draws = counts[GL_FUNCTION_DrawArrays] + counts[GL_FUNCTION_MultiDrawElementsBaseVertex];
+  const double calls_per_frame = count_calls(counts.data()) / frame_count;
+  const double calls_per_draw = draws ? count_calls(counts.data()) / (double)draws : 0.0;
+
+  double total_ms = 0.0;
+  for (double ms : frame_ms) {
+    total_ms += ms;
+  }
+  std::sort(frame_ms.begin(), frame_ms.end());
+
+  printf("load: %.1f ms, %u GL calls\n", load_ms, load_calls);
+  printf("frames: %d, %.3f ms mean, %.3f ms p50, %.3f ms p99, %.3f ms max\n",
+         options.frame_count,
+         total_ms / frame_count,
+         percentile(frame_ms, 0.5),
+         percentile(frame_ms, 0.99),
+         frame_ms.back());
+  printf("GL calls: %.1f per frame, %.1f draws per frame, %.1f calls per draw\n",
+         calls_per_frame,
+         draws / frame_count,
+         calls_per_draw);
+
+  // most called first
+  std::vector<int> functions;
+  for (int function = 0; function < GL_FUNCTION_COUNT; ++function) {
+    if (counts[function] && function != GL_FUNCTION_GetError) {
+      functions.push_back(function);
+    }
+  }
+  std::stable_sort(functions.begin(), functions.end(), [&](int a, int b) { return counts[a] > counts[b]; });
+  for (int function : functions) {
+    printf("  %-32s %8.1f per frame\n", gl_function_name((GlFunction)function), counts[function] / frame_count);
+  }
+
+  int result = 0;
+  if (options.max_calls_per_frame > 0.0 && calls_per_frame > options.max_calls_per_frame) {
+    fprintf(stderr,
+            "ERROR: %.1f GL calls per frame, over the budget of %.1f\n",
+            calls_per_frame,
+            options.max_calls_per_frame);
+    result = 1;
+  }
+  if (options.max_calls_per_draw > 0.0 && calls_per_draw > options.max_calls_per_draw) {
+    fprintf(stderr,
+            "ERROR: %.1f GL calls per draw, over the budget of %.1f\n",
+            calls_per_draw,
+            options.max_calls_per_draw);
+    result = 1;
+  }
+  if (options.trace_filename && !profile_write_chrome_trace(options.trace_filename)) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", options.trace_filename);
+    result = 1;
+  }
+  return result;
+}
@@ -0,0 +1,517 @@
+#include "lightmap.h"
+#include "mesh.h"
+#include "mesh_cache.h"
+#include "obj.h"
+#include "render_queue.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+struct TestOptions {
+  const char* scene_filename;
+  const char* cache_filename;
+};
+
+struct Test {
+  const char* name;
+  bool (*func)();
+};
+
+static TestOptions s_options;
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: gi-test [options] [test ...]\n"
+          "\n"
+          "  -s scene.obj        scene of the mesh cache test (data/cornell_box.obj)\n"
+          "  -o cache_filename   where the mesh cache test writes its cache (gi-test.cache)\n"
+          "\n"
+          "runs the named tests, or all of them, and prints an error for every one that fails. tests: radix_sort,\n"
+          "parse_float, mesh_cache, quantize.\n");
+}
+
+// xorshift64*, the tests only need something repeatable
+static uint64_t next_random(uint64_t* state) {
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static bool test_radix_sort() {
+  uint64_t state = 1;
+  // every key different, most digits the same (the skipped passes), all keys the same and keys only in the low bytes
+  const uint64_t masks[] = {~0ULL, 0xff0000ff000000ffULL, 0ULL, 0xffffULL};
+  const size_t counts[] = {0, 1, 2, 255, 256, 4097};
+  for (uint64_t mask : masks) {
+    for (size_t count : counts) {
+      std::vector<RenderItem> items(count);
+      for (size_t i = 0; i < count; ++i) {
+        items[i].key = next_random(&state) & mask;
+        items[i].index = (uint32_t)i;
+      }
+      std::vector<RenderItem> expected = items;
+      std::stable_sort(expected.begin(), expected.end(), [](const RenderItem& a, const RenderItem& b) {
+        return a.key < b.key;
+      });
+
+      std::vector<RenderItem> scratch(count);
+      render_queue_sort(items.data(), scratch.data(), count);
+      for (size_t i = 0; i < count; ++i) {
+        if (items[i].key != expected[i].key || items[i].index != expected[i].index) {
+          fprintf(stderr,
+                  "ERROR: radix sort of %zu keys (mask %016llx) has key %016llx, item %u at %zu instead of key "
+                  "%016llx, item %u\n",
+                  count,
+                  (unsigned long long)mask,
+                  (unsigned long long)items[i].key,
+                  items[i].index,
+                  i,
+                  (unsigned long long)expected[i].key,
+                  expected[i].index);
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+// a number in the grammar obj_parse_float() accepts, mostly around the edges of what its fast path takes
+static std::string random_number(uint64_t* state) {
+  std::string text;
+  const uint64_t r = next_random(state);
+  if (r & 1) {
+    text += (r & 2) ? '-' : '+';
+  }
+  const int digit_count = 1 + (int)((r >> 2) % ((r & 4) ? 25 : 9));
+  const int point = (int)((r >> 8) % (digit_count + 1));
+  for (int digit = 0; digit < digit_count; ++digit) {
+    if (digit == point && digit > 0) {
+      text += '.';
+    }
+    // runs of zeros and nines make the halfway and carry cases
+    const uint64_t d = next_random(state);
+    text += (d & 3) == 0 ? '0' : (d & 3) == 1 ? '9' : (char)('0' + (d >> 2) % 10);
+  }
+  if ((r >> 16) & 1) {
+    text += (r >> 17) & 1 ? 'e' : 'E';
+    const int exponent = (int)((r >> 18) % 101) - 50;
+    text += std::to_string(exponent);
+  }
+  return text;
+}
+
+static bool check_parse(const std::string& text, const char* suffix) {
+  const std::string line = text + suffix;
+  float parsed = 0.0f;
+  if (!obj_parse_float(line.c_str(), line.c_str() + line.size(), &parsed)) {
+    fprintf(stderr, "ERROR: obj_parse_float() rejects '%s'\n", line.c_str());
+    return false;
+  }
+  const float expected = strtof(text.c_str(), nullptr);
+  if (memcmp(&parsed, &expected, sizeof(float)) != 0) {
+    fprintf(stderr, "ERROR: obj_parse_float('%s') is %.9g, strtof() %.9g\n", line.c_str(), parsed, expected);
+    return false;
+  }
+  return true;
+}
+
+static bool test_parse_float() {
+  // halfway between two floats, and just either side of it, subnormals, overflow and the fast path's limits
+  const char* cases[] = {
+      "0",
+      "-0",
+      "1.",
+      "16777217",
+      "16777216.000000000000000001",
+      "16777217.000000000000000001",
+      "1.00000005960464477539062500",
+      "1.00000005960464477539062499",
+      "1.00000005960464477539062501",
+      "3.4028235e38",
+      "3.4028236e38",
+      "1e39",
+      "1.17549435e-38",
+      "1.4e-45",
+      "7e-46",
+      "1e-50",
+      "9007199254740993",
+      "1e22",
+      "1e23",
+      "123456789012345678901234567890",
+      "0.000000000000000000000000000001",
+  };
+  for (const char* text : cases) {
+    if (!check_parse(text, "")) {
+      return false;
+    }
+  }
+
+  // whatever follows a complete number is left alone
+  uint64_t state = 2;
+  const char* suffixes[] = {"", " 1", "/2", "\t", "x"};
+  for (int i = 0; i < 1000000; ++i) {
+    if (!check_parse(random_number(&state), suffixes[i % 5])) {
+      return false;
+    }
+  }
+
+  // decimals that round to a double exactly halfway between two floats without being there themselves, the double
+  // rounding the fast path has to leave to strtof()
+  for (int i = 0; i < 100000; ++i) {
+    const uint32_t bits = 0x00800000U + (uint32_t)(next_random(&state) % 0x7e000000U);
+    float low;
+    float high;
+    const uint32_t high_bits = bits + 1;
+    memcpy(&low, &bits, sizeof(low));
+    memcpy(&high, &high_bits, sizeof(high));
+    char text[32];
+    snprintf(text, sizeof(text), "%.*e", 12 + i % 4, ((double)low + (double)high) * 0.5);
+    if (!check_parse(text, "")) {
+      return false;
+    }
+  }
+
+  // an exponent needs digits as much as the number does
+  const char* rejected[] = {"", "-", ".5", "e5", "1e", "1e+", "1.5E-x"};
+  for (const char* text : rejected) {
+    float value;
+    if (obj_parse_float(text, text + strlen(text), &value)) {
+      fprintf(stderr, "ERROR: obj_parse_float() accepts '%s'\n", text);
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool same_bytes(const void* a, const void* b, size_t size, const char* what) {
+  if (size && memcmp(a, b, size) != 0) {
+    fprintf(stderr, "ERROR: the mesh cache's %s don't match the import\n", what);
+    return false;
+  }
+  return true;
+}
+
+static bool same_contents(const MeshCacheContents* a, const MeshCacheContents* b) {
+  const Mesh& mesh = a->mesh;
+  if (mesh.index_count != b->mesh.index_count || mesh.vertex_count != b->mesh.vertex_count ||
+      mesh.channel_count != b->mesh.channel_count || mesh.index_size_32_bit != b->mesh.index_size_32_bit ||
+      a->tex_width != b->tex_width || a->tex_height != b->tex_height || a->chart_count != b->chart_count ||
+      a->utilization != b->utilization) {
+    fprintf(stderr, "ERROR: the mesh cache's counts don't match the import\n");
+    return false;
+  }
+  const size_t index_size = mesh.index_size_32_bit ? sizeof(uint32_t) : sizeof(uint16_t);
+  const size_t stride = vertex_stride(mesh.channels, mesh.channel_count);
+  return same_bytes(mesh.channels, b->mesh.channels, mesh.channel_count * sizeof(VertexChannelDesc), "channels") &&
+         same_bytes(mesh.indices, b->mesh.indices, mesh.index_count * index_size, "indices") &&
+         same_bytes(mesh.vertices, b->mesh.vertices, mesh.vertex_count * stride, "vertices") &&
+         same_bytes(a->vertex_uvs, b->vertex_uvs, mesh.vertex_count * 2 * sizeof(float), "vertex uvs") &&
+         same_bytes(a->corner_uvs, b->corner_uvs, mesh.index_count * 2 * sizeof(float), "corner uvs") &&
+         same_bytes(a->pack_indices, b->pack_indices, mesh.index_count / 3 * sizeof(int32_t), "pack indices");
+}
+
+// writes `size` bytes of `filename` to `truncated_filename`
+static bool write_truncated(const char* filename, const char* truncated_filename, long size) {
+  FILE* file = fopen(filename, "rb");
+  if (!file) {
+    return false;
+  }
+  std::vector<char> data(size);
+  const bool read = fread(data.data(), 1, size, file) == (size_t)size;
+  fclose(file);
+  FILE* out = fopen(truncated_filename, "wb");
+  if (!out) {
+    return false;
+  }
+  const bool written = read && fwrite(data.data(), 1, size, out) == (size_t)size;
+  return 0 == fclose(out) && written;
+}
+
+static bool test_mesh_cache() {
+  const std::string scene = s_options.scene_filename;
+  const size_t slash = scene.find_last_of('/');
+  const std::string mtl_dirname = slash == std::string::npos ? std::string("./") : scene.substr(0, slash + 1);
+  const vectorial::mat4f transform = vectorial::mat4f::identity();
+  MeshLoadSettings load_settings;
+  mesh_load_settings_init(&load_settings);
+  LightmapChartSettings chart_settings;
+  lightmap_chart_settings_init(&chart_settings);
+  LightmapPackSettings pack_settings;
+  lightmap_pack_settings_init(&pack_settings);
+
+  MeshCache* imported = mesh_cache_load(
+      nullptr, scene.c_str(), mtl_dirname.c_str(), transform, &load_settings, &chart_settings, &pack_settings);
+  if (!imported) {
+    fprintf(stderr, "ERROR: failed to import '%s'\n", scene.c_str());
+    return false;
+  }
+
+  const uint64_t key = mesh_cache_key(scene.c_str(), mtl_dirname.c_str(), transform, &chart_settings, &pack_settings);
+  bool passed = mesh_cache_write(s_options.cache_filename, key, mesh_cache_contents(imported));
+  if (!passed) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", s_options.cache_filename);
+  }
+
+  MeshCache* mapped = passed ? mesh_cache_open(s_options.cache_filename, key) : nullptr;
+  if (passed && !mapped) {
+    fprintf(stderr, "ERROR: failed to open the cache '%s' just written\n", s_options.cache_filename);
+    passed = false;
+  }
+  passed = passed && same_contents(mesh_cache_contents(mapped), mesh_cache_contents(imported));
+  if (mapped) {
+    mesh_cache_close(mapped);
+  }
+
+  // the key of other inputs, and a file cut short anywhere, have to fall back to an import
+  MeshCache* stale = passed ? mesh_cache_open(s_options.cache_filename, key + 1) : nullptr;
+  if (stale) {
+    fprintf(stderr, "ERROR: the cache opens with another key\n");
+    mesh_cache_close(stale);
+    passed = false;
+  }
+  FILE* file = passed ? fopen(s_options.cache_filename, "rb") : nullptr;
+  long size = 0;
+  if (file) {
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fclose(file);
+  }
+  const std::string truncated_filename = std::string(s_options.cache_filename) + ".truncated";
+  const long truncated_sizes[] = {0, 16, size / 2, size - 1};
+  for (long truncated_size : truncated_sizes) {
+    if (!passed) {
+      break;
+    }
+    if (!write_truncated(s_options.cache_filename, truncated_filename.c_str(), truncated_size)) {
+      fprintf(stderr, "ERROR: failed to write '%s'\n", truncated_filename.c_str());
+      passed = false;
+      break;
+    }
+    MeshCache* truncated = mesh_cache_open(truncated_filename.c_str(), key);
+    if (truncated) {
+      fprintf(stderr, "ERROR: the cache opens cut to %ld of its %ld bytes\n", truncated_size, size);
+      mesh_cache_close(truncated);
+      passed = false;
+    }
+  }
+
+  unlink(truncated_filename.c_str());
+  unlink(s_options.cache_filename);
+  mesh_cache_close(imported);
+  return passed;
+}
+
+static float random_float(uint64_t* state) {
+  return (float)(next_random(state) >> 40) / (float)(1 << 24);
+}
+
+// the normalized reads of GL and the decode of lit.vs.glsl
+static vectorial::vec3f decode_octahedral(float x, float y) {
+  vectorial::vec3f n(x, y, 1.0f - fabsf(x) - fabsf(y));
+  if (n.z() < 0.0f) {
+    const float x_sign = n.x() < 0.0f ? -1.0f : 1.0f;
+    const float y_sign = n.y() < 0.0f ? -1.0f : 1.0f;
+    n = vectorial::vec3f((1.0f - fabsf(n.y())) * x_sign, (1.0f - fabsf(n.x())) * y_sign, n.z());
+  }
+  return vectorial::normalize(n);
+}
+
+static float decode_snorm(int value, float max) {
+  return std::max(value / max, -1.0f);
+}
+
+// the largest error every channel may come back with, the positions' and the uvs' in units of their rounding step
+struct QuantizeTolerance {
+  float steps;
+  float color;
+  float normal_degrees;
+};
+
+template <typename Format>
+static bool check_quantized(const Mesh* quantized,
+                            const MeshQuantization& quantization,
+                            const Vertex* vertices,
+                            const float* uvs,
+                            const QuantizeTolerance& tolerance) {
+  if (!Format::matches(quantized) || vertex_stride(quantized->channels, quantized->channel_count) % 4 != 0) {
+    fprintf(stderr, "ERROR: mesh_quantize() wrote another format, or one with an unaligned stride\n");
+    return false;
+  }
+  typedef typename Format::template Channel<CHANNEL_SEMANTIC_NORMAL>::channel NormalChannel;
+  const float normal_max = NormalChannel::type == CHANNEL_TYPE_OCT_SNORM8_2 ? 127.0f : 32767.0f;
+  float position_step[3];
+  (quantization.position_scale / 65535.0f).store(position_step);
+
+  float errors[4] = {0.0f, 0.0f, 0.0f, 0.0f};  // position and uv in steps, color, normal in degrees
+  for (unsigned index = 0; index < quantized->vertex_count; ++index) {
+    const auto p = Format::template load<CHANNEL_SEMANTIC_POSITION>(quantized->vertices, index);
+    const auto n = Format::template load<CHANNEL_SEMANTIC_NORMAL>(quantized->vertices, index);
+    const VertexUByte4 c = Format::template load<CHANNEL_SEMANTIC_COLOR>(quantized->vertices, index);
+    const VertexUShort2 uv = Format::template load<CHANNEL_SEMANTIC_TEXCOORD>(quantized->vertices, index);
+
+    float position[3];
+    (quantization.position_offset + quantization.position_scale * vectorial::vec3f(p.x, p.y, p.z) / 65535.0f)
+        .store(position);
+    const float position_error = std::max(std::max(fabsf(position[0] - vertices[index].p.x) / position_step[0],
+                                                   fabsf(position[1] - vertices[index].p.y) / position_step[1]),
+                                          fabsf(position[2] - vertices[index].p.z) / position_step[2]);
+    const float color_error = std::max(std::max(fabsf(c.x / 255.0f - vertices[index].c.x),
+                                                fabsf(c.y / 255.0f - vertices[index].c.y)),
+                                       fabsf(c.z / 255.0f - vertices[index].c.z));
+    const float uv_error =
+        std::max(fabsf(uv.x / 65535.0f - uvs[2 * index + 0]), fabsf(uv.y / 65535.0f - uvs[2 * index + 1]));
+    const vectorial::vec3f normal = decode_octahedral(decode_snorm(n.x, normal_max), decode_snorm(n.y, normal_max));
+    // the chord between the unit vectors, acos() of their dot loses the small angles to float rounding
+    const float chord = vectorial::length(normal - to_vec3f(vertices[index].n));
+    errors[0] = std::max(errors[0], position_error);
+    errors[1] = std::max(errors[1], uv_error * 65535.0f);
+    errors[2] = std::max(errors[2], color_error);
+    errors[3] = std::max(errors[3], 2.0f * asinf(std::min(0.5f * chord, 1.0f)) * 57.29578f);
+    if (c.w != 255) {
+      fprintf(stderr, "ERROR: vertex %u has alpha %u\n", index, c.w);
+      return false;
+    }
+  }
+
+  if (errors[0] > tolerance.steps || errors[1] > tolerance.steps || errors[2] > tolerance.color ||
+      errors[3] > tolerance.normal_degrees) {
+    fprintf(stderr,
+            "ERROR: %u byte vertices decode with errors of %g position steps, %g uv steps, %g in color and %g "
+            "degrees in normal\n",
+            Format::stride,
+            errors[0],
+            errors[1],
+            errors[2],
+            errors[3]);
+    return false;
+  }
+  return true;
+}
+
+static bool test_quantize() {
+  // random points in a box that isn't at the origin, unit normals in every direction including the axes, colors and
+  // uvs over the whole of [0, 1]
+  const unsigned vertex_count = 100003;
+  uint64_t state = 3;
+  std::vector<Vertex> vertices(vertex_count);
+  std::vector<float> uvs(2 * vertex_count);
+  for (unsigned index = 0; index < vertex_count; ++index) {
+    Vertex& vertex = vertices[index];
+    vertex.p.x = -3.0f + 7.0f * random_float(&state);
+    vertex.p.y = 10.0f + 0.5f * random_float(&state);
+    vertex.p.z = 200.0f * random_float(&state);
+    vectorial::vec3f normal;
+    if (index < 6) {
+      float axis[3] = {0.0f, 0.0f, 0.0f};
+      axis[index / 2] = index % 2 ? -1.0f : 1.0f;
+      normal = vectorial::vec3f(axis);
+    }
+    else {
+      do {
+        normal = vectorial::vec3f(random_float(&state), random_float(&state), random_float(&state)) * 2.0f - 1.0f;
+      } while (vectorial::length_squared(normal) < 1e-4f || vectorial::length_squared(normal) > 1.0f);
+      normal = vectorial::normalize(normal);
+    }
+    vertex.n.x = normal.x();
+    vertex.n.y = normal.y();
+    vertex.n.z = normal.z();
+    vertex.c.x = random_float(&state);
+    vertex.c.y = index == 0 ? 0.0f : 1.0f;
+    vertex.c.z = random_float(&state);
+    uvs[2 * index + 0] = random_float(&state);
+    uvs[2 * index + 1] = index == 0 ? 1.0f : random_float(&state);
+  }
+
+  Mesh mesh;
+  MeshVertexFormat::describe(&mesh);
+  mesh.indices = nullptr;
+  mesh.vertices = vertices.data();
+  mesh.index_count = 0;
+  mesh.vertex_count = vertex_count;
+  mesh.index_size_32_bit = false;
+
+  bool passed = true;
+  for (int normals_8_bit = 0; normals_8_bit < 2 && passed; ++normals_8_bit) {
+    MeshQuantizeSettings settings;
+    mesh_quantize_settings_init(&settings);
+    settings.normals_8_bit = normals_8_bit != 0;
+    MeshQuantization quantization;
+    Mesh* quantized = mesh_quantize(&mesh, uvs.data(), &settings, &quantization);
+    if (!quantized) {
+      fprintf(stderr, "ERROR: mesh_quantize() failed\n");
+      return false;
+    }
+    // rounding to the nearest step, give or take the float math of the encode and the decode
+    QuantizeTolerance tolerance;
+    tolerance.steps = 0.51f;
+    tolerance.color = 0.51f / 255.0f;
+    tolerance.normal_degrees = normals_8_bit ? 1.0f : 0.01f;
+    passed = normals_8_bit ? check_quantized<QuantizedVertexFormat8>(
+                                 quantized, quantization, vertices.data(), uvs.data(), tolerance)
+                           : check_quantized<QuantizedVertexFormat16>(
+                                 quantized, quantization, vertices.data(), uvs.data(), tolerance);
+    mesh_destroy(quantized);
+  }
+  return passed;
+}
+
+static const Test s_tests[] = {
+    {"radix_sort", &test_radix_sort},
+    {"parse_float", &test_parse_float},
+    {"mesh_cache", &test_mesh_cache},
+    {"quantize", &test_quantize},
+};
+
+int main(int argc, char** argv) {
+  s_options.scene_filename = "data/cornell_box.obj";
+  s_options.cache_filename = "gi-test.cache";
+  int opt;
+  while ((opt = getopt(argc, argv, "o:s:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        s_options.cache_filename = optarg;
+        break;
+      case 's':
+        s_options.scene_filename = optarg;
+        break;
+      default:
+        print_usage();
+        return 1;
+    }
+  }
+
+  int failed = 0;
+  const int test_count = (int)(sizeof(s_tests) / sizeof(s_tests[0]));
+  for (int arg = optind; arg < argc; ++arg) {
+    const Test* test = std::find_if(s_tests, s_tests + test_count, [&](const Test& t) {
+      return 0 == strcmp(t.name, argv[arg]);
+    });
+    if (test == s_tests + test_count) {
+      fprintf(stderr, "ERROR: unknown test '%s'\n", argv[arg]);
+      print_usage();
+      return 1;
+    }
+  }
+  for (const Test& test : s_tests) {
+    bool selected = optind == argc;
+    for (int arg = optind; arg < argc; ++arg) {
+      selected |= 0 == strcmp(test.name, argv[arg]);
+    }
+    if (!selected) {
+      continue;
+    }
+    const bool passed = test.func();
+    printf("%s: %s\n", test.name, passed ? "passed" : "FAILED");
+    failed += !passed;
+  }
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+#include "gl_backend.h"
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+
+GlApi gl_api;
+
+static bool s_loaded;
+static bool s_recording;
+static GlApi s_recorded_api;  // what the recording wrappers forward to
+static unsigned s_recording_counts[GL_FUNCTION_COUNT];
+static GLuint s_null_last_name;
+
+static const char* s_function_names[GL_FUNCTION_COUNT] = {
+#define GL_FUNCTION_NAME(ret, name, params, args) "gl" #name,
+    GL_FUNCTIONS(GL_FUNCTION_NAME)
+#undef GL_FUNCTION_NAME
+};
+
+template <typename T>
+static T null_value() {
+  return T();
+}
+
+// the null backend. whatever isn't overridden below returns zero.
+#define GL_NULL_FUNCTION(ret, name, params, args)                                                                      \
+  static ret null_##name params {                                                                                      \
+    return null_value<ret>();                                                                                          \
+  }
+GL_FUNCTIONS(GL_NULL_FUNCTION)
+#undef GL_NULL_FUNCTION
+
+// names are never reused, which keeps them unique across deletes
+static void null_gen_names(GLsizei n, GLuint* names) {
+  for (GLsizei index = 0; index < n; ++index) {
+    names[index] = ++s_null_last_name;
+  }
+}
+
+static GLuint null_create_program() {
+  return ++s_null_last_name;
+}
+
+static GLuint null_create_shader(GLenum type) {
+  return ++s_null_last_name;
+}
+
+// everything compiles and links without a log, and has no active uniforms to enumerate
+static void null_get_iv(GLuint object, GLenum pname, GLint* params) {
+  switch (pname) {
+    case GL_COMPILE_STATUS:
+    case GL_LINK_STATUS:
+      *params = GL_TRUE;
+      break;
+    default:
+      *params = 0;
+      break;
+  }
+}
+
+static void null_get_info_log(GLuint object, GLsizei buf_size, GLsizei* length, GLchar* info_log) {
+  if (length) {
+    *length = 0;
+  }
+  if (buf_size > 0) {
+    info_log[0] = '\0';
+  }
+}
+
+// every program has every uniform and the frame constants block, so the draws set all of them like the lit program's do
+static GLint null_get_uniform_location(GLuint program, const GLchar* name) {
+  return 0;
+}
+
+static GLuint null_get_uniform_block_index(GLuint program, const GLchar* name) {
+  return 0;
+}
+
+#define GL_RECORD_FUNCTION(ret, name, params, args)                                                                    \
+  static ret record_##name params {                                                                                    \
+    ++s_recording_counts[GL_FUNCTION_##name];                                                                          \
+    return s_recorded_api.name args;                                                                                   \
+  }
+GL_FUNCTIONS(GL_RECORD_FUNCTION)
+#undef GL_RECORD_FUNCTION
+
+static void* dlsym_default(const char* name) {
+  return dlsym(RTLD_DEFAULT, name);
+}
+
+bool gl_backend_load_real(void* (*get_proc_address)(const char* name)) {
+  if (!get_proc_address) {
+    get_proc_address = &dlsym_default;
+  }
+
+  GlApi api;
+  bool found_all = true;
+#define GL_LOAD_FUNCTION(ret, name, params, args)                                                                      \
+  api.name = (ret(*) params)get_proc_address("gl" #name);                                                              \
+  if (!api.name) {                                                                                                     \
+    fprintf(stderr, "ERROR: GL function gl%s not found\n", #name);                                                     \
+    found_all = false;                                                                                                 \
+  }
+  GL_FUNCTIONS(GL_LOAD_FUNCTION)
+#undef GL_LOAD_FUNCTION
+  if (!found_all) {
+    return false;
+  }
+
+  gl_backend_stop_recording();
+  gl_api = api;
+  s_loaded = true;
+  return true;
+}
+
+void gl_backend_load_null() {
+  gl_backend_stop_recording();
+#define GL_LOAD_NULL_FUNCTION(ret, name, params, args) gl_api.name = &null_##name;
+  GL_FUNCTIONS(GL_LOAD_NULL_FUNCTION)
+#undef GL_LOAD_NULL_FUNCTION
+  gl_api.GenBuffers = &null_gen_names;
+  gl_api.GenQueries = &null_gen_names;
+  gl_api.GenTextures = &null_gen_names;
+  gl_api.GenVertexArrays = &null_gen_names;
+  gl_api.CreateProgram = &null_create_program;
+  gl_api.CreateShader = &null_create_shader;
+  gl_api.GetProgramiv = &null_get_iv;
+  gl_api.GetShaderiv = &null_get_iv;
+  gl_api.GetProgramInfoLog = &null_get_info_log;
+  gl_api.GetShaderInfoLog = &null_get_info_log;
+  gl_api.GetUniformLocation = &null_get_uniform_location;
+  gl_api.GetUniformBlockIndex = &null_get_uniform_block_index;
+  s_loaded = true;
+}
+
+bool gl_backend_loaded() {
+  return s_loaded;
+}
+
+void gl_backend_record() {
+  if (s_recording) {
+    return;
+  }
+  s_recording = true;
+  s_recorded_api = gl_api;
+  gl_recording_reset();
+#define GL_LOAD_RECORD_FUNCTION(ret, name, params, args) gl_api.name = &record_##name;
+  GL_FUNCTIONS(GL_LOAD_RECORD_FUNCTION)
+#undef GL_LOAD_RECORD_FUNCTION
+}
+
+void gl_backend_stop_recording() {
+  if (!s_recording) {
+    return;
+  }
+  s_recording = false;
+  gl_api = s_recorded_api;
+}
+
+const unsigned* gl_recording_counts() {
+  return s_recording_counts;
+}
+
+void gl_recording_reset() {
+  memset(s_recording_counts, 0, sizeof(s_recording_counts));
+}
+
+const char* gl_function_name(GlFunction function) {
+  return function < GL_FUNCTION_COUNT ? s_function_names[function] : "unknown";
+}
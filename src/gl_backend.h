@@ -0,0 +1,242 @@
+#pragma once
+#if defined(__APPLE__)
+#include <OpenGL/gl3.h>
+#else
+#include <GL/glcorearb.h>
+#endif
+
+// every GL function the renderer calls goes through a table that one of the backends fills in:
+//
+//   real       the driver's functions, looked up by name
+//   null       does nothing, but hands out names and reports shaders as compiled so the renderer runs without a context
+//   recording  wraps whichever of the two is loaded and counts the calls by function
+//
+// the glXxx names are macros for the table entries, so the renderer keeps calling GL the usual way.
+
+// X(return_type, name, parameters, arguments)
+#define GL_FUNCTIONS(X)                                                                                                \
+  X(void, ActiveTexture, (GLenum texture), (texture))                                                                  \
+  X(void, AttachShader, (GLuint program, GLuint shader), (program, shader))                                            \
+  X(void, BeginQuery, (GLenum target, GLuint id), (target, id))                                                        \
+  X(void, BindBuffer, (GLenum target, GLuint buffer), (target, buffer))                                                \
+  X(void, BindBufferBase, (GLenum target, GLuint index, GLuint buffer), (target, index, buffer))                       \
+  X(void, BindTexture, (GLenum target, GLuint texture), (target, texture))                                             \
+  X(void, BindVertexArray, (GLuint array), (array))                                                                    \
+  X(void,                                                                                                              \
+    BufferData,                                                                                                        \
+    (GLenum target, GLsizeiptr size, const void* data, GLenum usage),                                                  \
+    (target, size, data, usage))                                                                                       \
+  X(void,                                                                                                              \
+    BufferSubData,                                                                                                     \
+    (GLenum target, GLintptr offset, GLsizeiptr size, const void* data),                                               \
+    (target, offset, size, data))                                                                                      \
+  X(void, Clear, (GLbitfield mask), (mask))                                                                            \
+  X(void,                                                                                                              \
+    ClearColor,                                                                                                        \
+    (GLfloat red, GLfloat green, GLfloat blue, GLfloat alpha),                                                         \
+    (red, green, blue, alpha))                                                                                         \
+  X(void, CompileShader, (GLuint shader), (shader))                                                                    \
+  X(GLuint, CreateProgram, (), ())                                                                                     \
+  X(GLuint, CreateShader, (GLenum type), (type))                                                                       \
+  X(void, CullFace, (GLenum mode), (mode))                                                                             \
+  X(void, DeleteBuffers, (GLsizei n, const GLuint* buffers), (n, buffers))                                             \
+  X(void, DeleteProgram, (GLuint program), (program))                                                                  \
+  X(void, DeleteQueries, (GLsizei n, const GLuint* ids), (n, ids))                                                     \
+  X(void, DeleteShader, (GLuint shader), (shader))                                                                     \
+  X(void, DeleteTextures, (GLsizei n, const GLuint* textures), (n, textures))                                          \
+  X(void, DeleteVertexArrays, (GLsizei n, const GLuint* arrays), (n, arrays))                                          \
+  X(void, DepthFunc, (GLenum func), (func))                                                                            \
+  X(void, DetachShader, (GLuint program, GLuint shader), (program, shader))                                            \
+  X(void, Disable, (GLenum cap), (cap))                                                                                \
+  X(void, DisableVertexAttribArray, (GLuint index), (index))                                                           \
+  X(void, DrawArrays, (GLenum mode, GLint first, GLsizei count), (mode, first, count))                                 \
+  X(void, Enable, (GLenum cap), (cap))                                                                                 \
+  X(void, EnableVertexAttribArray, (GLuint index), (index))                                                            \
+  X(void, EndQuery, (GLenum target), (target))                                                                         \
+  X(void, Finish, (), ())                                                                                              \
+  X(void, GenBuffers, (GLsizei n, GLuint * buffers), (n, buffers))                                                     \
+  X(void, GenQueries, (GLsizei n, GLuint * ids), (n, ids))                                                             \
+  X(void, GenTextures, (GLsizei n, GLuint * textures), (n, textures))                                                  \
+  X(void, GenVertexArrays, (GLsizei n, GLuint * arrays), (n, arrays))                                                  \
+  X(void,                                                                                                              \
+    GetActiveUniform,                                                                                                  \
+    (GLuint program, GLuint index, GLsizei buf_size, GLsizei * length, GLint * size, GLenum * type, GLchar * name),    \
+    (program, index, buf_size, length, size, type, name))                                                              \
+  X(void,                                                                                                              \
+    GetActiveUniformsiv,                                                                                               \
+    (GLuint program, GLsizei count, const GLuint* indices, GLenum pname, GLint* params),                               \
+    (program, count, indices, pname, params))                                                                          \
+  X(GLenum, GetError, (), ())                                                                                          \
+  X(void,                                                                                                              \
+    GetProgramInfoLog,                                                                                                 \
+    (GLuint program, GLsizei buf_size, GLsizei * length, GLchar * info_log),                                           \
+    (program, buf_size, length, info_log))                                                                             \
+  X(void, GetProgramiv, (GLuint program, GLenum pname, GLint * params), (program, pname, params))                      \
+  X(void, GetQueryObjectiv, (GLuint id, GLenum pname, GLint * params), (id, pname, params))                            \
+  X(void, GetQueryObjectui64v, (GLuint id, GLenum pname, GLuint64 * params), (id, pname, params))                      \
+  X(void,                                                                                                              \
+    GetShaderInfoLog,                                                                                                  \
+    (GLuint shader, GLsizei buf_size, GLsizei * length, GLchar * info_log),                                            \
+    (shader, buf_size, length, info_log))                                                                              \
+  X(void, GetShaderiv, (GLuint shader, GLenum pname, GLint * params), (shader, pname, params))                         \
+  X(const GLubyte*, GetString, (GLenum name), (name))                                                                  \
+  X(GLuint, GetUniformBlockIndex, (GLuint program, const GLchar* name), (program, name))                               \
+  X(GLint, GetUniformLocation, (GLuint program, const GLchar* name), (program, name))                                  \
+  X(void, LinkProgram, (GLuint program), (program))                                                                    \
+  X(void*,                                                                                                             \
+    MapBufferRange,                                                                                                    \
+    (GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access),                                            \
+    (target, offset, length, access))                                                                                  \
+  X(void,                                                                                                              \
+    MultiDrawElementsBaseVertex,                                                                                       \
+    (GLenum mode,                                                                                                      \
+     const GLsizei* count,                                                                                             \
+     GLenum type,                                                                                                      \
+     const void* const* indices,                                                                                       \
+     GLsizei draw_count,                                                                                               \
+     const GLint* base_vertex),                                                                                        \
+    (mode, count, type, indices, draw_count, base_vertex))                                                             \
+  X(void, PixelStorei, (GLenum pname, GLint param), (pname, param))                                                    \
+  X(void, PolygonMode, (GLenum face, GLenum mode), (face, mode))                                                       \
+  X(void,                                                                                                              \
+    ShaderSource,                                                                                                      \
+    (GLuint shader, GLsizei count, const GLchar* const* string, const GLint* length),                                  \
+    (shader, count, string, length))                                                                                   \
+  X(void,                                                                                                              \
+    TexImage2D,                                                                                                        \
+    (GLenum target,                                                                                                    \
+     GLint level,                                                                                                      \
+     GLint internal_format,                                                                                            \
+     GLsizei width,                                                                                                    \
+     GLsizei height,                                                                                                   \
+     GLint border,                                                                                                     \
+     GLenum format,                                                                                                    \
+     GLenum type,                                                                                                      \
+     const void* pixels),                                                                                              \
+    (target, level, internal_format, width, height, border, format, type, pixels))                                     \
+  X(void, TexParameteri, (GLenum target, GLenum pname, GLint param), (target, pname, param))                           \
+  X(void,                                                                                                              \
+    TexSubImage2D,                                                                                                     \
+    (GLenum target,                                                                                                    \
+     GLint level,                                                                                                      \
+     GLint x_offset,                                                                                                   \
+     GLint y_offset,                                                                                                   \
+     GLsizei width,                                                                                                    \
+     GLsizei height,                                                                                                   \
+     GLenum format,                                                                                                    \
+     GLenum type,                                                                                                      \
+     const void* pixels),                                                                                              \
+    (target, level, x_offset, y_offset, width, height, format, type, pixels))                                          \
+  X(void, Uniform1i, (GLint location, GLint value), (location, value))                                                 \
+  X(void, Uniform3fv, (GLint location, GLsizei count, const GLfloat* value), (location, count, value))                 \
+  X(void,                                                                                                              \
+    UniformBlockBinding,                                                                                               \
+    (GLuint program, GLuint block_index, GLuint block_binding),                                                        \
+    (program, block_index, block_binding))                                                                             \
+  X(void,                                                                                                              \
+    UniformMatrix4fv,                                                                                                  \
+    (GLint location, GLsizei count, GLboolean transpose, const GLfloat* value),                                        \
+    (location, count, transpose, value))                                                                               \
+  X(GLboolean, UnmapBuffer, (GLenum target), (target))                                                                 \
+  X(void, UseProgram, (GLuint program), (program))                                                                     \
+  X(void,                                                                                                              \
+    VertexAttribPointer,                                                                                               \
+    (GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer),                \
+    (index, size, type, normalized, stride, pointer))                                                                  \
+  X(void, Viewport, (GLint x, GLint y, GLsizei width, GLsizei height), (x, y, width, height))
+
+enum GlFunction {
+#define GL_FUNCTION_ENUM(ret, name, params, args) GL_FUNCTION_##name,
+  GL_FUNCTIONS(GL_FUNCTION_ENUM)
+#undef GL_FUNCTION_ENUM
+  GL_FUNCTION_COUNT
+};
+
+struct GlApi {
+#define GL_FUNCTION_POINTER(ret, name, params, args) ret(*name) params;
+  GL_FUNCTIONS(GL_FUNCTION_POINTER)
+#undef GL_FUNCTION_POINTER
+};
+
+extern GlApi gl_api;
+
+// looks every function up with `get_proc_address`, or with dlsym() in the already loaded GL library if it's nullptr.
+// returns false and leaves the table alone if any of them is missing.
+bool gl_backend_load_real(void* (*get_proc_address)(const char* name));
+void gl_backend_load_null();
+// true once one of the above has filled the table
+bool gl_backend_loaded();
+
+// routes the calls through counters on their way to the loaded backend, until gl_backend_stop_recording()
+void gl_backend_record();
+void gl_backend_stop_recording();
+// calls per GlFunction since recording started or the last reset
+const unsigned* gl_recording_counts();
+void gl_recording_reset();
+
+// "glXxx"
+const char* gl_function_name(GlFunction function);
+
+#define glActiveTexture gl_api.ActiveTexture
+#define glAttachShader gl_api.AttachShader
+#define glBeginQuery gl_api.BeginQuery
+#define glBindBuffer gl_api.BindBuffer
+#define glBindBufferBase gl_api.BindBufferBase
+#define glBindTexture gl_api.BindTexture
+#define glBindVertexArray gl_api.BindVertexArray
+#define glBufferData gl_api.BufferData
+#define glBufferSubData gl_api.BufferSubData
+#define glClear gl_api.Clear
+#define glClearColor gl_api.ClearColor
+#define glCompileShader gl_api.CompileShader
+#define glCreateProgram gl_api.CreateProgram
+#define glCreateShader gl_api.CreateShader
+#define glCullFace gl_api.CullFace
+#define glDeleteBuffers gl_api.DeleteBuffers
+#define glDeleteProgram gl_api.DeleteProgram
+#define glDeleteQueries gl_api.DeleteQueries
+#define glDeleteShader gl_api.DeleteShader
+#define glDeleteTextures gl_api.DeleteTextures
+#define glDeleteVertexArrays gl_api.DeleteVertexArrays
+#define glDepthFunc gl_api.DepthFunc
+#define glDetachShader gl_api.DetachShader
+#define glDisable gl_api.Disable
+#define glDisableVertexAttribArray gl_api.DisableVertexAttribArray
+#define glDrawArrays gl_api.DrawArrays
+#define glEnable gl_api.Enable
+#define glEnableVertexAttribArray gl_api.EnableVertexAttribArray
+#define glEndQuery gl_api.EndQuery
+#define glFinish gl_api.Finish
+#define glGenBuffers gl_api.GenBuffers
+#define glGenQueries gl_api.GenQueries
+#define glGenTextures gl_api.GenTextures
+#define glGenVertexArrays gl_api.GenVertexArrays
+#define glGetActiveUniform gl_api.GetActiveUniform
+#define glGetActiveUniformsiv gl_api.GetActiveUniformsiv
+#define glGetError gl_api.GetError
+#define glGetProgramInfoLog gl_api.GetProgramInfoLog
+#define glGetProgramiv gl_api.GetProgramiv
+#define glGetQueryObjectiv gl_api.GetQueryObjectiv
+#define glGetQueryObjectui64v gl_api.GetQueryObjectui64v
+#define glGetShaderInfoLog gl_api.GetShaderInfoLog
+#define glGetShaderiv gl_api.GetShaderiv
+#define glGetString gl_api.GetString
+#define glGetUniformBlockIndex gl_api.GetUniformBlockIndex
+#define glGetUniformLocation gl_api.GetUniformLocation
+#define glLinkProgram gl_api.LinkProgram
+#define glMapBufferRange gl_api.MapBufferRange
+#define glMultiDrawElementsBaseVertex gl_api.MultiDrawElementsBaseVertex
+#define glPixelStorei gl_api.PixelStorei
+#define glPolygonMode gl_api.PolygonMode
+#define glShaderSource gl_api.ShaderSource
+#define glTexImage2D gl_api.TexImage2D
+#define glTexParameteri gl_api.TexParameteri
+#define glTexSubImage2D gl_api.TexSubImage2D
+#define glUniform1i gl_api.Uniform1i
+#define glUniform3fv gl_api.Uniform3fv
+#define glUniformBlockBinding gl_api.UniformBlockBinding
+#define glUniformMatrix4fv gl_api.UniformMatrix4fv
+#define glUnmapBuffer gl_api.UnmapBuffer
+#define glUseProgram gl_api.UseProgram
+#define glVertexAttribPointer gl_api.VertexAttribPointer
+#define glViewport gl_api.Viewport
@@ -0,0 +1,132 @@
+#pragma once
+#include "simd.h"
+#include <math.h>
+
+// packet kernels that test one ray against 4 or 8 triangles or boxes at once. the packets are SoA, `[axis][lane]`.
+// config.h has no 8-wide backend so the 8-wide packets are two 4-wide halves, which still gives the compiler two
+// independent dependency chains to interleave.
+
+// Moller-Trumbore form: the first vertex and the two edges leaving it. unused lanes are all zero, which never hits.
+struct TriPacket4 {
+  float v0[3][4];
+  float e1[3][4];
+  float e2[3][4];
+};
+
+struct TriPacket8 {
+  TriPacket4 half[2];
+};
+
+// unused lanes have min > max, which never hits
+struct BoxPacket4 {
+  float bounds_min[3][4];
+  float bounds_max[3][4];
+};
+
+struct BoxPacket8 {
+  BoxPacket4 half[2];
+};
+
+// a ray splatted across the lanes. the near and far slab planes of a box are picked from the sign of the direction up
+// front, so the box test needs no min/max per axis and boxes with min > max miss.
+struct SimdRay {
+  simd4f org[3];
+  simd4f dir[3];
+  simd4f inv_dir[3];
+  simd4f org_inv_dir[3];
+  int dir_neg[3];
+};
+
+struct TriHit4 {
+  simd4f t;
+  simd4f b1;
+  simd4f b2;
+};
+
+struct TriHit8 {
+  TriHit4 half[2];
+};
+
+vectorial_inline void simd_ray_init(SimdRay* ray, const float* org, const float* dir) {
+  for (int axis = 0; axis < 3; ++axis) {
+    // keep axis-parallel rays away from 0 * inf in the slab test
+    const float inv_dir = 1.0f / (fabsf(dir[axis]) > 1e-20f ? dir[axis] : copysignf(1e-20f, dir[axis]));
+    ray->org[axis] = simd4f_splat(org[axis]);
+    ray->dir[axis] = simd4f_splat(dir[axis]);
+    ray->inv_dir[axis] = simd4f_splat(inv_dir);
+    ray->org_inv_dir[axis] = simd4f_splat(org[axis] * inv_dir);
+    ray->dir_neg[axis] = dir[axis] < 0.0f;
+  }
+}
+
+// returns a bit per lane that the ray hits with t in (0, t_max), and the hit distances and barycentrics of every lane
+vectorial_inline int intersect_tri4(const SimdRay& ray, const TriPacket4& tris, simd4f t_max, TriHit4* hit) {
+  const simd4f e1x = simd4f_uload4(tris.e1[0]);
+  const simd4f e1y = simd4f_uload4(tris.e1[1]);
+  const simd4f e1z = simd4f_uload4(tris.e1[2]);
+  const simd4f e2x = simd4f_uload4(tris.e2[0]);
+  const simd4f e2y = simd4f_uload4(tris.e2[1]);
+  const simd4f e2z = simd4f_uload4(tris.e2[2]);
+
+  // pvec = dir x e2
+  const simd4f px = simd4f_sub(simd4f_mul(ray.dir[1], e2z), simd4f_mul(ray.dir[2], e2y));
+  const simd4f py = simd4f_sub(simd4f_mul(ray.dir[2], e2x), simd4f_mul(ray.dir[0], e2z));
+  const simd4f pz = simd4f_sub(simd4f_mul(ray.dir[0], e2y), simd4f_mul(ray.dir[1], e2x));
+  const simd4f det = simd4f_madd(e1x, px, simd4f_madd(e1y, py, simd4f_mul(e1z, pz)));
+  const simd4f inv_det = simd4f_div(simd4f_splat(1.0f), det);
+
+  const simd4f tx = simd4f_sub(ray.org[0], simd4f_uload4(tris.v0[0]));
+  const simd4f ty = simd4f_sub(ray.org[1], simd4f_uload4(tris.v0[1]));
+  const simd4f tz = simd4f_sub(ray.org[2], simd4f_uload4(tris.v0[2]));
+  const simd4f b1 = simd4f_mul(simd4f_madd(tx, px, simd4f_madd(ty, py, simd4f_mul(tz, pz))), inv_det);
+
+  // qvec = tvec x e1
+  const simd4f qx = simd4f_sub(simd4f_mul(ty, e1z), simd4f_mul(tz, e1y));
+  const simd4f qy = simd4f_sub(simd4f_mul(tz, e1x), simd4f_mul(tx, e1z));
+  const simd4f qz = simd4f_sub(simd4f_mul(tx, e1y), simd4f_mul(ty, e1x));
+  const simd4f b2 =
+      simd4f_mul(simd4f_madd(ray.dir[0], qx, simd4f_madd(ray.dir[1], qy, simd4f_mul(ray.dir[2], qz))), inv_det);
+  const simd4f t = simd4f_mul(simd4f_madd(e2x, qx, simd4f_madd(e2y, qy, simd4f_mul(e2z, qz))), inv_det);
+
+  const simd4f zero = simd4f_zero();
+  simd4f mask = simd4f_cmpge(simd4f_abs(det), simd4f_splat(1e-12f));
+  mask = simd4f_and(mask, simd4f_cmpge(b1, zero));
+  mask = simd4f_and(mask, simd4f_cmpge(b2, zero));
+  mask = simd4f_and(mask, simd4f_cmple(simd4f_add(b1, b2), simd4f_splat(1.0f)));
+  mask = simd4f_and(mask, simd4f_cmpgt(t, zero));
+  mask = simd4f_and(mask, simd4f_cmplt(t, t_max));
+
+  hit->t = t;
+  hit->b1 = b1;
+  hit->b2 = b2;
+  return simd4f_movemask(mask);
+}
+
+vectorial_inline int intersect_tri8(const SimdRay& ray, const TriPacket8& tris, simd4f t_max, TriHit8* hit) {
+  const int lo = intersect_tri4(ray, tris.half[0], t_max, &hit->half[0]);
+  const int hi = intersect_tri4(ray, tris.half[1], t_max, &hit->half[1]);
+  return lo | (hi << 4);
+}
+
+// returns a bit per lane that the ray enters before t_max, and the entry distances
+vectorial_inline int intersect_box4(const SimdRay& ray, const BoxPacket4& boxes, simd4f t_max, simd4f* t_entry) {
+  simd4f t_near = simd4f_zero();
+  simd4f t_far = t_max;
+  for (int axis = 0; axis < 3; ++axis) {
+    const float* near_plane = ray.dir_neg[axis] ? boxes.bounds_max[axis] : boxes.bounds_min[axis];
+    const float* far_plane = ray.dir_neg[axis] ? boxes.bounds_min[axis] : boxes.bounds_max[axis];
+    const simd4f t0 = simd4f_sub(simd4f_mul(simd4f_uload4(near_plane), ray.inv_dir[axis]), ray.org_inv_dir[axis]);
+    const simd4f t1 = simd4f_sub(simd4f_mul(simd4f_uload4(far_plane), ray.inv_dir[axis]), ray.org_inv_dir[axis]);
+    t_near = simd4f_max(t_near, t0);
+    t_far = simd4f_min(t_far, t1);
+  }
+
+  *t_entry = t_near;
+  return simd4f_movemask(simd4f_cmple(t_near, t_far));
+}
+
+vectorial_inline int intersect_box8(const SimdRay& ray, const BoxPacket8& boxes, simd4f t_max, simd4f* t_entry) {
+  const int lo = intersect_box4(ray, boxes.half[0], t_max, &t_entry[0]);
+  const int hi = intersect_box4(ray, boxes.half[1], t_max, &t_entry[1]);
+  return lo | (hi << 4);
+}
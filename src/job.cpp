@@ -0,0 +1,176 @@
+#include "job.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct JobTask {
+  JobFunc func;
+  void* user_data;
+  int index;
+  std::atomic<int>* pending;
+};
+
+// each worker pops from the back of its own queue and steals from the front of everyone else's
+struct JobQueue {
+  std::mutex mutex;
+  std::deque<JobTask> tasks;
+};
+
+static std::vector<std::thread> s_threads;
+static JobQueue* s_queues;
+static int s_worker_count = 1;
+static std::atomic<int> s_queued_count;
+static std::atomic<bool> s_running;
+static std::mutex s_wake_mutex;
+static std::condition_variable s_wake_cond;
+
+static thread_local int s_worker_index = 0;
+
+static bool pop_task(JobTask* task, int worker_index) {
+  // own queue first, newest task first since it's most likely to still be in cache
+  {
+    JobQueue& queue = s_queues[worker_index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = queue.tasks.back();
+      queue.tasks.pop_back();
+      return true;
+    }
+  }
+
+  // steal the oldest task from someone else
+  for (int offset = 1; offset < s_worker_count; ++offset) {
+    JobQueue& queue = s_queues[(worker_index + offset) % s_worker_count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      *task = queue.tasks.front();
+      queue.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+static bool run_one_task(int worker_index) {
+  JobTask task;
+  if (!pop_task(&task, worker_index)) {
+    return false;
+  }
+  s_queued_count.fetch_sub(1, std::memory_order_relaxed);
+
+  task.func(task.user_data, task.index);
+  task.pending->fetch_sub(1, std::memory_order_release);
+  return true;
+}
+
+static void worker_main(int worker_index) {
+  s_worker_index = worker_index;
+  while (s_running.load(std::memory_order_acquire)) {
+    if (run_one_task(worker_index)) {
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(s_wake_mutex);
+    s_wake_cond.wait(lock, [] {
+      return s_queued_count.load(std::memory_order_relaxed) > 0 || !s_running.load(std::memory_order_relaxed);
+    });
+  }
+}
+
+void job_settings_init(JobSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->thread_count = 0;
+}
+
+void job_init(JobSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  int thread_count = settings->thread_count;
+  if (thread_count <= 0) {
+    thread_count = (int)std::thread::hardware_concurrency();
+  }
+  if (thread_count <= 0) {
+    thread_count = 1;
+  }
+
+  s_worker_count = thread_count;
+  s_queues = new JobQueue[thread_count];
+  s_queued_count = 0;
+  s_running = true;
+  for (int index = 1; index < thread_count; ++index) {
+    s_threads.emplace_back(worker_main, index);
+  }
+}
+
+void job_shutdown() {
+  {
+    std::lock_guard<std::mutex> lock(s_wake_mutex);
+    s_running = false;
+  }
+  s_wake_cond.notify_all();
+  for (std::thread& thread : s_threads) {
+    thread.join();
+  }
+  s_threads.clear();
+
+  delete[] s_queues;
+  s_queues = nullptr;
+  s_worker_count = 1;
+}
+
+int job_worker_count() {
+  return s_worker_count;
+}
+
+void job_parallel_for(JobFunc func, void* user_data, int count) {
+  if (count <= 0) {
+    return;
+  }
+
+  const int worker_index = s_worker_index;
+  if (!s_queues || count == 1) {
+    for (int index = 0; index < count; ++index) {
+      func(user_data, index);
+    }
+    return;
+  }
+
+  // hand each worker a contiguous block of indices so neighbouring items tend to run on the same thread, stealing
+  // evens things out when the blocks turn out to be uneven
+  std::atomic<int> pending(count);
+  for (int worker = 0; worker < s_worker_count; ++worker) {
+    const int begin = (int)(((long long)count * worker) / s_worker_count);
+    const int end = (int)(((long long)count * (worker + 1)) / s_worker_count);
+    if (begin == end) {
+      continue;
+    }
+
+    s_queued_count.fetch_add(end - begin, std::memory_order_relaxed);
+    JobQueue& queue = s_queues[(worker_index + worker) % s_worker_count];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    // pushed in reverse so the owner pops them in ascending order
+    for (int index = end - 1; index >= begin; --index) {
+      queue.tasks.push_back({func, user_data, index, &pending});
+    }
+  }
+  {
+    std::lock_guard<std::mutex> lock(s_wake_mutex);
+  }
+  s_wake_cond.notify_all();
+
+  // help out until our own batch is done
+  while (pending.load(std::memory_order_acquire) > 0) {
+    if (!run_one_task(worker_index)) {
+      std::this_thread::yield();
+    }
+  }
+}
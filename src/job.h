@@ -0,0 +1,19 @@
+#pragma once
+
+typedef void (*JobFunc)(void* user_data, int index);
+
+struct JobSettings {
+  // total number of threads taking part in the work, including the calling thread. 0 means one per core.
+  int thread_count;
+};
+
+void job_settings_init(JobSettings* settings);
+
+void job_init(JobSettings* settings);
+void job_shutdown();
+
+int job_worker_count();
+
+// runs func for every index in [0, count) and returns once they have all finished. the calling thread helps out while
+// it waits, so it is safe to call this from inside a job.
+void job_parallel_for(JobFunc func, void* user_data, int count);
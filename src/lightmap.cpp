@@ -0,0 +1,949 @@
+#include "lightmap.h"
+#include "mesh.h"
+#include "pack.h"
+#include "profile.h"
+#include "raster.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_map>
+
+static uint32_t s_brewer_colors[] = {
+    0xa6cee3ff,
+    0x1f78b4ff,
+    0xb2df8aff,
+    0x33a02cff,
+    0xfb9a99ff,
+    0xe31a1cff,
+    0xfdbf6fff,
+    0xff7f00ff,
+    0xcab2d6ff,
+    0x6a3d9aff,
+    0xffff99ff,
+    0xb15928ff,
+};
+#define BREWER_COLOR_COUNT 12
+
+static vectorial::vec2f snap_to_half(const vectorial::vec2f& pos) {
+  return vectorial::vec2f(truncf(pos.x()) + 0.5f, truncf(pos.y()) + 0.5f);
+}
+
+bool lightmap_project_triangles(std::vector<LightmapTriangle>& triangles, const Mesh* mesh) {
+  PROFILE_SCOPE("lightmap_project_triangles");
+  if (!MeshVertexFormat::matches(mesh)) {
+    return false;
+  }
+
+  triangles.reserve(mesh->index_count / 3);
+
+  for (unsigned tri_index0 = 0; tri_index0 < mesh->index_count; tri_index0 += 3) {
+    vectorial::vec3f positions[3];
+    for (int corner = 0; corner < 3; ++corner) {
+      const uint32_t vertex = mesh_index(mesh, tri_index0 + corner);
+      positions[corner] = to_vec3f(MeshVertexFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, vertex));
+    }
+
+    // find the longest edge
+    vectorial::vec3f edges[3];
+    edges[0] = positions[1] - positions[0];
+    edges[1] = positions[2] - positions[1];
+    edges[2] = positions[0] - positions[2];
+    float lengths[3];
+    lengths[0] = vectorial::length(edges[0]);
+    lengths[1] = vectorial::length(edges[1]);
+    lengths[2] = vectorial::length(edges[2]);
+    int longest_edge_index;
+    if (lengths[0] > lengths[1] && lengths[0] > lengths[2]) {
+      longest_edge_index = 0;
+    }
+    else if (lengths[1] > lengths[0] && lengths[1] > lengths[2]) {
+      longest_edge_index = 1;
+    }
+    else {
+      longest_edge_index = 2;
+    }
+
+    int sorted_indices[3];
+    sorted_indices[0] = longest_edge_index;
+    sorted_indices[1] = (longest_edge_index + 1) % 3;
+    sorted_indices[2] = (longest_edge_index + 2) % 3;
+
+    // project the triangle to an XY plane
+    vectorial::vec2f projected[3];
+    projected[0] = vectorial::vec2f::zero();
+    projected[1] = vectorial::vec2f(lengths[longest_edge_index], 0.0f);
+
+    // using the dot product, derive the projected length of the third edge
+    // dp = |a||b|cos(theta)
+    const vectorial::vec3f edge_a = vectorial::normalize(positions[sorted_indices[1]] - positions[sorted_indices[0]]);
+    const vectorial::vec3f edge_c = vectorial::normalize(positions[sorted_indices[2]] - positions[sorted_indices[0]]);
+    const float cos_ac = vectorial::dot(edge_a, edge_c);
+    const float sin_ac = sqrtf(1.0f - (cos_ac * cos_ac));
+    projected[2] = vectorial::vec2f(lengths[sorted_indices[2]] * cos_ac, lengths[sorted_indices[2]] * sin_ac);
+
+    // assuming the longest edge is on the x axis, find the height of the triangle using Heron's formula
+    //  - a = {longest edge}
+    //  - s = (a+b+c)/2
+    //  - A = sqrt(s(s-a)(s-b)(s-c))
+    //  - A = 0.5ah
+    // => h = A/(0.5a)
+    const float a = lengths[sorted_indices[0]];
+    const float b = lengths[sorted_indices[1]];
+    const float c = lengths[sorted_indices[2]];
+    const float s = (a + b + c) * 0.5f;
+    const float area = sqrtf(s * (s - a) * (s - b) * (s - c));
+    const float h = area / (0.5 * a);
+
+    LightmapTriangle tri;
+    tri.positions[0] = projected[0];
+    tri.positions[1] = projected[1];
+    tri.positions[2] = projected[2];
+    tri.width = lengths[sorted_indices[0]];
+    tri.height = h;
+    tri.mesh_tri_index = tri_index0 / 3;
+    tri.projected_edge_index = longest_edge_index;
+    tri.chart_index = -1;
+    tri.pack_index = -1;
+    triangles.push_back(tri);
+  }
+
+  return true;
+}
+
+// the welded corners of a triangle edge, smaller id first, and the triangle it belongs to
+struct ChartEdge {
+  uint64_t key;
+  unsigned tri_index;
+};
+
+struct PositionKey {
+  uint32_t bits[3];
+
+  bool operator==(const PositionKey& other) const {
+    return bits[0] == other.bits[0] && bits[1] == other.bits[1] && bits[2] == other.bits[2];
+  }
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey& key) const {
+    return (size_t)(key.bits[0] * 73856093U ^ key.bits[1] * 19349663U ^ key.bits[2] * 83492791U);
+  }
+};
+
+// the 2D convex hull of the points, counter-clockwise (Andrew's monotone chain)
+static void convex_hull(std::vector<vectorial::vec2f>& hull, std::vector<vectorial::vec2f>& points) {
+  std::sort(points.begin(), points.end(), [](const vectorial::vec2f& a, const vectorial::vec2f& b) {
+    return a.x() < b.x() || (a.x() == b.x() && a.y() < b.y());
+  });
+
+  const auto turn = [](const vectorial::vec2f& o, const vectorial::vec2f& a, const vectorial::vec2f& b) {
+    return (a.x() - o.x()) * (b.y() - o.y()) - (a.y() - o.y()) * (b.x() - o.x());
+  };
+
+  hull.clear();
+  const size_t point_count = points.size();
+  for (size_t index = 0; index < point_count; ++index) {
+    while (hull.size() >= 2 && turn(hull[hull.size() - 2], hull.back(), points[index]) <= 0.0f) {
+      hull.pop_back();
+    }
+    hull.push_back(points[index]);
+  }
+  const size_t lower_size = hull.size() + 1;
+  for (size_t index = point_count - 1; index-- > 0;) {
+    while (hull.size() >= lower_size && turn(hull[hull.size() - 2], hull.back(), points[index]) <= 0.0f) {
+      hull.pop_back();
+    }
+    hull.push_back(points[index]);
+  }
+  hull.pop_back();
+}
+
+void lightmap_chart_settings_init(LightmapChartSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->max_normal_angle = 2.0f;
+}
+
+int lightmap_build_charts(std::vector<LightmapTriangle>& triangles,
+                          const Mesh* mesh,
+                          const LightmapChartSettings* settings) {
+  PROFILE_SCOPE("lightmap_build_charts");
+  if (!MeshVertexFormat::matches(mesh)) {
+    return -1;
+  }
+  if (settings->max_normal_angle < 0.0f) {
+    for (LightmapTriangle& tri : triangles) {
+      tri.chart_index = -1;
+    }
+    return 0;
+  }
+
+  // the loader only shares bit-identical vertices, so faces meeting at a hard edge or a color seam still have their
+  // own. adjacency comes from welding identical positions instead of from the indices.
+  const unsigned tri_count = (unsigned)triangles.size();
+  std::vector<vectorial::vec3f> positions(3 * tri_count);
+  std::vector<uint32_t> position_ids(3 * tri_count);
+  std::unordered_map<PositionKey, uint32_t, PositionKeyHash> welded;
+  welded.reserve(3 * tri_count);
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    const unsigned first_corner = 3 * triangles[tri_index].mesh_tri_index;
+    for (int corner = 0; corner < 3; ++corner) {
+      const Vec3 position =
+          MeshVertexFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, mesh_index(mesh, first_corner + corner));
+      PositionKey key;
+      memcpy(key.bits, &position, sizeof(key.bits));
+      positions[3 * tri_index + corner] = to_vec3f(position);
+      position_ids[3 * tri_index + corner] =
+          welded.insert(std::make_pair(key, (uint32_t)welded.size())).first->second;
+    }
+  }
+
+  // triangles are neighbors when their edges have the same key, sorting brings them together
+  std::vector<ChartEdge> edges(3 * tri_count);
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    for (int corner = 0; corner < 3; ++corner) {
+      const uint64_t id0 = position_ids[3 * tri_index + corner];
+      const uint64_t id1 = position_ids[3 * tri_index + (corner + 1) % 3];
+      edges[3 * tri_index + corner].key = id0 < id1 ? (id0 << 32) | id1 : (id1 << 32) | id0;
+      edges[3 * tri_index + corner].tri_index = tri_index;
+    }
+  }
+  std::sort(edges.begin(), edges.end(), [](const ChartEdge& a, const ChartEdge& b) {
+    return a.key < b.key || (a.key == b.key && a.tri_index < b.tri_index);
+  });
+
+  std::vector<std::vector<unsigned>> neighbors(tri_count);
+  for (size_t begin = 0, end; begin < edges.size(); begin = end) {
+    for (end = begin + 1; end < edges.size() && edges[end].key == edges[begin].key; ++end) {
+    }
+    for (size_t a = begin; a < end; ++a) {
+      for (size_t b = begin; b < end; ++b) {
+        if (edges[a].tri_index != edges[b].tri_index) {
+          neighbors[edges[a].tri_index].push_back(edges[b].tri_index);
+        }
+      }
+    }
+  }
+
+  std::vector<vectorial::vec3f> normals(tri_count);
+  std::vector<bool> degenerate(tri_count);
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    const vectorial::vec3f* p = &positions[3 * tri_index];
+    const vectorial::vec3f n = vectorial::cross(p[1] - p[0], p[2] - p[0]);
+    const float length = vectorial::length(n);
+    degenerate[tri_index] = !(length > 0.0f);
+    normals[tri_index] = degenerate[tri_index] ? vectorial::vec3f::zero() : n / length;
+  }
+
+  // grow each chart from its first triangle, comparing against that one so the chart can't slowly bend around
+  const float min_cos = cosf(settings->max_normal_angle * 3.14159265f / 180.0f);
+  std::vector<unsigned> chart_tris;
+  std::vector<vectorial::vec2f> points;
+  std::vector<vectorial::vec2f> hull;
+  int chart_count = 0;
+  for (LightmapTriangle& tri : triangles) {
+    tri.chart_index = -1;
+  }
+  for (unsigned seed = 0; seed < tri_count; ++seed) {
+    if (triangles[seed].chart_index >= 0) {
+      continue;
+    }
+
+    const int chart_index = chart_count++;
+    const vectorial::vec3f normal = normals[seed];
+    chart_tris.clear();
+    chart_tris.push_back(seed);
+    triangles[seed].chart_index = chart_index;
+    for (size_t next = 0; next < chart_tris.size() && !degenerate[seed]; ++next) {
+      for (unsigned neighbor : neighbors[chart_tris[next]]) {
+        if (triangles[neighbor].chart_index < 0 && !degenerate[neighbor] &&
+            vectorial::dot(normals[neighbor], normal) >= min_cos) {
+          triangles[neighbor].chart_index = chart_index;
+          chart_tris.push_back(neighbor);
+        }
+      }
+    }
+
+    if (degenerate[seed]) {
+      std::copy(triangles[seed].positions, triangles[seed].positions + 3, triangles[seed].chart_positions);
+      continue;
+    }
+
+    // project onto the seed's plane
+    const vectorial::vec3f* seed_positions = &positions[3 * seed];
+    const vectorial::vec3f origin = seed_positions[0];
+    const vectorial::vec3f axis_u = vectorial::normalize(seed_positions[1] - origin);
+    const vectorial::vec3f axis_v = vectorial::cross(normal, axis_u);
+    points.clear();
+    for (unsigned tri_index : chart_tris) {
+      LightmapTriangle& tri = triangles[tri_index];
+      for (int corner = 0; corner < 3; ++corner) {
+        // positions[n] is the n-th vertex counting from the projected edge
+        const vectorial::vec3f d = positions[3 * tri_index + (tri.projected_edge_index + corner) % 3] - origin;
+        tri.chart_positions[corner] = vectorial::vec2f(vectorial::dot(d, axis_u), vectorial::dot(d, axis_v));
+        points.push_back(tri.chart_positions[corner]);
+      }
+    }
+    // the smallest bounding box has a side along one of the hull's edges
+    convex_hull(hull, points);
+    vectorial::vec2f best_axis(1.0f, 0.0f);
+    float best_area = FLT_MAX;
+    for (size_t edge = 0; edge < hull.size(); ++edge) {
+      const vectorial::vec2f axis = vectorial::normalize(hull[(edge + 1) % hull.size()] - hull[edge]);
+      const vectorial::vec2f perp(-axis.y(), axis.x());
+      float lo_u = FLT_MAX, hi_u = -FLT_MAX, lo_v = FLT_MAX, hi_v = -FLT_MAX;
+      for (const vectorial::vec2f& p : hull) {
+        lo_u = std::min(lo_u, vectorial::dot(p, axis));
+        hi_u = std::max(hi_u, vectorial::dot(p, axis));
+        lo_v = std::min(lo_v, vectorial::dot(p, perp));
+        hi_v = std::max(hi_v, vectorial::dot(p, perp));
+      }
+      const float area = (hi_u - lo_u) * (hi_v - lo_v);
+      if (area < best_area) {
+        best_area = area;
+        best_axis = axis;
+      }
+    }
+
+    const vectorial::vec2f best_perp(-best_axis.y(), best_axis.x());
+    for (unsigned tri_index : chart_tris) {
+      for (vectorial::vec2f& p : triangles[tri_index].chart_positions) {
+        p = vectorial::vec2f(vectorial::dot(p, best_axis), vectorial::dot(p, best_perp));
+      }
+    }
+  }
+
+  return chart_count;
+}
+
+// a group of triangles packed as one rectangle. `island_tris` holds its triangles and `local` their island space
+// positions, in LightmapTriangle::positions corner order, with the island bounds starting at the origin.
+struct LightmapIsland {
+  unsigned first;
+  unsigned count;
+  float width;
+  float height;
+};
+
+struct LightmapIslands {
+  std::vector<LightmapIsland> islands;
+  std::vector<unsigned> island_tris;
+  std::vector<vectorial::vec2f> local;  // 3 per triangle, indexed by triangle
+};
+
+// a triangle laid out in 2D with its bounds, for fitting two triangles into one rectangle
+struct PairFrame {
+  vectorial::vec2f p[3];
+  float x_min;
+  float x_max;
+  float y_min;
+  float y_max;
+  float top_x;  // x of the highest corner
+};
+
+static void pair_frame_bounds(PairFrame* frame) {
+  frame->x_min = frame->y_min = FLT_MAX;
+  frame->x_max = frame->y_max = -FLT_MAX;
+  for (int corner = 0; corner < 3; ++corner) {
+    const vectorial::vec2f& p = frame->p[corner];
+    frame->x_min = std::min(frame->x_min, p.x());
+    frame->x_max = std::max(frame->x_max, p.x());
+    if (p.y() > frame->y_max) {
+      frame->top_x = p.x();
+    }
+    frame->y_min = std::min(frame->y_min, p.y());
+    frame->y_max = std::max(frame->y_max, p.y());
+  }
+}
+
+// lays the triangle out with `edge` on the x axis and the opposite corner above it, then optionally flips it upside
+// down and/or mirrors it left to right
+static void pair_frame_init(PairFrame* frame, const vectorial::vec2f* positions, int edge, bool flip_y, bool mirror_x) {
+  const vectorial::vec2f origin = positions[edge];
+  const vectorial::vec2f axis = vectorial::normalize(positions[(edge + 1) % 3] - origin);
+  const vectorial::vec2f apex = positions[(edge + 2) % 3] - origin;
+  const float apex_side = axis.x() * apex.y() - axis.y() * apex.x();
+  const float sign_y = (apex_side < 0.0f) != flip_y ? -1.0f : 1.0f;
+  const float sign_x = mirror_x ? -1.0f : 1.0f;
+  for (int corner = 0; corner < 3; ++corner) {
+    const vectorial::vec2f d = positions[corner] - origin;
+    frame->p[corner] =
+        vectorial::vec2f(sign_x * vectorial::dot(d, axis), sign_y * (axis.x() * d.y() - axis.y() * d.x()));
+  }
+  pair_frame_bounds(frame);
+}
+
+// the lowest and highest point of the triangle on the vertical line at x, which is clamped to the triangle's bounds
+static void pair_frame_span(const PairFrame& frame, float x, float* lo, float* hi) {
+  x = std::min(std::max(x, frame.x_min), frame.x_max);
+  *lo = FLT_MAX;
+  *hi = -FLT_MAX;
+  for (int edge = 0; edge < 3; ++edge) {
+    const vectorial::vec2f& a = frame.p[edge];
+    const vectorial::vec2f& b = frame.p[(edge + 1) % 3];
+    if (x < std::min(a.x(), b.x()) || x > std::max(a.x(), b.x())) {
+      continue;
+    }
+    const float y0 = a.x() == b.x() ? a.y() : a.y() + (b.y() - a.y()) * (x - a.x()) / (b.x() - a.x());
+    const float y1 = a.x() == b.x() ? b.y() : y0;
+    *lo = std::min(*lo, std::min(y0, y1));
+    *hi = std::max(*hi, std::max(y0, y1));
+  }
+}
+
+// how far up `b` shifted right by `offset_x` has to go to stay `padding` texels clear of `a` in both axes. the top of
+// a grown by the padding is concave and the bottom of b convex, so the distance peaks at one of their corners.
+static float pair_lift(const PairFrame& a, const PairFrame& b, float offset_x, float padding) {
+  const float lo = std::max(a.x_min - padding, b.x_min + offset_x);
+  const float hi = std::min(a.x_max + padding, b.x_max + offset_x);
+  float lift = a.y_min - b.y_min;
+  if (lo > hi) {
+    return lift;
+  }
+
+  float candidates[11];
+  for (int corner = 0; corner < 3; ++corner) {
+    candidates[3 * corner + 0] = a.p[corner].x() - padding;
+    candidates[3 * corner + 1] = a.p[corner].x() + padding;
+    candidates[3 * corner + 2] = b.p[corner].x() + offset_x;
+  }
+  candidates[9] = lo;
+  candidates[10] = hi;
+  for (float x : candidates) {
+    x = std::min(std::max(x, lo), hi);
+
+    // highest point of a within the padding around x
+    const float window_lo = std::max(x - padding, a.x_min);
+    const float window_hi = std::min(x + padding, a.x_max);
+    float a_lo, a_hi, b_lo, b_hi;
+    pair_frame_span(a, std::min(std::max(a.top_x, window_lo), window_hi), &a_lo, &a_hi);
+    pair_frame_span(b, x - offset_x, &b_lo, &b_hi);
+    lift = std::max(lift, a_hi + padding - b_lo);
+  }
+  return lift;
+}
+
+static float padded_area(float width, float height, int padding) {
+  return (ceilf(width) + padding) * (ceilf(height) + padding);
+}
+
+// finds the tightest rectangle holding both triangles, trying every edge of each against each other. returns its
+// padded area, or FLT_MAX if the triangles are degenerate.
+static float pair_fit(const LightmapTriangle& tri_a,
+                      const LightmapTriangle& tri_b,
+                      int padding,
+                      vectorial::vec2f* local_a,
+                      vectorial::vec2f* local_b,
+                      float* width,
+                      float* height) {
+  float best_area = FLT_MAX;
+  for (int edge_a = 0; edge_a < 3; ++edge_a) {
+    PairFrame a;
+    pair_frame_init(&a, tri_a.positions, edge_a, false, false);
+    for (int orientation = 0; orientation < 12; ++orientation) {
+      PairFrame b;
+      pair_frame_init(&b, tri_b.positions, orientation % 3, (orientation / 3) & 1, (orientation / 6) & 1);
+
+      // line b up with either side of a
+      const float offsets[2] = {a.x_min - b.x_min, a.x_max - b.x_max};
+      for (float offset_x : offsets) {
+        const float lift = pair_lift(a, b, offset_x, (float)padding);
+        const float x_min = std::min(a.x_min, b.x_min + offset_x);
+        const float y_min = std::min(a.y_min, b.y_min + lift);
+        const float pair_width = std::max(a.x_max, b.x_max + offset_x) - x_min;
+        const float pair_height = std::max(a.y_max, b.y_max + lift) - y_min;
+        const float area = padded_area(pair_width, pair_height, padding);
+        if (!(area < best_area)) {
+          continue;
+        }
+
+        best_area = area;
+        *width = pair_width;
+        *height = pair_height;
+        for (int corner = 0; corner < 3; ++corner) {
+          local_a[corner] = a.p[corner] - vectorial::vec2f(x_min, y_min);
+          local_b[corner] = b.p[corner] + vectorial::vec2f(offset_x - x_min, lift - y_min);
+        }
+      }
+    }
+  }
+  return best_area;
+}
+
+// makes one island per chart, and one per remaining triangle except where two triangles of similar size nest into a
+// rectangle smaller than their two padded boxes. the islands come out tallest first.
+static void lightmap_build_islands(LightmapIslands* out, const std::vector<LightmapTriangle>& triangles, int padding) {
+  // only look for partners among the next few triangles of similar width, it's quadratic otherwise
+  const int pair_window = 4;
+
+  const unsigned tri_count = (unsigned)triangles.size();
+  std::vector<unsigned> order(tri_count);
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    order[tri_index] = tri_index;
+  }
+  std::sort(order.begin(), order.end(), [&triangles](unsigned a, unsigned b) {
+    return triangles[a].width > triangles[b].width;
+  });
+
+  out->islands.clear();
+  out->island_tris.clear();
+  out->local.resize(3 * tri_count);
+  std::vector<bool> used(tri_count, false);
+
+  // charts of more than one triangle are islands as they are, the rest get paired up
+  std::vector<unsigned> chart_sizes;
+  std::vector<unsigned> charted;
+  for (const LightmapTriangle& tri : triangles) {
+    if (tri.chart_index >= (int)chart_sizes.size()) {
+      chart_sizes.resize(tri.chart_index + 1, 0);
+    }
+    if (tri.chart_index >= 0) {
+      ++chart_sizes[tri.chart_index];
+    }
+  }
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    const int chart_index = triangles[tri_index].chart_index;
+    if (chart_index >= 0 && chart_sizes[chart_index] > 1) {
+      charted.push_back(tri_index);
+    }
+  }
+  std::stable_sort(charted.begin(), charted.end(), [&triangles](unsigned a, unsigned b) {
+    return triangles[a].chart_index < triangles[b].chart_index;
+  });
+  for (size_t begin = 0, end; begin < charted.size(); begin = end) {
+    const int chart_index = triangles[charted[begin]].chart_index;
+    vectorial::vec2f lo(FLT_MAX, FLT_MAX);
+    vectorial::vec2f hi(-FLT_MAX, -FLT_MAX);
+    for (end = begin; end < charted.size() && triangles[charted[end]].chart_index == chart_index; ++end) {
+      for (const vectorial::vec2f& p : triangles[charted[end]].chart_positions) {
+        lo = vectorial::min(lo, p);
+        hi = vectorial::max(hi, p);
+      }
+    }
+
+    LightmapIsland island;
+    island.first = (unsigned)out->island_tris.size();
+    island.count = (unsigned)(end - begin);
+    island.width = hi.x() - lo.x();
+    island.height = hi.y() - lo.y();
+    for (size_t ref = begin; ref < end; ++ref) {
+      const unsigned tri_index = charted[ref];
+      used[tri_index] = true;
+      out->island_tris.push_back(tri_index);
+      for (int corner = 0; corner < 3; ++corner) {
+        out->local[3 * tri_index + corner] = triangles[tri_index].chart_positions[corner] - lo;
+      }
+    }
+    out->islands.push_back(island);
+  }
+
+  for (unsigned order_index = 0; order_index < tri_count; ++order_index) {
+    const unsigned tri_index = order[order_index];
+    if (used[tri_index]) {
+      continue;
+    }
+    used[tri_index] = true;
+
+    LightmapIsland island;
+    island.first = (unsigned)out->island_tris.size();
+    island.count = 1;
+    out->island_tris.push_back(tri_index);
+
+    const LightmapTriangle& tri = triangles[tri_index];
+    const float single_area = padded_area(tri.width, tri.height, padding);
+    float best_saving = 0.0f;
+    unsigned best_partner = tri_count;
+    vectorial::vec2f local[6];
+    int candidates = 0;
+    for (unsigned next = order_index + 1; next < tri_count && candidates < pair_window; ++next) {
+      const unsigned partner = order[next];
+      if (used[partner]) {
+        continue;
+      }
+      ++candidates;
+
+      const LightmapTriangle& other = triangles[partner];
+      vectorial::vec2f pair_local[6];
+      // pair_fit() leaves them alone when no placement beats FLT_MAX
+      float width = 0.0f;
+      float height = 0.0f;
+      const float pair_area = pair_fit(tri, other, padding, pair_local, pair_local + 3, &width, &height);
+      const float saving = single_area + padded_area(other.width, other.height, padding) - pair_area;
+      if (saving > best_saving) {
+        best_saving = saving;
+        best_partner = partner;
+        island.width = width;
+        island.height = height;
+        std::copy(pair_local, pair_local + 6, local);
+      }
+    }
+
+    if (best_partner < tri_count) {
+      used[best_partner] = true;
+      island.count = 2;
+      out->island_tris.push_back(best_partner);
+      std::copy(local, local + 3, &out->local[3 * tri_index]);
+      std::copy(local + 3, local + 6, &out->local[3 * best_partner]);
+    }
+    else {
+      // the projection already puts the longest edge along the x axis with the triangle above it
+      PairFrame frame;
+      std::copy(tri.positions, tri.positions + 3, frame.p);
+      pair_frame_bounds(&frame);
+      island.width = frame.x_max - frame.x_min;
+      island.height = frame.y_max - frame.y_min;
+      for (int corner = 0; corner < 3; ++corner) {
+        out->local[3 * tri_index + corner] = frame.p[corner] - vectorial::vec2f(frame.x_min, frame.y_min);
+      }
+    }
+    out->islands.push_back(island);
+  }
+
+  std::stable_sort(out->islands.begin(), out->islands.end(), [](const LightmapIsland& a, const LightmapIsland& b) {
+    return a.height > b.height;
+  });
+}
+
+static bool lightmap_pack_skyline(std::vector<LightmapTriangle>& triangles,
+                                  const LightmapIslands& islands,
+                                  int padding,
+                                  int tex_width,
+                                  int tex_height) {
+  const unsigned island_count = (unsigned)islands.islands.size();
+  std::vector<PackRect> rects(island_count);
+  for (unsigned island_index = 0; island_index < island_count; ++island_index) {
+    const LightmapIsland& island = islands.islands[island_index];
+    rects[island_index].width = (int)ceilf(island.width) + padding;
+    rects[island_index].height = (int)ceilf(island.height) + padding;
+  }
+  if (!pack_skyline(rects.data(), island_count, tex_width, tex_height, true)) {
+    return false;
+  }
+
+  const vectorial::vec2f tex_scale(1.0f / tex_width, 1.0f / tex_height);
+  int pack_index = 0;
+  for (unsigned island_index = 0; island_index < island_count; ++island_index) {
+    const LightmapIsland& island = islands.islands[island_index];
+    const PackRect& rect = rects[island_index];
+
+    // the padding is split between both sides of the island
+    const vectorial::vec2f offset(rect.x + 0.5f * padding, rect.y + 0.5f * padding);
+    for (unsigned ref = island.first; ref < island.first + island.count; ++ref) {
+      const unsigned tri_index = islands.island_tris[ref];
+      LightmapTriangle& tri = triangles[tri_index];
+      for (int corner = 0; corner < 3; ++corner) {
+        vectorial::vec2f pos = islands.local[3 * tri_index + corner];
+        if (rect.rotated) {
+          pos = vectorial::vec2f(island.height - pos.y(), pos.x());
+        }
+        tri.uvs[corner] = (pos + offset) * tex_scale;
+      }
+      tri.pack_index = pack_index++;
+    }
+  }
+  return true;
+}
+
+static bool lightmap_pack_shelf(std::vector<LightmapTriangle>& triangles, int padding, int tex_width, int tex_height) {
+  const vectorial::vec2f tex_scale(1.0f / tex_width, 1.0f / tex_height);
+
+  // reverse sort the triangles by height
+  std::sort(triangles.begin(), triangles.end(), [](const LightmapTriangle& a, const LightmapTriangle& b) {
+    return a.height > b.height;
+  });
+
+  bool fits = true;
+  bool flip = false;
+  float dp_prev = 1.0f;
+  int row_height = -1.0f;
+  int u_top = 0;
+  int u_bottom = 0;
+  int v = 0;
+  const int tri_count = (int)triangles.size();
+  for (int tri_index = 0; tri_index < tri_count; ++tri_index) {
+    LightmapTriangle& tri = triangles[tri_index];
+
+    // extract the triangle positions
+    vectorial::vec2f pos0 = tri.positions[0];
+    vectorial::vec2f pos1 = tri.positions[1];
+    vectorial::vec2f pos2 = tri.positions[2];
+
+    // determine the relationship between the current triangle's angle and the previous one. if the current angle is
+    // smaller, the next triangle can fit starting from the top of the previous, otherwise it must start from the bottom
+    // of the previous
+    const vectorial::vec2f vec_10 = vectorial::normalize(pos0 - pos1);
+    const vectorial::vec2f vec_12 = vectorial::normalize(pos2 - pos1);
+    const float dp = vectorial::dot(vec_12, vec_10);
+    int u;
+    if (dp < dp_prev) {
+      // offset from the base
+      u = u_bottom;
+    }
+    else {
+      // offset from the top
+      u = u_top;
+    }
+
+    // compute the rectangular bounds (rounded to nearest integer)
+    const int32_t tri_width = (int32_t)(pos1.x() + 0.5f);
+    const int32_t tri_height = (int32_t)(pos2.y() + 0.5f);
+
+    // if this is the first iteration, set the initial row_height;
+    if (tri_index == 0) {
+      row_height = tri_height;
+    }
+
+    // if adding this will wrap us around the end of the buffer, start a new row
+    if (u + tri_width > tex_width) {
+      u = 0;
+      v += row_height + padding;
+      row_height = tri_height;
+      flip = false;
+    }
+
+    // the row is as tall as its first triangle, so it's enough to check that one. a triangle wider than the atlas
+    // overflows the row it starts.
+    fits = fits && v + row_height < tex_height && u + tri_width < tex_width;
+
+    // mirror the triangle over the diagonal
+    if (flip) {
+      vectorial::vec2f old_pos0 = pos0;
+      vectorial::vec2f old_pos1 = pos1;
+      vectorial::vec2f old_pos2 = pos2;
+
+      pos0 = old_pos1;
+      pos1 = old_pos0;
+      const float pos2_x_offset = (old_pos2.x() - old_pos0.x());
+      pos2 = vectorial::vec2f(old_pos1.x() - pos2_x_offset, -old_pos2.y());
+
+      // add an offset to account for being attached to the top of the row
+      vectorial::vec2f offset_y(0.0f, row_height);
+      pos0 += offset_y;
+      pos1 += offset_y;
+      pos2 += offset_y;
+    }
+
+    // snap the verts to texel centers
+    pos0 = snap_to_half(pos0);
+    pos1 = snap_to_half(pos1);
+    pos2 = snap_to_half(pos2);
+
+    // place the triangle in the correct spot on the map
+    vectorial::vec2f uv_offset(u, v);
+    tri.uvs[0] = (pos0 + uv_offset) * tex_scale;
+    tri.uvs[1] = (pos1 + uv_offset) * tex_scale;
+    tri.uvs[2] = (pos2 + uv_offset) * tex_scale;
+    tri.pack_index = tri_index;
+
+    if (flip) {
+      u_bottom = (pos0 + uv_offset).x() + padding;
+    }
+    else {
+      u_bottom = (pos1 + uv_offset).x() + padding;
+    }
+    u_top = (pos2 + uv_offset).x() + padding;
+    dp_prev = dp;
+    flip = !flip;
+  }
+
+  // sort the triangles by mesh order
+  std::sort(triangles.begin(), triangles.end(), [](const LightmapTriangle& a, const LightmapTriangle& b) {
+    return a.mesh_tri_index < b.mesh_tri_index;
+  });
+  return fits;
+}
+
+void lightmap_pack_settings_init(LightmapPackSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->packer = LIGHTMAP_PACKER_SKYLINE;
+  settings->padding = 2;
+  settings->tex_width = 0;
+  settings->tex_height = 0;
+  settings->max_size = 4096;
+}
+
+bool lightmap_pack(std::vector<LightmapTriangle>& triangles,
+                   const LightmapPackSettings* settings,
+                   LightmapPackResult* result) {
+  PROFILE_SCOPE("lightmap_pack");
+  const int padding = settings->padding;
+
+  // islands only depend on the padding, so they are built once for all the sizes tried. the skyline packer keeps the
+  // triangles in mesh order already.
+  LightmapIslands islands;
+  float min_area = 0.0f;
+  float tri_area = 0.0f;
+  if (settings->packer == LIGHTMAP_PACKER_SKYLINE) {
+    lightmap_build_islands(&islands, triangles, padding);
+    for (const LightmapIsland& island : islands.islands) {
+      min_area += padded_area(island.width, island.height, padding);
+    }
+  }
+  for (const LightmapTriangle& tri : triangles) {
+    tri_area += 0.5f * tri.width * tri.height;
+    if (settings->packer == LIGHTMAP_PACKER_SHELF) {
+      min_area += padded_area(tri.width, tri.height, padding);
+    }
+  }
+
+  const auto pack = [&](int tex_width, int tex_height) {
+    for (LightmapTriangle& tri : triangles) {
+      tri.pack_index = -1;
+    }
+    if (settings->packer == LIGHTMAP_PACKER_SHELF) {
+      return lightmap_pack_shelf(triangles, padding, tex_width, tex_height);
+    }
+    return lightmap_pack_skyline(triangles, islands, padding, tex_width, tex_height);
+  };
+
+  result->tex_width = settings->tex_width;
+  result->tex_height = settings->tex_height;
+  bool fits = false;
+  if (settings->tex_width > 0 && settings->tex_height > 0) {
+    fits = pack(settings->tex_width, settings->tex_height);
+  }
+  else {
+    // square and 2:1 powers of two by increasing area, skipping the ones too small to possibly fit
+    for (int size = 16; size <= settings->max_size && !fits; size *= 2) {
+      for (int wide = 0; wide < 2 && !fits; ++wide) {
+        const int tex_width = wide ? 2 * size : size;
+        if (tex_width > settings->max_size || (float)tex_width * size < min_area) {
+          continue;
+        }
+        result->tex_width = tex_width;
+        result->tex_height = size;
+        fits = pack(tex_width, size);
+      }
+    }
+  }
+
+  result->utilization = fits ? tri_area / ((float)result->tex_width * result->tex_height) : 0.0f;
+  if (fits) {
+    PROFILE_COUNT(PROFILE_COUNTER_TRIANGLES_PACKED, triangles.size());
+  }
+  return fits;
+}
+
+void lightmap_draw_debug(uint8_t* texels,
+                         int tex_width,
+                         int tex_height,
+                         const std::vector<LightmapTriangle>& triangles,
+                         int max_tris) {
+  const size_t tri_count = triangles.size();
+  float* uvs = (float*)malloc(std::max(tri_count, (size_t)1) * 6 * sizeof(float));
+  for (size_t tri_index = 0; tri_index < tri_count; ++tri_index) {
+    for (int corner = 0; corner < 3; ++corner) {
+      triangles[tri_index].uvs[corner].store(uvs + 6 * tri_index + 2 * corner);
+    }
+  }
+
+  RasterSettings raster_settings;
+  raster_settings_init(&raster_settings);
+  raster_settings.conservative = false;
+  int32_t* tri_ids = (int32_t*)malloc(tex_width * tex_height * sizeof(int32_t));
+  raster_triangles(tri_ids, nullptr, tex_width, tex_height, uvs, (unsigned)tri_count, &raster_settings);
+
+  for (int index = 0, texel_count = tex_width * tex_height; index < texel_count; ++index) {
+    uint8_t* texel = texels + 3 * index;
+    const int pack_index = tri_ids[index] >= 0 ? triangles[tri_ids[index]].pack_index : -1;
+    if (pack_index < 0 || (max_tris >= 0 && pack_index >= max_tris)) {
+      texel[0] = texel[1] = texel[2] = 0;
+      continue;
+    }
+
+    // choose a color
+    const uint32_t color = s_brewer_colors[pack_index % BREWER_COLOR_COUNT];
+    texel[0] = (uint8_t)((color >> 24) & 0xff);
+    texel[1] = (uint8_t)((color >> 16) & 0xff);
+    texel[2] = (uint8_t)((color >> 8) & 0xff);
+  }
+
+  free(tri_ids);
+  free(uvs);
+}
+
+void lightmap_rasterize_ids(
+    int32_t* tri_ids, uint8_t* coverage, int tex_width, int tex_height, const float* uv_data, unsigned tri_count) {
+  PROFILE_SCOPE("lightmap_rasterize_ids");
+  RasterSettings raster_settings;
+  raster_settings_init(&raster_settings);
+  raster_triangles(tri_ids, coverage, tex_width, tex_height, uv_data, tri_count, &raster_settings);
+}
+
+void lightmap_build_uvs(float* uv_data, const std::vector<LightmapTriangle>& triangles) {
+  int uv_index = 0;
+  for (const LightmapTriangle& tri : triangles) {
+    // uvs[n] belongs to the n-th vertex counting from the start of the projected edge
+    int out_index0 = tri.projected_edge_index;
+    int out_index1 = (tri.projected_edge_index + 1) % 3;
+    int out_index2 = (tri.projected_edge_index + 2) % 3;
+    tri.uvs[0].store(uv_data + 2 * (uv_index + out_index0));
+    tri.uvs[1].store(uv_data + 2 * (uv_index + out_index1));
+    tri.uvs[2].store(uv_data + 2 * (uv_index + out_index2));
+    uv_index += 3;
+  }
+}
+
+void lightmap_split_vertices(Mesh* mesh, const float* uv_data, std::vector<float>& vertex_uvs) {
+  PROFILE_SCOPE("lightmap_split_vertices");
+  const unsigned stride = vertex_stride(mesh->channels, mesh->channel_count);
+
+  // each vertex keeps the uv of its first corner, corners with another uv get a copy of it. the copies of a vertex
+  // are chained so corners with the same uv end up sharing one.
+  const unsigned vertex_count = mesh->vertex_count;
+  std::vector<int> copy_of;       // source vertex of every added vertex
+  std::vector<int> next_copy(vertex_count, -1);
+  vertex_uvs.assign(2 * vertex_count, 0.0f);
+  std::vector<bool> assigned(vertex_count, false);
+  std::vector<uint32_t> split_indices(mesh->index_count);
+  for (unsigned corner = 0; corner < mesh->index_count; ++corner) {
+    const float* uv = uv_data + 2 * corner;
+    int vertex = (int)mesh_index(mesh, corner);
+    if (!assigned[vertex]) {
+      assigned[vertex] = true;
+      vertex_uvs[2 * vertex + 0] = uv[0];
+      vertex_uvs[2 * vertex + 1] = uv[1];
+      split_indices[corner] = (uint32_t)vertex;
+      continue;
+    }
+
+    while (vertex_uvs[2 * vertex + 0] != uv[0] || vertex_uvs[2 * vertex + 1] != uv[1]) {
+      if (next_copy[vertex] < 0) {
+        const int source = vertex < (int)vertex_count ? vertex : copy_of[vertex - vertex_count];
+        const int copy = (int)(vertex_count + copy_of.size());
+        copy_of.push_back(source);
+        next_copy.push_back(-1);
+        vertex_uvs.push_back(uv[0]);
+        vertex_uvs.push_back(uv[1]);
+        next_copy[vertex] = copy;
+      }
+      vertex = next_copy[vertex];
+    }
+    split_indices[corner] = (uint32_t)vertex;
+  }
+
+  if (copy_of.empty()) {
+    return;
+  }
+
+  // the copies may push the mesh past what 16-bit indices can address
+  mesh->vertex_count = vertex_count + (unsigned)copy_of.size();
+  mesh_fit_index_size(mesh);
+  for (unsigned corner = 0; corner < mesh->index_count; ++corner) {
+    mesh_set_index(mesh, corner, split_indices[corner]);
+  }
+
+  mesh->vertices = realloc(mesh->vertices, mesh->vertex_count * stride);
+  for (size_t copy = 0; copy < copy_of.size(); ++copy) {
+    char* vertices = (char*)mesh->vertices;
+    memcpy(vertices + (vertex_count + copy) * stride, vertices + copy_of[copy] * stride, stride);
+  }
+}
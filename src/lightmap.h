@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+struct Mesh;
+
+struct LightmapTriangle {
+  vectorial::vec2f positions[3];
+  vectorial::vec2f uvs[3];
+  vectorial::vec2f chart_positions[3];  // in the chart's 2D frame, same corner order as `positions`
+  float width;
+  float height;
+  int mesh_tri_index;
+  int projected_edge_index;
+  int chart_index;  // -1 until lightmap_build_charts() puts the triangle in a chart
+  int pack_index;
+};
+
+struct LightmapChartSettings {
+  float max_normal_angle;  // degrees a triangle's normal may be off from the first triangle of its chart, negative
+                           // to leave every triangle on its own
+};
+
+// flattens every triangle of the mesh into its own 2D frame with the longest edge along the x axis
+bool lightmap_project_triangles(std::vector<LightmapTriangle>& triangles, const Mesh* mesh);
+
+void lightmap_chart_settings_init(LightmapChartSettings* settings);
+
+// groups triangles that share an edge and are (nearly) coplanar into charts and flattens each chart into one 2D frame,
+// turned to the smallest bounding box. the skyline packer places every chart as a single island. returns the number
+// of charts, or -1 if the mesh has no float3 positions.
+int lightmap_build_charts(std::vector<LightmapTriangle>& triangles,
+                          const Mesh* mesh,
+                          const LightmapChartSettings* settings);
+
+enum LightmapPacker {
+  LIGHTMAP_PACKER_SHELF,    // single triangles in rows by height, every other one flipped to nest with its neighbor
+  LIGHTMAP_PACKER_SKYLINE,  // charts, and the other triangles paired up where that saves texels, on a skyline
+};
+
+struct LightmapPackSettings {
+  LightmapPacker packer;
+  int padding;     // empty texels kept between islands
+  int tex_width;   // atlas size to pack into, 0 to pick the smallest power of two that fits
+  int tex_height;
+  int max_size;    // largest width or height tried when picking the size
+};
+
+struct LightmapPackResult {
+  int tex_width;
+  int tex_height;
+  float utilization;  // fraction of the atlas texels covered by triangles
+};
+
+void lightmap_pack_settings_init(LightmapPackSettings* settings);
+
+// assigns atlas uvs to every projected triangle at one texel per world unit. returns false if they don't fit in the
+// requested (or largest allowed) atlas, leaving the uvs undefined. the triangles are left sorted in mesh order.
+bool lightmap_pack(std::vector<LightmapTriangle>& triangles,
+                   const LightmapPackSettings* settings,
+                   LightmapPackResult* result);
+
+// fills an RGB8 image with a flat color per packed triangle. only the first `max_tris` in pack order are drawn (all of
+// them when negative).
+void lightmap_draw_debug(uint8_t* texels,
+                         int tex_width,
+                         int tex_height,
+                         const std::vector<LightmapTriangle>& triangles,
+                         int max_tris);
+
+// writes one float2 uv per triangle corner, in mesh vertex order
+void lightmap_build_uvs(float* uv_data, const std::vector<LightmapTriangle>& triangles);
+
+// gives every vertex of the mesh a single lightmap uv for drawing. vertices shared by corners that ended up in
+// different places in the atlas, along chart seams, are duplicated and the indices updated, the triangle order stays
+// the same. `vertex_uvs` gets one float2 per vertex of the updated mesh.
+void lightmap_split_vertices(Mesh* mesh, const float* uv_data, std::vector<float>& vertex_uvs);
+
+// writes the index of the triangle covering each texel, or -1 for empty texels, and optionally a RasterCoverage per
+// texel. texels that a triangle only partly overlaps count as covered, so every triangle gets at least one texel.
+// `uv_data` is laid out like the output of lightmap_build_uvs().
+void lightmap_rasterize_ids(
+    int32_t* tri_ids, uint8_t* coverage, int tex_width, int tex_height, const float* uv_data, unsigned tri_count);
@@ -0,0 +1,448 @@
+#include "app.h"
+#include "gl_backend.h"
+#include "profile.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+#if GI_DEMO_X11
+#include <X11/XKBlib.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#endif
+
+// frames the gpu timer queries get to finish before they're read back
+#define TIMER_QUERY_LATENCY 4
+
+struct DemoOptions {
+  bool offscreen;
+  bool progressive;
+  int frame_count;
+  int width;
+  int height;
+  const char* trace_filename;
+};
+
+static void print_usage() {
+  fprintf(stderr,
+          "usage: gi-demo [options]\n"
+          "\n"
+          "  -o                  render offscreen and replay the benchmark path instead of opening a window\n"
+          "  -p                  path trace the bounced light progressively instead of gathering it (F9 switches)\n"
+          "  -f frames           frames of the benchmark path (600)\n"
+          "  -s width,height     window or offscreen size (1280,720)\n"
+          "  -t trace.json       write a Chrome trace of the run when it ends (F8 writes one while it runs)\n"
+          "\n"
+          "run it from the repository root so it finds data/. the offscreen mode doesn't need a display, with Mesa it\n"
+          "renders on llvmpipe. it prints percentiles of the cpu time app_render() takes, of the gpu time of its\n"
+          "commands and of the whole frame up to glFinish(). software renderers only rasterize when the frame is\n"
+          "flushed, so there the gpu timer reads close to zero and the frame time is the one to watch.\n");
+}
+
+static bool parse_options(DemoOptions* options, int argc, char** argv) {
+  options->offscreen = false;
+  options->progressive = false;
+  options->frame_count = 600;
+  options->width = 1280;
+  options->height = 720;
+  options->trace_filename = nullptr;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "opf:s:t:h")) != -1) {
+    switch (opt) {
+      case 'o':
+        options->offscreen = true;
+        break;
+      case 'p':
+        options->progressive = true;
+        break;
+      case 'f':
+        options->frame_count = atoi(optarg);
+        break;
+      case 's':
+        if (2 != sscanf(optarg, "%d,%d", &options->width, &options->height)) {
+          return false;
+        }
+        break;
+      case 't':
+        options->trace_filename = optarg;
+        break;
+      default:
+        return false;
+    }
+  }
+  return optind == argc && options->frame_count > 0 && options->width > 0 && options->height > 0;
+}
+
+static void* egl_get_proc_address(const char* name) {
+  return (void*)eglGetProcAddress(name);
+}
+
+// a GL 3.3 core context on `display` and a config for `surface_type` surfaces
+static bool egl_create_context(EGLDisplay display, EGLint surface_type, EGLConfig* config, EGLContext* context) {
+  EGLint major;
+  EGLint minor;
+  if (!eglInitialize(display, &major, &minor) || !eglBindAPI(EGL_OPENGL_API)) {
+    fprintf(stderr, "ERROR: failed to initialize EGL (0x%04x)\n", eglGetError());
+    return false;
+  }
+
+  const EGLint config_attribs[] = {EGL_SURFACE_TYPE,
+                                   surface_type,
+                                   EGL_RENDERABLE_TYPE,
+                                   EGL_OPENGL_BIT,
+                                   EGL_RED_SIZE,
+                                   8,
+                                   EGL_GREEN_SIZE,
+                                   8,
+                                   EGL_BLUE_SIZE,
+                                   8,
+                                   EGL_DEPTH_SIZE,
+                                   24,
+                                   EGL_NONE};
+  EGLint config_count = 0;
+  if (!eglChooseConfig(display, config_attribs, config, 1, &config_count) || config_count < 1) {
+    fprintf(stderr, "ERROR: no EGL config for a GL context with a depth buffer\n");
+    return false;
+  }
+
+  const EGLint context_attribs[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                    3,
+                                    EGL_CONTEXT_MINOR_VERSION,
+                                    3,
+                                    EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                    EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                    EGL_NONE};
+  *context = eglCreateContext(display, *config, EGL_NO_CONTEXT, context_attribs);
+  if (*context == EGL_NO_CONTEXT) {
+    fprintf(stderr, "ERROR: failed to create a GL 3.3 core context (0x%04x)\n", eglGetError());
+    return false;
+  }
+  return true;
+}
+
+static bool make_current(EGLDisplay display, EGLSurface surface, EGLContext context) {
+  if (!eglMakeCurrent(display, surface, surface, context)) {
+    fprintf(stderr, "ERROR: failed to make the GL context current (0x%04x)\n", eglGetError());
+    return false;
+  }
+  if (!gl_backend_load_real(&egl_get_proc_address)) {
+    return false;
+  }
+  printf("GL: %s, %s\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+  return true;
+}
+
+// the benchmark path at `t` in [0, 1): the camera sways in front of the open side of the box while moving in and out,
+// and the light circles inside it
+static void benchmark_path_apply(float t) {
+  const float angle = 2.0f * 3.14159265f * t;
+  const float yaw = 0.4f * sinf(angle);
+  const float distance = 22.0f + 6.0f * sinf(2.0f * angle);
+  app_set_camera(distance * sinf(yaw), -distance * cosf(yaw), 10.0f, 0.0f, yaw);
+  app_set_light_position(6.0f * sinf(angle), -4.0f + 4.0f * cosf(angle), 12.0f);
+}
+
+static double percentile(const std::vector<double>& sorted, double fraction) {
+  return sorted[std::min(sorted.size() - 1, (size_t)(fraction * sorted.size()))];
+}
+
+static void print_timings(const char* name, std::vector<double>* ms) {
+  std::sort(ms->begin(), ms->end());
+  printf("%s: %.3f ms p50, %.3f ms p90, %.3f ms p99, %.3f ms max\n",
+         name,
+         percentile(*ms, 0.5),
+         percentile(*ms, 0.9),
+         percentile(*ms, 0.99),
+         ms->back());
+}
+
+// replays the path at a fixed time step, so every run renders the same frames
+static int run_benchmark(const DemoOptions& options, EGLDisplay display, EGLSurface surface) {
+  app_set_progressive_lightmap(options.progressive ? 1 : 0);
+  app_resize((float)options.width, (float)options.height);
+  const auto load_start = std::chrono::steady_clock::now();
+  app_render(0.0f);
+  const auto load_end = std::chrono::steady_clock::now();
+  printf("load: %.1f ms\n", std::chrono::duration<double, std::milli>(load_end - load_start).count());
+
+  GLuint queries[TIMER_QUERY_LATENCY];
+  glGenQueries(TIMER_QUERY_LATENCY, queries);
+  std::vector<double> cpu_ms(options.frame_count);
+  std::vector<double> gpu_ms(options.frame_count);
+  std::vector<double> frame_ms(options.frame_count);
+  for (int frame = 0; frame < options.frame_count + TIMER_QUERY_LATENCY; ++frame) {
+    GLuint& query = queries[frame % TIMER_QUERY_LATENCY];
+    if (frame >= TIMER_QUERY_LATENCY) {
+      GLuint64 elapsed_ns;
+      glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed_ns);
+      gpu_ms[frame - TIMER_QUERY_LATENCY] = elapsed_ns * 1e-6;
+    }
+    if (frame >= options.frame_count) {
+      continue;
+    }
+
+    benchmark_path_apply((float)frame / options.frame_count);
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    const auto frame_start = std::chrono::steady_clock::now();
+    app_render(1.0f / 60.0f);
+    const auto frame_end = std::chrono::steady_clock::now();
+    glEndQuery(GL_TIME_ELAPSED);
+    eglSwapBuffers(display, surface);
+    glFinish();
+    const auto finish_end = std::chrono::steady_clock::now();
+    cpu_ms[frame] = std::chrono::duration<double, std::milli>(frame_end - frame_start).count();
+    frame_ms[frame] = std::chrono::duration<double, std::milli>(finish_end - frame_start).count();
+  }
+  glDeleteQueries(TIMER_QUERY_LATENCY, queries);
+
+  printf("frames: %d at %dx%d\n", options.frame_count, options.width, options.height);
+  print_timings("cpu", &cpu_ms);
+  print_timings("gpu", &gpu_ms);
+  print_timings("frame", &frame_ms);
+  return 0;
+}
+
+static int run_offscreen(const DemoOptions& options) {
+  // surfaceless works without a display server or a gpu, fall back to the default display elsewhere
+  EGLDisplay display = EGL_NO_DISPLAY;
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+      (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (get_platform_display) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+
+  EGLConfig config;
+  EGLContext context;
+  if (!egl_create_context(display, EGL_PBUFFER_BIT, &config, &context)) {
+    eglTerminate(display);
+    return 1;
+  }
+  const EGLint surface_attribs[] = {EGL_WIDTH, options.width, EGL_HEIGHT, options.height, EGL_NONE};
+  EGLSurface surface = eglCreatePbufferSurface(display, config, surface_attribs);
+  if (surface == EGL_NO_SURFACE) {
+    fprintf(stderr, "ERROR: failed to create a %dx%d pbuffer (0x%04x)\n", options.width, options.height, eglGetError());
+    eglTerminate(display);
+    return 1;
+  }
+
+  int result = 1;
+  if (make_current(display, surface, context)) {
+    result = run_benchmark(options, display, surface);
+    app_shutdown();
+  }
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  eglDestroySurface(display, surface);
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  return result;
+}
+
+#if GI_DEMO_X11
+static bool to_app_key_code(KeySym key_sym, AppKeyCode* key) {
+  switch (key_sym) {
+    case XK_a:
+      *key = APP_KEY_CODE_A;
+      return true;
+    case XK_d:
+      *key = APP_KEY_CODE_D;
+      return true;
+    case XK_e:
+      *key = APP_KEY_CODE_E;
+      return true;
+    case XK_q:
+      *key = APP_KEY_CODE_Q;
+      return true;
+    case XK_r:
+      *key = APP_KEY_CODE_R;
+      return true;
+    case XK_s:
+      *key = APP_KEY_CODE_S;
+      return true;
+    case XK_w:
+      *key = APP_KEY_CODE_W;
+      return true;
+    case XK_Up:
+      *key = APP_KEY_CODE_UP;
+      return true;
+    case XK_Down:
+      *key = APP_KEY_CODE_DOWN;
+      return true;
+    case XK_Left:
+      *key = APP_KEY_CODE_LEFT;
+      return true;
+    case XK_Right:
+      *key = APP_KEY_CODE_RIGHT;
+      return true;
+    case XK_Alt_L:
+      *key = APP_KEY_CODE_LALT;
+      return true;
+    case XK_Control_L:
+      *key = APP_KEY_CODE_LCONTROL;
+      return true;
+    case XK_Shift_L:
+      *key = APP_KEY_CODE_LSHIFT;
+      return true;
+    case XK_Alt_R:
+      *key = APP_KEY_CODE_RALT;
+      return true;
+    case XK_Control_R:
+      *key = APP_KEY_CODE_RCONTROL;
+      return true;
+    case XK_Shift_R:
+      *key = APP_KEY_CODE_RSHIFT;
+      return true;
+    case XK_minus:
+      *key = APP_KEY_CODE_MINUS;
+      return true;
+    case XK_equal:
+      *key = APP_KEY_CODE_EQUAL;
+      return true;
+    default:
+      // the function keys are contiguous in both
+      if (key_sym >= XK_F1 && key_sym <= XK_F12) {
+        *key = (AppKeyCode)(APP_KEY_CODE_F1 + (key_sym - XK_F1));
+        return true;
+      }
+      return false;
+  }
+}
+
+static int run_window(const DemoOptions& options) {
+  Display* x_display = XOpenDisplay(nullptr);
+  if (!x_display) {
+    fprintf(stderr, "ERROR: can't open the X display, try -o to render offscreen\n");
+    return 1;
+  }
+
+  EGLDisplay display = eglGetDisplay((EGLNativeDisplayType)x_display);
+  EGLConfig config;
+  EGLContext context;
+  if (display == EGL_NO_DISPLAY || !egl_create_context(display, EGL_WINDOW_BIT, &config, &context)) {
+    XCloseDisplay(x_display);
+    return 1;
+  }
+
+  // the window needs the visual of the config
+  EGLint visual_id;
+  eglGetConfigAttrib(display, config, EGL_NATIVE_VISUAL_ID, &visual_id);
+  XVisualInfo visual_template;
+  visual_template.visualid = (VisualID)visual_id;
+  int visual_count = 0;
+  XVisualInfo* visual = XGetVisualInfo(x_display, VisualIDMask, &visual_template, &visual_count);
+  if (!visual) {
+    fprintf(stderr, "ERROR: no X visual for the EGL config\n");
+    eglTerminate(display);
+    XCloseDisplay(x_display);
+    return 1;
+  }
+
+  const Window root = DefaultRootWindow(x_display);
+  XSetWindowAttributes window_attribs;
+  window_attribs.colormap = XCreateColormap(x_display, root, visual->visual, AllocNone);
+  window_attribs.event_mask = KeyPressMask | KeyReleaseMask | StructureNotifyMask;
+  Window window = XCreateWindow(x_display,
+                                root,
+                                0,
+                                0,
+                                options.width,
+                                options.height,
+                                0,
+                                visual->depth,
+                                InputOutput,
+                                visual->visual,
+                                CWColormap | CWEventMask,
+                                &window_attribs);
+  XFree(visual);
+  XStoreName(x_display, window, "gi-demo");
+  Atom wm_delete_window = XInternAtom(x_display, "WM_DELETE_WINDOW", False);
+  XSetWMProtocols(x_display, window, &wm_delete_window, 1);
+  // held keys shouldn't turn into release and press pairs
+  XkbSetDetectableAutoRepeat(x_display, True, nullptr);
+  XMapWindow(x_display, window);
+
+  EGLSurface surface = eglCreateWindowSurface(display, config, (EGLNativeWindowType)window, nullptr);
+  int result = 1;
+  if (surface != EGL_NO_SURFACE && make_current(display, surface, context)) {
+    result = 0;
+    app_set_progressive_lightmap(options.progressive ? 1 : 0);
+    app_resize((float)options.width, (float)options.height);
+    auto last_frame = std::chrono::steady_clock::now();
+    for (bool running = true; running;) {
+      while (XPending(x_display)) {
+        XEvent event;
+        XNextEvent(x_display, &event);
+        AppKeyCode key;
+        switch (event.type) {
+          case KeyPress:
+          case KeyRelease:
+            if (to_app_key_code(XLookupKeysym(&event.xkey, 0), &key)) {
+              if (event.type == KeyPress) {
+                app_input_key_down(key);
+              }
+              else {
+                app_input_key_up(key);
+              }
+            }
+            break;
+          case ConfigureNotify:
+            app_resize((float)event.xconfigure.width, (float)event.xconfigure.height);
+            break;
+          case ClientMessage:
+            running = (Atom)event.xclient.data.l[0] != wm_delete_window;
+            break;
+        }
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      const float dt = std::chrono::duration<float>(now - last_frame).count();
+      last_frame = now;
+      app_render(dt);
+      eglSwapBuffers(display, surface);
+    }
+    app_shutdown();
+  }
+  else if (surface == EGL_NO_SURFACE) {
+    fprintf(stderr, "ERROR: failed to create the window surface (0x%04x)\n", eglGetError());
+  }
+
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (surface != EGL_NO_SURFACE) {
+    eglDestroySurface(display, surface);
+  }
+  eglDestroyContext(display, context);
+  eglTerminate(display);
+  XDestroyWindow(x_display, window);
+  XFreeColormap(x_display, window_attribs.colormap);
+  XCloseDisplay(x_display);
+  return result;
+}
+#else
+static int run_window(const DemoOptions& options) {
+  fprintf(stderr, "ERROR: built without X11, only -o works\n");
+  return 1;
+}
+#endif
+
+int main(int argc, char** argv) {
+  DemoOptions options;
+  if (!parse_options(&options, argc, argv)) {
+    print_usage();
+    return 1;
+  }
+  int result = options.offscreen ? run_offscreen(options) : run_window(options);
+  if (options.trace_filename && !profile_write_chrome_trace(options.trace_filename)) {
+    fprintf(stderr, "ERROR: failed to write '%s'\n", options.trace_filename);
+    result = 1;
+  }
+  return result;
+}
@@ -0,0 +1,838 @@
+#include "mesh.h"
+#include "obj.h"
+#include "profile.h"
+#include "simd.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <assert.h>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static vectorial::vec3f
+normal_from_face(const vectorial::vec3f& p0, const vectorial::vec3f& p1, const vectorial::vec3f& p2) {
+  vectorial::vec3f p01 = p1 - p0;
+  vectorial::vec3f p02 = p2 - p0;
+  vectorial::vec3f cross = vectorial::cross(p01, p02);
+  vectorial::vec3f normal = vectorial::normalize(cross);
+  return normal;
+}
+
+#define MESH_CACHE_SIZE 32
+#define MESH_STREAM_WINDOW 4096
+
+static uint32_t hash_vertex(const Vertex& vertex) {
+  // FNV-1a over the bytes, the vertex has no padding
+  const uint8_t* bytes = (const uint8_t*)&vertex;
+  uint32_t hash = 2166136261U;
+  for (size_t index = 0; index < sizeof(Vertex); ++index) {
+    hash = (hash ^ bytes[index]) * 16777619U;
+  }
+  return hash;
+}
+
+static float forsyth_vertex_score(int cache_position, uint32_t remaining_tris) {
+  if (remaining_tris == 0) {
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    // the last triangle's vertices get a fixed score so the next one doesn't just reuse the same edge
+    if (cache_position < 3) {
+      score = 0.75f;
+    }
+    else {
+      score = powf(1.0f - (cache_position - 3) * (1.0f / (MESH_CACHE_SIZE - 3)), 1.5f);
+    }
+  }
+
+  // favor vertices with few triangles left so they get finished off instead of dropping out of the cache
+  return score + 2.0f / sqrtf((float)remaining_tris);
+}
+
+// reorders the triangles for the post-transform vertex cache with Tom Forsyth's "Linear-Speed Vertex Cache
+// Optimisation": greedily emit the triangle whose vertices score highest in a simulated LRU cache
+static void optimize_vertex_cache(uint32_t* indices, size_t index_count, size_t vertex_count) {
+  const size_t tri_count = index_count / 3;
+  if (tri_count == 0) {
+    return;
+  }
+
+  // triangles of each vertex
+  std::vector<uint32_t> vertex_offsets(vertex_count + 1, 0);
+  for (size_t corner = 0; corner < index_count; ++corner) {
+    ++vertex_offsets[indices[corner] + 1];
+  }
+  for (size_t vertex_index = 0; vertex_index < vertex_count; ++vertex_index) {
+    vertex_offsets[vertex_index + 1] += vertex_offsets[vertex_index];
+  }
+  std::vector<uint32_t> vertex_tris(index_count);
+  std::vector<uint32_t> remaining(vertex_count, 0);
+  for (size_t corner = 0; corner < index_count; ++corner) {
+    const uint32_t index = indices[corner];
+    vertex_tris[vertex_offsets[index] + remaining[index]++] = (uint32_t)(corner / 3);
+  }
+
+  std::vector<int> cache_positions(vertex_count, -1);
+  std::vector<float> vertex_scores(vertex_count);
+  for (size_t vertex_index = 0; vertex_index < vertex_count; ++vertex_index) {
+    vertex_scores[vertex_index] = forsyth_vertex_score(-1, remaining[vertex_index]);
+  }
+  std::vector<float> tri_scores(tri_count);
+  for (size_t tri_index = 0; tri_index < tri_count; ++tri_index) {
+    const uint32_t* tri = &indices[3 * tri_index];
+    tri_scores[tri_index] = vertex_scores[tri[0]] + vertex_scores[tri[1]] + vertex_scores[tri[2]];
+  }
+
+  std::vector<bool> emitted(tri_count, false);
+  std::vector<uint32_t> output;
+  output.reserve(index_count);
+  uint32_t cache[MESH_CACHE_SIZE + 3];
+  int cache_count = 0;
+  size_t scan_cursor = 0;
+  uint32_t best_tri = UINT32_MAX;
+  for (size_t emitted_count = 0; emitted_count < tri_count; ++emitted_count) {
+    // nothing in the cache has triangles left, start over from the next triangle in input order
+    if (best_tri == UINT32_MAX) {
+      while (emitted[scan_cursor]) {
+        ++scan_cursor;
+      }
+      best_tri = (uint32_t)scan_cursor;
+    }
+
+    const uint32_t* tri = &indices[3 * best_tri];
+    emitted[best_tri] = true;
+    output.insert(output.end(), tri, tri + 3);
+
+    // the triangle's vertices move to the front of the cache, everything else shifts back
+    uint32_t new_cache[MESH_CACHE_SIZE + 3];
+    int new_count = 0;
+    for (int corner = 0; corner < 3; ++corner) {
+      new_cache[new_count++] = tri[corner];
+
+      // take the triangle off its vertices' lists
+      const uint32_t index = tri[corner];
+      uint32_t* tris = &vertex_tris[vertex_offsets[index]];
+      for (uint32_t ref = 0; ref < remaining[index]; ++ref) {
+        if (tris[ref] == best_tri) {
+          tris[ref] = tris[--remaining[index]];
+          break;
+        }
+      }
+    }
+    for (int slot = 0; slot < cache_count; ++slot) {
+      const uint32_t index = cache[slot];
+      if (index != tri[0] && index != tri[1] && index != tri[2]) {
+        new_cache[new_count++] = index;
+      }
+    }
+
+    // rescore everything that was in the cache and the triangles around it, keeping track of the best one
+    best_tri = UINT32_MAX;
+    float best_score = -1.0f;
+    for (int slot = 0; slot < new_count; ++slot) {
+      const uint32_t index = new_cache[slot];
+      cache_positions[index] = slot < MESH_CACHE_SIZE ? slot : -1;
+      vertex_scores[index] = forsyth_vertex_score(cache_positions[index], remaining[index]);
+    }
+    for (int slot = 0; slot < new_count; ++slot) {
+      const uint32_t index = new_cache[slot];
+      for (uint32_t ref = 0; ref < remaining[index]; ++ref) {
+        const uint32_t tri_index = vertex_tris[vertex_offsets[index] + ref];
+        const uint32_t* other = &indices[3 * tri_index];
+        tri_scores[tri_index] = vertex_scores[other[0]] + vertex_scores[other[1]] + vertex_scores[other[2]];
+        if (tri_scores[tri_index] > best_score) {
+          best_score = tri_scores[tri_index];
+          best_tri = tri_index;
+        }
+      }
+    }
+
+    cache_count = std::min(new_count, MESH_CACHE_SIZE);
+    memcpy(cache, new_cache, cache_count * sizeof(uint32_t));
+  }
+
+  memcpy(indices, &output[0], index_count * sizeof(uint32_t));
+}
+
+// renumbers the vertices in the order the indices first use them, so the vertex fetches walk forward through memory
+static void optimize_vertex_fetch(Vertex* vertices, size_t vertex_count, uint32_t* indices, size_t index_count) {
+  std::vector<uint32_t> remap(vertex_count, UINT32_MAX);
+  uint32_t next_index = 0;
+  for (size_t corner = 0; corner < index_count; ++corner) {
+    uint32_t& index = indices[corner];
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = next_index++;
+    }
+    index = remap[index];
+  }
+  for (uint32_t& index : remap) {
+    if (index == UINT32_MAX) {
+      index = next_index++;
+    }
+  }
+
+  // move the vertices in place, following each cycle of the permutation
+  for (size_t vertex_index = 0; vertex_index < vertex_count; ++vertex_index) {
+    while (remap[vertex_index] != vertex_index) {
+      const uint32_t target = remap[vertex_index];
+      std::swap(vertices[vertex_index], vertices[target]);
+      std::swap(remap[vertex_index], remap[target]);
+    }
+  }
+}
+
+// the index and vertex buffers of the mesh being imported. they grow as triangles come in, bit-identical vertices are
+// welded on the way and keep their first-seen order.
+struct MeshBuilder {
+  uint32_t* indices;
+  Vertex* vertices;
+  uint32_t* table;  // open addressing with linear probing into `vertices`, at most half full
+  size_t index_count;
+  size_t index_capacity;
+  size_t vertex_count;
+  size_t vertex_capacity;
+  size_t table_size;
+};
+
+static void mesh_builder_init(MeshBuilder* builder) {
+  memset(builder, 0, sizeof(*builder));
+}
+
+static void mesh_builder_rehash(MeshBuilder* builder, size_t table_size) {
+  free(builder->table);
+  builder->table = (uint32_t*)malloc(table_size * sizeof(uint32_t));
+  builder->table_size = table_size;
+  memset(builder->table, 0xff, table_size * sizeof(uint32_t));
+  for (size_t vertex_index = 0; vertex_index < builder->vertex_count; ++vertex_index) {
+    uint32_t slot = hash_vertex(builder->vertices[vertex_index]) & (table_size - 1);
+    while (builder->table[slot] != UINT32_MAX) {
+      slot = (slot + 1) & (table_size - 1);
+    }
+    builder->table[slot] = (uint32_t)vertex_index;
+  }
+}
+
+static uint32_t mesh_builder_add_vertex(MeshBuilder* builder, Vertex vertex) {
+  // -0 and +0 compare equal but hash differently
+  float* values = &vertex.p.x;
+  for (size_t index = 0; index < sizeof(Vertex) / sizeof(float); ++index) {
+    values[index] += 0.0f;
+  }
+
+  if (2 * (builder->vertex_count + 1) > builder->table_size) {
+    mesh_builder_rehash(builder, std::max(builder->table_size * 2, (size_t)16));
+  }
+  const size_t mask = builder->table_size - 1;
+  uint32_t slot = hash_vertex(vertex) & mask;
+  while (builder->table[slot] != UINT32_MAX) {
+    if (0 == memcmp(&builder->vertices[builder->table[slot]], &vertex, sizeof(Vertex))) {
+      return builder->table[slot];
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  // grow by half rather than doubling, the buffers end up being the mesh
+  if (builder->vertex_count == builder->vertex_capacity) {
+    builder->vertex_capacity = std::max(builder->vertex_capacity + builder->vertex_capacity / 2, (size_t)256);
+    builder->vertices = (Vertex*)realloc(builder->vertices, builder->vertex_capacity * sizeof(Vertex));
+  }
+  builder->vertices[builder->vertex_count] = vertex;
+  builder->table[slot] = (uint32_t)builder->vertex_count;
+  return (uint32_t)builder->vertex_count++;
+}
+
+static void mesh_builder_add_triangle(MeshBuilder* builder, const Vertex* corners) {
+  if (builder->index_count + 3 > builder->index_capacity) {
+    builder->index_capacity = std::max(builder->index_capacity + builder->index_capacity / 2, (size_t)768);
+    builder->indices = (uint32_t*)realloc(builder->indices, builder->index_capacity * sizeof(uint32_t));
+  }
+  for (int corner = 0; corner < 3; ++corner) {
+    builder->indices[builder->index_count++] = mesh_builder_add_vertex(builder, corners[corner]);
+  }
+}
+
+// orders everything for the GPU's caches in place and hands the buffers over to the mesh
+static Mesh* mesh_builder_finish(MeshBuilder* builder) {
+  free(builder->table);
+  optimize_vertex_cache(builder->indices, builder->index_count, builder->vertex_count);
+  optimize_vertex_fetch(builder->vertices, builder->vertex_count, builder->indices, builder->index_count);
+
+  Mesh* mesh = (Mesh*)malloc(sizeof(Mesh));
+  MeshVertexFormat::describe(mesh);
+  mesh->index_count = (unsigned)builder->index_count;
+  mesh->vertex_count = (unsigned)builder->vertex_count;
+  mesh->index_size_32_bit = true;
+  mesh->indices = builder->indices;
+
+  const size_t vb_size = builder->vertex_count * MeshVertexFormat::stride;
+  mesh->vertices = realloc(builder->vertices, std::max(vb_size, (size_t)1));
+  mesh_fit_index_size(mesh);
+  return mesh;
+}
+
+// the diffuse color of every material, three floats each
+static void material_colors(std::vector<float>& colors, const tinyobj::material_t* materials, int material_count) {
+  colors.resize(3 * material_count);
+  for (int material = 0; material < material_count; ++material) {
+    memcpy(&colors[3 * material], materials[material].diffuse, 3 * sizeof(float));
+  }
+}
+
+// fills in the mesh space vertices of one triangle of the OBJ. returns false if a corner refers to a missing position.
+static bool triangle_vertices(Vertex* out,
+                              const tinyobj::index_t* corners,
+                              const std::vector<float>& positions,
+                              const std::vector<float>& normals,
+                              const std::vector<float>& colors,
+                              int material,
+                              const vectorial::mat4f& transform) {
+  const int position_count = (int)(positions.size() / 3);
+  const int normal_count = (int)(normals.size() / 3);
+  bool has_normals = true;
+  for (int corner = 0; corner < 3; ++corner) {
+    if (corners[corner].vertex_index < 0 || corners[corner].vertex_index >= position_count) {
+      return false;
+    }
+    has_normals &= corners[corner].normal_index >= 0 && corners[corner].normal_index < normal_count;
+  }
+
+  // positions
+  vectorial::vec3f pos[3];
+  for (int corner = 0; corner < 3; ++corner) {
+    pos[corner].load(&positions[3 * corners[corner].vertex_index]);
+    pos[corner] = vectorial::transformPoint(transform, pos[corner]);
+  }
+
+  // normals
+  vectorial::vec3f nor[3];
+  if (has_normals) {
+    for (int corner = 0; corner < 3; ++corner) {
+      nor[corner].load(&normals[3 * corners[corner].normal_index]);
+      nor[corner] = vectorial::transformVector(transform, nor[corner]);
+    }
+  }
+  else {
+    nor[0] = nor[1] = nor[2] = normal_from_face(pos[0], pos[1], pos[2]);
+  }
+
+  vectorial::vec3f color(0.5f);
+  if (material >= 0 && 3 * (size_t)material < colors.size()) {
+    color.load(&colors[3 * material]);
+  }
+
+  for (int corner = 0; corner < 3; ++corner) {
+    pos[corner].store(&out[corner].p.x);
+    nor[corner].store(&out[corner].n.x);
+    color.store(&out[corner].c.x);
+  }
+  return true;
+}
+
+// LoadObjWithCallback() hands over one line at a time. the faces collect in a fixed size window that gets welded into
+// the mesh whenever it fills up. the positions and normals stay around for the whole file, a face can index any of
+// them.
+struct MeshStream {
+  MeshBuilder builder;
+  vectorial::mat4f transform;
+  std::vector<float> positions;
+  std::vector<float> normals;
+  std::vector<float> colors;
+  std::vector<tinyobj::index_t> window;  // three corners per triangle
+  std::vector<int> window_materials;
+  size_t window_size;
+  int material;
+};
+
+static void mesh_stream_flush(MeshStream* stream) {
+  for (size_t tri_index = 0; tri_index < stream->window_materials.size(); ++tri_index) {
+    Vertex corners[3];
+    if (triangle_vertices(corners,
+                          &stream->window[3 * tri_index],
+                          stream->positions,
+                          stream->normals,
+                          stream->colors,
+                          stream->window_materials[tri_index],
+                          stream->transform)) {
+      mesh_builder_add_triangle(&stream->builder, corners);
+    }
+  }
+  stream->window.clear();
+  stream->window_materials.clear();
+}
+
+static void mesh_stream_vertex(void* user_data, float x, float y, float z, float w) {
+  MeshStream* stream = (MeshStream*)user_data;
+  stream->positions.push_back(x);
+  stream->positions.push_back(y);
+  stream->positions.push_back(z);
+}
+
+static void mesh_stream_normal(void* user_data, float x, float y, float z) {
+  MeshStream* stream = (MeshStream*)user_data;
+  stream->normals.push_back(x);
+  stream->normals.push_back(y);
+  stream->normals.push_back(z);
+}
+
+// the callback gets the indices as written, 1-based, negative to count back and 0 when missing
+static int mesh_stream_fix_index(int index, size_t count) {
+  if (index > 0) {
+    return index - 1;
+  }
+  return index < 0 ? (int)count + index : -1;
+}
+
+static void mesh_stream_face(void* user_data, tinyobj::index_t* indices, int index_count) {
+  MeshStream* stream = (MeshStream*)user_data;
+  for (int corner = 0; corner < index_count; ++corner) {
+    indices[corner].vertex_index = mesh_stream_fix_index(indices[corner].vertex_index, stream->positions.size() / 3);
+    indices[corner].normal_index = mesh_stream_fix_index(indices[corner].normal_index, stream->normals.size() / 3);
+  }
+
+  // fan, like tinyobj's triangulation
+  for (int corner = 2; corner < index_count; ++corner) {
+    stream->window.push_back(indices[0]);
+    stream->window.push_back(indices[corner - 1]);
+    stream->window.push_back(indices[corner]);
+    stream->window_materials.push_back(stream->material);
+    if (stream->window_materials.size() >= stream->window_size) {
+      mesh_stream_flush(stream);
+    }
+  }
+}
+
+static void mesh_stream_usemtl(void* user_data, const char* name, int material) {
+  ((MeshStream*)user_data)->material = material;
+}
+
+static void mesh_stream_mtllib(void* user_data, const tinyobj::material_t* materials, int material_count) {
+  material_colors(((MeshStream*)user_data)->colors, materials, material_count);
+}
+
+static Mesh* mesh_load_streaming(const char* filename,
+                                 const char* mtl_dirname,
+                                 const vectorial::mat4f& transform,
+                                 const MeshLoadSettings* settings) {
+  std::ifstream file(filename);
+  if (!file) {
+    std::cerr << "ERROR: Cannot open file [" << filename << "]" << std::endl;
+    return nullptr;
+  }
+
+  MeshStream stream;
+  mesh_builder_init(&stream.builder);
+  stream.transform = transform;
+  stream.window_size = std::max(settings->window_size, 1U);
+  stream.window.reserve(3 * stream.window_size);
+  stream.window_materials.reserve(stream.window_size);
+  stream.material = -1;
+
+  tinyobj::callback_t callbacks;
+  callbacks.vertex_cb = mesh_stream_vertex;
+  callbacks.normal_cb = mesh_stream_normal;
+  callbacks.index_cb = mesh_stream_face;
+  callbacks.usemtl_cb = mesh_stream_usemtl;
+  callbacks.mtllib_cb = mesh_stream_mtllib;
+  tinyobj::MaterialFileReader material_reader(mtl_dirname ? mtl_dirname : "");
+  std::string err;
+  const bool ret = tinyobj::LoadObjWithCallback(file, callbacks, &stream, &material_reader, &err);
+  if (!err.empty()) {
+    std::cerr << "ERROR: " << err << std::endl;
+  }
+  if (!ret) {
+    free(stream.builder.indices);
+    free(stream.builder.vertices);
+    free(stream.builder.table);
+    return nullptr;
+  }
+  mesh_stream_flush(&stream);
+
+  // done with the OBJ's attributes before the optimizers allocate their tables
+  std::vector<float>().swap(stream.positions);
+  std::vector<float>().swap(stream.normals);
+  return mesh_builder_finish(&stream.builder);
+}
+
+static Mesh* mesh_load_parsed(const char* filename, const char* mtl_dirname, const vectorial::mat4f& transform) {
+  MeshBuilder builder;
+  mesh_builder_init(&builder);
+  {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string err;
+    bool ret = obj_load(&attrib, &shapes, &materials, &err, filename, mtl_dirname, true);
+    if (!err.empty()) {
+      std::cerr << "ERROR: " << err << std::endl;
+    }
+    if (!ret) {
+      return nullptr;
+    }
+
+    std::vector<float> colors;
+    material_colors(colors, materials.empty() ? nullptr : &materials[0], (int)materials.size());
+    for (const tinyobj::shape_t& shape : shapes) {
+      for (size_t face = 0, face_count = shape.mesh.indices.size() / 3; face < face_count; ++face) {
+        Vertex corners[3];
+        if (triangle_vertices(corners,
+                              &shape.mesh.indices[3 * face],
+                              attrib.vertices,
+                              attrib.normals,
+                              colors,
+                              shape.mesh.material_ids[face],
+                              transform)) {
+          mesh_builder_add_triangle(&builder, corners);
+        }
+      }
+    }
+  }
+
+  return mesh_builder_finish(&builder);
+}
+
+#define CHANNEL_TYPE_CASES(trait)                                                                                      \
+  case CHANNEL_TYPE_FLOAT_3:                                                                                           \
+    return ChannelTypeTraits<CHANNEL_TYPE_FLOAT_3>::trait;                                                             \
+  case CHANNEL_TYPE_UBYTE_4:                                                                                           \
+    return ChannelTypeTraits<CHANNEL_TYPE_UBYTE_4>::trait;                                                             \
+  case CHANNEL_TYPE_UNORM16_3:                                                                                         \
+    return ChannelTypeTraits<CHANNEL_TYPE_UNORM16_3>::trait;                                                           \
+  case CHANNEL_TYPE_UNORM16_2:                                                                                         \
+    return ChannelTypeTraits<CHANNEL_TYPE_UNORM16_2>::trait;                                                           \
+  case CHANNEL_TYPE_OCT_SNORM16_2:                                                                                     \
+    return ChannelTypeTraits<CHANNEL_TYPE_OCT_SNORM16_2>::trait;                                                       \
+  case CHANNEL_TYPE_OCT_SNORM8_2:                                                                                      \
+    return ChannelTypeTraits<CHANNEL_TYPE_OCT_SNORM8_2>::trait;                                                        \
+  case CHANNEL_TYPE_UNORM16_3_PADDED:                                                                                  \
+    return ChannelTypeTraits<CHANNEL_TYPE_UNORM16_3_PADDED>::trait
+
+int channel_size(const VertexChannelDesc* channel) {
+  switch (channel->type) {
+    CHANNEL_TYPE_CASES(size);
+    default:
+      assert(false && "unknown channel type");
+      return 0;
+  }
+}
+
+int channel_elements(const VertexChannelDesc* channel) {
+  switch (channel->type) {
+    CHANNEL_TYPE_CASES(elements);
+    default:
+      assert(false && "unknown channel type");
+      return 0;
+  }
+}
+
+bool channel_normalized(const VertexChannelDesc* channel) {
+  switch (channel->type) {
+    CHANNEL_TYPE_CASES(normalized);
+    default:
+      assert(false && "unknown channel type");
+      return false;
+  }
+}
+
+#undef CHANNEL_TYPE_CASES
+
+int vertex_stride(const VertexChannelDesc* channels, int channel_count) {
+  int stride = 0;
+  for (int index = 0; index < channel_count; ++index) {
+    stride += channel_size(channels + index);
+  }
+  return stride;
+}
+
+int mesh_channel_offset(const Mesh* mesh, ChannelSemantic semantic, const VertexChannelDesc** out_channel) {
+  int offset = 0;
+  for (unsigned index = 0; index < mesh->channel_count; ++index) {
+    if (mesh->channels[index].semantic == semantic) {
+      if (out_channel) {
+        *out_channel = mesh->channels + index;
+      }
+      return offset;
+    }
+    offset += channel_size(mesh->channels + index);
+  }
+  return -1;
+}
+
+void mesh_load_settings_init(MeshLoadSettings* settings) {
+  settings->streaming = false;
+  settings->window_size = MESH_STREAM_WINDOW;
+}
+
+Mesh* mesh_load(const char* filename,
+                const char* mtl_dirname,
+                const vectorial::mat4f& transform,
+                const MeshLoadSettings* settings) {
+  PROFILE_SCOPE("mesh_load");
+  if (settings->streaming) {
+    return mesh_load_streaming(filename, mtl_dirname, transform, settings);
+  }
+  return mesh_load_parsed(filename, mtl_dirname, transform);
+}
+
+void mesh_destroy(Mesh* mesh) {
+  free(mesh->indices);
+  free(mesh->vertices);
+  free(mesh);
+}
+
+void mesh_fit_index_size(Mesh* mesh) {
+  const bool index_size_32_bit = mesh->vertex_count > MESH_MAX_16_BIT_VERTICES;
+  if (index_size_32_bit && !mesh->index_size_32_bit) {
+    // widen in place, back to front so every index is read before it gets overwritten
+    mesh->indices = realloc(mesh->indices, std::max(mesh->index_count * sizeof(uint32_t), (size_t)1));
+    for (size_t corner = mesh->index_count; corner-- > 0;) {
+      uint16_t index;
+      memcpy(&index, (const uint8_t*)mesh->indices + corner * sizeof(uint16_t), sizeof(index));
+      ((uint32_t*)mesh->indices)[corner] = index;
+    }
+  }
+  else if (!index_size_32_bit && mesh->index_size_32_bit) {
+    // narrow in place, front to back for the same reason
+    for (size_t corner = 0; corner < mesh->index_count; ++corner) {
+      const uint16_t index = (uint16_t)((const uint32_t*)mesh->indices)[corner];
+      memcpy((uint8_t*)mesh->indices + corner * sizeof(uint16_t), &index, sizeof(index));
+    }
+    mesh->indices = realloc(mesh->indices, std::max(mesh->index_count * sizeof(uint16_t), (size_t)1));
+  }
+  mesh->index_size_32_bit = index_size_32_bit;
+}
+
+void mesh_split_16_bit(const Mesh* mesh, uint16_t* out_indices, std::vector<MeshSubmesh>& submeshes) {
+  submeshes.clear();
+  MeshSubmesh submesh = {0, 0, 0};
+  uint32_t min_vertex = UINT32_MAX;
+  uint32_t max_vertex = 0;
+  for (unsigned corner = 0; corner < mesh->index_count; corner += 3) {
+    uint32_t tri_min = UINT32_MAX;
+    uint32_t tri_max = 0;
+    for (int tri_corner = 0; tri_corner < 3; ++tri_corner) {
+      const uint32_t index = mesh_index(mesh, corner + tri_corner);
+      tri_min = std::min(tri_min, index);
+      tri_max = std::max(tri_max, index);
+    }
+
+    // the vertices are in the order the triangles first use them, so the runs tend to be long
+    const uint32_t run_min = std::min(min_vertex, tri_min);
+    const uint32_t run_max = std::max(max_vertex, tri_max);
+    if (submesh.index_count > 0 && run_max - run_min >= MESH_MAX_16_BIT_VERTICES) {
+      submesh.base_vertex = min_vertex;
+      submeshes.push_back(submesh);
+      submesh.index_offset = corner;
+      submesh.index_count = 0;
+      min_vertex = tri_min;
+      max_vertex = tri_max;
+    }
+    else {
+      min_vertex = run_min;
+      max_vertex = run_max;
+    }
+    submesh.index_count += 3;
+  }
+  if (submesh.index_count > 0) {
+    submesh.base_vertex = min_vertex;
+    submeshes.push_back(submesh);
+  }
+
+  for (const MeshSubmesh& run : submeshes) {
+    for (unsigned corner = run.index_offset; corner < run.index_offset + run.index_count; ++corner) {
+      out_indices[corner] = (uint16_t)(mesh_index(mesh, corner) - run.base_vertex);
+    }
+  }
+}
+
+void mesh_quantize_settings_init(MeshQuantizeSettings* settings) {
+  settings->normals_8_bit = true;
+}
+
+static simd4f quantize_unorm(simd4f value, float max) {
+  const simd4f clamped = simd4f_min(simd4f_max(value, simd4f_zero()), simd4f_splat(1.0f));
+  return simd4f_madd(clamped, simd4f_splat(max), simd4f_splat(0.5f));
+}
+
+// rounds [-1, 1] to the nearest step of a signed normalized integer
+static void quantize_snorm(float* out, simd4f value, float max) {
+  simd4f_ustore4(simd4f_mul(value, simd4f_splat(max)), out);
+  for (int lane = 0; lane < 4; ++lane) {
+    out[lane] = rintf(out[lane]);
+  }
+}
+
+static simd4f quantize_sign(simd4f value) {
+  return simd4f_select(simd4f_cmplt(value, simd4f_zero()), simd4f_splat(-1.0f), simd4f_splat(1.0f));
+}
+
+// projects the unit vectors onto the octahedron |x| + |y| + |z| = 1 and folds its lower half over the upper one, so the
+// x and y left over cover the [-1, 1] square
+static void quantize_octahedral(simd4f* out_x, simd4f* out_y, const simd4f* normal) {
+  const simd4f l1 = simd4f_add(simd4f_add(simd4f_abs(normal[0]), simd4f_abs(normal[1])), simd4f_abs(normal[2]));
+  const simd4f inv_l1 = simd4f_div(simd4f_splat(1.0f), simd4f_max(l1, simd4f_splat(1e-20f)));
+  const simd4f x = simd4f_mul(normal[0], inv_l1);
+  const simd4f y = simd4f_mul(normal[1], inv_l1);
+
+  const simd4f one = simd4f_splat(1.0f);
+  const simd4f folded_x = simd4f_mul(simd4f_sub(one, simd4f_abs(y)), quantize_sign(x));
+  const simd4f folded_y = simd4f_mul(simd4f_sub(one, simd4f_abs(x)), quantize_sign(y));
+  const simd4f lower = simd4f_cmplt(normal[2], simd4f_zero());
+  *out_x = simd4f_select(lower, folded_x, x);
+  *out_y = simd4f_select(lower, folded_y, y);
+}
+
+static void quantize_position(VertexUShort3* out, float x, float y, float z) {
+  out->x = (uint16_t)x;
+  out->y = (uint16_t)y;
+  out->z = (uint16_t)z;
+}
+
+static void quantize_position(VertexUShort3Padded* out, float x, float y, float z) {
+  out->x = (uint16_t)x;
+  out->y = (uint16_t)y;
+  out->z = (uint16_t)z;
+  out->padding = 0;
+}
+
+static void quantize_normal(VertexByte2* out, float x, float y) {
+  out->x = (int8_t)x;
+  out->y = (int8_t)y;
+}
+
+static void quantize_normal(VertexShort2* out, float x, float y) {
+  out->x = (int16_t)x;
+  out->y = (int16_t)y;
+}
+
+// encodes four vertices at a time, one lane each
+template <typename Format>
+static void quantize_vertices(void* out,
+                              const Vertex* vertices,
+                              const float* vertex_uvs,
+                              unsigned vertex_count,
+                              const float* bounds_min,
+                              const float* inv_extent) {
+  typedef typename Format::template Channel<CHANNEL_SEMANTIC_POSITION>::channel PositionChannel;
+  typedef typename Format::template Channel<CHANNEL_SEMANTIC_NORMAL>::channel NormalChannel;
+  const float normal_max = NormalChannel::type == CHANNEL_TYPE_OCT_SNORM8_2 ? 127.0f : 32767.0f;
+
+  for (unsigned block_index = 0; 4 * block_index < vertex_count; ++block_index) {
+    // transpose the vertices into lanes, repeating the last one past the end
+    float lanes[11][4];
+    for (int lane = 0; lane < 4; ++lane) {
+      const unsigned index = std::min(4 * block_index + lane, vertex_count - 1);
+      const Vertex& vertex = vertices[index];
+      const float values[11] = {vertex.p.x,
+                                vertex.p.y,
+                                vertex.p.z,
+                                vertex.n.x,
+                                vertex.n.y,
+                                vertex.n.z,
+                                vertex.c.x,
+                                vertex.c.y,
+                                vertex.c.z,
+                                vertex_uvs ? vertex_uvs[2 * index + 0] : 0.0f,
+                                vertex_uvs ? vertex_uvs[2 * index + 1] : 0.0f};
+      for (int value = 0; value < 11; ++value) {
+        lanes[value][lane] = values[value];
+      }
+    }
+
+    float positions[3][4];
+    simd4f normal[3];
+    float colors[3][4];
+    float uvs[2][4];
+    for (int axis = 0; axis < 3; ++axis) {
+      const simd4f relative = simd4f_mul(simd4f_sub(simd4f_uload4(lanes[axis]), simd4f_splat(bounds_min[axis])),
+                                         simd4f_splat(inv_extent[axis]));
+      simd4f_ustore4(quantize_unorm(relative, 65535.0f), positions[axis]);
+      normal[axis] = simd4f_uload4(lanes[3 + axis]);
+      simd4f_ustore4(quantize_unorm(simd4f_uload4(lanes[6 + axis]), 255.0f), colors[axis]);
+    }
+    for (int axis = 0; axis < 2; ++axis) {
+      simd4f_ustore4(quantize_unorm(simd4f_uload4(lanes[9 + axis]), 65535.0f), uvs[axis]);
+    }
+    simd4f octahedral[2];
+    float normals[2][4];
+    quantize_octahedral(&octahedral[0], &octahedral[1], normal);
+    quantize_snorm(normals[0], octahedral[0], normal_max);
+    quantize_snorm(normals[1], octahedral[1], normal_max);
+
+    for (unsigned lane = 0; lane < 4 && 4 * block_index + lane < vertex_count; ++lane) {
+      const size_t index = 4 * block_index + lane;
+      typename PositionChannel::value_type position;
+      quantize_position(&position, positions[0][lane], positions[1][lane], positions[2][lane]);
+      Format::template store<CHANNEL_SEMANTIC_POSITION>(out, index, position);
+      typename NormalChannel::value_type normal_value;
+      quantize_normal(&normal_value, normals[0][lane], normals[1][lane]);
+      Format::template store<CHANNEL_SEMANTIC_NORMAL>(out, index, normal_value);
+      Format::template store<CHANNEL_SEMANTIC_COLOR>(
+          out, index, {(uint8_t)colors[0][lane], (uint8_t)colors[1][lane], (uint8_t)colors[2][lane], 255});
+      Format::template store<CHANNEL_SEMANTIC_TEXCOORD>(out, index, {(uint16_t)uvs[0][lane], (uint16_t)uvs[1][lane]});
+    }
+  }
+}
+
+Mesh* mesh_quantize(const Mesh* mesh,
+                    const float* vertex_uvs,
+                    const MeshQuantizeSettings* settings,
+                    MeshQuantization* out_quantization) {
+  PROFILE_SCOPE("mesh_quantize");
+  if (!MeshVertexFormat::matches(mesh)) {
+    std::cerr << "ERROR: only meshes of Vertex can be quantized" << std::endl;
+    return nullptr;
+  }
+  const Vertex* vertices = (const Vertex*)mesh->vertices;
+
+  Mesh* quantized = (Mesh*)malloc(sizeof(Mesh));
+  if (settings->normals_8_bit) {
+    QuantizedVertexFormat8::describe(quantized);
+  }
+  else {
+    QuantizedVertexFormat16::describe(quantized);
+  }
+  quantized->index_count = mesh->index_count;
+  quantized->vertex_count = mesh->vertex_count;
+  quantized->index_size_32_bit = mesh->index_size_32_bit;
+
+  const size_t ib_size = mesh->index_count * (mesh->index_size_32_bit ? sizeof(uint32_t) : sizeof(uint16_t));
+  quantized->indices = malloc(std::max(ib_size, (size_t)1));
+  memcpy(quantized->indices, mesh->indices, ib_size);
+  const size_t vb_size = mesh->vertex_count * vertex_stride(quantized->channels, quantized->channel_count);
+  quantized->vertices = malloc(std::max(vb_size, (size_t)1));
+
+  vectorial::vec3f bounds_min(0.0f);
+  vectorial::vec3f bounds_max(0.0f);
+  for (unsigned index = 0; index < mesh->vertex_count; ++index) {
+    const vectorial::vec3f p(vertices[index].p.x, vertices[index].p.y, vertices[index].p.z);
+    bounds_min = index ? vectorial::min(bounds_min, p) : p;
+    bounds_max = index ? vectorial::max(bounds_max, p) : p;
+  }
+  const vectorial::vec3f extent = bounds_max - bounds_min;
+  out_quantization->position_offset = bounds_min;
+  out_quantization->position_scale = extent;
+  out_quantization->octahedral_normals = true;
+  float min_f[3];
+  float inv_extent[3];
+  bounds_min.store(min_f);
+  extent.store(inv_extent);
+  for (int axis = 0; axis < 3; ++axis) {
+    inv_extent[axis] = inv_extent[axis] > 0.0f ? 1.0f / inv_extent[axis] : 0.0f;
+  }
+
+  if (settings->normals_8_bit) {
+    quantize_vertices<QuantizedVertexFormat8>(
+        quantized->vertices, vertices, vertex_uvs, mesh->vertex_count, min_f, inv_extent);
+  }
+  else {
+    quantize_vertices<QuantizedVertexFormat16>(
+        quantized->vertices, vertices, vertex_uvs, mesh->vertex_count, min_f, inv_extent);
+  }
+  return quantized;
+}
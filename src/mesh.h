@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+#define MAX_CHANNELS 16
+
+enum ChannelSemantic {
+  CHANNEL_SEMANTIC_COLOR,
+  CHANNEL_SEMANTIC_NORMAL,
+  CHANNEL_SEMANTIC_POSITION,
+  CHANNEL_SEMANTIC_TEXCOORD,
+};
+
+enum ChannelType {
+  CHANNEL_TYPE_FLOAT_3,
+  CHANNEL_TYPE_UBYTE_4,        // normalized, colors as RGBA8
+  CHANNEL_TYPE_UNORM16_3,      // positions relative to the mesh bounds, see MeshQuantization
+  CHANNEL_TYPE_UNORM16_2,      // lightmap uvs
+  CHANNEL_TYPE_OCT_SNORM16_2,  // octahedral unit vectors
+  CHANNEL_TYPE_OCT_SNORM8_2,
+  CHANNEL_TYPE_UNORM16_3_PADDED,  // UNORM16_3 with 2 bytes of padding, to keep the stride a multiple of 4
+};
+
+struct VertexChannelDesc {
+  ChannelType type;
+  ChannelSemantic semantic;
+};
+
+// the most vertices 16-bit indices can address
+#define MESH_MAX_16_BIT_VERTICES 65536
+
+struct Mesh {
+  void* indices;
+  void* vertices;
+  VertexChannelDesc channels[MAX_CHANNELS];
+  unsigned index_count;
+  unsigned vertex_count;
+  unsigned channel_count;
+  bool index_size_32_bit;
+};
+
+// a run of triangles whose indices fit in 16 bits once `base_vertex` is taken off, see mesh_split_16_bit()
+struct MeshSubmesh {
+  unsigned index_offset;
+  unsigned index_count;
+  unsigned base_vertex;
+};
+
+struct Vec3 {
+  float x;
+  float y;
+  float z;
+};
+
+struct Vertex {
+  Vec3 p;
+  Vec3 n;
+  Vec3 c;
+};
+
+// the vertex of one corner, whatever the index size
+inline uint32_t mesh_index(const Mesh* mesh, size_t corner) {
+  return mesh->index_size_32_bit ? ((const uint32_t*)mesh->indices)[corner] : ((const uint16_t*)mesh->indices)[corner];
+}
+
+inline void mesh_set_index(Mesh* mesh, size_t corner, uint32_t index) {
+  if (mesh->index_size_32_bit) {
+    ((uint32_t*)mesh->indices)[corner] = index;
+  }
+  else {
+    ((uint16_t*)mesh->indices)[corner] = (uint16_t)index;
+  }
+}
+
+int channel_size(const VertexChannelDesc* channel);
+int channel_elements(const VertexChannelDesc* channel);
+// true if the integer elements read back as floats in [0, 1] (unsigned) or [-1, 1] (signed)
+bool channel_normalized(const VertexChannelDesc* channel);
+int vertex_stride(const VertexChannelDesc* channels, int channel_count);
+
+// returns the byte offset of the first channel with the given semantic, or -1 if the mesh doesn't have one
+int mesh_channel_offset(const Mesh* mesh, ChannelSemantic semantic, const VertexChannelDesc** out_channel);
+
+struct MeshLoadSettings {
+  // imports through tinyobj::LoadObjWithCallback() a window of faces at a time instead of parsing the whole OBJ up
+  // front. single threaded, but the peak memory stays close to the size of the OBJ's attributes plus the mesh: only
+  // the faces are windowed, every position and normal is kept until the end.
+  bool streaming;
+  unsigned window_size;  // triangles collected before they get welded into the mesh
+};
+
+void mesh_load_settings_init(MeshLoadSettings* settings);
+
+// loads an OBJ file and bakes the transform into the vertices. returns nullptr on failure.
+Mesh* mesh_load(const char* filename,
+                const char* mtl_dirname,
+                const vectorial::mat4f& transform,
+                const MeshLoadSettings* settings);
+void mesh_destroy(Mesh* mesh);
+
+// switches to 16-bit indices if the vertices fit, or to 32-bit ones if they don't
+void mesh_fit_index_size(Mesh* mesh);
+
+// splits the triangles, in order, into runs that each touch at most MESH_MAX_16_BIT_VERTICES consecutive vertices and
+// writes their indices relative to the run's first vertex to `out_indices` (mesh->index_count of them). drawn with a
+// base vertex, a mesh of any size then only needs 16-bit index buffers.
+void mesh_split_16_bit(const Mesh* mesh, uint16_t* out_indices, std::vector<MeshSubmesh>& submeshes);
+
+struct MeshQuantizeSettings {
+  // 2x8 bit octahedral normals instead of 2x16 bit, about a degree of error instead of none visible
+  bool normals_8_bit;
+};
+
+void mesh_quantize_settings_init(MeshQuantizeSettings* settings);
+
+// decodes a quantized mesh: position = offset + scale * unorm16_position, with the position read normalized to [0, 1]
+struct MeshQuantization {
+  vectorial::vec3f position_offset;
+  vectorial::vec3f position_scale;
+  bool octahedral_normals;
+};
+
+// packs a float mesh and its per vertex lightmap uvs into QuantizedVertexFormat8 or 16 (see vertex_format.h) for the
+// GPU: 16 or 20 bytes a vertex of RGBA8 colors, 16-bit uvs, 16-bit positions within the bounds and octahedral normals.
+// the uvs are zero if `vertex_uvs` is nullptr and the indices are copied as they are. the baker and the lightmap layout
+// keep working on the float mesh. returns nullptr unless `mesh` is in MeshVertexFormat.
+Mesh* mesh_quantize(const Mesh* mesh,
+                    const float* vertex_uvs,
+                    const MeshQuantizeSettings* settings,
+                    MeshQuantization* out_quantization);
@@ -0,0 +1,427 @@
+#include "mesh_cache.h"
+#include "lightmap.h"
+#include "profile.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define MESH_CACHE_MAGIC 0x434d4947U  // "GIMC"
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_ALIGNMENT 64
+#define MESH_CACHE_SECTION_COUNT 5
+
+// every section starts on a MESH_CACHE_ALIGNMENT boundary, offsets are from the start of the file
+struct MeshCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint64_t file_size;
+  uint32_t channel_types[MAX_CHANNELS];
+  uint32_t channel_semantics[MAX_CHANNELS];
+  uint32_t channel_count;
+  uint32_t index_count;
+  uint32_t vertex_count;
+  uint32_t index_size_32_bit;
+  int32_t tex_width;
+  int32_t tex_height;
+  int32_t chart_count;
+  float utilization;
+  uint64_t indices_offset;
+  uint64_t vertices_offset;
+  uint64_t vertex_uvs_offset;
+  uint64_t corner_uvs_offset;
+  uint64_t pack_indices_offset;
+};
+
+// either a mapping of the cache file or, when the contents were just imported, the buffers they point to
+struct MeshCache {
+  void* data;
+  size_t size;
+  Mesh* imported_mesh;
+  std::vector<float> vertex_uvs;
+  std::vector<float> corner_uvs;
+  std::vector<int32_t> pack_indices;
+  MeshCacheContents contents;
+};
+
+#define XXH_PRIME64_1 0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3 0x165667b19e3779f9ULL
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ULL
+
+static uint64_t xxh_rotl(uint64_t value, int bits) {
+  return (value << bits) | (value >> (64 - bits));
+}
+
+static uint64_t xxh_read64(const uint8_t* bytes) {
+  uint64_t value;
+  memcpy(&value, bytes, sizeof(value));
+  return value;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+  return xxh_rotl(acc + input * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+static uint64_t xxh_merge_round(uint64_t hash, uint64_t acc) {
+  return (hash ^ xxh_round(0, acc)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+// XXH64 of the bytes seeded with `hash`, so the key chains through several buffers. four lanes eat 32 bytes a round,
+// which keeps the hash of a large OBJ about as fast as reading it in.
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t size) {
+  const uint8_t* bytes = (const uint8_t*)data;
+  const uint8_t* end = bytes + size;
+  const uint64_t seed = hash;
+  if (size >= 32) {
+    uint64_t acc[4] = {seed + XXH_PRIME64_1 + XXH_PRIME64_2, seed + XXH_PRIME64_2, seed, seed - XXH_PRIME64_1};
+    for (; end - bytes >= 32; bytes += 32) {
+      acc[0] = xxh_round(acc[0], xxh_read64(bytes));
+      acc[1] = xxh_round(acc[1], xxh_read64(bytes + 8));
+      acc[2] = xxh_round(acc[2], xxh_read64(bytes + 16));
+      acc[3] = xxh_round(acc[3], xxh_read64(bytes + 24));
+    }
+    hash = xxh_rotl(acc[0], 1) + xxh_rotl(acc[1], 7) + xxh_rotl(acc[2], 12) + xxh_rotl(acc[3], 18);
+    for (int lane = 0; lane < 4; ++lane) {
+      hash = xxh_merge_round(hash, acc[lane]);
+    }
+  }
+  else {
+    hash = seed + XXH_PRIME64_5;
+  }
+  hash += size;
+
+  for (; end - bytes >= 8; bytes += 8) {
+    hash = xxh_rotl(hash ^ xxh_round(0, xxh_read64(bytes)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+  }
+  if (end - bytes >= 4) {
+    uint32_t word;
+    memcpy(&word, bytes, sizeof(word));
+    hash = xxh_rotl(hash ^ (word * XXH_PRIME64_1), 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+    bytes += 4;
+  }
+  for (; bytes < end; ++bytes) {
+    hash = xxh_rotl(hash ^ (*bytes * XXH_PRIME64_5), 11) * XXH_PRIME64_1;
+  }
+
+  hash ^= hash >> 33;
+  hash *= XXH_PRIME64_2;
+  hash ^= hash >> 29;
+  hash *= XXH_PRIME64_3;
+  hash ^= hash >> 32;
+  return hash;
+}
+
+static void* map_file(const char* filename, size_t* size) {
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat info;
+  void* data = nullptr;
+  if (0 == fstat(fd, &info) && info.st_size > 0) {
+    data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      data = nullptr;
+    }
+    *size = (size_t)info.st_size;
+  }
+  close(fd);
+  return data;
+}
+
+static uint64_t hash_file(uint64_t hash, const char* filename) {
+  size_t size = 0;
+  void* data = map_file(filename, &size);
+  if (!data) {
+    return hash_bytes(hash, "missing", 7);
+  }
+
+  hash = hash_bytes(hash, data, size);
+  munmap(data, size);
+  return hash;
+}
+
+static uint64_t align_offset(uint64_t offset) {
+  return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(uint64_t)(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// the bytes of the indices, the vertices, the vertex uvs, the corner uvs and the pack indices, the order they're in
+static void section_sizes(uint64_t* sizes, const Mesh& mesh) {
+  const uint64_t index_size = mesh.index_size_32_bit ? sizeof(uint32_t) : sizeof(uint16_t);
+  sizes[0] = mesh.index_count * index_size;
+  sizes[1] = mesh.vertex_count * (uint64_t)vertex_stride(mesh.channels, mesh.channel_count);
+  sizes[2] = mesh.vertex_count * 2 * (uint64_t)sizeof(float);
+  sizes[3] = mesh.index_count * 2 * (uint64_t)sizeof(float);
+  sizes[4] = mesh.index_count / 3 * (uint64_t)sizeof(int32_t);
+}
+
+uint64_t mesh_cache_key(const char* filename,
+                        const char* mtl_dirname,
+                        const vectorial::mat4f& transform,
+                        const LightmapChartSettings* chart_settings,
+                        const LightmapPackSettings* pack_settings) {
+  uint64_t hash = 0;
+  const uint32_t version = MESH_CACHE_VERSION;
+  hash = hash_bytes(hash, &version, sizeof(version));
+
+  size_t size = 0;
+  char* obj = (char*)map_file(filename, &size);
+  if (!obj) {
+    return hash_bytes(hash, "missing", 7);
+  }
+  hash = hash_bytes(hash, obj, size);
+
+  // the materials live in separate files named on mtllib lines
+  for (size_t line = 0; line < size;) {
+    const char* newline = (const char*)memchr(obj + line, '\n', size - line);
+    const size_t end = newline ? (size_t)(newline - obj) : size;
+    if (end - line > 7 && 0 == memcmp(obj + line, "mtllib", 6) && (obj[line + 6] == ' ' || obj[line + 6] == '\t')) {
+      const std::string names(obj + line + 7, obj + end);
+      size_t name_begin = names.find_first_not_of(" \t\r");
+      while (name_begin != std::string::npos) {
+        const size_t name_end = names.find_first_of(" \t\r", name_begin);
+        const std::string name = names.substr(name_begin, name_end - name_begin);
+        hash = hash_file(hash, (std::string(mtl_dirname) + name).c_str());
+        name_begin = names.find_first_not_of(" \t\r", name_end);
+      }
+    }
+    line = end + 1;
+  }
+  munmap(obj, size);
+
+  float matrix[16];
+  transform.store(matrix);
+  hash = hash_bytes(hash, matrix, sizeof(matrix));
+  hash = hash_bytes(hash, chart_settings, sizeof(*chart_settings));
+  hash = hash_bytes(hash, pack_settings, sizeof(*pack_settings));
+  return hash;
+}
+
+MeshCache* mesh_cache_open(const char* cache_filename, uint64_t key) {
+  size_t size = 0;
+  void* data = map_file(cache_filename, &size);
+  if (!data) {
+    return nullptr;
+  }
+
+  const MeshCacheHeader* header = (const MeshCacheHeader*)data;
+  bool valid = size >= sizeof(MeshCacheHeader) && header->magic == MESH_CACHE_MAGIC &&
+               header->version == MESH_CACHE_VERSION && header->key == key && header->file_size == size &&
+               header->channel_count <= MAX_CHANNELS;
+  Mesh mesh;
+  if (valid) {
+    for (uint32_t channel = 0; channel < header->channel_count; ++channel) {
+      valid = valid && header->channel_types[channel] <= CHANNEL_TYPE_UNORM16_3_PADDED &&
+              header->channel_semantics[channel] <= CHANNEL_SEMANTIC_TEXCOORD;
+      mesh.channels[channel].type = (ChannelType)header->channel_types[channel];
+      mesh.channels[channel].semantic = (ChannelSemantic)header->channel_semantics[channel];
+    }
+    mesh.channel_count = header->channel_count;
+    mesh.index_count = header->index_count;
+    mesh.vertex_count = header->vertex_count;
+    mesh.index_size_32_bit = header->index_size_32_bit != 0;
+  }
+
+  // every section has to be aligned, after the header and inside the file before anything points into it
+  if (valid) {
+    const uint64_t offsets[MESH_CACHE_SECTION_COUNT] = {
+        header->indices_offset,
+        header->vertices_offset,
+        header->vertex_uvs_offset,
+        header->corner_uvs_offset,
+        header->pack_indices_offset,
+    };
+    uint64_t sizes[MESH_CACHE_SECTION_COUNT];
+    section_sizes(sizes, mesh);
+    for (int section = 0; section < MESH_CACHE_SECTION_COUNT; ++section) {
+      valid = valid && offsets[section] % MESH_CACHE_ALIGNMENT == 0 && offsets[section] >= sizeof(MeshCacheHeader) &&
+              offsets[section] <= size && sizes[section] <= size - offsets[section];
+    }
+  }
+  if (!valid) {
+    munmap(data, size);
+    return nullptr;
+  }
+
+  MeshCache* cache = new MeshCache;
+  cache->data = data;
+  cache->size = size;
+  cache->imported_mesh = nullptr;
+
+  char* base = (char*)data;
+  MeshCacheContents* contents = &cache->contents;
+  contents->mesh = mesh;
+  contents->mesh.indices = base + header->indices_offset;
+  contents->mesh.vertices = base + header->vertices_offset;
+  contents->vertex_uvs = (const float*)(base + header->vertex_uvs_offset);
+  contents->corner_uvs = (const float*)(base + header->corner_uvs_offset);
+  contents->pack_indices = (const int32_t*)(base + header->pack_indices_offset);
+  contents->tex_width = header->tex_width;
+  contents->tex_height = header->tex_height;
+  contents->chart_count = header->chart_count;
+  contents->utilization = header->utilization;
+  return cache;
+}
+
+MeshCache* mesh_cache_load(const char* cache_filename,
+                           const char* filename,
+                           const char* mtl_dirname,
+                           const vectorial::mat4f& transform,
+                           const MeshLoadSettings* load_settings,
+                           const LightmapChartSettings* chart_settings,
+                           const LightmapPackSettings* pack_settings) {
+  PROFILE_SCOPE("mesh_cache_load");
+  uint64_t key = 0;
+  if (cache_filename) {
+    key = mesh_cache_key(filename, mtl_dirname, transform, chart_settings, pack_settings);
+    MeshCache* cache = mesh_cache_open(cache_filename, key);
+    if (cache) {
+      return cache;
+    }
+  }
+
+  Mesh* mesh = mesh_load(filename, mtl_dirname, transform, load_settings);
+  if (!mesh) {
+    return nullptr;
+  }
+
+  std::vector<LightmapTriangle> triangles;
+  LightmapPackResult pack_result;
+  if (!lightmap_project_triangles(triangles, mesh)) {
+    fprintf(stderr, "ERROR: '%s' has no float3 positions\n", filename);
+    mesh_destroy(mesh);
+    return nullptr;
+  }
+  const int chart_count = lightmap_build_charts(triangles, mesh, chart_settings);
+  if (!lightmap_pack(triangles, pack_settings, &pack_result)) {
+    fprintf(stderr,
+            "ERROR: the lightmap of '%s' doesn't fit in %dx%d\n",
+            filename,
+            pack_result.tex_width,
+            pack_result.tex_height);
+    mesh_destroy(mesh);
+    return nullptr;
+  }
+
+  MeshCache* cache = new MeshCache;
+  cache->data = nullptr;
+  cache->size = 0;
+  cache->imported_mesh = mesh;
+  cache->corner_uvs.resize(mesh->index_count * 2);
+  lightmap_build_uvs(cache->corner_uvs.data(), triangles);
+  lightmap_split_vertices(mesh, cache->corner_uvs.data(), cache->vertex_uvs);
+  cache->pack_indices.resize(triangles.size());
+  for (size_t tri_index = 0; tri_index < triangles.size(); ++tri_index) {
+    cache->pack_indices[tri_index] = triangles[tri_index].pack_index;
+  }
+
+  MeshCacheContents* contents = &cache->contents;
+  contents->mesh = *mesh;
+  contents->vertex_uvs = cache->vertex_uvs.data();
+  contents->corner_uvs = cache->corner_uvs.data();
+  contents->pack_indices = cache->pack_indices.data();
+  contents->tex_width = pack_result.tex_width;
+  contents->tex_height = pack_result.tex_height;
+  contents->chart_count = chart_count;
+  contents->utilization = pack_result.utilization;
+
+  if (cache_filename && !mesh_cache_write(cache_filename, key, contents)) {
+    fprintf(stderr, "WARN: failed to write the mesh cache '%s'\n", cache_filename);
+  }
+  return cache;
+}
+
+bool mesh_cache_hit(const MeshCache* cache) {
+  return cache->data != nullptr;
+}
+
+const MeshCacheContents* mesh_cache_contents(const MeshCache* cache) {
+  return &cache->contents;
+}
+
+void mesh_cache_close(MeshCache* cache) {
+  if (!cache) {
+    return;
+  }
+
+  if (cache->data) {
+    munmap(cache->data, cache->size);
+  }
+  if (cache->imported_mesh) {
+    mesh_destroy(cache->imported_mesh);
+  }
+  delete cache;
+}
+
+bool mesh_cache_write(const char* cache_filename, uint64_t key, const MeshCacheContents* contents) {
+  const Mesh& mesh = contents->mesh;
+  const void* sections[MESH_CACHE_SECTION_COUNT] = {
+      mesh.indices, mesh.vertices, contents->vertex_uvs, contents->corner_uvs, contents->pack_indices,
+  };
+  uint64_t sizes[MESH_CACHE_SECTION_COUNT];
+  section_sizes(sizes, mesh);
+
+  MeshCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.key = key;
+  for (unsigned channel = 0; channel < mesh.channel_count; ++channel) {
+    header.channel_types[channel] = (uint32_t)mesh.channels[channel].type;
+    header.channel_semantics[channel] = (uint32_t)mesh.channels[channel].semantic;
+  }
+  header.channel_count = mesh.channel_count;
+  header.index_count = mesh.index_count;
+  header.vertex_count = mesh.vertex_count;
+  header.index_size_32_bit = mesh.index_size_32_bit ? 1 : 0;
+  header.tex_width = contents->tex_width;
+  header.tex_height = contents->tex_height;
+  header.chart_count = contents->chart_count;
+  header.utilization = contents->utilization;
+
+  uint64_t* offsets[MESH_CACHE_SECTION_COUNT] = {
+      &header.indices_offset,
+      &header.vertices_offset,
+      &header.vertex_uvs_offset,
+      &header.corner_uvs_offset,
+      &header.pack_indices_offset,
+  };
+  uint64_t offset = sizeof(header);
+  for (int section = 0; section < MESH_CACHE_SECTION_COUNT; ++section) {
+    offset = align_offset(offset);
+    *offsets[section] = offset;
+    offset += sizes[section];
+  }
+  header.file_size = offset;
+
+  const std::string temp_filename = std::string(cache_filename) + ".tmp";
+  FILE* file = fopen(temp_filename.c_str(), "wb");
+  if (!file) {
+    return false;
+  }
+
+  static const char s_zeros[MESH_CACHE_ALIGNMENT] = {};
+  bool ok = 1 == fwrite(&header, sizeof(header), 1, file);
+  offset = sizeof(header);
+  for (int section = 0; section < MESH_CACHE_SECTION_COUNT && ok; ++section) {
+    const size_t pad = (size_t)(*offsets[section] - offset);
+    ok = pad == fwrite(s_zeros, 1, pad, file) && sizes[section] == fwrite(sections[section], 1, sizes[section], file);
+    offset = *offsets[section] + sizes[section];
+  }
+  ok = 0 == fclose(file) && ok;
+
+  if (!ok || 0 != rename(temp_filename.c_str(), cache_filename)) {
+    remove(temp_filename.c_str());
+    return false;
+  }
+  return true;
+}
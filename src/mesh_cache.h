@@ -0,0 +1,53 @@
+#pragma once
+#include "mesh.h"
+#include <stdint.h>
+#include <vectorial/vectorial.h>
+
+struct LightmapChartSettings;
+struct LightmapPackSettings;
+struct MeshCache;
+
+// a finished mesh and its lightmap layout, the way the renderer and the baker consume them
+struct MeshCacheContents {
+  Mesh mesh;                     // after lightmap_split_vertices()
+  const float* vertex_uvs;       // one float2 per vertex
+  const float* corner_uvs;       // one float2 per index, see lightmap_build_uvs()
+  const int32_t* pack_indices;   // pack order of every triangle
+  int tex_width;
+  int tex_height;
+  int chart_count;
+  float utilization;
+};
+
+// hashes the OBJ, the MTL files it references, the import transform and the lightmap settings. a cache file only
+// loads with the key it was written with.
+uint64_t mesh_cache_key(const char* filename,
+                        const char* mtl_dirname,
+                        const vectorial::mat4f& transform,
+                        const LightmapChartSettings* chart_settings,
+                        const LightmapPackSettings* pack_settings);
+
+// maps `cache_filename` if it was written with the key of these inputs. otherwise imports the OBJ, lays out its
+// lightmap and writes the cache for next time, a failed write only costs the next load. `cache_filename` may be
+// nullptr to always import. `load_settings` only pick how to import and aren't part of the key. returns nullptr if the
+// import or the lightmap layout fails.
+MeshCache* mesh_cache_load(const char* cache_filename,
+                           const char* filename,
+                           const char* mtl_dirname,
+                           const vectorial::mat4f& transform,
+                           const MeshLoadSettings* load_settings,
+                           const LightmapChartSettings* chart_settings,
+                           const LightmapPackSettings* pack_settings);
+
+// true if the contents came from the cache file rather than an import
+bool mesh_cache_hit(const MeshCache* cache);
+
+// maps a cache file written by mesh_cache_write(). returns nullptr if it's missing, from another version, written with
+// another key, truncated or has a section out of place. the contents point straight into the mapping and stay valid
+// until mesh_cache_close().
+MeshCache* mesh_cache_open(const char* cache_filename, uint64_t key);
+const MeshCacheContents* mesh_cache_contents(const MeshCache* cache);
+void mesh_cache_close(MeshCache* cache);
+
+// writes to a temporary file next to `cache_filename` and renames it over, so readers never see a partial file
+bool mesh_cache_write(const char* cache_filename, uint64_t key, const MeshCacheContents* contents);
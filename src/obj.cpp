@@ -0,0 +1,554 @@
+#include "obj.h"
+#include "job.h"
+#include "profile.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <float.h>
+#include <map>
+#include <sstream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// bytes of OBJ per parse job, rounded up to the next line break
+#define OBJ_CHUNK_SIZE (1 << 20)
+
+enum ObjEventType {
+  OBJ_EVENT_USEMTL,
+  OBJ_EVENT_MTLLIB,
+  OBJ_EVENT_GROUP,
+  OBJ_EVENT_OBJECT,
+};
+
+// a line that changes the parser state. a chunk can't act on it without knowing everything before it, so the events
+// get replayed in file order once all the chunks are parsed.
+struct ObjEvent {
+  ObjEventType type;
+  size_t face_index;  // faces of the chunk that come before the line
+  std::string name;   // material, group or object name, or the whole file list of an mtllib line
+};
+
+struct ObjChunk {
+  const char* begin;
+  const char* end;
+  std::vector<float> vertices;
+  std::vector<float> normals;
+  std::vector<float> texcoords;
+  std::vector<tinyobj::index_t> corners;
+  std::vector<unsigned> face_sizes;
+  // negative indices count back from the attributes read so far, of which a chunk only knows its own. every entry is
+  // corner * 4 + the attribute (0 vertex, 1 normal, 2 texcoord) that still needs the count of the chunks before.
+  std::vector<size_t> relative_corners;
+  std::vector<ObjEvent> events;
+  bool has_tags;
+  // attribute counts in all the chunks before this one
+  size_t vertex_base;
+  size_t normal_base;
+  size_t texcoord_base;
+};
+
+struct ObjMergeJob {
+  ObjChunk* chunks;
+  tinyobj::attrib_t* attrib;
+};
+
+// the part of tinyobj's LoadObj() that has to see the file in order
+struct ObjReplay {
+  tinyobj::shape_t shape;
+  std::string name;
+  int material;
+  size_t group_face_count;  // faces added to `shape` since the last flush
+  bool triangulate;
+};
+
+static const double s_exact_powers_of_ten[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static bool is_space(char c) {
+  return c == ' ' || c == '\t';
+}
+
+static bool is_digit(char c) {
+  return (unsigned)(c - '0') < 10;
+}
+
+static const char* skip_spaces(const char* s, const char* end) {
+  while (s < end && is_space(*s)) {
+    ++s;
+  }
+  return s;
+}
+
+// the first whitespace separated word
+static std::string read_name(const char* s, const char* end) {
+  s = skip_spaces(s, end);
+  const char* name_end = s;
+  while (name_end < end && !is_space(*name_end)) {
+    ++name_end;
+  }
+  return std::string(s, name_end);
+}
+
+// the result is correctly rounded. up to 19 significant digits scaled by a power of ten that a double holds exactly
+// take one correctly rounded double multiply or divide. rounding that to float again can only go wrong if the double
+// lands exactly halfway between two floats, which goes to strtof() along with all the other cases.
+bool obj_parse_float(const char* s, const char* end, float* result) {
+  const char* begin = s;
+  if (s >= end) {
+    return false;
+  }
+  bool negative = false;
+  if (*s == '+' || *s == '-') {
+    negative = *s == '-';
+    ++s;
+  }
+
+  uint64_t mantissa = 0;
+  int digit_count = 0;
+  int exponent = 0;
+  bool truncated = false;
+  const char* digits = s;
+  for (; s < end && is_digit(*s); ++s) {
+    if (digit_count < 19) {
+      mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+      digit_count += mantissa != 0;
+    }
+    else {
+      ++exponent;
+      truncated |= *s != '0';
+    }
+  }
+  if (s == digits) {
+    return false;
+  }
+
+  if (s < end && *s == '.') {
+    for (++s; s < end && is_digit(*s); ++s) {
+      if (digit_count < 19) {
+        mantissa = mantissa * 10 + (uint64_t)(*s - '0');
+        digit_count += mantissa != 0;
+        --exponent;
+      }
+      else {
+        truncated |= *s != '0';
+      }
+    }
+  }
+
+  if (s < end && (*s == 'e' || *s == 'E')) {
+    ++s;
+    bool exponent_negative = false;
+    if (s < end && (*s == '+' || *s == '-')) {
+      exponent_negative = *s == '-';
+      ++s;
+    }
+    if (s == end || !is_digit(*s)) {
+      return false;
+    }
+    int value = 0;
+    for (; s < end && is_digit(*s); ++s) {
+      if (value < 100000) {
+        value = value * 10 + (*s - '0');
+      }
+    }
+    exponent += exponent_negative ? -value : value;
+  }
+
+  if (mantissa == 0) {
+    *result = negative ? -0.0f : 0.0f;
+    return true;
+  }
+
+  if (!truncated && mantissa <= (1ULL << 53) && exponent >= -22 && exponent <= 22) {
+    double value = (double)mantissa;
+    value = exponent < 0 ? value / s_exact_powers_of_ten[-exponent] : value * s_exact_powers_of_ten[exponent];
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    // a double halfway between two normal floats has the bit just below the float's precision set and the rest clear
+    if (value >= FLT_MIN && (bits & 0x1fffffffULL) != 0x10000000ULL) {
+      *result = (float)(negative ? -value : value);
+      return true;
+    }
+  }
+
+  const std::string text(begin, s);
+  *result = strtof(text.c_str(), nullptr);
+  return true;
+}
+
+// tinyobj's parseReal()
+static float parse_real(const char** s, const char* end) {
+  const char* field = skip_spaces(*s, end);
+  const char* field_end = field;
+  while (field_end < end && !is_space(*field_end) && *field_end != '\r') {
+    ++field_end;
+  }
+  float value = 0.0f;
+  obj_parse_float(field, field_end, &value);
+  *s = field_end;
+  return value;
+}
+
+// atoi()
+static int parse_int(const char* s, const char* end) {
+  while (s < end && (is_space(*s) || *s == '\v' || *s == '\f')) {
+    ++s;
+  }
+  bool negative = false;
+  if (s < end && (*s == '+' || *s == '-')) {
+    negative = *s == '-';
+    ++s;
+  }
+  int value = 0;
+  for (; s < end && is_digit(*s); ++s) {
+    value = value * 10 + (*s - '0');
+  }
+  return negative ? -value : value;
+}
+
+// skips to the next '/', whitespace or the end of the line
+static const char* skip_index(const char* s, const char* end) {
+  while (s < end && *s != '/' && !is_space(*s) && *s != '\r') {
+    ++s;
+  }
+  return s;
+}
+
+// tinyobj's fixIndex(), 1-based indices become 0-based and negative ones count back from `count`
+static int fix_index(ObjChunk* chunk, int index, size_t count, int attribute) {
+  if (index > 0) {
+    return index - 1;
+  }
+  if (index == 0) {
+    return 0;
+  }
+  chunk->relative_corners.push_back(chunk->corners.size() * 4 + attribute);
+  return (int)count + index;
+}
+
+// tinyobj's parseTriple(): i, i/j, i//k or i/j/k
+static void parse_corner(ObjChunk* chunk, const char** s, const char* end) {
+  tinyobj::index_t corner;
+  corner.vertex_index = -1;
+  corner.normal_index = -1;
+  corner.texcoord_index = -1;
+
+  const char* token = *s;
+  corner.vertex_index = fix_index(chunk, parse_int(token, end), chunk->vertices.size() / 3, 0);
+  token = skip_index(token, end);
+  if (token < end && *token == '/') {
+    ++token;
+    if (token < end && *token == '/') {
+      ++token;
+      corner.normal_index = fix_index(chunk, parse_int(token, end), chunk->normals.size() / 3, 1);
+      token = skip_index(token, end);
+    }
+    else {
+      corner.texcoord_index = fix_index(chunk, parse_int(token, end), chunk->texcoords.size() / 2, 2);
+      token = skip_index(token, end);
+      if (token < end && *token == '/') {
+        ++token;
+        corner.normal_index = fix_index(chunk, parse_int(token, end), chunk->normals.size() / 3, 1);
+        token = skip_index(token, end);
+      }
+    }
+  }
+
+  chunk->corners.push_back(corner);
+  *s = token;
+}
+
+static void add_event(ObjChunk* chunk, ObjEventType type, const std::string& name) {
+  ObjEvent event;
+  event.type = type;
+  event.face_index = chunk->face_sizes.size();
+  event.name = name;
+  chunk->events.push_back(event);
+}
+
+static bool is_keyword(const char* s, const char* end, const char* keyword, size_t length) {
+  return (size_t)(end - s) > length && 0 == memcmp(s, keyword, length) && is_space(s[length]);
+}
+
+// one line of the OBJ, without its line break
+static void parse_line(ObjChunk* chunk, const char* s, const char* end) {
+  s = skip_spaces(s, end);
+  if (s == end || *s == '#') {
+    return;
+  }
+
+  if (is_keyword(s, end, "v", 1)) {
+    s += 2;
+    for (int axis = 0; axis < 3; ++axis) {
+      chunk->vertices.push_back(parse_real(&s, end));
+    }
+  }
+  else if (is_keyword(s, end, "vn", 2)) {
+    s += 3;
+    for (int axis = 0; axis < 3; ++axis) {
+      chunk->normals.push_back(parse_real(&s, end));
+    }
+  }
+  else if (is_keyword(s, end, "vt", 2)) {
+    s += 3;
+    for (int axis = 0; axis < 2; ++axis) {
+      chunk->texcoords.push_back(parse_real(&s, end));
+    }
+  }
+  else if (is_keyword(s, end, "f", 1)) {
+    s = skip_spaces(s + 2, end);
+    unsigned corner_count = 0;
+    while (s < end) {
+      parse_corner(chunk, &s, end);
+      ++corner_count;
+      while (s < end && (is_space(*s) || *s == '\r')) {
+        ++s;
+      }
+    }
+    chunk->face_sizes.push_back(corner_count);
+  }
+  else if (is_keyword(s, end, "usemtl", 6)) {
+    add_event(chunk, OBJ_EVENT_USEMTL, read_name(s + 7, end));
+  }
+  else if (is_keyword(s, end, "mtllib", 6)) {
+    add_event(chunk, OBJ_EVENT_MTLLIB, std::string(s + 7, end));
+  }
+  else if (is_keyword(s, end, "g", 1)) {
+    add_event(chunk, OBJ_EVENT_GROUP, read_name(s + 2, end));
+  }
+  else if (is_keyword(s, end, "o", 1)) {
+    add_event(chunk, OBJ_EVENT_OBJECT, read_name(s + 2, end));
+  }
+  else if (is_keyword(s, end, "t", 1)) {
+    chunk->has_tags = true;
+  }
+}
+
+static void obj_parse_chunk(void* user_data, int index) {
+  PROFILE_SCOPE("obj_parse_chunk");
+  ObjChunk* chunk = (ObjChunk*)user_data + index;
+  for (const char* line = chunk->begin; line < chunk->end;) {
+    const char* line_end = line;
+    while (line_end < chunk->end && *line_end != '\n' && *line_end != '\r') {
+      ++line_end;
+    }
+    parse_line(chunk, line, line_end);
+    line = line_end + 1;
+  }
+}
+
+static void obj_merge_chunk(void* user_data, int index) {
+  const ObjMergeJob* job = (const ObjMergeJob*)user_data;
+  ObjChunk& chunk = job->chunks[index];
+  std::copy(chunk.vertices.begin(), chunk.vertices.end(), job->attrib->vertices.begin() + 3 * chunk.vertex_base);
+  std::copy(chunk.normals.begin(), chunk.normals.end(), job->attrib->normals.begin() + 3 * chunk.normal_base);
+  std::copy(chunk.texcoords.begin(), chunk.texcoords.end(), job->attrib->texcoords.begin() + 2 * chunk.texcoord_base);
+
+  for (size_t slot : chunk.relative_corners) {
+    tinyobj::index_t& corner = chunk.corners[slot / 4];
+    switch (slot % 4) {
+      case 0:
+        corner.vertex_index += (int)chunk.vertex_base;
+        break;
+      case 1:
+        corner.normal_index += (int)chunk.normal_base;
+        break;
+      default:
+        corner.texcoord_index += (int)chunk.texcoord_base;
+        break;
+    }
+  }
+}
+
+// tinyobj's exportFaceGroupToShape(). the faces went into the shape as they were replayed, so all that's left is to
+// name it and to report whether any were added since the last flush.
+static bool replay_flush(ObjReplay* replay) {
+  if (replay->group_face_count == 0) {
+    return false;
+  }
+  replay->shape.name = replay->name;
+  replay->group_face_count = 0;
+  return true;
+}
+
+static void replay_faces(
+    ObjReplay* replay, const ObjChunk& chunk, size_t face_begin, size_t face_end, size_t* corner_index) {
+  tinyobj::mesh_t& mesh = replay->shape.mesh;
+  for (size_t face_index = face_begin; face_index < face_end; ++face_index) {
+    const tinyobj::index_t* corners = &chunk.corners[*corner_index];
+    const unsigned corner_count = chunk.face_sizes[face_index];
+    if (replay->triangulate) {
+      // fan
+      for (unsigned corner = 2; corner < corner_count; ++corner) {
+        mesh.indices.push_back(corners[0]);
+        mesh.indices.push_back(corners[corner - 1]);
+        mesh.indices.push_back(corners[corner]);
+        mesh.num_face_vertices.push_back(3);
+        mesh.material_ids.push_back(replay->material);
+      }
+    }
+    else {
+      mesh.indices.insert(mesh.indices.end(), corners, corners + corner_count);
+      mesh.num_face_vertices.push_back((unsigned char)corner_count);
+      mesh.material_ids.push_back(replay->material);
+    }
+    *corner_index += corner_count;
+  }
+  replay->group_face_count += face_end - face_begin;
+}
+
+bool obj_load(tinyobj::attrib_t* attrib,
+              std::vector<tinyobj::shape_t>* shapes,
+              std::vector<tinyobj::material_t>* materials,
+              std::string* err,
+              const char* filename,
+              const char* mtl_basedir,
+              bool triangulate) {
+  PROFILE_SCOPE("obj_load");
+  attrib->vertices.clear();
+  attrib->normals.clear();
+  attrib->texcoords.clear();
+  shapes->clear();
+
+  const int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    if (err) {
+      *err = std::string("Cannot open file [") + filename + "]\n";
+    }
+    return false;
+  }
+  struct stat info;
+  const char* data = nullptr;
+  size_t size = 0;
+  if (0 == fstat(fd, &info) && info.st_size > 0) {
+    size = (size_t)info.st_size;
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      if (err) {
+        *err = std::string("Cannot map file [") + filename + "]\n";
+      }
+      return false;
+    }
+    madvise(mapping, size, MADV_WILLNEED);
+    data = (const char*)mapping;
+  }
+  close(fd);
+
+  // every chunk but the last ends right after a line break
+  const size_t chunk_count = size / OBJ_CHUNK_SIZE + 1;
+  std::vector<ObjChunk> chunks(chunk_count);
+  const char* chunk_begin = data;
+  for (size_t chunk_index = 0; chunk_index < chunk_count; ++chunk_index) {
+    const char* chunk_end = std::max(chunk_begin, data + size * (chunk_index + 1) / chunk_count);
+    if (chunk_end > data && chunk_end < data + size && chunk_end[-1] != '\n') {
+      const char* line_break = (const char*)memchr(chunk_end, '\n', data + size - chunk_end);
+      chunk_end = line_break ? line_break + 1 : data + size;
+    }
+    chunks[chunk_index].begin = chunk_begin;
+    chunks[chunk_index].end = chunk_end;
+    chunks[chunk_index].has_tags = false;
+    chunk_begin = chunk_end;
+  }
+  job_parallel_for(obj_parse_chunk, &chunks[0], (int)chunk_count);
+  if (data) {
+    munmap((void*)data, size);
+  }
+
+  size_t vertex_count = 0;
+  size_t normal_count = 0;
+  size_t texcoord_count = 0;
+  for (ObjChunk& chunk : chunks) {
+    if (chunk.has_tags) {
+      return tinyobj::LoadObj(attrib, shapes, materials, err, filename, mtl_basedir, triangulate);
+    }
+    chunk.vertex_base = vertex_count;
+    chunk.normal_base = normal_count;
+    chunk.texcoord_base = texcoord_count;
+    vertex_count += chunk.vertices.size() / 3;
+    normal_count += chunk.normals.size() / 3;
+    texcoord_count += chunk.texcoords.size() / 2;
+  }
+  attrib->vertices.resize(3 * vertex_count);
+  attrib->normals.resize(3 * normal_count);
+  attrib->texcoords.resize(2 * texcoord_count);
+  ObjMergeJob merge_job = {&chunks[0], attrib};
+  job_parallel_for(obj_merge_chunk, &merge_job, (int)chunk_count);
+
+  tinyobj::MaterialFileReader material_reader(mtl_basedir ? mtl_basedir : "");
+  std::map<std::string, int> material_map;
+  ObjReplay replay;
+  replay.material = -1;
+  replay.group_face_count = 0;
+  replay.triangulate = triangulate;
+  for (const ObjChunk& chunk : chunks) {
+    size_t face_index = 0;
+    size_t corner_index = 0;
+    for (const ObjEvent& event : chunk.events) {
+      replay_faces(&replay, chunk, face_index, event.face_index, &corner_index);
+      face_index = event.face_index;
+
+      switch (event.type) {
+        case OBJ_EVENT_USEMTL: {
+          const auto found = material_map.find(event.name);
+          const int material = found != material_map.end() ? found->second : -1;
+          if (material != replay.material) {
+            replay_flush(&replay);
+            replay.material = material;
+          }
+          break;
+        }
+        case OBJ_EVENT_MTLLIB: {
+          std::vector<std::string> mtl_filenames;
+          std::stringstream stream(event.name);
+          std::string mtl_filename;
+          while (std::getline(stream, mtl_filename, ' ')) {
+            mtl_filenames.push_back(mtl_filename);
+          }
+          if (mtl_filenames.empty()) {
+            if (err) {
+              *err += "WARN: Looks like empty filename for mtllib. Use default material. \n";
+            }
+            break;
+          }
+
+          bool found = false;
+          for (const std::string& name : mtl_filenames) {
+            std::string mtl_err;
+            const bool ok = material_reader(name, materials, &material_map, &mtl_err);
+            if (err) {
+              *err += mtl_err;
+            }
+            if (ok) {
+              found = true;
+              break;
+            }
+          }
+          if (!found && err) {
+            *err += "WARN: Failed to load material file(s). Use default material.\n";
+          }
+          break;
+        }
+        case OBJ_EVENT_GROUP:
+        case OBJ_EVENT_OBJECT:
+          if (replay_flush(&replay)) {
+            shapes->push_back(std::move(replay.shape));
+          }
+          replay.shape = tinyobj::shape_t();
+          replay.name = event.name;
+          break;
+      }
+    }
+    replay_faces(&replay, chunk, face_index, chunk.face_sizes.size(), &corner_index);
+  }
+  if (replay_flush(&replay) || !replay.shape.mesh.indices.empty()) {
+    shapes->push_back(std::move(replay.shape));
+  }
+
+  return true;
+}
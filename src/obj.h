@@ -0,0 +1,20 @@
+#pragma once
+#include "vendor/tinyobjloader/tiny_obj_loader.h"
+#include <string>
+#include <vector>
+
+// a drop-in for tinyobj::LoadObj() that maps the file, splits it into chunks at line boundaries and parses them on the
+// job system. it fills in the same attrib, shapes and materials, except that every number is correctly rounded where
+// tinyobj's parser can be a bit off. files with subdivision tags ('t' lines) go through tinyobj::LoadObj().
+bool obj_load(tinyobj::attrib_t* attrib,
+              std::vector<tinyobj::shape_t>* shapes,
+              std::vector<tinyobj::material_t>* materials,
+              std::string* err,
+              const char* filename,
+              const char* mtl_basedir,
+              bool triangulate);
+
+// parses the number at the start of [s, end) into a correctly rounded float, the same as strtof() would. accepts what
+// tinyobj's tryParseDouble() does, [sign] digits [. [digits]] [(e|E) [sign] digits], and like it ignores whatever
+// follows a complete number. returns false if there is no number.
+bool obj_parse_float(const char* s, const char* end, float* result);
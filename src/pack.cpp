@@ -0,0 +1,112 @@
+#include "pack.h"
+#include <algorithm>
+#include <vector>
+
+// one horizontal run of the skyline, the runs are sorted by x and cover the whole bin width
+struct SkylineNode {
+  int x;
+  int y;
+  int width;
+};
+
+// returns the y a rect starting at node `index` would rest at, or -1 if it sticks out of the bin
+static int skyline_fit(const std::vector<SkylineNode>& nodes,
+                       size_t index,
+                       int width,
+                       int height,
+                       int bin_width,
+                       int bin_height) {
+  if (nodes[index].x + width > bin_width) {
+    return -1;
+  }
+
+  int y = 0;
+  for (int remaining = width; remaining > 0; remaining -= nodes[index++].width) {
+    y = std::max(y, nodes[index].y);
+    if (y + height > bin_height) {
+      return -1;
+    }
+  }
+  return y;
+}
+
+static void skyline_add(std::vector<SkylineNode>& nodes, size_t index, int x, int y, int width) {
+  SkylineNode node;
+  node.x = x;
+  node.y = y;
+  node.width = width;
+  nodes.insert(nodes.begin() + index, node);
+
+  // trim the runs the new one covers
+  const int right = x + width;
+  while (index + 1 < nodes.size() && nodes[index + 1].x < right) {
+    SkylineNode& next = nodes[index + 1];
+    const int overlap = right - next.x;
+    if (overlap < next.width) {
+      next.x += overlap;
+      next.width -= overlap;
+      break;
+    }
+    nodes.erase(nodes.begin() + index + 1);
+  }
+
+  // merge neighbors at the same height
+  for (size_t node_index = 0; node_index + 1 < nodes.size();) {
+    if (nodes[node_index].y == nodes[node_index + 1].y) {
+      nodes[node_index].width += nodes[node_index + 1].width;
+      nodes.erase(nodes.begin() + node_index + 1);
+    }
+    else {
+      ++node_index;
+    }
+  }
+}
+
+bool pack_skyline(PackRect* rects, unsigned rect_count, int bin_width, int bin_height, bool allow_rotation) {
+  for (unsigned rect_index = 0; rect_index < rect_count; ++rect_index) {
+    rects[rect_index].x = -1;
+    rects[rect_index].y = -1;
+    rects[rect_index].rotated = false;
+  }
+
+  std::vector<SkylineNode> nodes;
+  skyline_add(nodes, 0, 0, 0, bin_width);
+
+  for (unsigned rect_index = 0; rect_index < rect_count; ++rect_index) {
+    PackRect& rect = rects[rect_index];
+
+    int best_top = bin_height + 1;
+    int best_x = 0;
+    int best_y = 0;
+    size_t best_node = 0;
+    bool best_rotated = false;
+    for (int rotated = 0; rotated < (allow_rotation && rect.width != rect.height ? 2 : 1); ++rotated) {
+      const int width = rotated ? rect.height : rect.width;
+      const int height = rotated ? rect.width : rect.height;
+      for (size_t node_index = 0; node_index < nodes.size(); ++node_index) {
+        const int y = skyline_fit(nodes, node_index, width, height, bin_width, bin_height);
+        if (y < 0) {
+          continue;
+        }
+        const int top = y + height;
+        if (top < best_top || (top == best_top && nodes[node_index].x < best_x)) {
+          best_top = top;
+          best_x = nodes[node_index].x;
+          best_y = y;
+          best_node = node_index;
+          best_rotated = rotated != 0;
+        }
+      }
+    }
+    if (best_top > bin_height) {
+      return false;
+    }
+
+    rect.x = best_x;
+    rect.y = best_y;
+    rect.rotated = best_rotated;
+    skyline_add(nodes, best_node, best_x, best_top, best_rotated ? rect.height : rect.width);
+  }
+
+  return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+struct PackRect {
+  int width;
+  int height;
+  int x;         // out, -1 if the rect didn't fit
+  int y;         // out
+  bool rotated;  // out, placed turned by 90 degrees so it covers height x width texels
+};
+
+// places the rects in the given order on a skyline, each one where its top ends up lowest (then leftmost). sorting
+// them tallest first packs best. returns false as soon as one doesn't fit, the rects after it are left unplaced.
+bool pack_skyline(PackRect* rects, unsigned rect_count, int bin_width, int bin_height, bool allow_rotation);
@@ -0,0 +1,247 @@
+#include "profile.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <vector>
+
+#define PROFILE_EVENTS_PER_THREAD (64 * 1024)
+#define PROFILE_FRAME_SAMPLES (4 * 1024)
+
+static const char* s_counter_names[PROFILE_COUNTER_COUNT] = {
+    "draw calls",
+    "GL calls",
+    "bytes uploaded",
+    "triangles packed",
+    "rays traced",
+};
+
+const char* profile_counter_name(ProfileCounter counter) {
+  return counter < PROFILE_COUNTER_COUNT ? s_counter_names[counter] : "unknown";
+}
+
+#if PROFILE_ENABLED
+
+struct ProfileEvent {
+  const char* name;
+  uint64_t start_ns;
+  uint64_t end_ns;
+};
+
+// only the thread using it writes to it, the atomics are there for the readers
+struct ProfileThread {
+  // a ring, the newest at (event_count - 1) % PROFILE_EVENTS_PER_THREAD
+  ProfileEvent events[PROFILE_EVENTS_PER_THREAD];
+  std::atomic<uint64_t> event_count;
+  std::atomic<uint64_t> counters[PROFILE_COUNTER_COUNT];
+  int id;       // the tid in the trace
+  bool in_use;  // by a running thread
+};
+
+struct ProfileFrameSample {
+  uint64_t time_ns;
+  uint64_t counters[PROFILE_COUNTER_COUNT];
+};
+
+// hands the ring back when the thread exits
+struct ProfileThreadSlot {
+  ProfileThread* thread;
+  ~ProfileThreadSlot();
+};
+
+static const std::chrono::steady_clock::time_point s_epoch = std::chrono::steady_clock::now();
+static std::mutex s_mutex;
+static std::vector<ProfileThread*> s_threads;  // never freed, see profile.h
+static int s_next_thread_id;
+static thread_local ProfileThreadSlot s_thread_slot;
+
+static uint64_t s_last_totals[PROFILE_COUNTER_COUNT];
+static uint64_t s_frame_counters[PROFILE_COUNTER_COUNT];
+static std::vector<ProfileFrameSample> s_frame_samples;  // a ring like the events
+static uint64_t s_frame_sample_count;
+
+ProfileThreadSlot::~ProfileThreadSlot() {
+  if (thread) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    thread->in_use = false;
+  }
+}
+
+static ProfileThread* profile_thread() {
+  ProfileThread* thread = s_thread_slot.thread;
+  if (thread) {
+    return thread;
+  }
+
+  std::lock_guard<std::mutex> lock(s_mutex);
+  for (ProfileThread* unused : s_threads) {
+    if (!unused->in_use) {
+      thread = unused;
+      break;
+    }
+  }
+  if (!thread) {
+    thread = new ProfileThread;
+    thread->event_count.store(0, std::memory_order_relaxed);
+    for (int counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+      thread->counters[counter].store(0, std::memory_order_relaxed);
+    }
+    s_threads.push_back(thread);
+  }
+  // a reused ring starts over as a new thread in the trace. its counters carry on, they only add to the totals
+  thread->event_count.store(0, std::memory_order_relaxed);
+  thread->id = s_next_thread_id++;
+  thread->in_use = true;
+  s_thread_slot.thread = thread;
+  return thread;
+}
+
+uint64_t profile_now_ns() {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_epoch)
+      .count();
+}
+
+void profile_event(const char* name, uint64_t start_ns, uint64_t end_ns) {
+  ProfileThread* thread = profile_thread();
+  const uint64_t index = thread->event_count.load(std::memory_order_relaxed);
+  ProfileEvent& event = thread->events[index % PROFILE_EVENTS_PER_THREAD];
+  event.name = name;
+  event.start_ns = start_ns;
+  event.end_ns = end_ns;
+  thread->event_count.store(index + 1, std::memory_order_release);
+}
+
+void profile_count(ProfileCounter counter, uint64_t value) {
+  // not a read-modify-write, nobody else writes this thread's counters
+  std::atomic<uint64_t>& total = profile_thread()->counters[counter];
+  total.store(total.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+static uint64_t counter_total_locked(ProfileCounter counter) {
+  uint64_t total = 0;
+  for (const ProfileThread* thread : s_threads) {
+    total += thread->counters[counter].load(std::memory_order_relaxed);
+  }
+  return total;
+}
+
+void profile_frame() {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  ProfileFrameSample sample;
+  sample.time_ns = profile_now_ns();
+  for (int counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+    const uint64_t total = counter_total_locked((ProfileCounter)counter);
+    s_frame_counters[counter] = total - s_last_totals[counter];
+    s_last_totals[counter] = total;
+    sample.counters[counter] = s_frame_counters[counter];
+  }
+
+  if (s_frame_samples.size() < PROFILE_FRAME_SAMPLES) {
+    s_frame_samples.push_back(sample);
+  }
+  else {
+    s_frame_samples[s_frame_sample_count % PROFILE_FRAME_SAMPLES] = sample;
+  }
+  ++s_frame_sample_count;
+}
+
+uint64_t profile_counter_total(ProfileCounter counter) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  return counter_total_locked(counter);
+}
+
+uint64_t profile_counter_frame(ProfileCounter counter) {
+  std::lock_guard<std::mutex> lock(s_mutex);
+  return s_frame_counters[counter];
+}
+
+static void write_json_string(FILE* file, const char* str) {
+  fputc('"', file);
+  for (; *str; ++str) {
+    if (*str == '"' || *str == '\\') {
+      fputc('\\', file);
+    }
+    fputc(*str, file);
+  }
+  fputc('"', file);
+}
+
+bool profile_write_chrome_trace(const char* filename) {
+  FILE* file = fopen(filename, "w");
+  if (!file) {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(s_mutex);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (const ProfileThread* thread : s_threads) {
+    fprintf(file,
+            "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+            first ? "" : ",\n",
+            thread->id,
+            thread->id);
+    first = false;
+
+    const uint64_t end = thread->event_count.load(std::memory_order_acquire);
+    const uint64_t begin = end > PROFILE_EVENTS_PER_THREAD ? end - PROFILE_EVENTS_PER_THREAD : 0;
+    for (uint64_t index = begin; index < end; ++index) {
+      const ProfileEvent& event = thread->events[index % PROFILE_EVENTS_PER_THREAD];
+      fprintf(file, ",\n{\"name\":");
+      write_json_string(file, event.name);
+      fprintf(file,
+              ",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+              thread->id,
+              event.start_ns * 1e-3,
+              (event.end_ns - event.start_ns) * 1e-3);
+    }
+  }
+
+  // a counter track each, in frame order
+  const uint64_t sample_begin =
+      s_frame_sample_count > PROFILE_FRAME_SAMPLES ? s_frame_sample_count - PROFILE_FRAME_SAMPLES : 0;
+  for (uint64_t index = sample_begin; index < s_frame_sample_count; ++index) {
+    const ProfileFrameSample& sample = s_frame_samples[index % PROFILE_FRAME_SAMPLES];
+    for (int counter = 0; counter < PROFILE_COUNTER_COUNT; ++counter) {
+      fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+      first = false;
+      write_json_string(file, s_counter_names[counter]);
+      fprintf(file,
+              ",\"ph\":\"C\",\"pid\":0,\"ts\":%.3f,\"args\":{\"value\":%llu}}",
+              sample.time_ns * 1e-3,
+              (unsigned long long)sample.counters[counter]);
+    }
+  }
+  fprintf(file, "\n]}\n");
+  return 0 == fclose(file);
+}
+
+#else
+
+uint64_t profile_now_ns() {
+  return 0;
+}
+
+void profile_event(const char* name, uint64_t start_ns, uint64_t end_ns) {
+}
+
+void profile_count(ProfileCounter counter, uint64_t value) {
+}
+
+void profile_frame() {
+}
+
+uint64_t profile_counter_total(ProfileCounter counter) {
+  return 0;
+}
+
+uint64_t profile_counter_frame(ProfileCounter counter) {
+  return 0;
+}
+
+bool profile_write_chrome_trace(const char* filename) {
+  fprintf(stderr, "ERROR: built with PROFILE_ENABLED 0, there's no trace to write\n");
+  return false;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+// scoped timers and counters for the hot paths. with PROFILE_ENABLED 0 the macros expand to nothing and the functions
+// are empty, so instrumented code costs nothing.
+//
+//   void bake_lightmap(...) {
+//     PROFILE_SCOPE("bake_lightmap");
+//     ...
+//     PROFILE_COUNT(PROFILE_COUNTER_RAYS_TRACED, ray_count);
+//   }
+//
+// every thread records into its own ring of the most recent events, no locks or atomics on the way. the rings of
+// threads that exit are kept and handed, emptied and under a new trace id, to the next new thread.
+//
+// off by default, every thread that records keeps a 1.5 MB ring for good. configure with -DGI_PROFILE=ON to record,
+// the timers don't measurably slow the bake.
+
+#ifndef PROFILE_ENABLED
+#define PROFILE_ENABLED 0
+#endif
+
+enum ProfileCounter {
+  PROFILE_COUNTER_DRAW_CALLS,
+  PROFILE_COUNTER_GL_CALLS,
+  PROFILE_COUNTER_BYTES_UPLOADED,
+  PROFILE_COUNTER_TRIANGLES_PACKED,
+  PROFILE_COUNTER_RAYS_TRACED,
+  PROFILE_COUNTER_COUNT,
+};
+
+#if PROFILE_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+// times the rest of the enclosing scope. `name` has to be a string literal, or at least outlive the export.
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter, value) profile_count(counter, (uint64_t)(value))
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter, value)
+#endif
+
+uint64_t profile_now_ns();
+void profile_event(const char* name, uint64_t start_ns, uint64_t end_ns);
+void profile_count(ProfileCounter counter, uint64_t value);
+
+struct ProfileScope {
+  const char* name;
+  uint64_t start_ns;
+
+  explicit ProfileScope(const char* name) : name(name), start_ns(profile_now_ns()) {}
+  ~ProfileScope() { profile_event(name, start_ns, profile_now_ns()); }
+};
+
+// closes a frame: the per frame counters become what was counted since the last call, and a sample of them goes into
+// the trace
+void profile_frame();
+
+const char* profile_counter_name(ProfileCounter counter);
+// everything counted so far, on every thread
+uint64_t profile_counter_total(ProfileCounter counter);
+// what was counted in the last frame profile_frame() closed
+uint64_t profile_counter_frame(ProfileCounter counter);
+
+// writes the recorded events and counter samples as Chrome trace JSON (chrome://tracing, ui.perfetto.dev). call it
+// while no other thread is recording, e.g. between frames or after the jobs have finished.
+bool profile_write_chrome_trace(const char* filename);
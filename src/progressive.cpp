@@ -0,0 +1,323 @@
+#include "progressive.h"
+#include "job.h"
+#include "profile.h"
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct ProgressiveJob {
+  ProgressiveBake* bake;
+  const uint32_t* tiles;
+};
+
+void progressive_settings_init(ProgressiveSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->samples_per_pass = 4;
+  settings->max_samples = 1024;
+  settings->max_bounces = 3;
+  settings->tile_size = 16;
+  settings->ray_bias = 0.001f;
+}
+
+ProgressiveBake* progressive_bake_create(const BakeScene* scene,
+                                         const TexelGbuffer* gbuffer,
+                                         const ProgressiveSettings* settings) {
+  PROFILE_SCOPE("progressive_bake_create");
+  ProgressiveBake* bake = new ProgressiveBake;
+  bake->scene = scene;
+  bake->gbuffer = gbuffer;
+  bake->settings = *settings;
+  bake->sums = nullptr;
+  bake->texel_ms = 0.0;
+  bake->light.pos = vectorial::vec3f::zero();
+  bake->light.color = vectorial::vec3f::zero();
+  bake->light.intensity = 0.0f;
+  bake->light.range = 0.0f;
+  bake->next_tile = 0;
+  const int tex_width = gbuffer->tex_width;
+  const int tex_height = gbuffer->tex_height;
+
+  bake->tile_shift = 0;
+  while ((1 << bake->tile_shift) < settings->tile_size) {
+    ++bake->tile_shift;
+  }
+  bake->settings.tile_size = 1 << bake->tile_shift;
+  bake->tiles_x = (tex_width + bake->settings.tile_size - 1) >> bake->tile_shift;
+  const int tiles_y = (tex_height + bake->settings.tile_size - 1) >> bake->tile_shift;
+  bake->atlas_tiles.assign(bake->tiles_x * tiles_y, -1);
+
+  // an aligned power of two square is one run of the Morton order
+  for (unsigned texel = 0; texel < bake->gbuffer->texel_count; ++texel) {
+    const uint32_t atlas_texel = bake->gbuffer->atlas_texels[texel];
+    const int tile_x = (int)(atlas_texel % tex_width) >> bake->tile_shift;
+    const int tile_y = (int)(atlas_texel / tex_width) >> bake->tile_shift;
+    int32_t& tile = bake->atlas_tiles[tile_y * bake->tiles_x + tile_x];
+    if (tile < 0) {
+      tile = (int32_t)bake->tiles.size();
+      ProgressiveTile new_tile;
+      new_tile.x = tile_x << bake->tile_shift;
+      new_tile.y = tile_y << bake->tile_shift;
+      new_tile.texel_begin = texel;
+      new_tile.sample_count = 0;
+      new_tile.dirty = false;
+      new_tile.dilate_sources = 0;
+      bake->tiles.push_back(new_tile);
+    }
+    bake->tiles[tile].texel_end = texel + 1;
+  }
+
+  // the empty texels on the edges of a tile that dilate from the covered ones across it
+  const int tile_mask = bake->settings.tile_size - 1;
+  for (int y = 0; y < tex_height; ++y) {
+    for (int x = 0; x < tex_width; ++x) {
+      const int32_t tile = bake->atlas_tiles[(y >> bake->tile_shift) * bake->tiles_x + (x >> bake->tile_shift)];
+      const bool edge = (x & tile_mask) == 0 || (x & tile_mask) == tile_mask || (y & tile_mask) == 0 ||
+                        (y & tile_mask) == tile_mask;
+      if (tile < 0 || !edge || gbuffer->tri_ids[y * tex_width + x] >= 0) {
+        continue;
+      }
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int nx = x + dx;
+          const int ny = y + dy;
+          if (nx < 0 || ny < 0 || nx >= tex_width || ny >= tex_height || gbuffer->tri_ids[ny * tex_width + nx] < 0) {
+            continue;
+          }
+          const int source_dx = (nx >> bake->tile_shift) - (x >> bake->tile_shift);
+          const int source_dy = (ny >> bake->tile_shift) - (y >> bake->tile_shift);
+          if (source_dx != 0 || source_dy != 0) {
+            bake->tiles[tile].dilate_sources |= (uint16_t)(1u << ((source_dy + 1) * 3 + source_dx + 1));
+          }
+        }
+      }
+    }
+  }
+
+  void* sums = nullptr;
+  if (posix_memalign(&sums, 16, bake->gbuffer->texel_count * 4 * sizeof(float) + 16) != 0) {
+    fprintf(stderr, "ERROR: out of memory for the progressive bake of %u lightmap texels\n", gbuffer->texel_count);
+    progressive_bake_destroy(bake);
+    return nullptr;
+  }
+  bake->sums = (float*)sums;
+  memset(bake->sums, 0, bake->gbuffer->texel_count * 4 * sizeof(float));
+  return bake;
+}
+
+void progressive_bake_destroy(ProgressiveBake* bake) {
+  if (!bake) {
+    return;
+  }
+
+  free(bake->sums);
+  delete bake;
+}
+
+void progressive_bake_restart(ProgressiveBake* bake, const Light& light) {
+  bake->light = light;
+  bake->next_tile = 0;
+  bake->dirty_tiles.clear();
+  for (ProgressiveTile& tile : bake->tiles) {
+    tile.sample_count = 0;
+    tile.dirty = false;
+  }
+  memset(bake->sums, 0, bake->gbuffer->texel_count * 4 * sizeof(float));
+}
+
+// one pass over a tile. every texel's paths are numbered on from the ones it has, in a sequence seeded by where it is
+// in the atlas, so the result doesn't depend on the thread or on how the passes were spread over the frames.
+static void progressive_refine_tile(void* user_data, int index) {
+  PROFILE_SCOPE("progressive_refine_tile");
+  const ProgressiveJob* job = (const ProgressiveJob*)user_data;
+  ProgressiveBake* bake = job->bake;
+  const ProgressiveSettings* settings = &bake->settings;
+  ProgressiveTile* tile = &bake->tiles[job->tiles[index]];
+  const int sample_count = std::min(settings->samples_per_pass, settings->max_samples - tile->sample_count);
+  unsigned ray_count = 0;
+
+  for (unsigned texel = tile->texel_begin; texel < tile->texel_end; ++texel) {
+    const vectorial::vec3f pos = texel_gbuffer_position(bake->gbuffer, texel);
+    const vectorial::vec3f normal = texel_gbuffer_normal(bake->gbuffer, texel);
+    vectorial::vec3f sum = vectorial::vec3f(bake->sums + 4 * texel);
+    for (int sample = 0; sample < sample_count; ++sample) {
+      BakeSampler sampler;
+      bake_sampler_start(&sampler, bake->gbuffer->atlas_texels[texel], (uint32_t)(tile->sample_count + sample));
+      sum += bake_trace_path(
+          bake->scene, bake->light, pos, normal, settings->max_bounces, settings->ray_bias, &sampler, &ray_count);
+    }
+    sum.store(bake->sums + 4 * texel);
+  }
+  tile->sample_count += sample_count;
+  PROFILE_COUNT(PROFILE_COUNTER_RAYS_TRACED, ray_count);
+}
+
+static void mark_dirty(ProgressiveBake* bake, uint32_t tile) {
+  if (!bake->tiles[tile].dirty) {
+    bake->tiles[tile].dirty = true;
+    bake->dirty_tiles.push_back(tile);
+  }
+}
+
+unsigned progressive_bake_refine(ProgressiveBake* bake, double budget_ms) {
+  PROFILE_SCOPE("progressive_bake_refine");
+  const auto start = std::chrono::steady_clock::now();
+  const unsigned tile_count = (unsigned)bake->tiles.size();
+  const unsigned worker_count = (unsigned)job_worker_count();
+  const int tiles_y = tile_count ? (int)bake->atlas_tiles.size() / bake->tiles_x : 0;
+  std::vector<uint32_t> batch;
+  unsigned refined = 0;
+
+  for (;;) {
+    const auto batch_start = std::chrono::steady_clock::now();
+    const double left_ms = budget_ms - std::chrono::duration<double, std::milli>(batch_start - start).count();
+    if (left_ms <= 0.0) {
+      break;
+    }
+
+    // the tiles still short of samples, in turn, as many as fit half of what's left so the batches shrink towards the
+    // end of the budget as the cost of the last ones comes in. a batch of one only has to fit all of it. until there's
+    // a cost to go by, a tile for every worker.
+    const double left_texels = bake->texel_ms > 0.0 ? left_ms * worker_count / bake->texel_ms
+                                                    : (double)worker_count * bake->settings.tile_size *
+                                                          bake->settings.tile_size;
+    unsigned batch_texels = 0;
+    batch.clear();
+    for (unsigned checked = 0; checked < tile_count; ++checked) {
+      const ProgressiveTile& tile = bake->tiles[bake->next_tile];
+      if (tile.sample_count < bake->settings.max_samples) {
+        const unsigned texel_count = tile.texel_end - tile.texel_begin;
+        const bool fits = batch.empty() ? !refined || texel_count <= left_texels
+                                        : batch_texels + texel_count <= 0.5 * left_texels;
+        if (!fits) {
+          break;
+        }
+        batch.push_back(bake->next_tile);
+        batch_texels += texel_count;
+      }
+      bake->next_tile = (bake->next_tile + 1) % tile_count;
+    }
+    if (batch.empty()) {
+      break;
+    }
+
+    ProgressiveJob job;
+    job.bake = bake;
+    job.tiles = batch.data();
+    job_parallel_for(&progressive_refine_tile, &job, (int)batch.size());
+    const double batch_ms =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - batch_start).count();
+    const double texel_ms = batch_ms * worker_count / batch_texels;
+    bake->texel_ms = bake->texel_ms > 0.0 ? 0.75 * bake->texel_ms + 0.25 * texel_ms : texel_ms;
+
+    // the neighbours whose dilated texels read the refined ones have to go up again too
+    for (uint32_t tile : batch) {
+      mark_dirty(bake, tile);
+      const int tile_x = bake->tiles[tile].x >> bake->tile_shift;
+      const int tile_y = bake->tiles[tile].y >> bake->tile_shift;
+      for (int dy = -1; dy <= 1; ++dy) {
+        for (int dx = -1; dx <= 1; ++dx) {
+          const int neighbour_x = tile_x - dx;
+          const int neighbour_y = tile_y - dy;
+          if ((dx == 0 && dy == 0) || neighbour_x < 0 || neighbour_y < 0 || neighbour_x >= bake->tiles_x ||
+              neighbour_y >= tiles_y) {
+            continue;
+          }
+          const int32_t neighbour = bake->atlas_tiles[neighbour_y * bake->tiles_x + neighbour_x];
+          if (neighbour >= 0 && (bake->tiles[neighbour].dilate_sources >> ((dy + 1) * 3 + dx + 1)) & 1) {
+            mark_dirty(bake, (uint32_t)neighbour);
+          }
+        }
+      }
+    }
+    refined += (unsigned)batch.size();
+  }
+  return refined;
+}
+
+unsigned progressive_bake_take_dirty(ProgressiveBake* bake, uint32_t* tiles, unsigned max_tiles) {
+  const unsigned count = std::min(max_tiles, (unsigned)bake->dirty_tiles.size());
+  for (unsigned index = 0; index < count; ++index) {
+    tiles[index] = bake->dirty_tiles[index];
+    bake->tiles[tiles[index]].dirty = false;
+  }
+  bake->dirty_tiles.erase(bake->dirty_tiles.begin(), bake->dirty_tiles.begin() + count);
+  return count;
+}
+
+void progressive_bake_tile_rect(const ProgressiveBake* bake, uint32_t tile, int* x, int* y, int* width, int* height) {
+  *x = bake->tiles[tile].x;
+  *y = bake->tiles[tile].y;
+  *width = std::min(bake->settings.tile_size, bake->gbuffer->tex_width - *x);
+  *height = std::min(bake->settings.tile_size, bake->gbuffer->tex_height - *y);
+}
+
+// the average of the texel's samples, false if it's empty or has none yet
+static bool read_texel(const ProgressiveBake* bake, int x, int y, float* rgb) {
+  const TexelGbuffer* gbuffer = bake->gbuffer;
+  if (x < 0 || y < 0 || x >= gbuffer->tex_width || y >= gbuffer->tex_height) {
+    return false;
+  }
+  const int32_t texel = gbuffer->texel_indices[y * gbuffer->tex_width + x];
+  if (texel < 0) {
+    return false;
+  }
+  const int32_t tile = bake->atlas_tiles[(y >> bake->tile_shift) * bake->tiles_x + (x >> bake->tile_shift)];
+  const int sample_count = bake->tiles[tile].sample_count;
+  if (sample_count == 0) {
+    return false;
+  }
+  for (int channel = 0; channel < 3; ++channel) {
+    rgb[channel] = bake->sums[4 * texel + channel] / sample_count;
+  }
+  return true;
+}
+
+void progressive_bake_read_tile(const ProgressiveBake* bake, uint32_t tile, float* texels) {
+  int tile_x;
+  int tile_y;
+  int width;
+  int height;
+  progressive_bake_tile_rect(bake, tile, &tile_x, &tile_y, &width, &height);
+
+  for (int y = tile_y; y < tile_y + height; ++y) {
+    for (int x = tile_x; x < tile_x + width; ++x) {
+      float* out = texels + 3 * ((y - tile_y) * width + (x - tile_x));
+      if (read_texel(bake, x, y, out)) {
+        continue;
+      }
+
+      float sum[3] = {0.0f, 0.0f, 0.0f};
+      int count = 0;
+      if (bake->gbuffer->tri_ids[y * bake->gbuffer->tex_width + x] < 0) {
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dx = -1; dx <= 1; ++dx) {
+            float rgb[3];
+            if (read_texel(bake, x + dx, y + dy, rgb)) {
+              sum[0] += rgb[0];
+              sum[1] += rgb[1];
+              sum[2] += rgb[2];
+              ++count;
+            }
+          }
+        }
+      }
+      for (int channel = 0; channel < 3; ++channel) {
+        out[channel] = count > 0 ? sum[channel] / count : 0.0f;
+      }
+    }
+  }
+}
+
+float progressive_bake_progress(const ProgressiveBake* bake) {
+  uint64_t samples = 0;
+  for (const ProgressiveTile& tile : bake->tiles) {
+    samples += (uint64_t)tile.sample_count * (tile.texel_end - tile.texel_begin);
+  }
+  const uint64_t max_samples = (uint64_t)bake->settings.max_samples * bake->gbuffer->texel_count;
+  return max_samples ? (float)((double)samples / max_samples) : 1.0f;
+}
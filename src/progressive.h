@@ -0,0 +1,74 @@
+#pragma once
+#include "bake.h"
+#include "texel_gbuffer.h"
+#include <stdint.h>
+#include <vector>
+
+struct ProgressiveSettings {
+  int samples_per_pass;  // indirect paths every texel of a tile traces each time the tile comes up
+  int max_samples;       // a texel is done after this many
+  int max_bounces;
+  int tile_size;         // atlas texels along a tile's side, rounded up to a power of two
+  float ray_bias;
+};
+
+void progressive_settings_init(ProgressiveSettings* settings);
+
+// a square of the atlas and the G-buffer texels in it, which are contiguous since they're in Morton order
+struct ProgressiveTile {
+  int x;  // atlas texel of the top left corner
+  int y;
+  unsigned texel_begin;
+  unsigned texel_end;
+  int sample_count;         // of every texel in it
+  bool dirty;               // refined since it was last taken
+  uint16_t dilate_sources;  // bit (dy + 1) * 3 + dx + 1 for the tiles around it that its dilated texels read
+};
+
+// path traces the bounced light of a lightmap a few samples at a time, for a host that wants to see it converge while
+// it keeps drawing frames. the tiles come up in turn, so every one of them gets its first samples before any gets
+// more. the refined tiles queue up to be taken and uploaded.
+struct ProgressiveBake {
+  const BakeScene* scene;  // the caller's, both outlive the bake
+  const TexelGbuffer* gbuffer;
+  ProgressiveSettings settings;
+  std::vector<ProgressiveTile> tiles;  // only the ones with texels, in Morton order
+  std::vector<int32_t> atlas_tiles;    // tile of every square of the atlas, -1 for empty ones
+  int tiles_x;
+  int tile_shift;
+  float* sums;     // 4 floats a G-buffer texel, rgb and a pad
+  double texel_ms;  // what a pass over one texel has cost a worker lately, 0 until the first batch
+
+  Light light;
+  unsigned next_tile;                 // the one to refine next
+  std::vector<uint32_t> dirty_tiles;  // oldest first
+};
+
+// refines the texels of `gbuffer`, built over `scene`. both stay the caller's and may be shared with a Transfer.
+// returns nullptr if it runs out of memory.
+ProgressiveBake* progressive_bake_create(const BakeScene* scene,
+                                         const TexelGbuffer* gbuffer,
+                                         const ProgressiveSettings* settings);
+void progressive_bake_destroy(ProgressiveBake* bake);
+
+// drops every sample and starts over with `light`. the tiles come up again from the first.
+void progressive_bake_restart(ProgressiveBake* bake, const Light& light);
+
+// refines tiles on the job system until `budget_ms` is spent or every texel has `max_samples`. every batch takes the
+// tiles the workers are expected to get through in what's left of the budget, going by what the last ones cost, and
+// at least one tile a call. returns the tiles refined.
+unsigned progressive_bake_refine(ProgressiveBake* bake, double budget_ms);
+
+// moves up to `max_tiles` of the oldest refined tiles to `tiles` and returns how many
+unsigned progressive_bake_take_dirty(ProgressiveBake* bake, uint32_t* tiles, unsigned max_tiles);
+
+// the part of the tile inside the atlas
+void progressive_bake_tile_rect(const ProgressiveBake* bake, uint32_t tile, int* x, int* y, int* width, int* height);
+
+// writes the bounced light of the tile as tightly packed RGB floats, rows of the width
+// progressive_bake_tile_rect() gives. the empty texels next to covered ones are dilated like bake_dilate() does, also
+// from the tiles around it, so refining a tile queues the neighbours that dilate from it as well.
+void progressive_bake_read_tile(const ProgressiveBake* bake, uint32_t tile, float* texels);
+
+// how far the texels are on their way to `max_samples`, from 0 to 1
+float progressive_bake_progress(const ProgressiveBake* bake);
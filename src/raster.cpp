@@ -0,0 +1,285 @@
+#include "raster.h"
+#include "job.h"
+#include "simd.h"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+// edge i runs from corner i+1 to corner i+2, counter-clockwise. the edge functions are evaluated straight from the
+// corners at every texel instead of stepped, so a center exactly on a shared edge lands on the same side for both
+// triangles and the fill rule holds.
+struct RasterTri {
+  float edge_x[3];
+  float edge_y[3];
+  float dx[3];
+  float dy[3];
+  float extent[3];   // how much the edge function can grow from a texel center to its furthest corner
+  float epsilon[3];  // rounding slack for the block tests
+  bool top_left[3];
+  bool has_area;
+  int x0;  // texels the bounds overlap, inclusive
+  int y0;
+  int x1;
+  int y1;
+};
+
+struct RasterJob {
+  int32_t* tri_ids;
+  uint8_t* coverage;
+  int tex_width;
+  int tex_height;
+  int tile_size;
+  int tiles_x;
+  bool conservative;
+  const RasterTri* tris;
+  const uint32_t* tile_offsets;  // tile_count + 1
+  const uint32_t* tile_tris;
+};
+
+static float edge_function(float ax, float ay, float bx, float by, float x, float y) {
+  return (bx - ax) * (y - ay) - (by - ay) * (x - ax);
+}
+
+static bool is_top_left_edge(float ax, float ay, float bx, float by) {
+  // assumes counter-clockwise winding with +y up, matching GL's window space
+  return (ay == by && bx < ax) || (by < ay);
+}
+
+static bool raster_tri_setup(RasterTri* tri, const float* uvs, int tex_width, int tex_height) {
+  float x[3], y[3];
+  for (int corner = 0; corner < 3; ++corner) {
+    x[corner] = uvs[2 * corner + 0] * (float)tex_width;
+    y[corner] = uvs[2 * corner + 1] * (float)tex_height;
+  }
+
+  // make the winding counter-clockwise so the fill rule is consistent
+  const float area = edge_function(x[0], y[0], x[1], y[1], x[2], y[2]);
+  if (area < 0.0f) {
+    std::swap(x[1], x[2]);
+    std::swap(y[1], y[2]);
+  }
+  tri->has_area = area != 0.0f;
+
+  for (int edge = 0; edge < 3; ++edge) {
+    const int a = (edge + 1) % 3;
+    const int b = (edge + 2) % 3;
+    tri->edge_x[edge] = x[a];
+    tri->edge_y[edge] = y[a];
+    tri->dx[edge] = x[b] - x[a];
+    tri->dy[edge] = y[b] - y[a];
+    tri->extent[edge] = 0.5f * (fabsf(tri->dx[edge]) + fabsf(tri->dy[edge]));
+    tri->epsilon[edge] = tri->extent[edge] * (float)(tex_width + tex_height) * 1e-5f;
+    tri->top_left[edge] = is_top_left_edge(x[a], y[a], x[b], y[b]);
+  }
+
+  const float lo_x = std::min(x[0], std::min(x[1], x[2]));
+  const float lo_y = std::min(y[0], std::min(y[1], y[2]));
+  const float hi_x = std::max(x[0], std::max(x[1], x[2]));
+  const float hi_y = std::max(y[0], std::max(y[1], y[2]));
+  tri->x0 = std::max(0, (int)floorf(lo_x));
+  tri->y0 = std::max(0, (int)floorf(lo_y));
+  tri->x1 = std::min(tex_width - 1, std::max((int)ceilf(hi_x) - 1, (int)floorf(lo_x)));
+  tri->y1 = std::min(tex_height - 1, std::max((int)ceilf(hi_y) - 1, (int)floorf(lo_y)));
+  return tri->x0 <= tri->x1 && tri->y0 <= tri->y1;
+}
+
+// tests every texel of a 4x4 block, a row of 4 at a time
+static void raster_block(const RasterJob* job,
+                         const RasterTri& tri,
+                         int32_t tri_index,
+                         int block_x,
+                         int block_y,
+                         int x0,
+                         int y0,
+                         int x1,
+                         int y1) {
+  const simd4f zero = simd4f_zero();
+  const simd4f cx = simd4f_add(simd4f_splat((float)block_x), simd4f_create(0.5f, 1.5f, 2.5f, 3.5f));
+  simd4f dy[3], extent[3], top_left[3];
+  for (int edge = 0; edge < 3; ++edge) {
+    dy[edge] = simd4f_mul(simd4f_splat(tri.dy[edge]), simd4f_sub(cx, simd4f_splat(tri.edge_x[edge])));
+    extent[edge] = simd4f_splat(tri.extent[edge]);
+    top_left[edge] = tri.top_left[edge] ? simd4f_cmpge(zero, zero) : zero;
+  }
+
+  // drop the lanes outside the bounds, the edge tests alone overshoot near sharp corners
+  const int lane_lo = std::max(x0 - block_x, 0);
+  const int lane_hi = std::min(x1 - block_x, 3);
+  const int lanes = ((1 << (lane_hi + 1)) - 1) & ~((1 << lane_lo) - 1);
+
+  for (int y = std::max(block_y, y0), y_end = std::min(block_y + 3, y1); y <= y_end; ++y) {
+    const float cy = y + 0.5f;
+    simd4f inside = simd4f_cmpge(zero, zero);
+    simd4f overlap = inside;
+    for (int edge = 0; edge < 3; ++edge) {
+      const simd4f w = simd4f_sub(simd4f_splat(tri.dx[edge] * (cy - tri.edge_y[edge])), dy[edge]);
+      inside = simd4f_and(inside, simd4f_or(simd4f_cmpgt(w, zero), simd4f_and(simd4f_cmpge(w, zero), top_left[edge])));
+      overlap = simd4f_and(overlap, simd4f_cmpge(simd4f_add(w, extent[edge]), zero));
+    }
+
+    const int center_mask = tri.has_area ? simd4f_movemask(inside) & lanes : 0;
+    const int overlap_mask = job->conservative ? simd4f_movemask(overlap) & lanes & ~center_mask : 0;
+    if (0 == (center_mask | overlap_mask)) {
+      continue;
+    }
+
+    // branch-free, the lane patterns along triangle edges don't predict well
+    int32_t* tri_ids = job->tri_ids + y * job->tex_width + block_x;
+    uint8_t* coverage = job->coverage + y * job->tex_width + block_x;
+    for (int lane = lane_lo; lane <= lane_hi; ++lane) {
+      const bool center = (center_mask >> lane) & 1;
+      const bool overlap = ((overlap_mask >> lane) & 1) && coverage[lane] != RASTER_COVERAGE_CENTER;
+      tri_ids[lane] = center || overlap ? tri_index : tri_ids[lane];
+      coverage[lane] = center ? (uint8_t)RASTER_COVERAGE_CENTER
+                              : overlap ? (uint8_t)RASTER_COVERAGE_CONSERVATIVE : coverage[lane];
+    }
+  }
+}
+
+// walks the 4x4 blocks of the triangle's bounds. blocks entirely outside every texel it could overlap are skipped
+// and blocks whose texel centers are all safely inside are filled without testing each texel.
+static void raster_tri(const RasterJob* job, const RasterTri& tri, int32_t tri_index, int x0, int y0, int x1, int y1) {
+  for (int block_y = y0 & ~3; block_y <= y1; block_y += 4) {
+    // the edge functions at the block centers step linearly along the row. the texel centers of a block are within
+    // 3 extents of its center and the texels it could overlap are within 4.
+    const float cy = block_y + 2.0f;
+    float w[3], reject_bias[3], accept_bias[3];
+    for (int edge = 0; edge < 3; ++edge) {
+      w[edge] = tri.dx[edge] * (cy - tri.edge_y[edge]) - tri.dy[edge] * ((x0 & ~3) + 2.0f - tri.edge_x[edge]);
+      reject_bias[edge] = -4.0f * tri.extent[edge] - tri.epsilon[edge];
+      accept_bias[edge] = 3.0f * tri.extent[edge] + tri.epsilon[edge];
+    }
+
+    for (int block_x = x0 & ~3; block_x <= x1; block_x += 4) {
+      const bool reject = (w[0] < reject_bias[0]) | (w[1] < reject_bias[1]) | (w[2] < reject_bias[2]);
+      const bool accept =
+          tri.has_area & (w[0] > accept_bias[0]) & (w[1] > accept_bias[1]) & (w[2] > accept_bias[2]);
+      for (int edge = 0; edge < 3; ++edge) {
+        w[edge] -= 4.0f * tri.dy[edge];
+      }
+      if (reject) {
+        continue;
+      }
+      if (!accept) {
+        raster_block(job, tri, tri_index, block_x, block_y, x0, y0, x1, y1);
+        continue;
+      }
+
+      const int fill_x0 = std::max(block_x, x0);
+      const int fill_x1 = std::min(block_x + 3, x1);
+      for (int y = std::max(block_y, y0), y_end = std::min(block_y + 3, y1); y <= y_end; ++y) {
+        for (int x = fill_x0; x <= fill_x1; ++x) {
+          job->tri_ids[y * job->tex_width + x] = tri_index;
+          job->coverage[y * job->tex_width + x] = RASTER_COVERAGE_CENTER;
+        }
+      }
+    }
+  }
+}
+
+static void raster_tile(void* user_data, int tile_index) {
+  const RasterJob* job = (const RasterJob*)user_data;
+  const int tile_x0 = (tile_index % job->tiles_x) * job->tile_size;
+  const int tile_y0 = (tile_index / job->tiles_x) * job->tile_size;
+  const int tile_x1 = std::min(tile_x0 + job->tile_size, job->tex_width) - 1;
+  const int tile_y1 = std::min(tile_y0 + job->tile_size, job->tex_height) - 1;
+
+  for (int y = tile_y0; y <= tile_y1; ++y) {
+    for (int x = tile_x0; x <= tile_x1; ++x) {
+      job->tri_ids[y * job->tex_width + x] = -1;
+      job->coverage[y * job->tex_width + x] = RASTER_COVERAGE_NONE;
+    }
+  }
+
+  // the tile's triangles are in index order, so the highest index wins like it would drawing them one by one
+  for (uint32_t ref = job->tile_offsets[tile_index]; ref < job->tile_offsets[tile_index + 1]; ++ref) {
+    const uint32_t tri_index = job->tile_tris[ref];
+    const RasterTri& tri = job->tris[tri_index];
+    raster_tri(job,
+               tri,
+               (int32_t)tri_index,
+               std::max(tri.x0, tile_x0),
+               std::max(tri.y0, tile_y0),
+               std::min(tri.x1, tile_x1),
+               std::min(tri.y1, tile_y1));
+  }
+}
+
+void raster_settings_init(RasterSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->tile_size = 32;
+  settings->conservative = true;
+}
+
+void raster_triangles(int32_t* tri_ids,
+                      uint8_t* coverage,
+                      int tex_width,
+                      int tex_height,
+                      const float* uvs,
+                      unsigned tri_count,
+                      const RasterSettings* settings) {
+  RasterJob job;
+  job.tri_ids = tri_ids;
+  job.coverage = coverage ? coverage : (uint8_t*)malloc(tex_width * tex_height);
+  job.tex_width = tex_width;
+  job.tex_height = tex_height;
+  job.tile_size = (std::max(settings->tile_size, 4) + 3) & ~3;
+  job.tiles_x = (tex_width + job.tile_size - 1) / job.tile_size;
+  job.conservative = settings->conservative;
+  const int tiles_y = (tex_height + job.tile_size - 1) / job.tile_size;
+  const int tile_count = job.tiles_x * tiles_y;
+
+  // set up every triangle and bin it into the tiles its bounds touch, counting first so each tile's list is contiguous
+  RasterTri* tris = (RasterTri*)malloc(std::max(tri_count, 1U) * sizeof(RasterTri));
+  bool* visible = (bool*)malloc(std::max(tri_count, 1U) * sizeof(bool));
+  uint32_t* tile_offsets = (uint32_t*)calloc(tile_count + 1, sizeof(uint32_t));
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    RasterTri& tri = tris[tri_index];
+    visible[tri_index] = raster_tri_setup(&tri, uvs + 6 * tri_index, tex_width, tex_height);
+    if (!visible[tri_index]) {
+      continue;
+    }
+    for (int ty = tri.y0 / job.tile_size; ty <= tri.y1 / job.tile_size; ++ty) {
+      for (int tx = tri.x0 / job.tile_size; tx <= tri.x1 / job.tile_size; ++tx) {
+        ++tile_offsets[ty * job.tiles_x + tx + 1];
+      }
+    }
+  }
+  for (int tile = 0; tile < tile_count; ++tile) {
+    tile_offsets[tile + 1] += tile_offsets[tile];
+  }
+
+  uint32_t* tile_tris = (uint32_t*)malloc(std::max(tile_offsets[tile_count], 1U) * sizeof(uint32_t));
+  uint32_t* tile_cursors = (uint32_t*)malloc(tile_count * sizeof(uint32_t));
+  for (int tile = 0; tile < tile_count; ++tile) {
+    tile_cursors[tile] = tile_offsets[tile];
+  }
+  for (unsigned tri_index = 0; tri_index < tri_count; ++tri_index) {
+    if (!visible[tri_index]) {
+      continue;
+    }
+    const RasterTri& tri = tris[tri_index];
+    for (int ty = tri.y0 / job.tile_size; ty <= tri.y1 / job.tile_size; ++ty) {
+      for (int tx = tri.x0 / job.tile_size; tx <= tri.x1 / job.tile_size; ++tx) {
+        tile_tris[tile_cursors[ty * job.tiles_x + tx]++] = tri_index;
+      }
+    }
+  }
+
+  job.tris = tris;
+  job.tile_offsets = tile_offsets;
+  job.tile_tris = tile_tris;
+  job_parallel_for(&raster_tile, &job, tile_count);
+
+  free(tile_cursors);
+  free(tile_tris);
+  free(tile_offsets);
+  free(visible);
+  free(tris);
+  if (!coverage) {
+    free(job.coverage);
+  }
+}
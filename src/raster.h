@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+enum RasterCoverage {
+  RASTER_COVERAGE_NONE,
+  RASTER_COVERAGE_CENTER,        // the texel center is inside a triangle, using GL's top-left fill rule
+  RASTER_COVERAGE_CONSERVATIVE,  // a triangle overlaps the texel but no triangle covers its center
+};
+
+struct RasterSettings {
+  int tile_size;      // rounded up to a multiple of 4
+  bool conservative;  // also mark texels a triangle only partly overlaps, so slivers that miss every center show up
+};
+
+void raster_settings_init(RasterSettings* settings);
+
+// rasterizes triangles given as three float2 uvs each into a tex_width x tex_height grid. `tri_ids` gets the index of
+// the triangle covering each texel or -1, `coverage` (optional) gets a RasterCoverage per texel. where triangles
+// overlap the highest index wins, center coverage always wins over conservative coverage. the grid is binned into
+// tiles that are rasterized on the job system, 4 texels at a time.
+void raster_triangles(int32_t* tri_ids,
+                      uint8_t* coverage,
+                      int tex_width,
+                      int tex_height,
+                      const float* uvs,
+                      unsigned tri_count,
+                      const RasterSettings* settings);
@@ -0,0 +1,54 @@
+#include "render_queue.h"
+#include <string.h>
+
+uint64_t render_key(unsigned program, unsigned polygon_mode, unsigned vertex_array, float depth) {
+  // non-negative floats order the same as their bits
+  depth = depth > 0.0f ? (depth < 1.0f ? depth : 1.0f) : 0.0f;
+  uint32_t depth_bits;
+  memcpy(&depth_bits, &depth, sizeof(depth_bits));
+
+  uint64_t key = program & ((1U << RENDER_KEY_PROGRAM_BITS) - 1);
+  key = (key << RENDER_KEY_POLYGON_MODE_BITS) | (polygon_mode & ((1U << RENDER_KEY_POLYGON_MODE_BITS) - 1));
+  key = (key << RENDER_KEY_VERTEX_ARRAY_BITS) | (vertex_array & ((1U << RENDER_KEY_VERTEX_ARRAY_BITS) - 1));
+  key = (key << RENDER_KEY_DEPTH_BITS) | depth_bits;
+  return key;
+}
+
+void render_queue_sort(RenderItem* items, RenderItem* scratch, size_t count) {
+  // one pass over the keys builds the histograms of all 8 digits
+  size_t histograms[8][256];
+  memset(histograms, 0, sizeof(histograms));
+  for (size_t index = 0; index < count; ++index) {
+    const uint64_t key = items[index].key;
+    for (int digit = 0; digit < 8; ++digit) {
+      ++histograms[digit][(key >> (8 * digit)) & 0xff];
+    }
+  }
+
+  RenderItem* src = items;
+  RenderItem* dst = scratch;
+  for (int digit = 0; digit < 8; ++digit) {
+    size_t* histogram = histograms[digit];
+    if (count == 0 || histogram[(src[0].key >> (8 * digit)) & 0xff] == count) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (int bucket = 0; bucket < 256; ++bucket) {
+      const size_t bucket_count = histogram[bucket];
+      histogram[bucket] = offset;
+      offset += bucket_count;
+    }
+    for (size_t index = 0; index < count; ++index) {
+      dst[histogram[(src[index].key >> (8 * digit)) & 0xff]++] = src[index];
+    }
+
+    RenderItem* swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != items) {
+    memcpy(items, src, count * sizeof(RenderItem));
+  }
+}
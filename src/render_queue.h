@@ -0,0 +1,24 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// a draw and the state it needs, packed into a key so sorting the queue puts draws that share state next to each
+// other. from the top bit down: program, polygon mode, vertex array and depth, so depth only orders the draws out of
+// one vertex array, front to back. the fields are truncated to their bits, so the key only decides the order and
+// whoever submits still has to compare the real state.
+struct RenderItem {
+  uint64_t key;
+  uint32_t index;  // whatever the submitter needs to find the draw again
+};
+
+#define RENDER_KEY_PROGRAM_BITS 8
+#define RENDER_KEY_POLYGON_MODE_BITS 2
+#define RENDER_KEY_VERTEX_ARRAY_BITS 22
+#define RENDER_KEY_DEPTH_BITS 32
+
+// `depth` is clamped to [0, 1], nearer sorts first
+uint64_t render_key(unsigned program, unsigned polygon_mode, unsigned vertex_array, float depth);
+
+// sorts by key with a least significant digit radix sort, 8 bits a pass, skipping the passes where every key has the
+// same digit. items with the same key keep their order. `scratch` has room for `count` items.
+void render_queue_sort(RenderItem* items, RenderItem* scratch, size_t count);
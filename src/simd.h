@@ -0,0 +1,137 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <vectorial/simd4f.h>
+
+// the lane-wise compares, masks and selects that vectorial's simd4f doesn't have, on the same backend config.h picks.
+// a mask is a simd4f with every bit of a lane set for true and clear for false. simd4f_movemask() packs the lanes into
+// the low 4 bits of an int, lane 0 in bit 0.
+
+#if defined(VECTORIAL_SSE)
+
+vectorial_inline simd4f simd4f_cmplt(simd4f a, simd4f b) { return _mm_cmplt_ps(a, b); }
+vectorial_inline simd4f simd4f_cmple(simd4f a, simd4f b) { return _mm_cmple_ps(a, b); }
+vectorial_inline simd4f simd4f_cmpgt(simd4f a, simd4f b) { return _mm_cmpgt_ps(a, b); }
+vectorial_inline simd4f simd4f_cmpge(simd4f a, simd4f b) { return _mm_cmpge_ps(a, b); }
+vectorial_inline simd4f simd4f_and(simd4f a, simd4f b) { return _mm_and_ps(a, b); }
+vectorial_inline simd4f simd4f_or(simd4f a, simd4f b) { return _mm_or_ps(a, b); }
+vectorial_inline simd4f simd4f_abs(simd4f v) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), v); }
+vectorial_inline int simd4f_movemask(simd4f mask) { return _mm_movemask_ps(mask); }
+
+// mask ? a : b
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+#if defined(VECTORIAL_USE_SSE4_1)
+  return _mm_blendv_ps(b, a, mask);
+#else
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+#endif
+}
+
+#elif defined(VECTORIAL_NEON)
+
+vectorial_inline simd4f simd4f_cmplt(simd4f a, simd4f b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+vectorial_inline simd4f simd4f_cmple(simd4f a, simd4f b) { return vreinterpretq_f32_u32(vcleq_f32(a, b)); }
+vectorial_inline simd4f simd4f_cmpgt(simd4f a, simd4f b) { return vreinterpretq_f32_u32(vcgtq_f32(a, b)); }
+vectorial_inline simd4f simd4f_cmpge(simd4f a, simd4f b) { return vreinterpretq_f32_u32(vcgeq_f32(a, b)); }
+vectorial_inline simd4f simd4f_and(simd4f a, simd4f b) {
+  return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+vectorial_inline simd4f simd4f_or(simd4f a, simd4f b) {
+  return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b)));
+}
+vectorial_inline simd4f simd4f_abs(simd4f v) { return vabsq_f32(v); }
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+  return vbslq_f32(vreinterpretq_u32_f32(mask), a, b);
+}
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+  const uint32x4_t bits = vshrq_n_u32(vreinterpretq_u32_f32(mask), 31);
+  return (int)(vgetq_lane_u32(bits, 0) | (vgetq_lane_u32(bits, 1) << 1) | (vgetq_lane_u32(bits, 2) << 2) |
+               (vgetq_lane_u32(bits, 3) << 3));
+}
+
+#elif defined(VECTORIAL_GNU)
+
+typedef int simd4i __attribute__((vector_size(16)));
+
+vectorial_inline simd4f simd4f_cmplt(simd4f a, simd4f b) { return (simd4f)(a < b); }
+vectorial_inline simd4f simd4f_cmple(simd4f a, simd4f b) { return (simd4f)(a <= b); }
+vectorial_inline simd4f simd4f_cmpgt(simd4f a, simd4f b) { return (simd4f)(a > b); }
+vectorial_inline simd4f simd4f_cmpge(simd4f a, simd4f b) { return (simd4f)(a >= b); }
+vectorial_inline simd4f simd4f_and(simd4f a, simd4f b) { return (simd4f)((simd4i)a & (simd4i)b); }
+vectorial_inline simd4f simd4f_or(simd4f a, simd4f b) { return (simd4f)((simd4i)a | (simd4i)b); }
+vectorial_inline simd4f simd4f_abs(simd4f v) {
+  const simd4i sign = {(int)0x80000000, (int)0x80000000, (int)0x80000000, (int)0x80000000};
+  return (simd4f)((simd4i)v & ~sign);
+}
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+  return (simd4f)(((simd4i)mask & (simd4i)a) | (~(simd4i)mask & (simd4i)b));
+}
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+  const simd4i bits = (simd4i)mask;
+  return (bits[0] < 0) | ((bits[1] < 0) << 1) | ((bits[2] < 0) << 2) | ((bits[3] < 0) << 3);
+}
+
+#else  // VECTORIAL_SCALAR
+
+vectorial_inline float simd4f_lane_mask(bool value) {
+  const uint32_t bits = value ? 0xffffffffU : 0U;
+  float lane;
+  memcpy(&lane, &bits, sizeof(lane));
+  return lane;
+}
+
+vectorial_inline uint32_t simd4f_lane_bits(float lane) {
+  uint32_t bits;
+  memcpy(&bits, &lane, sizeof(bits));
+  return bits;
+}
+
+vectorial_inline float simd4f_lane_from_bits(uint32_t bits) {
+  float lane;
+  memcpy(&lane, &bits, sizeof(lane));
+  return lane;
+}
+
+#define SIMD4F_SCALAR_CMP(name, op)                                                              \
+  vectorial_inline simd4f name(simd4f a, simd4f b) {                                             \
+    return simd4f_create(simd4f_lane_mask(a.x op b.x), simd4f_lane_mask(a.y op b.y),             \
+                         simd4f_lane_mask(a.z op b.z), simd4f_lane_mask(a.w op b.w));            \
+  }
+#define SIMD4F_SCALAR_BITS(name, expr)                                                           \
+  vectorial_inline simd4f name(simd4f a, simd4f b) {                                             \
+    uint32_t x, y;                                                                               \
+    simd4f r;                                                                                    \
+    x = simd4f_lane_bits(a.x), y = simd4f_lane_bits(b.x), r.x = simd4f_lane_from_bits(expr);     \
+    x = simd4f_lane_bits(a.y), y = simd4f_lane_bits(b.y), r.y = simd4f_lane_from_bits(expr);     \
+    x = simd4f_lane_bits(a.z), y = simd4f_lane_bits(b.z), r.z = simd4f_lane_from_bits(expr);     \
+    x = simd4f_lane_bits(a.w), y = simd4f_lane_bits(b.w), r.w = simd4f_lane_from_bits(expr);     \
+    return r;                                                                                    \
+  }
+
+SIMD4F_SCALAR_CMP(simd4f_cmplt, <)
+SIMD4F_SCALAR_CMP(simd4f_cmple, <=)
+SIMD4F_SCALAR_CMP(simd4f_cmpgt, >)
+SIMD4F_SCALAR_CMP(simd4f_cmpge, >=)
+SIMD4F_SCALAR_BITS(simd4f_and, x & y)
+SIMD4F_SCALAR_BITS(simd4f_or, x | y)
+
+#undef SIMD4F_SCALAR_BITS
+#undef SIMD4F_SCALAR_CMP
+
+vectorial_inline simd4f simd4f_abs(simd4f v) { return simd4f_create(fabsf(v.x), fabsf(v.y), fabsf(v.z), fabsf(v.w)); }
+
+vectorial_inline simd4f simd4f_select(simd4f mask, simd4f a, simd4f b) {
+  return simd4f_create(simd4f_lane_bits(mask.x) ? a.x : b.x,
+                       simd4f_lane_bits(mask.y) ? a.y : b.y,
+                       simd4f_lane_bits(mask.z) ? a.z : b.z,
+                       simd4f_lane_bits(mask.w) ? a.w : b.w);
+}
+
+vectorial_inline int simd4f_movemask(simd4f mask) {
+  return (int)((simd4f_lane_bits(mask.x) >> 31) | ((simd4f_lane_bits(mask.y) >> 31) << 1) |
+               ((simd4f_lane_bits(mask.z) >> 31) << 2) | ((simd4f_lane_bits(mask.w) >> 31) << 3));
+}
+
+#endif
@@ -0,0 +1,185 @@
+#include "texel_gbuffer.h"
+#include "bake.h"
+#include "job.h"
+#include "lightmap.h"
+#include "profile.h"
+#include "simd.h"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define TEXEL_GBUFFER_TEXELS_PER_JOB 1024
+
+struct TexelGbufferJob {
+  TexelGbuffer* gbuffer;
+  const BakeScene* scene;
+  const float* uv_data;
+};
+
+// the bits of the low 16 moved to the even positions
+static uint32_t morton_spread(uint32_t bits) {
+  bits &= 0x0000ffffU;
+  bits = (bits | (bits << 8)) & 0x00ff00ffU;
+  bits = (bits | (bits << 4)) & 0x0f0f0f0fU;
+  bits = (bits | (bits << 2)) & 0x33333333U;
+  bits = (bits | (bits << 1)) & 0x55555555U;
+  return bits;
+}
+
+// nullptr if it's out of memory
+static float* alloc_texels(unsigned texel_count) {
+  const size_t padded_count = (texel_count + 3) & ~3u;
+  void* texels = nullptr;
+  if (posix_memalign(&texels, 16, std::max(padded_count, (size_t)4) * sizeof(float)) != 0) {
+    return nullptr;
+  }
+  memset(texels, 0, std::max(padded_count, (size_t)4) * sizeof(float));
+  return (float*)texels;
+}
+
+static void texel_gbuffer_fill(void* user_data, int block_index) {
+  PROFILE_SCOPE("texel_gbuffer_fill");
+  const TexelGbufferJob* job = (const TexelGbufferJob*)user_data;
+  TexelGbuffer* gbuffer = job->gbuffer;
+  const unsigned texel_begin = block_index * TEXEL_GBUFFER_TEXELS_PER_JOB;
+  const unsigned texel_end = std::min(texel_begin + TEXEL_GBUFFER_TEXELS_PER_JOB, gbuffer->texel_count);
+
+  for (unsigned texel = texel_begin; texel < texel_end; ++texel) {
+    const uint32_t atlas_texel = gbuffer->atlas_texels[texel];
+    const int32_t tri_index = gbuffer->tri_ids[atlas_texel];
+    vectorial::vec3f pos;
+    vectorial::vec3f normal;
+    bake_texel_surface(&pos,
+                       &normal,
+                       job->scene,
+                       job->uv_data,
+                       gbuffer->tex_width,
+                       gbuffer->tex_height,
+                       atlas_texel % gbuffer->tex_width,
+                       atlas_texel / gbuffer->tex_width,
+                       tri_index);
+    const vectorial::vec3f albedo = job->scene->albedos[tri_index];
+
+    gbuffer->texel_tris[texel] = tri_index;
+    gbuffer->positions[0][texel] = pos.x();
+    gbuffer->positions[1][texel] = pos.y();
+    gbuffer->positions[2][texel] = pos.z();
+    gbuffer->normals[0][texel] = normal.x();
+    gbuffer->normals[1][texel] = normal.y();
+    gbuffer->normals[2][texel] = normal.z();
+    gbuffer->albedos[0][texel] = albedo.x();
+    gbuffer->albedos[1][texel] = albedo.y();
+    gbuffer->albedos[2][texel] = albedo.z();
+  }
+}
+
+bool texel_gbuffer_create(TexelGbuffer* gbuffer,
+                          const BakeScene* scene,
+                          const float* uv_data,
+                          int tex_width,
+                          int tex_height) {
+  PROFILE_SCOPE("texel_gbuffer_create");
+  gbuffer->tex_width = tex_width;
+  gbuffer->tex_height = tex_height;
+  gbuffer->tri_ids = (int32_t*)malloc(tex_width * tex_height * sizeof(int32_t));
+  lightmap_rasterize_ids(gbuffer->tri_ids, nullptr, tex_width, tex_height, uv_data, scene->tri_count);
+
+  // the Morton code above the atlas index, sorting them sorts the texels along the curve
+  std::vector<uint64_t> keys;
+  for (int y = 0; y < tex_height; ++y) {
+    for (int x = 0; x < tex_width; ++x) {
+      const uint32_t atlas_texel = (uint32_t)(y * tex_width + x);
+      if (gbuffer->tri_ids[atlas_texel] >= 0) {
+        const uint32_t morton = morton_spread((uint32_t)x) | (morton_spread((uint32_t)y) << 1);
+        keys.push_back(((uint64_t)morton << 32) | atlas_texel);
+      }
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+
+  gbuffer->texel_count = (unsigned)keys.size();
+  gbuffer->atlas_texels = (uint32_t*)malloc(std::max(keys.size(), (size_t)1) * sizeof(uint32_t));
+  gbuffer->texel_tris = (int32_t*)malloc(std::max(keys.size(), (size_t)1) * sizeof(int32_t));
+  gbuffer->texel_indices = (int32_t*)malloc(tex_width * tex_height * sizeof(int32_t));
+  for (int atlas_texel = 0; atlas_texel < tex_width * tex_height; ++atlas_texel) {
+    gbuffer->texel_indices[atlas_texel] = -1;
+  }
+  for (size_t texel = 0; texel < keys.size(); ++texel) {
+    gbuffer->atlas_texels[texel] = (uint32_t)keys[texel];
+    gbuffer->texel_indices[gbuffer->atlas_texels[texel]] = (int32_t)texel;
+  }
+  bool allocated = true;
+  for (int axis = 0; axis < 3; ++axis) {
+    gbuffer->positions[axis] = alloc_texels(gbuffer->texel_count);
+    gbuffer->normals[axis] = alloc_texels(gbuffer->texel_count);
+    gbuffer->albedos[axis] = alloc_texels(gbuffer->texel_count);
+    allocated = allocated && gbuffer->positions[axis] && gbuffer->normals[axis] && gbuffer->albedos[axis];
+  }
+  if (!allocated) {
+    fprintf(stderr, "ERROR: out of memory for the G-buffer of %u lightmap texels\n", gbuffer->texel_count);
+    texel_gbuffer_destroy(gbuffer);
+    return false;
+  }
+
+  TexelGbufferJob job;
+  job.gbuffer = gbuffer;
+  job.scene = scene;
+  job.uv_data = uv_data;
+  job_parallel_for(&texel_gbuffer_fill,
+                   &job,
+                   (int)((gbuffer->texel_count + TEXEL_GBUFFER_TEXELS_PER_JOB - 1) / TEXEL_GBUFFER_TEXELS_PER_JOB));
+  return true;
+}
+
+void texel_gbuffer_destroy(TexelGbuffer* gbuffer) {
+  for (int axis = 0; axis < 3; ++axis) {
+    free(gbuffer->albedos[axis]);
+    free(gbuffer->normals[axis]);
+    free(gbuffer->positions[axis]);
+    gbuffer->albedos[axis] = gbuffer->normals[axis] = gbuffer->positions[axis] = nullptr;
+  }
+  free(gbuffer->texel_tris);
+  free(gbuffer->atlas_texels);
+  free(gbuffer->texel_indices);
+  free(gbuffer->tri_ids);
+  gbuffer->texel_tris = nullptr;
+  gbuffer->atlas_texels = nullptr;
+  gbuffer->texel_indices = nullptr;
+  gbuffer->tri_ids = nullptr;
+  gbuffer->texel_count = 0;
+}
+
+size_t texel_gbuffer_byte_count(const TexelGbuffer* gbuffer) {
+  const size_t padded_count = (gbuffer->texel_count + 3) & ~3u;
+  return gbuffer->tex_width * gbuffer->tex_height * 2 * sizeof(int32_t) +
+         gbuffer->texel_count * (sizeof(uint32_t) + sizeof(int32_t)) + 9 * padded_count * sizeof(float);
+}
+
+void texel_gbuffer_find_in_sphere(std::vector<uint32_t>& texels,
+                                  const TexelGbuffer* gbuffer,
+                                  const vectorial::vec3f& center,
+                                  float radius) {
+  PROFILE_SCOPE("texel_gbuffer_find_in_sphere");
+  const simd4f center_x = simd4f_splat(center.x());
+  const simd4f center_y = simd4f_splat(center.y());
+  const simd4f center_z = simd4f_splat(center.z());
+  const simd4f radius_sq = simd4f_splat(radius * radius);
+  for (unsigned base = 0; base < gbuffer->texel_count; base += 4) {
+    const simd4f dx = simd4f_sub(simd4f_uload4(gbuffer->positions[0] + base), center_x);
+    const simd4f dy = simd4f_sub(simd4f_uload4(gbuffer->positions[1] + base), center_y);
+    const simd4f dz = simd4f_sub(simd4f_uload4(gbuffer->positions[2] + base), center_z);
+    const simd4f dist_sq = simd4f_add(simd4f_add(simd4f_mul(dx, dx), simd4f_mul(dy, dy)), simd4f_mul(dz, dz));
+    int mask = simd4f_movemask(simd4f_cmplt(dist_sq, radius_sq));
+    // the padding past the last texel is at the origin, it mustn't count
+    if (base + 4 > gbuffer->texel_count) {
+      mask &= (1 << (gbuffer->texel_count - base)) - 1;
+    }
+    for (int lane = 0; lane < 4; ++lane) {
+      if (mask & (1 << lane)) {
+        texels.push_back(base + lane);
+      }
+    }
+  }
+}
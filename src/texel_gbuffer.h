@@ -0,0 +1,58 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include <vectorial/vectorial.h>
+
+struct BakeScene;
+
+// the surface behind every covered texel of a lightmap atlas, worked out once so the kernels that light the texels
+// stream through it instead of going back to the triangles. the texels are in Morton order, so a run of them is a
+// square-ish patch of the atlas and of the surface, and every attribute is its own array.
+struct TexelGbuffer {
+  int tex_width;
+  int tex_height;
+  unsigned texel_count;
+  int32_t* tri_ids;        // the atlas coverage, see lightmap_rasterize_ids()
+  int32_t* texel_indices;  // texel of every atlas index, -1 for empty ones
+  uint32_t* atlas_texels;  // atlas index (y * tex_width + x) of every texel
+  int32_t* texel_tris;     // triangle of every texel
+
+  // x, y and z (or r, g and b) of every texel. 16-byte aligned and padded with zeros to a multiple of 4 texels, so
+  // they load as simd4f all the way through.
+  float* positions[3];
+  float* normals[3];
+  float* albedos[3];
+};
+
+// rasterizes the triangles into the atlas and fills in the texels they cover. `uv_data` has one float2 per triangle
+// corner, see lightmap_build_uvs(). the surfaces are filled in on the job system. returns false and leaves the G-buffer
+// empty if it runs out of memory.
+bool texel_gbuffer_create(TexelGbuffer* gbuffer,
+                          const BakeScene* scene,
+                          const float* uv_data,
+                          int tex_width,
+                          int tex_height);
+void texel_gbuffer_destroy(TexelGbuffer* gbuffer);
+
+// of everything above
+size_t texel_gbuffer_byte_count(const TexelGbuffer* gbuffer);
+
+// appends the texels closer than `radius` to `center` to `texels`, in order. streams through the positions 4 at a
+// time.
+void texel_gbuffer_find_in_sphere(std::vector<uint32_t>& texels,
+                                  const TexelGbuffer* gbuffer,
+                                  const vectorial::vec3f& center,
+                                  float radius);
+
+inline vectorial::vec3f texel_gbuffer_position(const TexelGbuffer* gbuffer, unsigned texel) {
+  return vectorial::vec3f(gbuffer->positions[0][texel], gbuffer->positions[1][texel], gbuffer->positions[2][texel]);
+}
+
+inline vectorial::vec3f texel_gbuffer_normal(const TexelGbuffer* gbuffer, unsigned texel) {
+  return vectorial::vec3f(gbuffer->normals[0][texel], gbuffer->normals[1][texel], gbuffer->normals[2][texel]);
+}
+
+inline vectorial::vec3f texel_gbuffer_albedo(const TexelGbuffer* gbuffer, unsigned texel) {
+  return vectorial::vec3f(gbuffer->albedos[0][texel], gbuffer->albedos[1][texel], gbuffer->albedos[2][texel]);
+}
@@ -0,0 +1,528 @@
+#include "transfer.h"
+#include "bvh.h"
+#include "job.h"
+#include "lightmap.h"
+#include "mesh.h"
+#include "profile.h"
+#include "vertex_format.h"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vectorial/simd4f.h>
+
+#define TRANSFER_COLUMN_MASK (TRANSFER_MAX_ROWS - 1)
+#define TRANSFER_WEIGHT_SHIFT 24
+#define TRANSFER_WEIGHT_MAX 255
+
+// a source texel of the row being built and how many of its rays landed there
+struct TransferSource {
+  uint32_t column;
+  uint32_t hits;
+  uint32_t order;  // breaks ties between sources with as many hits
+};
+
+struct TransferBuildJob {
+  Transfer* transfer;
+  const float* uv_data;
+  uint32_t* entries;       // `max_sources` for every row
+  uint32_t* entry_counts;  // used of those
+  int max_sources;
+};
+
+struct TransferLightJob {
+  Transfer* transfer;
+  const Light* light;
+};
+
+struct TransferBounceJob {
+  Transfer* transfer;
+  const float* radiosity_in;
+  float* radiosity_out;
+};
+
+// per row state, see Transfer. the G-buffer counts on its own.
+#define TRANSFER_ROW_BYTES (2 * sizeof(uint32_t) + sizeof(float) + 5 * 4 * sizeof(float))
+
+static float radical_inverse(uint32_t bits) {
+  bits = (bits << 16) | (bits >> 16);
+  bits = ((bits & 0x55555555U) << 1) | ((bits & 0xaaaaaaaaU) >> 1);
+  bits = ((bits & 0x33333333U) << 2) | ((bits & 0xccccccccU) >> 2);
+  bits = ((bits & 0x0f0f0f0fU) << 4) | ((bits & 0xf0f0f0f0U) >> 4);
+  bits = ((bits & 0x00ff00ffU) << 8) | ((bits & 0xff00ff00U) >> 8);
+  return (float)(bits >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32_t hash_u32(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+// nullptr if it's out of memory
+static float* alloc_rows(unsigned row_count) {
+  void* rows = nullptr;
+  if (posix_memalign(&rows, 16, row_count * 4 * sizeof(float) + 16) != 0) {
+    return nullptr;
+  }
+  return (float*)rows;
+}
+
+static int grid_coord(const Transfer* transfer, float value, int axis) {
+  return (int)floorf((value - transfer->grid_origin[axis]) / transfer->grid_cell_size);
+}
+
+static int grid_cell(const Transfer* transfer, const vectorial::vec3f& pos) {
+  float pos_f[3];
+  pos.store(pos_f);
+  int coords[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    coords[axis] = std::min(std::max(grid_coord(transfer, pos_f[axis], axis), 0), transfer->grid_dims[axis] - 1);
+  }
+  return coords[0] + transfer->grid_dims[0] * (coords[1] + transfer->grid_dims[1] * coords[2]);
+}
+
+// calls `visit` with every row of the cells the sphere overlaps
+template <typename Visit>
+static void grid_visit(const Transfer* transfer, const vectorial::vec3f& center, float radius, Visit visit) {
+  float center_f[3];
+  center.store(center_f);
+  int lo[3];
+  int hi[3];
+  for (int axis = 0; axis < 3; ++axis) {
+    lo[axis] = grid_coord(transfer, center_f[axis] - radius, axis);
+    hi[axis] = grid_coord(transfer, center_f[axis] + radius, axis);
+    if (radius <= 0.0f || hi[axis] < 0 || lo[axis] >= transfer->grid_dims[axis]) {
+      return;
+    }
+    lo[axis] = std::max(lo[axis], 0);
+    hi[axis] = std::min(hi[axis], transfer->grid_dims[axis] - 1);
+  }
+
+  for (int z = lo[2]; z <= hi[2]; ++z) {
+    for (int y = lo[1]; y <= hi[1]; ++y) {
+      const int row_cell = transfer->grid_dims[0] * (y + transfer->grid_dims[1] * z);
+      const uint32_t* rows = transfer->grid_rows + transfer->grid_offsets[row_cell + lo[0]];
+      const uint32_t* end = transfer->grid_rows + transfer->grid_offsets[row_cell + hi[0] + 1];
+      for (; rows < end; ++rows) {
+        visit(*rows);
+      }
+    }
+  }
+}
+
+// the row of the texel a ray landed in. hits on the edge of a chart can round into a texel of another triangle or into
+// the padding, so a neighbour of the same triangle wins over those.
+static int32_t hit_row(const TransferBuildJob* job, const BvhHit& hit) {
+  const TexelGbuffer* gbuffer = job->transfer->gbuffer;
+  const float* uvs = job->uv_data + 6 * hit.tri_index;
+  const float b0 = 1.0f - hit.b1 - hit.b2;
+  const float u = (uvs[0] * b0 + uvs[2] * hit.b1 + uvs[4] * hit.b2) * gbuffer->tex_width;
+  const float v = (uvs[1] * b0 + uvs[3] * hit.b1 + uvs[5] * hit.b2) * gbuffer->tex_height;
+  const int x = std::min(std::max((int)u, 0), gbuffer->tex_width - 1);
+  const int y = std::min(std::max((int)v, 0), gbuffer->tex_height - 1);
+
+  const int texel = y * gbuffer->tex_width + x;
+  if (gbuffer->tri_ids[texel] == (int32_t)hit.tri_index) {
+    return gbuffer->texel_indices[texel];
+  }
+  for (int dy = -1; dy <= 1; ++dy) {
+    for (int dx = -1; dx <= 1; ++dx) {
+      const int nx = x + dx;
+      const int ny = y + dy;
+      if (nx < 0 || ny < 0 || nx >= gbuffer->tex_width || ny >= gbuffer->tex_height) {
+        continue;
+      }
+      const int neighbour = ny * gbuffer->tex_width + nx;
+      if (gbuffer->tri_ids[neighbour] == (int32_t)hit.tri_index) {
+        return gbuffer->texel_indices[neighbour];
+      }
+    }
+  }
+  return gbuffer->texel_indices[texel];
+}
+
+// casts the rays of every row in the block and keeps the `max_sources` texels most of them landed in. with
+// cosine-distributed rays the share of them a texel gets is its form factor.
+static void transfer_build_rows(void* user_data, int block_index) {
+  PROFILE_SCOPE("transfer_build_rows");
+  const TransferBuildJob* job = (const TransferBuildJob*)user_data;
+  Transfer* transfer = job->transfer;
+  const int rays_per_texel = transfer->settings.rays_per_texel;
+  const float ray_bias = transfer->settings.ray_bias;
+  const unsigned row_begin = block_index * transfer->settings.rows_per_job;
+  const unsigned row_end = std::min(row_begin + transfer->settings.rows_per_job, transfer->row_count);
+
+  std::vector<uint32_t> columns;
+  std::vector<TransferSource> sources;
+  unsigned ray_count = 0;
+  columns.reserve(rays_per_texel);
+  sources.reserve(rays_per_texel);
+  for (unsigned row = row_begin; row < row_end; ++row) {
+    const vectorial::vec3f pos = texel_gbuffer_position(transfer->gbuffer, row);
+    const vectorial::vec3f normal = texel_gbuffer_normal(transfer->gbuffer, row);
+    const vectorial::vec3f org = pos + normal * ray_bias;
+
+    // a Hammersley set, turned by a different angle for every texel so neighbouring ones don't alias
+    const float texel = (float)transfer->gbuffer->atlas_texels[row];
+    const float rotation = texel * 0.618034f - floorf(texel * 0.618034f);
+    columns.clear();
+    for (int ray = 0; ray < rays_per_texel; ++ray) {
+      const float u1 = (ray + 0.5f) / rays_per_texel;
+      float u2 = radical_inverse((uint32_t)ray) + rotation;
+      u2 -= u2 >= 1.0f ? 1.0f : 0.0f;
+      const vectorial::vec3f dir = bake_sample_cosine_hemisphere(normal, u1, u2);
+
+      BvhHit hit;
+      ++ray_count;
+      if (!bvh_intersect_closest(transfer->scene->bvh, org, dir, FLT_MAX, &hit)) {
+        continue;
+      }
+      // only the front of a triangle has texels
+      const vectorial::vec3f* p = &transfer->scene->positions[3 * hit.tri_index];
+      if (vectorial::dot(vectorial::cross(p[1] - p[0], p[2] - p[0]), dir) > 0.0f) {
+        continue;
+      }
+      const int32_t column = hit_row(job, hit);
+      if (column >= 0) {
+        columns.push_back((uint32_t)column);
+      }
+    }
+
+    std::sort(columns.begin(), columns.end());
+    sources.clear();
+    for (uint32_t column : columns) {
+      if (sources.empty() || sources.back().column != column) {
+        sources.push_back(TransferSource{column, 0, 0});
+      }
+      ++sources.back().hits;
+    }
+
+    // the sources that don't fit hand their hits to the closest kept one, which is most likely about as bright, so a
+    // row still gathers as much light as its rays saw. ties are broken by a hash of the texel, not by where it is in
+    // the rows, or the kept ones would bunch up in one corner of the atlas.
+    if (sources.size() > (size_t)job->max_sources) {
+      const uint32_t salt = hash_u32(row);
+      for (TransferSource& source : sources) {
+        source.order = hash_u32(job->transfer->gbuffer->atlas_texels[source.column] ^ salt);
+      }
+      std::nth_element(sources.begin(),
+                       sources.begin() + job->max_sources,
+                       sources.end(),
+                       [](const TransferSource& a, const TransferSource& b) {
+                         return a.hits != b.hits ? a.hits > b.hits : a.order < b.order;
+                       });
+      for (size_t index = job->max_sources; index < sources.size(); ++index) {
+        const vectorial::vec3f pos = texel_gbuffer_position(transfer->gbuffer, sources[index].column);
+        TransferSource* closest = &sources[0];
+        float closest_dist_sq = FLT_MAX;
+        for (int kept = 0; kept < job->max_sources; ++kept) {
+          const vectorial::vec3f d = texel_gbuffer_position(transfer->gbuffer, sources[kept].column) - pos;
+          const float dist_sq = vectorial::dot(d, d);
+          if (dist_sq < closest_dist_sq) {
+            closest_dist_sq = dist_sq;
+            closest = &sources[kept];
+          }
+        }
+        closest->hits += sources[index].hits;
+      }
+      sources.resize(job->max_sources);
+      std::sort(sources.begin(), sources.end(), [](const TransferSource& a, const TransferSource& b) {
+        return a.column < b.column;
+      });
+    }
+    uint32_t max_hits = 0;
+    for (const TransferSource& source : sources) {
+      max_hits = std::max(max_hits, source.hits);
+    }
+
+    uint32_t* entries = job->entries + (size_t)row * job->max_sources;
+    for (size_t index = 0; index < sources.size(); ++index) {
+      const uint32_t weight =
+          std::max(1u, (sources[index].hits * TRANSFER_WEIGHT_MAX + max_hits / 2) / std::max(max_hits, 1u));
+      entries[index] = sources[index].column | (weight << TRANSFER_WEIGHT_SHIFT);
+    }
+    job->entry_counts[row] = (uint32_t)sources.size();
+    transfer->row_scales[row] = (float)max_hits / (TRANSFER_WEIGHT_MAX * (float)rays_per_texel);
+  }
+  PROFILE_COUNT(PROFILE_COUNTER_RAYS_TRACED, ray_count);
+}
+
+void transfer_settings_init(TransferSettings* settings) {
+  if (!settings) {
+    return;
+  }
+
+  settings->rays_per_texel = 128;
+  settings->max_sources = 64;
+  settings->max_bytes = 32 * 1024 * 1024;
+  settings->rows_per_job = 256;
+  settings->grid_resolution = 32;
+  settings->ray_bias = 0.001f;
+}
+
+Transfer* transfer_create(const BakeScene* scene,
+                          const TexelGbuffer* gbuffer,
+                          const float* uv_data,
+                          const TransferSettings* settings) {
+  PROFILE_SCOPE("transfer_create");
+  Transfer* transfer = new Transfer;
+  memset(transfer->radiosity, 0, sizeof(transfer->radiosity));
+  transfer->scene = scene;
+  transfer->gbuffer = gbuffer;
+  transfer->row_count = gbuffer->texel_count;
+  transfer->row_offsets = nullptr;
+  transfer->entries = nullptr;
+  transfer->row_scales = nullptr;
+  transfer->grid_offsets = nullptr;
+  transfer->grid_rows = nullptr;
+  transfer->direct = nullptr;
+  transfer->direct_radiosity = nullptr;
+  transfer->irradiance = nullptr;
+  transfer->lit = false;
+  transfer->settings = *settings;
+
+  // the grid covers the mesh with cubes
+  vectorial::vec3f bounds_min = transfer->scene->positions[0];
+  vectorial::vec3f bounds_max = transfer->scene->positions[0];
+  for (const vectorial::vec3f& pos : transfer->scene->positions) {
+    bounds_min = vectorial::min(bounds_min, pos);
+    bounds_max = vectorial::max(bounds_max, pos);
+  }
+  float extent[3];
+  (bounds_max - bounds_min).store(extent);
+  bounds_min.store(transfer->grid_origin);
+  const float max_extent = std::max(std::max(extent[0], extent[1]), std::max(extent[2], FLT_MIN));
+  transfer->grid_cell_size = max_extent / settings->grid_resolution;
+  size_t cell_count = 1;
+  for (int axis = 0; axis < 3; ++axis) {
+    transfer->grid_dims[axis] =
+        std::min(std::max((int)ceilf(extent[axis] / transfer->grid_cell_size), 1), settings->grid_resolution);
+    cell_count *= transfer->grid_dims[axis];
+  }
+
+  // what's left of the budget after the per-row state goes to the entries, evenly over the rows
+  const size_t row_count = transfer->row_count;
+  const size_t fixed_bytes = row_count * TRANSFER_ROW_BYTES + texel_gbuffer_byte_count(transfer->gbuffer) +
+                             (cell_count + 1) * sizeof(uint32_t);
+  const size_t entry_budget = settings->max_bytes > fixed_bytes ? settings->max_bytes - fixed_bytes : 0;
+  const int max_sources =
+      (int)std::min((size_t)settings->max_sources, row_count ? entry_budget / (row_count * sizeof(uint32_t)) : 0);
+  if (row_count > TRANSFER_MAX_ROWS || (row_count && max_sources < 1)) {
+    fprintf(stderr,
+            "ERROR: %zu lightmap texels don't fit a %zu byte transfer budget\n",
+            row_count,
+            settings->max_bytes);
+    transfer_destroy(transfer);
+    return nullptr;
+  }
+
+  transfer->row_offsets = (uint32_t*)malloc((row_count + 1) * sizeof(uint32_t));
+  transfer->row_scales = (float*)malloc(row_count * sizeof(float));
+  transfer->direct = alloc_rows(transfer->row_count);
+  transfer->direct_radiosity = alloc_rows(transfer->row_count);
+  transfer->irradiance = alloc_rows(transfer->row_count);
+  transfer->radiosity[0] = alloc_rows(transfer->row_count);
+  transfer->radiosity[1] = alloc_rows(transfer->row_count);
+  if (!transfer->direct || !transfer->direct_radiosity || !transfer->irradiance || !transfer->radiosity[0] ||
+      !transfer->radiosity[1]) {
+    fprintf(stderr, "ERROR: out of memory for the transfer of %zu lightmap texels\n", row_count);
+    transfer_destroy(transfer);
+    return nullptr;
+  }
+
+  // a counting sort of the rows by cell
+  transfer->grid_offsets = (uint32_t*)calloc(cell_count + 1, sizeof(uint32_t));
+  transfer->grid_rows = (uint32_t*)malloc(std::max(row_count, (size_t)1) * sizeof(uint32_t));
+  for (size_t row = 0; row < row_count; ++row) {
+    ++transfer->grid_offsets[grid_cell(transfer, texel_gbuffer_position(transfer->gbuffer, row)) + 1];
+  }
+  for (size_t cell = 0; cell < cell_count; ++cell) {
+    transfer->grid_offsets[cell + 1] += transfer->grid_offsets[cell];
+  }
+  std::vector<uint32_t> grid_fill(transfer->grid_offsets, transfer->grid_offsets + cell_count);
+  for (size_t row = 0; row < row_count; ++row) {
+    const int cell = grid_cell(transfer, texel_gbuffer_position(transfer->gbuffer, row));
+    transfer->grid_rows[grid_fill[cell]++] = (uint32_t)row;
+  }
+
+  TransferBuildJob job;
+  job.transfer = transfer;
+  job.uv_data = uv_data;
+  job.entries = (uint32_t*)malloc(std::max(row_count * max_sources, (size_t)1) * sizeof(uint32_t));
+  job.entry_counts = (uint32_t*)malloc(std::max(row_count, (size_t)1) * sizeof(uint32_t));
+  job.max_sources = max_sources;
+  const int block_count = (int)((row_count + settings->rows_per_job - 1) / settings->rows_per_job);
+  job_parallel_for(&transfer_build_rows, &job, block_count);
+
+  // squeeze the rows together, every one starts at or before where it was built
+  uint32_t entry_count = 0;
+  for (size_t row = 0; row < row_count; ++row) {
+    transfer->row_offsets[row] = entry_count;
+    memmove(job.entries + entry_count, job.entries + row * max_sources, job.entry_counts[row] * sizeof(uint32_t));
+    entry_count += job.entry_counts[row];
+  }
+  transfer->row_offsets[row_count] = entry_count;
+  transfer->entries = (uint32_t*)realloc(job.entries, std::max(entry_count, 1u) * sizeof(uint32_t));
+  transfer->byte_count = fixed_bytes + entry_count * sizeof(uint32_t);
+
+  free(job.entry_counts);
+  return transfer;
+}
+
+void transfer_destroy(Transfer* transfer) {
+  if (!transfer) {
+    return;
+  }
+
+  free(transfer->radiosity[1]);
+  free(transfer->radiosity[0]);
+  free(transfer->irradiance);
+  free(transfer->direct_radiosity);
+  free(transfer->direct);
+  free(transfer->grid_rows);
+  free(transfer->grid_offsets);
+  free(transfer->row_scales);
+  free(transfer->entries);
+  free(transfer->row_offsets);
+  delete transfer;
+}
+
+// the light the row gathers from what the other rows reflect. the columns are scattered, so every entry is one load of
+// an rgb row and a multiply-add, two running sums hide the latency of the loads.
+static simd4f gather_row(const Transfer* transfer, const float* radiosity, unsigned row) {
+  const uint32_t* entry = transfer->entries + transfer->row_offsets[row];
+  const uint32_t* end = transfer->entries + transfer->row_offsets[row + 1];
+  simd4f sum0 = simd4f_zero();
+  simd4f sum1 = simd4f_zero();
+  for (; entry + 2 <= end; entry += 2) {
+    const simd4f source0 = simd4f_uload4(radiosity + 4 * (entry[0] & TRANSFER_COLUMN_MASK));
+    const simd4f source1 = simd4f_uload4(radiosity + 4 * (entry[1] & TRANSFER_COLUMN_MASK));
+    sum0 = simd4f_madd(source0, simd4f_splat((float)(entry[0] >> TRANSFER_WEIGHT_SHIFT)), sum0);
+    sum1 = simd4f_madd(source1, simd4f_splat((float)(entry[1] >> TRANSFER_WEIGHT_SHIFT)), sum1);
+  }
+  if (entry < end) {
+    const simd4f source = simd4f_uload4(radiosity + 4 * (entry[0] & TRANSFER_COLUMN_MASK));
+    sum0 = simd4f_madd(source, simd4f_splat((float)(entry[0] >> TRANSFER_WEIGHT_SHIFT)), sum0);
+  }
+  return simd4f_mul(simd4f_add(sum0, sum1), simd4f_splat(transfer->row_scales[row]));
+}
+
+static simd4f row_albedo(const Transfer* transfer, unsigned row) {
+  const TexelGbuffer* gbuffer = transfer->gbuffer;
+  return simd4f_create(gbuffer->albedos[0][row], gbuffer->albedos[1][row], gbuffer->albedos[2][row], 0.0f);
+}
+
+static void transfer_light_rows(void* user_data, int block_index) {
+  PROFILE_SCOPE("transfer_light_rows");
+  const TransferLightJob* job = (const TransferLightJob*)user_data;
+  Transfer* transfer = job->transfer;
+  const TexelGbuffer* gbuffer = transfer->gbuffer;
+  const size_t begin = (size_t)block_index * transfer->settings.rows_per_job;
+  const size_t end = std::min(begin + transfer->settings.rows_per_job, transfer->relit_rows.size());
+
+  unsigned ray_count = 0;
+  for (size_t index = begin; index < end; ++index) {
+    const uint32_t row = transfer->relit_rows[index];
+    const vectorial::vec3f direct = bake_direct_irradiance(transfer->scene,
+                                                           *job->light,
+                                                           texel_gbuffer_position(gbuffer, row),
+                                                           texel_gbuffer_normal(gbuffer, row),
+                                                           transfer->settings.ray_bias,
+                                                           &ray_count);
+    const simd4f irradiance = simd4f_create(direct.x(), direct.y(), direct.z(), 0.0f);
+    simd4f_ustore4(irradiance, transfer->direct + 4 * row);
+    simd4f_ustore4(simd4f_mul(irradiance, row_albedo(transfer, row)), transfer->direct_radiosity + 4 * row);
+  }
+  PROFILE_COUNT(PROFILE_COUNTER_RAYS_TRACED, ray_count);
+}
+
+static void transfer_bounce_rows(void* user_data, int block_index) {
+  PROFILE_SCOPE("transfer_bounce_rows");
+  const TransferBounceJob* job = (const TransferBounceJob*)user_data;
+  Transfer* transfer = job->transfer;
+  const unsigned row_begin = block_index * transfer->settings.rows_per_job;
+  const unsigned row_end = std::min(row_begin + transfer->settings.rows_per_job, transfer->row_count);
+
+  for (unsigned row = row_begin; row < row_end; ++row) {
+    const simd4f irradiance =
+        simd4f_add(simd4f_uload4(transfer->direct + 4 * row), gather_row(transfer, job->radiosity_in, row));
+    simd4f_ustore4(irradiance, transfer->irradiance + 4 * row);
+    simd4f_ustore4(simd4f_mul(irradiance, row_albedo(transfer, row)), job->radiosity_out + 4 * row);
+  }
+}
+
+// the rows whose direct light can change: the ones in reach of the new light get traced, the ones only the old light
+// reached go dark without a ray. the first time every row is dark but the ones in reach.
+static void transfer_find_relit_rows(Transfer* transfer, const Light& light) {
+  transfer->relit_rows.clear();
+  if (!transfer->lit) {
+    memset(transfer->direct, 0, transfer->row_count * 4 * sizeof(float));
+    memset(transfer->direct_radiosity, 0, transfer->row_count * 4 * sizeof(float));
+    texel_gbuffer_find_in_sphere(transfer->relit_rows, transfer->gbuffer, light.pos, light.range);
+    return;
+  }
+
+  const Light& old_light = transfer->lit_light;
+  const float range_sq = light.range * light.range;
+  const float old_range_sq = old_light.range * old_light.range;
+  grid_visit(transfer, old_light.pos, old_light.range, [&](uint32_t row) {
+    const vectorial::vec3f pos = texel_gbuffer_position(transfer->gbuffer, row);
+    if (vectorial::length_squared(old_light.pos - pos) < old_range_sq &&
+        !(vectorial::length_squared(light.pos - pos) < range_sq)) {
+      memset(transfer->direct + 4 * row, 0, 4 * sizeof(float));
+      memset(transfer->direct_radiosity + 4 * row, 0, 4 * sizeof(float));
+    }
+  });
+  grid_visit(transfer, light.pos, light.range, [&](uint32_t row) {
+    if (vectorial::length_squared(light.pos - texel_gbuffer_position(transfer->gbuffer, row)) < range_sq) {
+      transfer->relit_rows.push_back(row);
+    }
+  });
+}
+
+void transfer_relight(Transfer* transfer, const Light& light, int bounce_count, bool with_direct, float* out) {
+  PROFILE_SCOPE("transfer_relight");
+  const int rows_per_job = transfer->settings.rows_per_job;
+  transfer_find_relit_rows(transfer, light);
+  TransferLightJob light_job;
+  light_job.transfer = transfer;
+  light_job.light = &light;
+  job_parallel_for(
+      &transfer_light_rows, &light_job, (int)((transfer->relit_rows.size() + rows_per_job - 1) / rows_per_job));
+  transfer->lit_light = light;
+  transfer->lit = true;
+
+  // every bounce reads what the last one reflected, so they can't overlap
+  TransferBounceJob bounce_job;
+  bounce_job.transfer = transfer;
+  bounce_job.radiosity_in = transfer->direct_radiosity;
+  for (int bounce = 0; bounce < bounce_count; ++bounce) {
+    bounce_job.radiosity_out = transfer->radiosity[bounce & 1];
+    job_parallel_for(
+        &transfer_bounce_rows, &bounce_job, (int)((transfer->row_count + rows_per_job - 1) / rows_per_job));
+    bounce_job.radiosity_in = bounce_job.radiosity_out;
+  }
+
+  const TexelGbuffer* gbuffer = transfer->gbuffer;
+  memset(out, 0, gbuffer->tex_width * gbuffer->tex_height * 3 * sizeof(float));
+  const float* irradiance_rows = bounce_count > 0 ? transfer->irradiance : transfer->direct;
+  for (unsigned row = 0; row < transfer->row_count; ++row) {
+    const float* irradiance = irradiance_rows + 4 * row;
+    const float* direct = transfer->direct + 4 * row;
+    float* texel = out + 3 * gbuffer->atlas_texels[row];
+    for (int channel = 0; channel < 3; ++channel) {
+      texel[channel] = with_direct ? irradiance[channel] : irradiance[channel] - direct[channel];
+    }
+  }
+  bake_dilate(out, gbuffer->tri_ids, gbuffer->tex_width, gbuffer->tex_height);
+}
+
+size_t transfer_entry_count(const Transfer* transfer) {
+  return transfer->row_offsets[transfer->row_count];
+}
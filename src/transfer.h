@@ -0,0 +1,75 @@
+#pragma once
+#include "bake.h"
+#include "texel_gbuffer.h"
+#include <stddef.h>
+#include <stdint.h>
+
+struct TransferSettings {
+  int rays_per_texel;   // cosine-distributed rays every texel casts to find the texels it sees
+  int max_sources;      // most texels a texel keeps, the light of the weakest is spread over the rest
+  size_t max_bytes;     // budget for the matrix and the per-texel state, rows keep fewer sources to fit
+  int rows_per_job;
+  int grid_resolution;  // cells along the longest side of the grid that finds the texels in reach of the light
+  float ray_bias;
+};
+
+void transfer_settings_init(TransferSettings* settings);
+
+// the diffuse transfer between the texels of a lightmap atlas: row r holds the form factors from every texel r sees
+// to texel r, so one bounce of light is one sparse matrix-vector product. the texels of `gbuffer` are the rows and the
+// columns, so neighbouring texels gather from about the same columns.
+//
+// the rows are compressed sparse rows. every entry packs the column into the low 24 bits and the form factor into the
+// high 8, as a fraction of the largest one in the row. `row_scales` turn them back into form factors.
+struct Transfer {
+  unsigned row_count;
+  uint32_t* row_offsets;  // row_count + 1, entries of row r are [row_offsets[r], row_offsets[r + 1])
+  uint32_t* entries;
+  float* row_scales;
+  size_t byte_count;      // of everything above, the G-buffer and the relight state
+
+  const BakeScene* scene;  // the caller's, both outlive the transfer
+  const TexelGbuffer* gbuffer;
+
+  // a uniform grid over the row positions. the rows of cell c are grid_rows[grid_offsets[c]] up to
+  // grid_rows[grid_offsets[c + 1]], cell (x, y, z) is c = x + grid_dims[0] * (y + grid_dims[1] * z).
+  float grid_origin[3];
+  float grid_cell_size;
+  int grid_dims[3];
+  uint32_t* grid_offsets;
+  uint32_t* grid_rows;
+
+  // 4 floats a row, rgb and a pad so a row loads as one simd4f. 16-byte aligned.
+  float* direct;            // straight from the light
+  float* direct_radiosity;  // albedo * direct, what the first bounce reads
+  float* irradiance;        // direct plus every bounce so far
+  float* radiosity[2];      // albedo * irradiance, what the next bounce reads. ping-pongs between bounces.
+
+  Light lit_light;  // the direct light is of this one
+  bool lit;
+  std::vector<uint32_t> relit_rows;  // whose direct light the last transfer_relight() traced
+
+  TransferSettings settings;
+};
+
+#define TRANSFER_MAX_ROWS (1u << 24)
+
+// casts `rays_per_texel` rays from every texel of `gbuffer`, built over `scene`, and keeps the texels they land on.
+// `uv_data` has one float2 per triangle corner, see lightmap_build_uvs(). returns nullptr if the G-buffer has more than
+// TRANSFER_MAX_ROWS texels, the per-texel state alone goes over `max_bytes` or it runs out of memory. the rows are
+// built on the job system.
+Transfer* transfer_create(const BakeScene* scene,
+                          const TexelGbuffer* gbuffer,
+                          const float* uv_data,
+                          const TransferSettings* settings);
+void transfer_destroy(Transfer* transfer);
+
+// lights the rows straight from `light` and then gathers `bounce_count` bounces through the matrix, each one a
+// multithreaded SIMD product over the rows. nothing outside `range` gets direct light, so after the first call only the
+// rows in reach of the old or the new light are touched, found through the grid, and only those in reach of the new
+// one trace a shadow ray. writes RGB floats for the whole atlas to `out`, dilated like bake_lightmap(): the bounced
+// light alone, or with `with_direct` everything the path tracer would have baked.
+void transfer_relight(Transfer* transfer, const Light& light, int bounce_count, bool with_direct, float* out);
+
+// entries over all rows
+size_t transfer_entry_count(const Transfer* transfer);
@@ -0,0 +1,194 @@
+#pragma once
+#include "mesh.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// vertex layouts declared as a list of channels at compile time. the stride, the offset of every channel and the
+// VertexChannelDesc table a Mesh carries around all come out as constants, and the accessors read a channel as its
+// value type straight from its offset. asking a format for a semantic it doesn't have doesn't compile.
+//
+//   typedef VertexFormat<VertexChannel<CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_POSITION>> PositionFormat;
+//   const Vec3 p = PositionFormat::load<CHANNEL_SEMANTIC_POSITION>(mesh->vertices, index);
+
+struct VertexUByte4 {
+  uint8_t x;
+  uint8_t y;
+  uint8_t z;
+  uint8_t w;
+};
+
+struct VertexUShort3 {
+  uint16_t x;
+  uint16_t y;
+  uint16_t z;
+};
+
+struct VertexUShort3Padded {
+  uint16_t x;
+  uint16_t y;
+  uint16_t z;
+  uint16_t padding;
+};
+
+struct VertexUShort2 {
+  uint16_t x;
+  uint16_t y;
+};
+
+struct VertexShort2 {
+  int16_t x;
+  int16_t y;
+};
+
+struct VertexByte2 {
+  int8_t x;
+  int8_t y;
+};
+
+template <ChannelType Type>
+struct ChannelTypeTraits;
+
+#define CHANNEL_TYPE_TRAITS(channel_type, value, element_count, is_normalized)                                         \
+  template <>                                                                                                          \
+  struct ChannelTypeTraits<channel_type> {                                                                             \
+    typedef value value_type;                                                                                          \
+    static constexpr int size = (int)sizeof(value);                                                                    \
+    static constexpr int elements = element_count;                                                                     \
+    static constexpr bool normalized = is_normalized;                                                                  \
+  }
+
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_FLOAT_3, Vec3, 3, false);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_UBYTE_4, VertexUByte4, 4, true);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_UNORM16_3, VertexUShort3, 3, true);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_UNORM16_2, VertexUShort2, 2, true);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_OCT_SNORM16_2, VertexShort2, 2, true);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_OCT_SNORM8_2, VertexByte2, 2, true);
+CHANNEL_TYPE_TRAITS(CHANNEL_TYPE_UNORM16_3_PADDED, VertexUShort3Padded, 3, true);
+
+#undef CHANNEL_TYPE_TRAITS
+
+template <ChannelType Type, ChannelSemantic Semantic>
+struct VertexChannel : ChannelTypeTraits<Type> {
+  static constexpr ChannelType type = Type;
+  static constexpr ChannelSemantic semantic = Semantic;
+};
+
+// the summed size of a list of channels
+template <typename... Channels>
+struct VertexChannelSize;
+
+template <>
+struct VertexChannelSize<> {
+  static constexpr int size = 0;
+};
+
+template <typename First, typename... Rest>
+struct VertexChannelSize<First, Rest...> {
+  static constexpr int size = First::size + VertexChannelSize<Rest...>::size;
+};
+
+// the first channel with a semantic and its offset, `channel` is void and `offset` -1 if there isn't one
+template <ChannelSemantic Semantic, typename... Channels>
+struct VertexChannelFind;
+
+template <ChannelSemantic Semantic>
+struct VertexChannelFind<Semantic> {
+  typedef void channel;
+  static constexpr int offset = -1;
+};
+
+template <ChannelSemantic Semantic, typename First, typename... Rest>
+struct VertexChannelFind<Semantic, First, Rest...> {
+  typedef VertexChannelFind<Semantic, Rest...> Next;
+  static constexpr bool found = First::semantic == Semantic;
+  typedef typename std::conditional<found, First, typename Next::channel>::type channel;
+  static constexpr int offset = found ? 0 : (Next::offset < 0 ? -1 : First::size + Next::offset);
+};
+
+template <typename... Channels>
+struct VertexFormat {
+  static constexpr unsigned channel_count = sizeof...(Channels);
+  static constexpr unsigned stride = VertexChannelSize<Channels...>::size;
+  static const VertexChannelDesc channels[sizeof...(Channels)];
+
+  template <ChannelSemantic Semantic>
+  struct Channel : VertexChannelFind<Semantic, Channels...> {};
+
+  template <ChannelSemantic Semantic>
+  static constexpr bool has() {
+    return Channel<Semantic>::offset >= 0;
+  }
+
+  template <ChannelSemantic Semantic>
+  static typename Channel<Semantic>::channel::value_type load(const void* vertices, size_t index) {
+    typename Channel<Semantic>::channel::value_type value;
+    memcpy(&value, (const uint8_t*)vertices + stride * index + Channel<Semantic>::offset, sizeof(value));
+    return value;
+  }
+
+  template <ChannelSemantic Semantic>
+  static void store(void* vertices, size_t index, const typename Channel<Semantic>::channel::value_type& value) {
+    memcpy((uint8_t*)vertices + stride * index + Channel<Semantic>::offset, &value, sizeof(value));
+  }
+
+  // true if the mesh's vertices are laid out exactly like this format
+  static bool matches(const Mesh* mesh) {
+    if (mesh->channel_count != channel_count) {
+      return false;
+    }
+    for (unsigned index = 0; index < channel_count; ++index) {
+      if (mesh->channels[index].type != channels[index].type ||
+          mesh->channels[index].semantic != channels[index].semantic) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  static void describe(Mesh* mesh) {
+    memcpy(mesh->channels, channels, sizeof(channels));
+    mesh->channel_count = channel_count;
+  }
+};
+
+template <typename... Channels>
+constexpr unsigned VertexFormat<Channels...>::channel_count;
+template <typename... Channels>
+constexpr unsigned VertexFormat<Channels...>::stride;
+template <typename... Channels>
+const VertexChannelDesc VertexFormat<Channels...>::channels[sizeof...(Channels)] = {
+    {Channels::type, Channels::semantic}...};
+
+inline vectorial::vec3f to_vec3f(const Vec3& value) {
+  return vectorial::vec3f(value.x, value.y, value.z);
+}
+
+// the float vertices mesh_load() writes, one Vertex each
+typedef VertexFormat<VertexChannel<CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_POSITION>,
+                     VertexChannel<CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_NORMAL>,
+                     VertexChannel<CHANNEL_TYPE_FLOAT_3, CHANNEL_SEMANTIC_COLOR>>
+    MeshVertexFormat;
+
+static_assert(MeshVertexFormat::stride == sizeof(Vertex), "MeshVertexFormat doesn't match Vertex");
+static_assert(MeshVertexFormat::Channel<CHANNEL_SEMANTIC_POSITION>::offset == offsetof(Vertex, p),
+              "MeshVertexFormat doesn't match Vertex");
+static_assert(MeshVertexFormat::Channel<CHANNEL_SEMANTIC_NORMAL>::offset == offsetof(Vertex, n),
+              "MeshVertexFormat doesn't match Vertex");
+static_assert(MeshVertexFormat::Channel<CHANNEL_SEMANTIC_COLOR>::offset == offsetof(Vertex, c),
+              "MeshVertexFormat doesn't match Vertex");
+
+// what mesh_quantize() writes. the 4 byte channels go first to keep every channel aligned to its element size, and
+// with 4 byte normals the positions take 2 bytes of padding so every vertex starts 4 byte aligned too.
+template <ChannelType PositionType, ChannelType NormalType>
+using QuantizedVertexFormat = VertexFormat<VertexChannel<CHANNEL_TYPE_UBYTE_4, CHANNEL_SEMANTIC_COLOR>,
+                                           VertexChannel<CHANNEL_TYPE_UNORM16_2, CHANNEL_SEMANTIC_TEXCOORD>,
+                                           VertexChannel<PositionType, CHANNEL_SEMANTIC_POSITION>,
+                                           VertexChannel<NormalType, CHANNEL_SEMANTIC_NORMAL>>;
+
+typedef QuantizedVertexFormat<CHANNEL_TYPE_UNORM16_3, CHANNEL_TYPE_OCT_SNORM8_2> QuantizedVertexFormat8;
+typedef QuantizedVertexFormat<CHANNEL_TYPE_UNORM16_3_PADDED, CHANNEL_TYPE_OCT_SNORM16_2> QuantizedVertexFormat16;
+
+static_assert(QuantizedVertexFormat8::stride == 16, "QuantizedVertexFormat8 should be 16 bytes");
+static_assert(QuantizedVertexFormat16::stride == 20, "QuantizedVertexFormat16 should be 20 bytes");